@@ -0,0 +1,18 @@
+# cmake -DREADELF=<readelf> -DLIBRARY=<libsysinfo.a> -P CheckProbes.cmake
+# fails unless the .note.stapsdt sections of LIBRARY describe every sysinfo probe
+execute_process(COMMAND ${READELF} --notes ${LIBRARY}
+        OUTPUT_VARIABLE notes
+        RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${READELF} --notes ${LIBRARY} failed: ${result}")
+endif ()
+
+foreach (probe datagram route address link rule nexthop qdisc tclass done error)
+    if (NOT notes MATCHES "Provider: sysinfo\n[ \t]*Name: ${probe}\n")
+        list(APPEND missing ${probe})
+    endif ()
+endforeach ()
+
+if (missing)
+    message(FATAL_ERROR "probes missing in ${LIBRARY}: ${missing}")
+endif ()
@@ -1,5 +1,6 @@
 include(CMakeFindDependencyMacro)
 
 find_dependency(fmt REQUIRED)
+find_dependency(Threads REQUIRED)
 
 include("${CMAKE_CURRENT_LIST_DIR}/wormsysinfoTargets.cmake")
@@ -0,0 +1,547 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+/*
+ * socket inventory through NETLINK_SOCK_DIAG against parsing /proc/net/tcp{,6}.
+ * a network namespace of its own is filled with loopback TCP connections, made by worker
+ * processes that hold both ends (a process has a limited number of descriptors). then
+ * every way of listing them is timed, best of repeats:
+ *   procfs        read and parse /proc/net/tcp and /proc/net/tcp6
+ *   diag          DiagSocket::dump into reused columns
+ *   diag stream   DiagSocket::dump handing out one Entry at a time
+ * and once more for the accepted ends only (established, local port of a listener),
+ * which procfs has to filter after parsing and the kernel filters before copying.
+ */
+
+#include <wormhole/sysinfo/DiagSocket.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+constexpr std::uint16_t BasePort = 20000;
+constexpr std::size_t AcceptBatch = 1024;
+
+struct Options
+{
+  std::size_t connections{10000};
+  std::size_t repeat{5};
+  bool unshare{true};
+};
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-diag [options]\n"
+      "  -n, --connections N  loopback connections, two sockets each (default 10000)\n"
+      "  -r, --repeat N       runs per method, the best one counts (default 5)\n"
+      "  -U, --no-unshare     run in the current namespaces, which need CAP_NET_ADMIN\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text, int base = 10)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr std::array<struct option, 5> longOptions{{
+      {"connections", required_argument, nullptr, 'n'},
+      {"repeat", required_argument, nullptr, 'r'},
+      {"no-unshare", no_argument, nullptr, 'U'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:r:Uh", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'n':
+        if (auto connections = number<std::size_t>(arg); connections && *connections > 0)
+        {
+          options.connections = *connections;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid connections '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'r':
+        if (auto repeat = number<std::size_t>(arg); repeat && *repeat > 0)
+        {
+          options.repeat = *repeat;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid repeat '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'U':
+        options.unshare = false;
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+  return options;
+}
+
+outcome::std_result<void> writeFile(char const* path, std::string_view content)
+{
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  auto written = write(fd, content.data(), content.size());
+  int error = errno;
+  close(fd);
+  if (written < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+// root of a user namespace of our own, which owns a network namespace of our own with lo up
+outcome::std_result<void> enterNamespaces()
+{
+  auto const uid = getuid();
+  auto const gid = getgid();
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/setgroups", "deny"));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/uid_map", fmt::format("0 {} 1", uid)));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/gid_map", fmt::format("0 {} 1", gid)));
+
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  struct ifreq request{};
+  std::strncpy(request.ifr_name, "lo", IFNAMSIZ - 1);
+  request.ifr_flags = IFF_UP;
+  int result = ioctl(fd, SIOCSIFFLAGS, &request);
+  int error = errno;
+  close(fd);
+  if (result < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+/*
+ * a listener on port and connections connections to it, accepted in batches that fit the
+ * backlog. runs in a worker process, which keeps them open until its parent goes away.
+ */
+outcome::std_result<void> connectLoopback(std::uint16_t port, std::size_t connections)
+{
+  struct sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0 || bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, static_cast<int>(AcceptBatch)) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  for (std::size_t done = 0; done < connections;)
+  {
+    auto const batch = std::min(AcceptBatch, connections - done);
+    for (std::size_t i = 0; i < batch; ++i)
+    {
+      int client = socket(AF_INET, SOCK_STREAM, 0);
+      if (client < 0 || ::connect(client, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+    }
+    for (std::size_t i = 0; i < batch; ++i)
+    {
+      if (accept(listener, nullptr, nullptr) < 0)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+    }
+    done += batch;
+  }
+  return outcome::success();
+}
+
+struct Workers
+{
+  std::vector<pid_t> pids;
+  int release{-1};  // closing it ends the workers
+  std::size_t listeners{0};
+
+  ~Workers()
+  {
+    if (release >= 0)
+    {
+      close(release);
+    }
+    for (auto const pid : pids)
+    {
+      waitpid(pid, nullptr, 0);
+    }
+  }
+};
+
+outcome::std_result<void> spawn(Workers& workers, std::size_t connections)
+{
+  struct rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  // both ends, the listener and a few more
+  auto const perWorker = std::max<std::size_t>((std::min<rlim_t>(limit.rlim_cur, std::numeric_limits<int>::max()) - 64) / 2, 1);
+
+  std::array<int, 2> ready{};
+  std::array<int, 2> release{};
+  if (pipe2(ready.data(), O_CLOEXEC) < 0 || pipe2(release.data(), O_CLOEXEC) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  workers.release = release[1];
+  for (std::size_t first = 0; first < connections; first += perWorker)
+  {
+    auto const port = static_cast<std::uint16_t>(BasePort + workers.listeners++);
+    auto const count = std::min(perWorker, connections - first);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    if (pid == 0)
+    {
+      close(ready[0]);
+      close(release[1]);
+      auto connected = connectLoopback(port, count);
+      char const status = connected ? 0 : static_cast<char>(connected.error().value());
+      static_cast<void>(write(ready[1], &status, 1));
+      char byte;
+      static_cast<void>(read(release[0], &byte, 1));
+      _exit(EXIT_SUCCESS);
+    }
+    workers.pids.push_back(pid);
+  }
+  close(ready[1]);
+  close(release[0]);
+  for (std::size_t i = 0; i < workers.pids.size(); ++i)
+  {
+    char status = 0;
+    if (read(ready[0], &status, 1) != 1)
+    {
+      close(ready[0]);
+      return static_cast<errno_errc>(EPIPE);
+    }
+    if (status != 0)
+    {
+      close(ready[0]);
+      return static_cast<errno_errc>(status);
+    }
+  }
+  close(ready[0]);
+  return outcome::success();
+}
+
+struct ProcEntry
+{
+  std::array<std::uint8_t, 16> local{};
+  std::array<std::uint8_t, 16> remote{};
+  std::uint16_t localPort{0};
+  std::uint16_t remotePort{0};
+  std::uint8_t state{0};
+  std::uint32_t sendQueue{0};
+  std::uint32_t receiveQueue{0};
+  std::uint32_t uid{0};
+  std::uint64_t inode{0};
+};
+
+outcome::std_result<void> readFile(char const* path, std::string& content)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  content.clear();
+  for (;;)
+  {
+    auto const offset = content.size();
+    content.resize(offset + 256 * 1024);
+    auto got = read(fd, content.data() + offset, content.size() - offset);
+    if (got <= 0)
+    {
+      int error = errno;
+      content.resize(offset);
+      close(fd);
+      if (got < 0)
+      {
+        return static_cast<errno_errc>(error);
+      }
+      return outcome::success();
+    }
+    content.resize(offset + static_cast<std::size_t>(got));
+  }
+}
+
+std::string_view token(std::string_view& line, char separator = ' ')
+{
+  auto const start = line.find_first_not_of(' ');
+  line.remove_prefix(std::min(start, line.size()));
+  auto const end = std::min(line.find(separator), line.size());
+  auto const result = line.substr(0, end);
+  line.remove_prefix(std::min(end + 1, line.size()));
+  return result;
+}
+
+// "0100007F:1F90": the address as the kernel's words in host order, in hex
+bool endpoint(std::string_view text, std::array<std::uint8_t, 16>& address, std::uint16_t& port)
+{
+  auto const colon = text.find(':');
+  if (colon == std::string_view::npos || colon % 8 != 0)
+  {
+    return false;
+  }
+  for (std::size_t word = 0; word < colon / 8; ++word)
+  {
+    auto const value = number<std::uint32_t>(text.substr(word * 8, 8), 16);
+    if (!value)
+    {
+      return false;
+    }
+    std::memcpy(address.data() + word * 4, &*value, 4);
+  }
+  auto const value = number<std::uint16_t>(text.substr(colon + 1), 16);
+  port = value.value_or(0);
+  return value.has_value();
+}
+
+//   sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode
+outcome::std_result<void> parseProc(std::string_view content, std::vector<ProcEntry>& entries)
+{
+  content.remove_prefix(std::min(content.find('\n') + 1, content.size()));
+  while (!content.empty())
+  {
+    auto const end = std::min(content.find('\n'), content.size());
+    auto line = content.substr(0, end);
+    content.remove_prefix(std::min(end + 1, content.size()));
+    ProcEntry entry;
+    token(line);  // sl
+    auto const local = token(line);
+    auto const remote = token(line);
+    auto const state = number<std::uint8_t>(token(line), 16);
+    auto const send = number<std::uint32_t>(token(line, ':'), 16);
+    auto const receive = number<std::uint32_t>(token(line), 16);
+    token(line);  // tr:tm->when
+    token(line);  // retrnsmt
+    auto const uid = number<std::uint32_t>(token(line));
+    token(line);  // timeout
+    auto const inode = number<std::uint64_t>(token(line));
+    if (!endpoint(local, entry.local, entry.localPort) || !endpoint(remote, entry.remote, entry.remotePort) || !state || !send || !receive || !uid || !inode)
+    {
+      return static_cast<errno_errc>(EBADMSG);
+    }
+    entry.state = *state;
+    entry.sendQueue = *send;
+    entry.receiveQueue = *receive;
+    entry.uid = *uid;
+    entry.inode = *inode;
+    entries.push_back(entry);
+  }
+  return outcome::success();
+}
+
+struct Result
+{
+  std::size_t sockets{0};
+  Clock::duration best{Clock::duration::max()};
+};
+
+template <typename F>
+outcome::std_result<Result> measure(std::size_t repeat, F&& run)
+{
+  Result result;
+  for (std::size_t i = 0; i < repeat; ++i)
+  {
+    auto const start = Clock::now();
+    BOOST_OUTCOME_TRY(auto sockets, run());
+    result.best = std::min(result.best, Clock::now() - start);
+    result.sockets = sockets;
+  }
+  return result;
+}
+
+void print(std::string_view method, Result const& result, Result const& baseline)
+{
+  auto const seconds = std::chrono::duration<double>(result.best).count();
+  fmt::print("{:<24} {:>9} {:>10.2f} {:>12.0f} {:>8.1f}x\n", method, result.sockets, seconds * 1e3, static_cast<double>(result.sockets) / seconds,
+      std::chrono::duration<double>(baseline.best).count() / seconds);
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->unshare)
+  {
+    if (auto entered = enterNamespaces(); !entered)
+    {
+      fmt::print(stderr, "sysinfo-diag: namespaces: {}\n", entered.error().message());
+      return EXIT_FAILURE;
+    }
+  }
+
+  Workers workers;
+  if (auto spawned = spawn(workers, options->connections); !spawned)
+  {
+    fmt::print(stderr, "sysinfo-diag: connections: {}\n", spawned.error().message());
+    return EXIT_FAILURE;
+  }
+  auto diag = Netlink::DiagSocket::open();
+  if (!diag)
+  {
+    fmt::print(stderr, "sysinfo-diag: open: {}\n", diag.error().message());
+    return EXIT_FAILURE;
+  }
+
+  std::string content;
+  std::vector<ProcEntry> entries;
+  auto const procfs = [&]() -> outcome::std_result<std::size_t>
+  {
+    entries.clear();
+    for (auto const* path : {"/proc/net/tcp", "/proc/net/tcp6"})
+    {
+      BOOST_OUTCOME_TRY(readFile(path, content));
+      BOOST_OUTCOME_TRY(parseProc(content, entries));
+    }
+    return entries.size();
+  };
+  auto const lastPort = static_cast<std::uint16_t>(BasePort + workers.listeners - 1);
+  auto const procfsAccepted = [&]() -> outcome::std_result<std::size_t>
+  {
+    BOOST_OUTCOME_TRY(procfs());
+    return static_cast<std::size_t>(std::ranges::count_if(entries,
+        [lastPort](ProcEntry const& entry)
+        {
+          return entry.state == 1 && entry.localPort >= BasePort && entry.localPort <= lastPort;
+        }));
+  };
+
+  Netlink::DiagSocket::Sockets sockets;
+  Netlink::DiagSocket::Query const all;
+  Netlink::DiagSocket::Query accepted;
+  accepted.states = Netlink::DiagSocket::State::Established;
+  accepted.localPort = Netlink::DiagSocket::PortRange{BasePort, lastPort};
+  auto const columns = [&](Netlink::DiagSocket::Query const& query)
+  {
+    return [&diag, &sockets, &query]() -> outcome::std_result<std::size_t>
+    {
+      sockets.clear();
+      BOOST_OUTCOME_TRY(diag.value().dump(query, sockets));
+      return sockets.size();
+    };
+  };
+  auto const stream = [&](Netlink::DiagSocket::Query const& query)
+  {
+    return [&diag, &query]() -> outcome::std_result<std::size_t>
+    {
+      std::uint64_t inodes = 0;
+      BOOST_OUTCOME_TRY(auto count, diag.value().dump(query,
+          [&inodes](Netlink::DiagSocket::Entry const& entry)
+          {
+            inodes += entry.inode;
+          }));
+      return count;
+    };
+  };
+
+  fmt::print("{} connections, {} listeners\n", options->connections, workers.listeners);
+  fmt::print("{:<24} {:>9} {:>10} {:>12} {:>9}\n", "method", "sockets", "ms", "sockets/s", "speedup");
+  struct Method
+  {
+    std::string_view name;
+    std::function<outcome::std_result<std::size_t>()> run;
+  };
+  std::array<std::array<Method, 3>, 2> const groups{{
+      {{{"procfs", procfs}, {"diag", columns(all)}, {"diag stream", stream(all)}}},
+      {{{"procfs accepted", procfsAccepted}, {"diag accepted", columns(accepted)}, {"diag stream accepted", stream(accepted)}}},
+  }};
+  for (auto const& group : groups)
+  {
+    std::optional<Result> baseline;
+    for (auto const& method : group)
+    {
+      auto result = measure(options->repeat, method.run);
+      if (!result)
+      {
+        fmt::print(stderr, "sysinfo-diag: {}: {}\n", method.name, result.error().message());
+        return EXIT_FAILURE;
+      }
+      if (!baseline)
+      {
+        baseline = result.value();
+      }
+      print(method.name, result.value(), *baseline);
+    }
+  }
+  return EXIT_SUCCESS;
+}
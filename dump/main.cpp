@@ -0,0 +1,552 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+/*
+ * heap allocations and wall time of full-table route dumps, which are backed by a
+ * DumpArena. a network namespace of its own gets a veth pair with /32 and /128 routes
+ * through it, one socket dumps the routes of both families repeatedly:
+ *   first        the first dump, the socket's arena grows its blocks
+ *   reused       the best of the following dumps, on the arena the first one released
+ *   heap copy    the entries of a dump copied into a std::vector growing on the heap one
+ *                entry at a time, as Request::AddItem collected them before the arena
+ * allocations are calls of the global operator new during the dump (or the copy), heap
+ * their bytes; arena is what the response took from its arena.
+ */
+
+#include <wormhole/sysinfo/NetlinkSocket.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+std::atomic<std::size_t> allocations{0};
+std::atomic<std::size_t> allocated{0};
+
+void* allocate(std::size_t size, std::size_t alignment)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated.fetch_add(size, std::memory_order_relaxed);
+  void* pointer = alignment <= alignof(std::max_align_t) ? std::malloc(size == 0 ? 1 : size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  if (pointer == nullptr)
+  {
+    throw std::bad_alloc{};
+  }
+  return pointer;
+}
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+  return allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+namespace
+{
+constexpr std::string_view VethName = "dmp0";
+constexpr std::string_view VethPeerName = "dmp1";
+constexpr std::uint32_t RouteBase = 0xC6120000;  // 198.18.0.0/15
+constexpr std::size_t MaxRoutes = 131072;
+
+struct Options
+{
+  std::size_t routes{20000};
+  std::size_t repeat{5};
+  bool unshare{true};
+};
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-dump [options]\n"
+      "  -n, --routes N      routes per family (default 20000, at most 131072)\n"
+      "  -r, --repeat N      dumps, the first one is reported on its own (default 5)\n"
+      "  -U, --no-unshare    run in the current namespaces, which need CAP_NET_ADMIN\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr std::array<struct option, 5> longOptions{{
+      {"routes", required_argument, nullptr, 'n'},
+      {"repeat", required_argument, nullptr, 'r'},
+      {"no-unshare", no_argument, nullptr, 'U'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:r:Uh", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'n':
+        if (auto routes = number<std::size_t>(arg); routes && *routes <= MaxRoutes)
+        {
+          options.routes = *routes;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid routes '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'r':
+        if (auto repeat = number<std::size_t>(arg); repeat && *repeat > 1)
+        {
+          options.repeat = *repeat;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid repeat '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'U':
+        options.unshare = false;
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+  return options;
+}
+
+outcome::std_result<void> writeFile(char const* path, std::string_view content)
+{
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  auto written = write(fd, content.data(), content.size());
+  int error = errno;
+  close(fd);
+  if (written < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+// root of a user namespace of our own, which owns a network namespace of our own
+outcome::std_result<void> enterNamespaces()
+{
+  auto const uid = getuid();
+  auto const gid = getgid();
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/setgroups", "deny"));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/uid_map", fmt::format("0 {} 1", uid)));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/gid_map", fmt::format("0 {} 1", gid)));
+  return outcome::success();
+}
+
+// one rtnetlink request, built in place
+class Request
+{
+public:
+  template <typename HEADER>
+  Request(std::uint16_t type, std::uint16_t flags, HEADER const& header)
+    : m_buffer(NLMSG_SPACE(sizeof(HEADER)))
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = static_cast<std::uint16_t>(flags | NLM_F_REQUEST | NLM_F_ACK);
+    std::memcpy(NLMSG_DATA(nlh), &header, sizeof(header));
+  }
+
+  Request& attribute(unsigned short type, void const* data, std::size_t length)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + RTA_SPACE(length));
+    auto* rta = reinterpret_cast<struct rtattr*>(m_buffer.data() + offset);
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+    std::memcpy(RTA_DATA(rta), data, length);
+    return *this;
+  }
+  Request& attribute(unsigned short type, std::string_view text)
+  {
+    std::string terminated{text};
+    return attribute(type, terminated.c_str(), terminated.size() + 1);
+  }
+  Request& attribute(unsigned short type, std::uint32_t value)
+  {
+    return attribute(type, &value, sizeof(value));
+  }
+  template <typename HEADER>
+  Request& raw(HEADER const& header)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + NLMSG_ALIGN(sizeof(HEADER)));
+    std::memcpy(m_buffer.data() + offset, &header, sizeof(header));
+    return *this;
+  }
+  std::size_t begin(unsigned short type)
+  {
+    auto const offset = m_buffer.size();
+    attribute(type, nullptr, 0);
+    return offset;
+  }
+  void end(std::size_t nest)
+  {
+    reinterpret_cast<struct rtattr*>(m_buffer.data() + nest)->rta_len = static_cast<unsigned short>(m_buffer.size() - nest);
+  }
+
+  std::span<char const> finish(std::uint32_t seq)
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_len = static_cast<std::uint32_t>(m_buffer.size());
+    nlh->nlmsg_seq = seq;
+    return m_buffer;
+  }
+
+private:
+  std::vector<char> m_buffer;
+};
+
+// makes the changes, every request waits for its acknowledgement
+class Changes
+{
+public:
+  static outcome::std_result<Changes> open()
+  {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    return Changes{fd};
+  }
+
+  Changes(Changes const&) = delete;
+  Changes(Changes&& rhs) noexcept
+    : m_socket{std::exchange(rhs.m_socket, -1)}
+    , m_seq{rhs.m_seq}
+  {
+  }
+  Changes& operator=(Changes const&) = delete;
+  Changes& operator=(Changes&&) = delete;
+  ~Changes()
+  {
+    if (m_socket >= 0)
+    {
+      close(m_socket);
+    }
+  }
+
+  outcome::std_result<void> createVeth(std::string_view name, std::string_view peer)
+  {
+    struct ifinfomsg header{};
+    Request request{RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, header};
+    request.attribute(IFLA_IFNAME, name);
+    auto linkInfo = request.begin(IFLA_LINKINFO);
+    request.attribute(IFLA_INFO_KIND, "veth"sv);
+    auto data = request.begin(IFLA_INFO_DATA);
+    auto peerInfo = request.begin(VETH_INFO_PEER);
+    request.raw(header).attribute(IFLA_IFNAME, peer);
+    request.end(peerInfo);
+    request.end(data);
+    request.end(linkInfo);
+    return send(request);
+  }
+
+  outcome::std_result<void> setUp(int index)
+  {
+    struct ifinfomsg header{};
+    header.ifi_index = index;
+    header.ifi_flags = IFF_UP;
+    header.ifi_change = IFF_UP;
+    Request request{RTM_NEWLINK, 0, header};
+    return send(request);
+  }
+
+  // a host route through index, number n of its family
+  outcome::std_result<void> route(int family, std::uint32_t n, int index)
+  {
+    struct rtmsg header{};
+    header.rtm_family = static_cast<unsigned char>(family);
+    header.rtm_dst_len = family == AF_INET ? 32 : 128;
+    header.rtm_table = RT_TABLE_MAIN;
+    header.rtm_protocol = RTPROT_STATIC;
+    header.rtm_scope = RT_SCOPE_LINK;
+    header.rtm_type = RTN_UNICAST;
+    Request request{RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL, header};
+    if (family == AF_INET)
+    {
+      auto const networkOrder = htonl(RouteBase + n);
+      request.attribute(RTA_DST, &networkOrder, sizeof(networkOrder));
+    }
+    else
+    {
+      // 2001:db8::n
+      std::array<std::uint8_t, 16> address{0x20, 0x01, 0x0d, 0xb8};
+      auto const networkOrder = htonl(n);
+      std::memcpy(address.data() + 12, &networkOrder, sizeof(networkOrder));
+      request.attribute(RTA_DST, address.data(), address.size());
+    }
+    request.attribute(RTA_OIF, static_cast<std::uint32_t>(index));
+    return send(request);
+  }
+
+private:
+  explicit Changes(int t_socket)
+    : m_socket{t_socket}
+  {
+  }
+
+  outcome::std_result<void> send(Request& request)
+  {
+    auto const message = request.finish(++m_seq);
+    if (::send(m_socket, message.data(), message.size(), 0) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    std::array<char, 8192> buffer;
+    for (;;)
+    {
+      auto length = recv(m_socket, buffer.data(), buffer.size(), 0);
+      if (length < 0)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+      auto remaining = static_cast<std::size_t>(length);
+      for (auto* nlh = reinterpret_cast<struct nlmsghdr*>(buffer.data()); NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining))
+      {
+        if (nlh->nlmsg_seq != m_seq || nlh->nlmsg_type != NLMSG_ERROR)
+        {
+          continue;
+        }
+        auto const* error = static_cast<struct nlmsgerr const*>(NLMSG_DATA(nlh));
+        if (error->error != 0)
+        {
+          return static_cast<errno_errc>(-error->error);
+        }
+        return outcome::success();
+      }
+    }
+  }
+
+  int m_socket;
+  std::uint32_t m_seq{0};
+};
+
+outcome::std_result<void> setUp(std::size_t routes)
+{
+  BOOST_OUTCOME_TRY(auto changes, Changes::open());
+  BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex("lo"))));
+  BOOST_OUTCOME_TRY(changes.createVeth(VethName, VethPeerName));
+  auto const veth = static_cast<int>(if_nametoindex(std::string{VethName}.c_str()));
+  BOOST_OUTCOME_TRY(changes.setUp(veth));
+  BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex(std::string{VethPeerName}.c_str()))));
+  for (std::uint32_t n = 0; n < routes; ++n)
+  {
+    BOOST_OUTCOME_TRY(changes.route(AF_INET, n, veth));
+    BOOST_OUTCOME_TRY(changes.route(AF_INET6, n, veth));
+  }
+  return outcome::success();
+}
+
+
+struct Result
+{
+  std::size_t entries{0};
+  std::size_t allocations{0};
+  std::size_t heap{0};
+  std::size_t arena{0};
+  Clock::duration time{Clock::duration::max()};
+};
+
+// counts what happens in between
+class Counter
+{
+public:
+  Counter()
+    : m_allocations{allocations.load()}
+    , m_allocated{allocated.load()}
+    , m_start{Clock::now()}
+  {
+  }
+
+  void stop(Result& result) const
+  {
+    result.time = Clock::now() - m_start;
+    result.allocations = allocations.load() - m_allocations;
+    result.heap = allocated.load() - m_allocated;
+  }
+
+private:
+  std::size_t m_allocations;
+  std::size_t m_allocated;
+  Clock::time_point m_start;
+};
+
+// every route of both families, the response stays alive until the next dump
+outcome::std_result<Result> dump(Netlink::Socket& socket, std::optional<Netlink::Message::RouteRequest::Response_t>& response)
+{
+  response.reset();
+  Result result;
+  Counter const counter;
+  BOOST_OUTCOME_TRY(socket.send_request<Netlink::Message::RouteRequest>(AF_UNSPEC));
+  BOOST_OUTCOME_TRY(auto received, socket.receive<Netlink::Message::RouteRequest>(Netlink::Socket::ReceiveMode::Wait));
+  counter.stop(result);
+  response = std::move(received);
+  result.entries = response->data.size();
+  if (auto const* arena = dynamic_cast<Netlink::DumpArena const*>(response->arena.get()); arena)
+  {
+    result.arena = arena->used();
+  }
+  return result;
+}
+
+Result copy(std::span<Route const> routes)
+{
+  Result result;
+  Counter const counter;
+  std::vector<Route> copied;
+  for (auto const& route : routes)
+  {
+    copied.push_back(route);
+  }
+  counter.stop(result);
+  result.entries = copied.size();
+  return result;
+}
+
+void print(std::string_view method, Result const& result)
+{
+  fmt::print("{:<12} {:>9} {:>10.2f} {:>12} {:>10} {:>10}\n", method, result.entries, std::chrono::duration<double>(result.time).count() * 1e3, result.allocations,
+      result.heap / 1024, result.arena / 1024);
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->unshare)
+  {
+    if (auto entered = enterNamespaces(); !entered)
+    {
+      fmt::print(stderr, "sysinfo-dump: namespaces: {}\n", entered.error().message());
+      return EXIT_FAILURE;
+    }
+  }
+  if (auto prepared = setUp(options->routes); !prepared)
+  {
+    fmt::print(stderr, "sysinfo-dump: set up: {}\n", prepared.error().message());
+    return EXIT_FAILURE;
+  }
+  auto socket = Netlink::Socket::open({});
+  if (!socket)
+  {
+    fmt::print(stderr, "sysinfo-dump: open: {}\n", socket.error().message());
+    return EXIT_FAILURE;
+  }
+
+  std::optional<Netlink::Message::RouteRequest::Response_t> response;
+  std::optional<Result> first;
+  Result reused;
+  for (std::size_t i = 0; i < options->repeat; ++i)
+  {
+    auto result = dump(socket.value(), response);
+    if (!result)
+    {
+      fmt::print(stderr, "sysinfo-dump: dump: {}\n", result.error().message());
+      return EXIT_FAILURE;
+    }
+    if (!first)
+    {
+      first = result.value();
+    }
+    else if (result.value().time < reused.time)
+    {
+      reused = result.value();
+    }
+  }
+  auto const heap = copy(response->data);
+
+  fmt::print("{} routes per family\n", options->routes);
+  fmt::print("{:<12} {:>9} {:>10} {:>12} {:>10} {:>10}\n", "method", "entries", "ms", "allocations", "heap KiB", "arena KiB");
+  print("first", *first);
+  print("reused", reused);
+  print("heap copy", heap);
+  return EXIT_SUCCESS;
+}
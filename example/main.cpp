@@ -77,6 +77,15 @@ outcome::std_result<void> network_routes()
     fmt::print("Response id: {}\n", response.id);
     fmt::print("{}\n", fmt::join(response.data, "\n"));
   }
+  {
+    BOOST_OUTCOME_TRY(auto id, socket.send_request<Netlink::Message::QdiscRequest>(AF_UNSPEC));
+    fmt::print("QdiscRequest id: {}\n", id);
+
+    BOOST_OUTCOME_TRY(auto response, socket.receive<Netlink::Message::QdiscRequest>(Netlink::Socket::ReceiveMode::Wait));
+
+    fmt::print("Response id: {}\n", response.id);
+    fmt::print("{}\n", fmt::join(response.data, "\n"));
+  }
 
   std::size_t count{4};
   do
@@ -96,6 +105,22 @@ outcome::std_result<void> network_routes()
                    {
                      fmt::print("{}\n", item);
                    },
+                   [](Rule const& item)
+                   {
+                     fmt::print("{}\n", item);
+                   },
+                   [](Nexthop const& item)
+                   {
+                     fmt::print("{}\n", item);
+                   },
+                   [](Qdisc const& item)
+                   {
+                     fmt::print("{}\n", item);
+                   },
+                   [](TrafficClass const& item)
+                   {
+                     fmt::print("{}\n", item);
+                   },
                    [](auto const& response)
                    {
                      fmt::print("Response id: {}\n", response.id);
@@ -0,0 +1,296 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+/*
+ * text export speed of a route table: routes of both families, made up in memory, are
+ * formatted into a buffer that is dropped every megabyte, best of repeats:
+ *   ostream        the default style as it was produced before the native formatters:
+ *                  every value goes through an ostream over the output (fmt::streamed,
+ *                  which is what fmt::ostream_formatter did), addresses through boost's
+ *                  operator<<
+ *   fmt            the native formatter, default style
+ *   fmt iproute2   {:i}, the lines of `ip route`
+ *   fmt compact    {:c}
+ */
+
+#include <wormhole/sysinfo/types.hpp>
+
+#include <getopt.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+constexpr std::size_t FlushSize = 1024 * 1024;
+
+struct Options
+{
+  std::size_t routes{1000000};
+  std::size_t repeat{3};
+};
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-format [options]\n"
+      "  -n, --routes N      routes in the table (default 1000000)\n"
+      "  -r, --repeat N      runs per method, the best one counts (default 3)\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr std::array<struct option, 4> longOptions{{
+      {"routes", required_argument, nullptr, 'n'},
+      {"repeat", required_argument, nullptr, 'r'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:r:h", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'n':
+        if (auto routes = number<std::size_t>(arg); routes && *routes > 0)
+        {
+          options.routes = *routes;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid routes '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'r':
+        if (auto repeat = number<std::size_t>(arg); repeat && *repeat > 0)
+        {
+          options.repeat = *repeat;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid repeat '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+  return options;
+}
+
+// every fourth route IPv6, every other one through a gateway, a few dozen interfaces
+std::vector<Route> table(std::size_t count)
+{
+  std::array<InterfaceName, 32> interfaces;
+  for (std::size_t i = 0; i < interfaces.size(); ++i)
+  {
+    interfaces[i] = fmt::format("eth{}", i);
+  }
+  std::vector<Route> routes(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    auto& route = routes[i];
+    auto const n = static_cast<std::uint32_t>(i);
+    if (i % 4 == 3)
+    {
+      boost::asio::ip::address_v6::bytes_type bytes{0x20, 0x01, 0x0d, 0xb8};
+      bytes[4] = static_cast<unsigned char>(n >> 16);
+      bytes[5] = static_cast<unsigned char>(n >> 8);
+      bytes[6] = static_cast<unsigned char>(n);
+      route.family = AF_INET6;
+      route.destination.emplace<boost::asio::ip::network_v6>(boost::asio::ip::make_address_v6(bytes), 56);
+      if (i % 2 == 1)
+      {
+        route.gateway = boost::asio::ip::make_address_v6("fe80::1");
+      }
+    }
+    else
+    {
+      route.family = AF_INET;
+      route.destination.emplace<boost::asio::ip::network_v4>(boost::asio::ip::make_address_v4(0x0A000000 + (n << 8)), 24);
+      if (i % 2 == 1)
+      {
+        route.gateway = boost::asio::ip::make_address_v4(0xC0A80001 + n % 200);
+      }
+    }
+    route.interfaceIndex = Interface::Index{static_cast<int>(2 + i % interfaces.size())};
+    route.interfaceName = interfaces[i % interfaces.size()];
+    route.priority = i % 3 == 0 ? 100 : 0;
+  }
+  return routes;
+}
+
+// the operator<< of a Route before the native formatters
+struct Streamed
+{
+  Route const& route;
+
+  friend std::ostream& operator<<(std::ostream& str, Streamed const& streamed)
+  {
+    auto const& route = streamed.route;
+    fmt::print(str, "{} route: ", fmt::streamed(route.action));
+    if (route.type != Route::Type::Unicast)
+    {
+      fmt::print(str, "{} ", fmt::streamed(route.type));
+    }
+    std::visit([&str](auto const& item)
+        {
+          fmt::print(str, "{}", fmt::streamed(item));
+        },
+        route.destination.value);
+    if (!route.gateway.is_unspecified())
+    {
+      fmt::print(str, " via {}", fmt::streamed(route.gateway));
+    }
+    if (!route.interfaceName.empty())
+    {
+      fmt::print(str, " dev {}", route.interfaceName.view());
+    }
+    if (!route.source.is_unspecified())
+    {
+      fmt::print(str, " src {}", fmt::streamed(route.source));
+    }
+    if (route.priority != 0)
+    {
+      fmt::print(str, " metric {}", route.priority);
+    }
+    fmt::print(str, " table {}", fmt::streamed(route.table));
+    return str;
+  }
+};
+
+struct Result
+{
+  std::size_t lines{0};
+  std::size_t bytes{0};
+  Clock::duration best{Clock::duration::max()};
+};
+
+// format(buffer, route) for every route, repeat times
+Result measure(std::size_t repeat, std::vector<Route> const& routes, std::function<void(fmt::memory_buffer&, Route const&)> const& format)
+{
+  Result result;
+  fmt::memory_buffer buffer;
+  buffer.reserve(2 * FlushSize);
+  for (std::size_t i = 0; i < repeat; ++i)
+  {
+    std::size_t bytes = 0;
+    auto const start = Clock::now();
+    for (auto const& route : routes)
+    {
+      format(buffer, route);
+      if (buffer.size() >= FlushSize)
+      {
+        bytes += buffer.size();
+        buffer.clear();
+      }
+    }
+    bytes += buffer.size();
+    buffer.clear();
+    result.best = std::min(result.best, Clock::now() - start);
+    result.lines = routes.size();
+    result.bytes = bytes;
+  }
+  return result;
+}
+
+void print(std::string_view method, Result const& result, Result const& baseline)
+{
+  auto const seconds = std::chrono::duration<double>(result.best).count();
+  fmt::print("{:<14} {:>10.2f} {:>12.0f} {:>8.1f} {:>8.1f}x\n", method, seconds * 1e3, static_cast<double>(result.lines) / seconds,
+      static_cast<double>(result.bytes) / seconds / 1e6, std::chrono::duration<double>(baseline.best).count() / seconds);
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  auto const routes = table(options->routes);
+
+  struct Method
+  {
+    std::string_view name;
+    std::function<void(fmt::memory_buffer&, Route const&)> format;
+  };
+  std::array<Method, 4> const methods{{
+      {"ostream",
+          [](fmt::memory_buffer& buffer, Route const& route)
+          {
+            fmt::format_to(std::back_inserter(buffer), "{}\n", fmt::streamed(Streamed{route}));
+          }},
+      {"fmt",
+          [](fmt::memory_buffer& buffer, Route const& route)
+          {
+            fmt::format_to(std::back_inserter(buffer), "{}\n", route);
+          }},
+      {"fmt iproute2",
+          [](fmt::memory_buffer& buffer, Route const& route)
+          {
+            fmt::format_to(std::back_inserter(buffer), "{:i}\n", route);
+          }},
+      {"fmt compact",
+          [](fmt::memory_buffer& buffer, Route const& route)
+          {
+            fmt::format_to(std::back_inserter(buffer), "{:c}\n", route);
+          }},
+  }};
+
+  fmt::print("{} routes\n", routes.size());
+  fmt::print("{:<14} {:>10} {:>12} {:>8} {:>9}\n", "method", "ms", "lines/s", "MB/s", "speedup");
+  std::optional<Result> baseline;
+  for (auto const& method : methods)
+  {
+    auto const result = measure(options->repeat, routes, method.format);
+    if (!baseline)
+    {
+      baseline = result;
+    }
+    print(method.name, result, *baseline);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,498 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+/*
+ * cold start time of a snapshot of links, addresses and routes of both families.
+ * a network namespace of its own gets a veth pair with /32 and /128 routes through it,
+ * then every way of taking the snapshot is timed, best of repeats:
+ *   serial     one socket dumps links, routes and addresses one after the other, as the
+ *              example does
+ *   load -t 1  Inventory::load on a single thread: one socket per dump, run in turn
+ *   load       Inventory::load with its default pool, the dumps run concurrently
+ * the inventory numbers include opening its multicast socket and merging the dumps.
+ */
+
+#include <wormhole/sysinfo/Inventory.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+constexpr std::string_view VethName = "inv0";
+constexpr std::string_view VethPeerName = "inv1";
+constexpr std::uint32_t RouteBase = 0xC6120000;  // 198.18.0.0/15
+constexpr std::size_t MaxRoutes = 131072;
+
+struct Options
+{
+  std::size_t routes{20000};
+  std::size_t repeat{5};
+  std::size_t threads{0};
+  bool unshare{true};
+};
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-inventory [options]\n"
+      "  -n, --routes N      routes per family (default 20000, at most 131072)\n"
+      "  -r, --repeat N      runs per method, the best one counts (default 5)\n"
+      "  -t, --threads N     threads of the concurrent load (default 0: one per dump, at most the number of cpus)\n"
+      "  -U, --no-unshare    run in the current namespaces, which need CAP_NET_ADMIN\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr std::array<struct option, 6> longOptions{{
+      {"routes", required_argument, nullptr, 'n'},
+      {"repeat", required_argument, nullptr, 'r'},
+      {"threads", required_argument, nullptr, 't'},
+      {"no-unshare", no_argument, nullptr, 'U'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:r:t:Uh", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'n':
+        if (auto routes = number<std::size_t>(arg); routes && *routes <= MaxRoutes)
+        {
+          options.routes = *routes;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid routes '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'r':
+        if (auto repeat = number<std::size_t>(arg); repeat && *repeat > 0)
+        {
+          options.repeat = *repeat;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid repeat '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 't':
+        if (auto threads = number<std::size_t>(arg); threads)
+        {
+          options.threads = *threads;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid threads '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'U':
+        options.unshare = false;
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+  return options;
+}
+
+outcome::std_result<void> writeFile(char const* path, std::string_view content)
+{
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  auto written = write(fd, content.data(), content.size());
+  int error = errno;
+  close(fd);
+  if (written < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+// root of a user namespace of our own, which owns a network namespace of our own
+outcome::std_result<void> enterNamespaces()
+{
+  auto const uid = getuid();
+  auto const gid = getgid();
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/setgroups", "deny"));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/uid_map", fmt::format("0 {} 1", uid)));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/gid_map", fmt::format("0 {} 1", gid)));
+  return outcome::success();
+}
+
+// one rtnetlink request, built in place
+class Request
+{
+public:
+  template <typename HEADER>
+  Request(std::uint16_t type, std::uint16_t flags, HEADER const& header)
+    : m_buffer(NLMSG_SPACE(sizeof(HEADER)))
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = static_cast<std::uint16_t>(flags | NLM_F_REQUEST | NLM_F_ACK);
+    std::memcpy(NLMSG_DATA(nlh), &header, sizeof(header));
+  }
+
+  Request& attribute(unsigned short type, void const* data, std::size_t length)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + RTA_SPACE(length));
+    auto* rta = reinterpret_cast<struct rtattr*>(m_buffer.data() + offset);
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+    std::memcpy(RTA_DATA(rta), data, length);
+    return *this;
+  }
+  Request& attribute(unsigned short type, std::string_view text)
+  {
+    std::string terminated{text};
+    return attribute(type, terminated.c_str(), terminated.size() + 1);
+  }
+  Request& attribute(unsigned short type, std::uint32_t value)
+  {
+    return attribute(type, &value, sizeof(value));
+  }
+  template <typename HEADER>
+  Request& raw(HEADER const& header)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + NLMSG_ALIGN(sizeof(HEADER)));
+    std::memcpy(m_buffer.data() + offset, &header, sizeof(header));
+    return *this;
+  }
+  std::size_t begin(unsigned short type)
+  {
+    auto const offset = m_buffer.size();
+    attribute(type, nullptr, 0);
+    return offset;
+  }
+  void end(std::size_t nest)
+  {
+    reinterpret_cast<struct rtattr*>(m_buffer.data() + nest)->rta_len = static_cast<unsigned short>(m_buffer.size() - nest);
+  }
+
+  std::span<char const> finish(std::uint32_t seq)
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_len = static_cast<std::uint32_t>(m_buffer.size());
+    nlh->nlmsg_seq = seq;
+    return m_buffer;
+  }
+
+private:
+  std::vector<char> m_buffer;
+};
+
+// makes the changes, every request waits for its acknowledgement
+class Changes
+{
+public:
+  static outcome::std_result<Changes> open()
+  {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    return Changes{fd};
+  }
+
+  Changes(Changes const&) = delete;
+  Changes(Changes&& rhs) noexcept
+    : m_socket{std::exchange(rhs.m_socket, -1)}
+    , m_seq{rhs.m_seq}
+  {
+  }
+  Changes& operator=(Changes const&) = delete;
+  Changes& operator=(Changes&&) = delete;
+  ~Changes()
+  {
+    if (m_socket >= 0)
+    {
+      close(m_socket);
+    }
+  }
+
+  outcome::std_result<void> createVeth(std::string_view name, std::string_view peer)
+  {
+    struct ifinfomsg header{};
+    Request request{RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, header};
+    request.attribute(IFLA_IFNAME, name);
+    auto linkInfo = request.begin(IFLA_LINKINFO);
+    request.attribute(IFLA_INFO_KIND, "veth"sv);
+    auto data = request.begin(IFLA_INFO_DATA);
+    auto peerInfo = request.begin(VETH_INFO_PEER);
+    request.raw(header).attribute(IFLA_IFNAME, peer);
+    request.end(peerInfo);
+    request.end(data);
+    request.end(linkInfo);
+    return send(request);
+  }
+
+  outcome::std_result<void> setUp(int index)
+  {
+    struct ifinfomsg header{};
+    header.ifi_index = index;
+    header.ifi_flags = IFF_UP;
+    header.ifi_change = IFF_UP;
+    Request request{RTM_NEWLINK, 0, header};
+    return send(request);
+  }
+
+  // a host route through index, number n of its family
+  outcome::std_result<void> route(int family, std::uint32_t n, int index)
+  {
+    struct rtmsg header{};
+    header.rtm_family = static_cast<unsigned char>(family);
+    header.rtm_dst_len = family == AF_INET ? 32 : 128;
+    header.rtm_table = RT_TABLE_MAIN;
+    header.rtm_protocol = RTPROT_STATIC;
+    header.rtm_scope = RT_SCOPE_LINK;
+    header.rtm_type = RTN_UNICAST;
+    Request request{RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL, header};
+    if (family == AF_INET)
+    {
+      auto const networkOrder = htonl(RouteBase + n);
+      request.attribute(RTA_DST, &networkOrder, sizeof(networkOrder));
+    }
+    else
+    {
+      // 2001:db8::n
+      std::array<std::uint8_t, 16> address{0x20, 0x01, 0x0d, 0xb8};
+      auto const networkOrder = htonl(n);
+      std::memcpy(address.data() + 12, &networkOrder, sizeof(networkOrder));
+      request.attribute(RTA_DST, address.data(), address.size());
+    }
+    request.attribute(RTA_OIF, static_cast<std::uint32_t>(index));
+    return send(request);
+  }
+
+private:
+  explicit Changes(int t_socket)
+    : m_socket{t_socket}
+  {
+  }
+
+  outcome::std_result<void> send(Request& request)
+  {
+    auto const message = request.finish(++m_seq);
+    if (::send(m_socket, message.data(), message.size(), 0) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    std::array<char, 8192> buffer;
+    for (;;)
+    {
+      auto length = recv(m_socket, buffer.data(), buffer.size(), 0);
+      if (length < 0)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+      auto remaining = static_cast<std::size_t>(length);
+      for (auto* nlh = reinterpret_cast<struct nlmsghdr*>(buffer.data()); NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining))
+      {
+        if (nlh->nlmsg_seq != m_seq || nlh->nlmsg_type != NLMSG_ERROR)
+        {
+          continue;
+        }
+        auto const* error = static_cast<struct nlmsgerr const*>(NLMSG_DATA(nlh));
+        if (error->error != 0)
+        {
+          return static_cast<errno_errc>(-error->error);
+        }
+        return outcome::success();
+      }
+    }
+  }
+
+  int m_socket;
+  std::uint32_t m_seq{0};
+};
+
+outcome::std_result<void> setUp(std::size_t routes)
+{
+  BOOST_OUTCOME_TRY(auto changes, Changes::open());
+  BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex("lo"))));
+  BOOST_OUTCOME_TRY(changes.createVeth(VethName, VethPeerName));
+  auto const veth = static_cast<int>(if_nametoindex(std::string{VethName}.c_str()));
+  BOOST_OUTCOME_TRY(changes.setUp(veth));
+  BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex(std::string{VethPeerName}.c_str()))));
+  for (std::uint32_t n = 0; n < routes; ++n)
+  {
+    BOOST_OUTCOME_TRY(changes.route(AF_INET, n, veth));
+    BOOST_OUTCOME_TRY(changes.route(AF_INET6, n, veth));
+  }
+  return outcome::success();
+}
+
+// the dumps of Inventory::load on one socket, one after the other; returns the entries
+outcome::std_result<std::size_t> serial()
+{
+  BOOST_OUTCOME_TRY(auto socket, Netlink::Socket::open({}));
+  std::size_t entries = 0;
+  auto const dump = [&socket, &entries]<typename Request>(int family) -> outcome::std_result<void>
+  {
+    BOOST_OUTCOME_TRY(socket.send_request<Request>(family));
+    BOOST_OUTCOME_TRY(auto response, socket.template receive<Request>(Netlink::Socket::ReceiveMode::Wait));
+    entries += response.data.size();
+    return outcome::success();
+  };
+  BOOST_OUTCOME_TRY(dump.operator()<Netlink::Message::LinkRequest>(AF_UNSPEC));
+  BOOST_OUTCOME_TRY(dump.operator()<Netlink::Message::RouteRequest>(AF_INET));
+  BOOST_OUTCOME_TRY(dump.operator()<Netlink::Message::RouteRequest>(AF_INET6));
+  BOOST_OUTCOME_TRY(dump.operator()<Netlink::Message::AddressRequest>(AF_INET));
+  BOOST_OUTCOME_TRY(dump.operator()<Netlink::Message::AddressRequest>(AF_INET6));
+  return entries;
+}
+
+outcome::std_result<std::size_t> load(std::size_t threads)
+{
+  BOOST_OUTCOME_TRY(auto inventory, Inventory::load({.threads = threads}));
+  return inventory.links().size() + inventory.addresses().size() + inventory.routes().size();
+}
+
+struct Result
+{
+  std::size_t entries{0};
+  Clock::duration best{Clock::duration::max()};
+};
+
+template <typename F>
+outcome::std_result<Result> measure(std::size_t repeat, F&& run)
+{
+  Result result;
+  for (std::size_t i = 0; i < repeat; ++i)
+  {
+    auto const start = Clock::now();
+    BOOST_OUTCOME_TRY(auto entries, run());
+    result.best = std::min(result.best, Clock::now() - start);
+    result.entries = entries;
+  }
+  return result;
+}
+
+void print(std::string_view method, Result const& result, Result const& baseline)
+{
+  auto const seconds = std::chrono::duration<double>(result.best).count();
+  fmt::print("{:<12} {:>9} {:>10.2f} {:>12.0f} {:>8.1f}x\n", method, result.entries, seconds * 1e3, static_cast<double>(result.entries) / seconds,
+      std::chrono::duration<double>(baseline.best).count() / seconds);
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->unshare)
+  {
+    if (auto entered = enterNamespaces(); !entered)
+    {
+      fmt::print(stderr, "sysinfo-inventory: namespaces: {}\n", entered.error().message());
+      return EXIT_FAILURE;
+    }
+  }
+  if (auto prepared = setUp(options->routes); !prepared)
+  {
+    fmt::print(stderr, "sysinfo-inventory: set up: {}\n", prepared.error().message());
+    return EXIT_FAILURE;
+  }
+
+  fmt::print("{} routes per family, {} cpus\n", options->routes, std::thread::hardware_concurrency());
+  fmt::print("{:<12} {:>9} {:>10} {:>12} {:>9}\n", "method", "entries", "ms", "entries/s", "speedup");
+  struct Method
+  {
+    std::string_view name;
+    std::function<outcome::std_result<std::size_t>()> run;
+  };
+  std::array<Method, 3> const methods{{
+      {"serial", serial},
+      {"load -t 1", []
+          {
+            return load(1);
+          }},
+      {"load", [threads = options->threads]
+          {
+            return load(threads);
+          }},
+  }};
+  std::optional<Result> baseline;
+  for (auto const& method : methods)
+  {
+    auto result = measure(options->repeat, method.run);
+    if (!result)
+    {
+      fmt::print(stderr, "sysinfo-inventory: {}: {}\n", method.name, result.error().message());
+      return EXIT_FAILURE;
+    }
+    if (!baseline)
+    {
+      baseline = result.value();
+    }
+    print(method.name, result.value(), *baseline);
+  }
+  return EXIT_SUCCESS;
+}
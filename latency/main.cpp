@@ -0,0 +1,662 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+/*
+ * kernel to callback latency of events: changes are made with netlink requests of our own,
+ * stamped right before they are sent, and measured again where receive() hands out their
+ * event. everything happens in a user and network namespace of its own:
+ *   route  /32 routes via a veth are added (measured) and deleted again (not measured)
+ *   link   a bridge without ports is set up and down, one RTM_NEWLINK per change. devices
+ *          with a carrier follow a change with further events from linkwatch later on
+ * modes: block waits in receive(), nonblock spins on it, batch fires bursts of changes
+ * before the receiver gets to run and receives them in recvmmsg batches. reactor and spin
+ * serve the socket from a Reactor along with idle ones, sleeping in epoll_wait or busy
+ * polling it. cpu is the receiver thread's cpu time over the time it ran.
+ */
+
+#include <wormhole/sysinfo/NetlinkSocket.hpp>
+#include <wormhole/sysinfo/Reactor.hpp>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/if_link.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+using Clock = Netlink::Metrics::Clock;
+
+namespace
+{
+constexpr std::string_view VethName = "lat0";
+constexpr std::string_view VethPeerName = "lat1";
+constexpr std::string_view BridgeName = "latbr0";
+constexpr std::uint32_t RouteBase = 0xC6120000;  // 198.18.0.0/16
+constexpr std::size_t MaxEvents = 65536;
+
+struct Options
+{
+  std::size_t count{10000};
+  std::size_t burst{64};
+  std::size_t idle{15};
+  int cpu{-1};
+  bool unshare{true};
+};
+
+enum struct Mode
+{
+  Block,
+  Nonblock,
+  Batch,
+  Reactor,
+  Spin
+};
+
+enum struct Kind
+{
+  Route,
+  Link
+};
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-latency [options]\n"
+      "  -n, --count N       changes per mode and kind (default 10000, at most 65536)\n"
+      "  -b, --burst N       changes per burst in batch mode (default 64)\n"
+      "  -s, --sockets N     idle sockets served by the reactor along with the measured one (default 15)\n"
+      "  -c, --cpu N         pin the reactor's thread to cpu N\n"
+      "  -U, --no-unshare    run in the current namespaces, which need CAP_NET_ADMIN\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr std::array<struct option, 7> longOptions{{
+      {"count", required_argument, nullptr, 'n'},
+      {"burst", required_argument, nullptr, 'b'},
+      {"sockets", required_argument, nullptr, 's'},
+      {"cpu", required_argument, nullptr, 'c'},
+      {"no-unshare", no_argument, nullptr, 'U'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:b:s:c:Uh", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'n':
+        if (auto count = number<std::size_t>(arg); count && *count > 0 && *count <= MaxEvents)
+        {
+          options.count = *count;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid count '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'b':
+        if (auto burst = number<std::size_t>(arg); burst && *burst > 0)
+        {
+          options.burst = *burst;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid burst '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 's':
+        if (auto idle = number<std::size_t>(arg); idle && *idle <= 1024)
+        {
+          options.idle = *idle;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid sockets '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'c':
+        if (auto cpu = number<int>(arg); cpu && *cpu >= 0)
+        {
+          options.cpu = *cpu;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid cpu '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'U':
+        options.unshare = false;
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+  return options;
+}
+
+outcome::std_result<void> writeFile(char const* path, std::string_view content)
+{
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  auto written = write(fd, content.data(), content.size());
+  int error = errno;
+  close(fd);
+  if (written < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+// root of a user namespace of our own, which owns a network namespace of our own
+outcome::std_result<void> enterNamespaces()
+{
+  auto const uid = getuid();
+  auto const gid = getgid();
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/setgroups", "deny"));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/uid_map", fmt::format("0 {} 1", uid)));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/gid_map", fmt::format("0 {} 1", gid)));
+  return outcome::success();
+}
+
+// one rtnetlink request, built in place
+class Request
+{
+public:
+  template <typename HEADER>
+  Request(std::uint16_t type, std::uint16_t flags, HEADER const& header)
+    : m_buffer(NLMSG_SPACE(sizeof(HEADER)))
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = static_cast<std::uint16_t>(flags | NLM_F_REQUEST | NLM_F_ACK);
+    std::memcpy(NLMSG_DATA(nlh), &header, sizeof(header));
+  }
+
+  Request& attribute(unsigned short type, void const* data, std::size_t length)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + RTA_SPACE(length));
+    auto* rta = reinterpret_cast<struct rtattr*>(m_buffer.data() + offset);
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+    std::memcpy(RTA_DATA(rta), data, length);
+    return *this;
+  }
+  Request& attribute(unsigned short type, std::string_view text)
+  {
+    std::string terminated{text};
+    return attribute(type, terminated.c_str(), terminated.size() + 1);
+  }
+  Request& attribute(unsigned short type, std::uint32_t value)
+  {
+    return attribute(type, &value, sizeof(value));
+  }
+  template <typename HEADER>
+  Request& raw(HEADER const& header)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + NLMSG_ALIGN(sizeof(HEADER)));
+    std::memcpy(m_buffer.data() + offset, &header, sizeof(header));
+    return *this;
+  }
+  std::size_t begin(unsigned short type)
+  {
+    auto const offset = m_buffer.size();
+    attribute(type, nullptr, 0);
+    return offset;
+  }
+  void end(std::size_t nest)
+  {
+    reinterpret_cast<struct rtattr*>(m_buffer.data() + nest)->rta_len = static_cast<unsigned short>(m_buffer.size() - nest);
+  }
+
+  std::span<char const> finish(std::uint32_t seq)
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_len = static_cast<std::uint32_t>(m_buffer.size());
+    nlh->nlmsg_seq = seq;
+    return m_buffer;
+  }
+
+private:
+  std::vector<char> m_buffer;
+};
+
+// makes the changes, every request waits for its acknowledgement
+class Changes
+{
+public:
+  static outcome::std_result<Changes> open()
+  {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    return Changes{fd};
+  }
+
+  Changes(Changes const&) = delete;
+  Changes(Changes&& rhs) noexcept
+    : m_socket{std::exchange(rhs.m_socket, -1)}
+    , m_seq{rhs.m_seq}
+  {
+  }
+  Changes& operator=(Changes const&) = delete;
+  Changes& operator=(Changes&&) = delete;
+  ~Changes()
+  {
+    if (m_socket >= 0)
+    {
+      close(m_socket);
+    }
+  }
+
+  outcome::std_result<void> createVeth(std::string_view name, std::string_view peer)
+  {
+    struct ifinfomsg header{};
+    Request request{RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, header};
+    request.attribute(IFLA_IFNAME, name);
+    auto linkInfo = request.begin(IFLA_LINKINFO);
+    request.attribute(IFLA_INFO_KIND, "veth"sv);
+    auto data = request.begin(IFLA_INFO_DATA);
+    auto peerInfo = request.begin(VETH_INFO_PEER);
+    request.raw(header).attribute(IFLA_IFNAME, peer);
+    request.end(peerInfo);
+    request.end(data);
+    request.end(linkInfo);
+    return send(request);
+  }
+
+  outcome::std_result<void> createBridge(std::string_view name)
+  {
+    struct ifinfomsg header{};
+    Request request{RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, header};
+    request.attribute(IFLA_IFNAME, name);
+    auto linkInfo = request.begin(IFLA_LINKINFO);
+    request.attribute(IFLA_INFO_KIND, "bridge"sv);
+    request.end(linkInfo);
+    return send(request);
+  }
+
+  outcome::std_result<void> setUp(int index, bool up)
+  {
+    struct ifinfomsg header{};
+    header.ifi_index = index;
+    header.ifi_flags = up ? IFF_UP : 0;
+    header.ifi_change = IFF_UP;
+    Request request{RTM_NEWLINK, 0, header};
+    return send(request);
+  }
+
+  outcome::std_result<void> route(std::uint16_t type, std::uint32_t destination, int index)
+  {
+    struct rtmsg header{};
+    header.rtm_family = AF_INET;
+    header.rtm_dst_len = 32;
+    header.rtm_table = RT_TABLE_MAIN;
+    header.rtm_protocol = RTPROT_STATIC;
+    header.rtm_scope = type == RTM_NEWROUTE ? RT_SCOPE_LINK : RT_SCOPE_NOWHERE;
+    header.rtm_type = RTN_UNICAST;
+    Request request{type, static_cast<std::uint16_t>(type == RTM_NEWROUTE ? NLM_F_CREATE | NLM_F_EXCL : 0), header};
+    auto const networkOrder = htonl(destination);
+    request.attribute(RTA_DST, &networkOrder, sizeof(networkOrder)).attribute(RTA_OIF, static_cast<std::uint32_t>(index));
+    return send(request);
+  }
+
+private:
+  explicit Changes(int t_socket)
+    : m_socket{t_socket}
+  {
+  }
+
+  outcome::std_result<void> send(Request& request)
+  {
+    auto const message = request.finish(++m_seq);
+    if (::send(m_socket, message.data(), message.size(), 0) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    std::array<char, 8192> buffer;
+    for (;;)
+    {
+      auto length = recv(m_socket, buffer.data(), buffer.size(), 0);
+      if (length < 0)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+      auto remaining = static_cast<std::size_t>(length);
+      for (auto* nlh = reinterpret_cast<struct nlmsghdr*>(buffer.data()); NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining))
+      {
+        if (nlh->nlmsg_seq != m_seq || nlh->nlmsg_type != NLMSG_ERROR)
+        {
+          continue;
+        }
+        auto const* error = static_cast<struct nlmsgerr const*>(NLMSG_DATA(nlh));
+        if (error->error != 0)
+        {
+          return static_cast<errno_errc>(-error->error);
+        }
+        return outcome::success();
+      }
+    }
+  }
+
+  int m_socket;
+  std::uint32_t m_seq{0};
+};
+
+struct Links
+{
+  int veth;
+  int bridge;
+};
+
+outcome::std_result<Links> setUp(Changes& changes)
+{
+  BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex("lo")), true));
+  BOOST_OUTCOME_TRY(changes.createVeth(VethName, VethPeerName));
+  BOOST_OUTCOME_TRY(changes.createBridge(BridgeName));
+  Links links{static_cast<int>(if_nametoindex(std::string{VethName}.c_str())), static_cast<int>(if_nametoindex(std::string{BridgeName}.c_str()))};
+  BOOST_OUTCOME_TRY(changes.setUp(links.veth, true));
+  BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex(std::string{VethPeerName}.c_str())), true));
+  return links;
+}
+
+struct Run
+{
+  Netlink::Histogram callback;  // change sent until receive() returned its event
+  Netlink::Histogram wakeup;    // change sent until the datagram was received
+  std::size_t lost{0};
+  double cpu{0};  // percent of the receiver's wall time spent on a cpu
+};
+
+Clock::duration threadCpuTime()
+{
+  struct timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+std::uint64_t nanoseconds(Clock::duration duration)
+{
+  return static_cast<std::uint64_t>(std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+}
+
+outcome::std_result<void> measure(Run& run, Mode mode, Kind kind, Options const& options, Changes& changes, Links const& links)
+{
+  using Socket = Netlink::Socket;
+  if (kind == Kind::Link)
+  {
+    BOOST_OUTCOME_TRY(changes.setUp(links.bridge, false));
+  }
+  static constexpr Socket::GroupList routeGroups{Socket::GroupIpV4Route{}};
+  static constexpr Socket::GroupList linkGroups{Socket::GroupLink{}};
+  BOOST_OUTCOME_TRY(auto socket, Socket::open(kind == Kind::Route ? routeGroups : linkGroups));
+  BOOST_OUTCOME_TRY(socket.set_receive_buffer(8 * 1024 * 1024));
+  socket.set_timestamps(true);
+
+  auto const count = options.count;
+  auto const burst = mode == Mode::Batch ? options.burst : 1;
+  std::vector<Clock::time_point> sent(count);
+  std::atomic<std::size_t> received{0};
+  std::atomic<bool> stop{false};
+  std::size_t flaps = 0;
+
+  auto const handle = [&](Netlink::Message::ResponseTypes const& event, Clock::time_point now)
+  {
+    std::optional<std::size_t> index;
+    if (auto const* route = std::get_if<Route>(&event); route && route->action == Action::New)
+    {
+      if (auto const* network = std::get_if<boost::asio::ip::network_v4>(&route->destination.value); network && (network->address().to_uint() & 0xFFFF0000) == RouteBase)
+      {
+        index = network->address().to_uint() & 0xFFFF;
+      }
+    }
+    else if (auto const* link = std::get_if<Interface>(&event); link && link->index.value == links.bridge)
+    {
+      index = flaps++;
+    }
+    if (!index || *index >= count)
+    {
+      return;
+    }
+    run.callback.record(nanoseconds(now - sent[*index]));
+    run.wakeup.record(nanoseconds(socket.timestamp() - sent[*index]));
+    received.fetch_add(1, std::memory_order_release);
+  };
+
+  // the measured socket among idle ones, which join a group nothing here announces to
+  std::unique_ptr<Netlink::Reactor> reactor;
+  std::vector<Socket> idle;
+  if (mode == Mode::Reactor || mode == Mode::Spin)
+  {
+    auto opened = Netlink::Reactor::open({.mode = mode == Mode::Spin ? Netlink::Reactor::Mode::BusyPoll : Netlink::Reactor::Mode::Block, .cpu = options.cpu});
+    if (!opened)
+    {
+      return opened.error();
+    }
+    reactor = std::move(opened.value());
+    static constexpr Socket::GroupList idleGroups{Socket::GroupIpV6Rule{}};
+    idle.reserve(options.idle);
+    for (std::size_t i = 0; i < options.idle; ++i)
+    {
+      BOOST_OUTCOME_TRY(auto other, Socket::open(idleGroups));
+      idle.push_back(std::move(other));
+    }
+    for (auto& other : idle)
+    {
+      BOOST_OUTCOME_TRY(reactor->add(other, [](Socket&, outcome::std_result<Netlink::Message::ResponseTypes>&&) {}));
+    }
+    BOOST_OUTCOME_TRY(reactor->add(socket,
+        [&](Socket&, outcome::std_result<Netlink::Message::ResponseTypes>&& event)
+        {
+          auto const now = Clock::now();
+          if (event)
+          {
+            handle(event.value(), now);
+          }
+        }));
+  }
+
+  std::jthread receiver{[&]
+      {
+        auto const started = Clock::now();
+        auto const cpuStarted = threadCpuTime();
+        if (reactor)
+        {
+          static_cast<void>(reactor->run());
+        }
+        auto const receiveMode = mode == Mode::Nonblock ? Socket::ReceiveMode::Nonblock : Socket::ReceiveMode::Wait;
+        while (!reactor && received.load(std::memory_order_relaxed) < count && !stop.load(std::memory_order_relaxed))
+        {
+          auto event = socket.receive(receiveMode);
+          auto const now = Clock::now();
+          if (!event)
+          {
+            std::this_thread::yield();
+            continue;
+          }
+          handle(event.value(), now);
+        }
+        auto const wall = Clock::now() - started;
+        run.cpu = 100.0 * std::chrono::duration<double>(threadCpuTime() - cpuStarted).count() / std::max(std::chrono::duration<double>(wall).count(), 1e-9);
+      }};
+  // ends the receiver before it is joined, on every way out
+  struct Stop
+  {
+    std::atomic<bool>& stop;
+    Netlink::Reactor* reactor;
+    ~Stop()
+    {
+      stop = true;
+      if (reactor)
+      {
+        reactor->stop();
+      }
+    }
+  } const stopReceiver{stop, reactor.get()};
+
+  for (std::size_t first = 0; first < count; first += burst)
+  {
+    auto const last = std::min(first + burst, count);
+    for (auto i = first; i < last; ++i)
+    {
+      // stamped before the request, the kernel multicasts the event while handling it
+      sent[i] = Clock::now();
+      auto changed = kind == Kind::Route ? changes.route(RTM_NEWROUTE, RouteBase + static_cast<std::uint32_t>(i), links.veth) : changes.setUp(links.bridge, i % 2 == 0);
+      if (!changed)
+      {
+        return changed.error();
+      }
+    }
+    auto const deadline = Clock::now() + 1s;
+    while (received.load(std::memory_order_acquire) < last && Clock::now() < deadline)
+    {
+      std::this_thread::yield();
+    }
+    if (received.load(std::memory_order_acquire) < last)
+    {
+      break;
+    }
+    if (kind == Kind::Route)
+    {
+      for (auto i = first; i < last; ++i)
+      {
+        BOOST_OUTCOME_TRY(changes.route(RTM_DELROUTE, RouteBase + static_cast<std::uint32_t>(i), links.veth));
+      }
+    }
+  }
+  stop = true;
+  if (reactor)
+  {
+    reactor->stop();
+  }
+  else if (kind == Kind::Link || mode != Mode::Block)
+  {
+    // a blocked receiver still waiting for a lost event needs one more to return
+    BOOST_OUTCOME_TRY(changes.setUp(links.bridge, false));
+    BOOST_OUTCOME_TRY(changes.route(RTM_NEWROUTE, RouteBase + 0xFFFF, links.veth));
+    BOOST_OUTCOME_TRY(changes.route(RTM_DELROUTE, RouteBase + 0xFFFF, links.veth));
+  }
+  receiver.join();
+  run.lost = count - received.load();
+  return outcome::success();
+}
+
+void print(std::string_view mode, std::string_view kind, Run const& run)
+{
+  auto const callback = run.callback.snapshot();
+  auto const wakeup = run.wakeup.snapshot();
+  auto const us = [](std::uint64_t ns)
+  {
+    return static_cast<double>(ns) / 1000.0;
+  };
+  fmt::print("{:<9} {:<6} {:>7} {:>9.1f} {:>9.1f} {:>9.1f} {:>9.1f} {:>11.1f} {:>6} {:>6.1f}\n", mode, kind, callback.count, us(callback.percentile(50)), us(callback.percentile(99)),
+      us(callback.percentile(99.9)), us(callback.max), us(wakeup.percentile(50)), run.lost, run.cpu);
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->unshare)
+  {
+    if (auto entered = enterNamespaces(); !entered)
+    {
+      fmt::print(stderr, "sysinfo-latency: namespaces: {}\n", entered.error().message());
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto changes = Changes::open();
+  if (!changes)
+  {
+    fmt::print(stderr, "sysinfo-latency: open: {}\n", changes.error().message());
+    return EXIT_FAILURE;
+  }
+  auto links = setUp(changes.value());
+  if (!links)
+  {
+    fmt::print(stderr, "sysinfo-latency: links: {}\n", links.error().message());
+    return EXIT_FAILURE;
+  }
+
+  fmt::print("{:<9} {:<6} {:>7} {:>9} {:>9} {:>9} {:>9} {:>11} {:>6} {:>6}\n", "mode", "kind", "events", "p50 us", "p99 us", "p999 us", "max us", "recv p50 us", "lost", "cpu %");
+  static constexpr std::array modes{std::pair{Mode::Block, "block"sv}, std::pair{Mode::Nonblock, "nonblock"sv}, std::pair{Mode::Batch, "batch"sv},
+      std::pair{Mode::Reactor, "reactor"sv}, std::pair{Mode::Spin, "spin"sv}};
+  static constexpr std::array kinds{std::pair{Kind::Route, "route"sv}, std::pair{Kind::Link, "link"sv}};
+  for (auto const& [mode, modeName] : modes)
+  {
+    for (auto const& [kind, kindName] : kinds)
+    {
+      Run run;
+      if (auto measured = measure(run, mode, kind, *options, changes.value(), links.value()); !measured)
+      {
+        fmt::print(stderr, "sysinfo-latency: {} {}: {}\n", modeName, kindName, measured.error().message());
+        return EXIT_FAILURE;
+      }
+      print(modeName, kindName, run);
+    }
+  }
+  return EXIT_SUCCESS;
+}
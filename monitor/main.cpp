@@ -0,0 +1,570 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include <wormhole/sysinfo/Export.hpp>
+#include <wormhole/sysinfo/Journal.hpp>
+#include <wormhole/sysinfo/NetlinkSocket.hpp>
+
+#include <getopt.h>
+#include <net/if.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+
+namespace
+{
+struct Options
+{
+  bool links{false};
+  bool addresses{false};
+  bool routes{false};
+  int family{AF_UNSPEC};
+  std::optional<Route::Table> table;
+  std::optional<Interface::Index> interface;
+  Export::Format format{Export::Format::IpRoute};
+  std::chrono::milliseconds statsInterval{0};
+  int receiveBuffer{0};
+  std::optional<std::filesystem::path> journal;
+  std::optional<std::filesystem::path> replay;
+  Export::Journal::Clock::time_point from{};
+  Export::Journal::Clock::time_point to{Export::Journal::Clock::time_point::max()};
+};
+
+struct Counters
+{
+  std::uint64_t events{0};
+  std::uint64_t written{0};
+  std::uint64_t filtered{0};
+  std::uint64_t noBuffers{0};
+  std::uint64_t truncated{0};
+};
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-monitor [options] [link] [address] [route]\n"
+      "  -f, --family inet|inet6     only events of this address family\n"
+      "  -t, --table TABLE           only routes of this table (main, local, default or number)\n"
+      "  -i, --interface NAME|INDEX  only events of this interface\n"
+      "  -o, --output FORMAT         ip (default), compact, json or binary\n"
+      "  -s, --stats SECONDS         print events/s, drops, ENOBUFS and truncations to stderr every SECONDS\n"
+      "  -b, --rcvbuf BYTES          socket receive buffer size\n"
+      "  -j, --journal DIR           append the events to a journal in DIR instead of printing them\n"
+      "  -R, --replay DIR            print the events journaled in DIR and exit\n"
+      "      --from SECONDS          replay from this unix time on\n"
+      "      --to SECONDS            replay up to this unix time\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr int From = 256;
+  static constexpr int To = 257;
+  static constexpr std::array<struct option, 12> longOptions{{
+      {"family", required_argument, nullptr, 'f'},
+      {"table", required_argument, nullptr, 't'},
+      {"interface", required_argument, nullptr, 'i'},
+      {"output", required_argument, nullptr, 'o'},
+      {"stats", required_argument, nullptr, 's'},
+      {"rcvbuf", required_argument, nullptr, 'b'},
+      {"journal", required_argument, nullptr, 'j'},
+      {"replay", required_argument, nullptr, 'R'},
+      {"from", required_argument, nullptr, From},
+      {"to", required_argument, nullptr, To},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "f:t:i:o:s:b:j:R:h", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'f':
+        if (arg == "inet"sv || arg == "4"sv)
+        {
+          options.family = AF_INET;
+        }
+        else if (arg == "inet6"sv || arg == "6"sv)
+        {
+          options.family = AF_INET6;
+        }
+        else
+        {
+          fmt::print(stderr, "unknown family '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 't':
+        if (arg == "main"sv)
+        {
+          options.table = Route::Table::Main;
+        }
+        else if (arg == "local"sv)
+        {
+          options.table = Route::Table::Local;
+        }
+        else if (arg == "default"sv)
+        {
+          options.table = Route::Table::Default;
+        }
+        else if (auto table = number<std::uint32_t>(arg); table)
+        {
+          options.table = static_cast<Route::Table>(*table);
+        }
+        else
+        {
+          fmt::print(stderr, "unknown table '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'i':
+        if (auto index = number<int>(arg); index)
+        {
+          options.interface = Interface::Index{*index};
+        }
+        else if (auto ifindex = if_nametoindex(optarg); ifindex != 0)
+        {
+          options.interface = Interface::Index{static_cast<int>(ifindex)};
+        }
+        else
+        {
+          fmt::print(stderr, "unknown interface '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'o':
+        if (arg == "ip"sv)
+        {
+          options.format = Export::Format::IpRoute;
+        }
+        else if (arg == "compact"sv)
+        {
+          options.format = Export::Format::Compact;
+        }
+        else if (arg == "json"sv)
+        {
+          options.format = Export::Format::JsonLines;
+        }
+        else if (arg == "binary"sv)
+        {
+          options.format = Export::Format::Binary;
+        }
+        else
+        {
+          fmt::print(stderr, "unknown output format '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 's':
+        if (auto seconds = number<unsigned>(arg); seconds && *seconds > 0)
+        {
+          options.statsInterval = std::chrono::seconds{*seconds};
+        }
+        else
+        {
+          fmt::print(stderr, "invalid stats interval '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'b':
+        if (auto bytes = number<int>(arg); bytes && *bytes > 0)
+        {
+          options.receiveBuffer = *bytes;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid receive buffer size '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'j':
+        options.journal = std::filesystem::path{arg};
+        break;
+      case 'R':
+        options.replay = std::filesystem::path{arg};
+        break;
+      case From:
+      case To:
+        if (auto seconds = number<std::int64_t>(arg); seconds)
+        {
+          (opt == From ? options.from : options.to) = Export::Journal::Clock::time_point{std::chrono::seconds{*seconds}};
+        }
+        else
+        {
+          fmt::print(stderr, "invalid time '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+
+  for (int i = optind; i < argc; ++i)
+  {
+    std::string_view const object = argv[i];
+    if (object == "link"sv)
+    {
+      options.links = true;
+    }
+    else if (object == "address"sv || object == "addr"sv)
+    {
+      options.addresses = true;
+    }
+    else if (object == "route"sv)
+    {
+      options.routes = true;
+    }
+    else
+    {
+      fmt::print(stderr, "unknown object '{}'\n", object);
+      return std::nullopt;
+    }
+  }
+  if (!options.links && !options.addresses && !options.routes)
+  {
+    options.links = options.addresses = options.routes = true;
+  }
+  return options;
+}
+
+std::vector<Netlink::Socket::Groups> groups(Options const& options)
+{
+  std::vector<Netlink::Socket::Groups> list;
+  list.reserve(5);
+  bool const v4 = options.family != AF_INET6;
+  bool const v6 = options.family != AF_INET;
+  if (options.links)
+  {
+    list.push_back(Netlink::Socket::GroupLink{});
+  }
+  if (options.addresses && v4)
+  {
+    list.push_back(Netlink::Socket::GroupIpV4Address{});
+  }
+  if (options.addresses && v6)
+  {
+    list.push_back(Netlink::Socket::GroupIpV6Address{});
+  }
+  if (options.routes && v4)
+  {
+    list.push_back(Netlink::Socket::GroupIpV4Route{});
+  }
+  if (options.routes && v6)
+  {
+    list.push_back(Netlink::Socket::GroupIpV6Route{});
+  }
+  return list;
+}
+
+class Filter
+{
+public:
+  explicit Filter(Options const& t_options)
+    : m_options{t_options}
+  {
+  }
+
+  // the objects matter for a replay, live events are limited by the groups joined
+  bool operator()(Interface const& link) const
+  {
+    return m_options.links && (!m_options.interface || link.index == *m_options.interface);
+  }
+  bool operator()(Address const& address) const
+  {
+    return m_options.addresses && family(address.address.is_v6() ? AF_INET6 : AF_INET) && (!m_options.interface || address.interfaceIndex == *m_options.interface);
+  }
+  bool operator()(Route const& route) const
+  {
+    return m_options.routes && family(route.family) && (!m_options.table || route.table == *m_options.table) && (!m_options.interface || usesInterface(route));
+  }
+  template <typename T>
+  bool operator()(T const&) const
+  {
+    return true;
+  }
+
+private:
+  bool family(int value) const
+  {
+    return m_options.family == AF_UNSPEC || m_options.family == value;
+  }
+  bool usesInterface(Route const& route) const
+  {
+    if (route.interfaceIndex == *m_options.interface)
+    {
+      return true;
+    }
+    return route.nexthops && std::any_of(route.nexthops->paths.begin(), route.nexthops->paths.end(), [this](auto const& path)
+                                 {
+                                   return path.interfaceIndex == *m_options.interface;
+                                 });
+  }
+
+  Options const& m_options;
+};
+
+// the socket's drop counter as shown in /proc/net/netlink, columns: sk Eth Pid Groups Rmem Wmem Dump Locks Drops Inode
+std::optional<std::uint64_t> socketDrops(std::uint32_t portId)
+{
+  std::ifstream table{"/proc/net/netlink"};
+  std::string line;
+  std::getline(table, line);
+  while (std::getline(table, line))
+  {
+    std::istringstream columns{line};
+    std::string sk;
+    int protocol;
+    std::uint32_t pid;
+    std::string groups;
+    std::uint64_t rmem, wmem, dump, locks, drops;
+    if (columns >> sk >> protocol >> pid >> groups >> rmem >> wmem >> dump >> locks >> drops && protocol == NETLINK_ROUTE && pid == portId)
+    {
+      return drops;
+    }
+  }
+  return std::nullopt;
+}
+
+void printStats(Counters const& window, Counters const& total, std::chrono::duration<double> elapsed, std::optional<std::uint64_t> drops)
+{
+  fmt::print(stderr, "sysinfo-monitor: {:.0f} events/s, {} events, {} written, {} filtered, {} drops, {} enobufs, {} truncated\n",
+      static_cast<double>(window.events) / elapsed.count(), total.events, total.written, total.filtered,
+      drops ? fmt::format("{}", *drops) : "?"s, total.noBuffers, total.truncated);
+}
+
+int replay(Options const& options)
+{
+  auto reader = Export::JournalReader::open(*options.replay);
+  if (!reader)
+  {
+    fmt::print(stderr, "sysinfo-monitor: replay: {}\n", reader.error().message());
+    return EXIT_FAILURE;
+  }
+  Export::Writer writer{STDOUT_FILENO, options.format};
+  Filter const filter{options};
+  outcome::std_result<void> written = outcome::success();
+  auto replayed = reader.value().replay(options.from, options.to, [&](Export::Journal::Clock::time_point, Export::Binary::Record&& record)
+      {
+        if (written && std::visit(filter, record))
+        {
+          written = std::visit([&writer](auto const& entry)
+              {
+                return writer.write(entry);
+              },
+              record);
+        }
+      });
+  if (!replayed)
+  {
+    fmt::print(stderr, "sysinfo-monitor: replay: {}\n", replayed.error().message());
+    return EXIT_FAILURE;
+  }
+  if (!written || !(written = writer.flush()))
+  {
+    fmt::print(stderr, "sysinfo-monitor: write: {}\n", written.error().message());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->replay)
+  {
+    return replay(*options);
+  }
+
+  auto const groupList = groups(*options);
+  auto socket = Netlink::Socket::open(groupList);
+  if (!socket)
+  {
+    fmt::print(stderr, "sysinfo-monitor: open: {}\n", socket.error().message());
+    return EXIT_FAILURE;
+  }
+  if (options->receiveBuffer != 0)
+  {
+    if (auto result = socket.value().set_receive_buffer(options->receiveBuffer); !result)
+    {
+      fmt::print(stderr, "sysinfo-monitor: receive buffer: {}\n", result.error().message());
+    }
+  }
+
+  std::signal(SIGINT, [](int)
+      {
+        stopRequested = 1;
+      });
+  std::signal(SIGTERM, [](int)
+      {
+        stopRequested = 1;
+      });
+
+  Export::Writer writer{STDOUT_FILENO, options->format};
+  std::unique_ptr<Export::Journal> journal;
+  if (options->journal)
+  {
+    auto opened = Export::Journal::open(*options->journal);
+    if (!opened)
+    {
+      fmt::print(stderr, "sysinfo-monitor: journal: {}\n", opened.error().message());
+      return EXIT_FAILURE;
+    }
+    journal = std::move(opened.value());
+  }
+  Filter const filter{*options};
+  Counters total;
+  Counters window;
+  auto const portId = socket.value().port_id();
+  auto windowStart = std::chrono::steady_clock::now();
+  struct pollfd pfd
+  {
+    .fd = socket.value().native_handle(), .events = POLLIN, .revents = 0
+  };
+
+  while (!stopRequested)
+  {
+    int timeout = -1;
+    if (options->statsInterval.count() > 0)
+    {
+      auto const left = std::chrono::duration_cast<std::chrono::milliseconds>(windowStart + options->statsInterval - std::chrono::steady_clock::now());
+      timeout = static_cast<int>(std::max<std::int64_t>(left.count(), 0));
+    }
+    if (journal)
+    {
+      // a quiet socket still gets its last events committed
+      auto const interval = static_cast<int>(journal->options().commitInterval.count());
+      timeout = timeout < 0 ? interval : std::min(timeout, interval);
+    }
+
+    int const ready = poll(&pfd, 1, timeout);
+    if (ready == 0 && journal)
+    {
+      if (auto committed = journal->commit(); !committed)
+      {
+        fmt::print(stderr, "sysinfo-monitor: journal: {}\n", committed.error().message());
+        return EXIT_FAILURE;
+      }
+    }
+    if (ready > 0)
+    {
+      // drain everything queued, then hand the whole batch to stdout
+      for (;;)
+      {
+        auto event = socket.value().receive(Netlink::Socket::ReceiveMode::Nonblock);
+        if (!event && (event.error() == static_cast<errno_errc>(EAGAIN) || event.error() == static_cast<errno_errc>(EINTR)))
+        {
+          break;
+        }
+        if (!event && event.error() == static_cast<errno_errc>(ENOBUFS))
+        {
+          ++window.noBuffers;
+          ++total.noBuffers;
+          continue;
+        }
+        if (!event && event.error() == Netlink::SocketError::Truncated)
+        {
+          ++window.truncated;
+          ++total.truncated;
+          continue;
+        }
+        if (!event)
+        {
+          fmt::print(stderr, "sysinfo-monitor: receive: {}\n", event.error().message());
+          return EXIT_FAILURE;
+        }
+
+        ++window.events;
+        ++total.events;
+        bool const accepted = std::visit(filter, event.value());
+        if (!accepted)
+        {
+          ++total.filtered;
+          continue;
+        }
+        if (journal)
+        {
+          if (auto appended = journal->append(event.value()); !appended)
+          {
+            fmt::print(stderr, "sysinfo-monitor: journal: {}\n", appended.error().message());
+            return EXIT_FAILURE;
+          }
+        }
+        else if (auto written = writer.write(event.value()); !written)
+        {
+          fmt::print(stderr, "sysinfo-monitor: write: {}\n", written.error().message());
+          return EXIT_FAILURE;
+        }
+        ++total.written;
+      }
+      if (auto flushed = writer.flush(); !flushed)
+      {
+        fmt::print(stderr, "sysinfo-monitor: write: {}\n", flushed.error().message());
+        return EXIT_FAILURE;
+      }
+    }
+
+    auto const now = std::chrono::steady_clock::now();
+    if (options->statsInterval.count() > 0 && now - windowStart >= options->statsInterval)
+    {
+      printStats(window, total, now - windowStart, socketDrops(portId));
+      window = {};
+      windowStart = now;
+    }
+  }
+
+  static_cast<void>(writer.flush());
+  journal.reset();
+  if (options->statsInterval.count() > 0)
+  {
+    printStats(window, total, std::chrono::steady_clock::now() - windowStart, socketDrops(portId));
+  }
+  return EXIT_SUCCESS;
+}
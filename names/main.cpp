@@ -0,0 +1,563 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+/*
+ * what interned interface names save on a large route dump. a network namespace of its
+ * own gets veth pairs and /32 routes spread over them, one socket dumps them and keeps
+ * the response:
+ *   dump         heap allocations, resident memory and wall time of the dump, the names
+ *                are InterfaceName, 4 bytes per route and one interned copy per name
+ *   std::string  the same names copied into one std::string per route, the type
+ *                Route::interfaceName had before
+ * resident memory is the growth of the process' resident set (/proc/self/statm).
+ */
+
+#include <wormhole/sysinfo/NetlinkSocket.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+using namespace wormhole::sysinfo;
+using namespace std::literals;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+std::atomic<std::size_t> allocations{0};
+std::atomic<std::size_t> allocated{0};
+
+void* allocate(std::size_t size, std::size_t alignment)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated.fetch_add(size, std::memory_order_relaxed);
+  void* pointer = alignment <= alignof(std::max_align_t) ? std::malloc(size == 0 ? 1 : size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  if (pointer == nullptr)
+  {
+    throw std::bad_alloc{};
+  }
+  return pointer;
+}
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+  return allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+namespace
+{
+constexpr std::uint32_t RouteBase = 0x0A000000;  // 10.0.0.0/8
+constexpr std::size_t MaxRoutes = 1U << 24;
+constexpr std::size_t MaxLinks = 256;
+constexpr std::size_t BatchSize = 60 * 1024;
+
+struct Options
+{
+  std::size_t routes{100000};
+  std::size_t links{16};
+  bool unshare{true};
+};
+
+void usage(std::FILE* out)
+{
+  fmt::print(out,
+      "usage: sysinfo-names [options]\n"
+      "  -n, --routes N      routes (default 100000, at most 16777216)\n"
+      "  -l, --links N       veth pairs the routes are spread over (default 16, at most 256)\n"
+      "  -U, --no-unshare    run in the current namespaces, which need CAP_NET_ADMIN\n"
+      "  -h, --help\n");
+}
+
+template <typename T>
+std::optional<T> number(std::string_view text)
+{
+  T value{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size())
+  {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+  static constexpr std::array<struct option, 5> longOptions{{
+      {"routes", required_argument, nullptr, 'n'},
+      {"links", required_argument, nullptr, 'l'},
+      {"no-unshare", no_argument, nullptr, 'U'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  }};
+
+  Options options;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:l:Uh", longOptions.data(), nullptr)) != -1)
+  {
+    std::string_view const arg = optarg ? optarg : "";
+    switch (opt)
+    {
+      case 'n':
+        if (auto routes = number<std::size_t>(arg); routes && *routes > 0 && *routes <= MaxRoutes)
+        {
+          options.routes = *routes;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid routes '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'l':
+        if (auto links = number<std::size_t>(arg); links && *links > 0 && *links <= MaxLinks)
+        {
+          options.links = *links;
+        }
+        else
+        {
+          fmt::print(stderr, "invalid links '{}'\n", arg);
+          return std::nullopt;
+        }
+        break;
+      case 'U':
+        options.unshare = false;
+        break;
+      case 'h':
+        usage(stdout);
+        std::exit(EXIT_SUCCESS);
+      default:
+        usage(stderr);
+        return std::nullopt;
+    }
+  }
+  return options;
+}
+
+outcome::std_result<void> writeFile(char const* path, std::string_view content)
+{
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  auto written = write(fd, content.data(), content.size());
+  int error = errno;
+  close(fd);
+  if (written < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+// root of a user namespace of our own, which owns a network namespace of our own
+outcome::std_result<void> enterNamespaces()
+{
+  auto const uid = getuid();
+  auto const gid = getgid();
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/setgroups", "deny"));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/uid_map", fmt::format("0 {} 1", uid)));
+  BOOST_OUTCOME_TRY(writeFile("/proc/self/gid_map", fmt::format("0 {} 1", gid)));
+  return outcome::success();
+}
+
+// one rtnetlink request, built in place
+class Request
+{
+public:
+  template <typename HEADER>
+  Request(std::uint16_t type, std::uint16_t flags, HEADER const& header)
+    : m_buffer(NLMSG_SPACE(sizeof(HEADER)))
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = static_cast<std::uint16_t>(flags | NLM_F_REQUEST | NLM_F_ACK);
+    std::memcpy(NLMSG_DATA(nlh), &header, sizeof(header));
+  }
+
+  Request& attribute(unsigned short type, void const* data, std::size_t length)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + RTA_SPACE(length));
+    auto* rta = reinterpret_cast<struct rtattr*>(m_buffer.data() + offset);
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+    std::memcpy(RTA_DATA(rta), data, length);
+    return *this;
+  }
+  Request& attribute(unsigned short type, std::string_view text)
+  {
+    std::string terminated{text};
+    return attribute(type, terminated.c_str(), terminated.size() + 1);
+  }
+  Request& attribute(unsigned short type, std::uint32_t value)
+  {
+    return attribute(type, &value, sizeof(value));
+  }
+  template <typename HEADER>
+  Request& raw(HEADER const& header)
+  {
+    auto const offset = m_buffer.size();
+    m_buffer.resize(offset + NLMSG_ALIGN(sizeof(HEADER)));
+    std::memcpy(m_buffer.data() + offset, &header, sizeof(header));
+    return *this;
+  }
+  std::size_t begin(unsigned short type)
+  {
+    auto const offset = m_buffer.size();
+    attribute(type, nullptr, 0);
+    return offset;
+  }
+  void end(std::size_t nest)
+  {
+    reinterpret_cast<struct rtattr*>(m_buffer.data() + nest)->rta_len = static_cast<unsigned short>(m_buffer.size() - nest);
+  }
+
+  // no acknowledgement, only an error is answered
+  Request& quiet()
+  {
+    reinterpret_cast<struct nlmsghdr*>(m_buffer.data())->nlmsg_flags &= static_cast<std::uint16_t>(~NLM_F_ACK);
+    return *this;
+  }
+
+  std::span<char const> finish(std::uint32_t seq)
+  {
+    auto* nlh = reinterpret_cast<struct nlmsghdr*>(m_buffer.data());
+    nlh->nlmsg_len = static_cast<std::uint32_t>(m_buffer.size());
+    nlh->nlmsg_seq = seq;
+    return m_buffer;
+  }
+
+private:
+  std::vector<char> m_buffer;
+};
+
+// makes the changes; requests are sent one by one, waiting for their acknowledgement, or
+// posted in batches without one, which the next acknowledged request waits for
+class Changes
+{
+public:
+  static outcome::std_result<Changes> open()
+  {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    return Changes{fd};
+  }
+
+  Changes(Changes const&) = delete;
+  Changes(Changes&& rhs) noexcept
+    : m_socket{std::exchange(rhs.m_socket, -1)}
+    , m_seq{rhs.m_seq}
+    , m_batch{std::move(rhs.m_batch)}
+  {
+  }
+  Changes& operator=(Changes const&) = delete;
+  Changes& operator=(Changes&&) = delete;
+  ~Changes()
+  {
+    if (m_socket >= 0)
+    {
+      close(m_socket);
+    }
+  }
+
+  outcome::std_result<void> createVeth(std::string_view name, std::string_view peer)
+  {
+    struct ifinfomsg header{};
+    Request request{RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, header};
+    request.attribute(IFLA_IFNAME, name);
+    auto linkInfo = request.begin(IFLA_LINKINFO);
+    request.attribute(IFLA_INFO_KIND, "veth"sv);
+    auto data = request.begin(IFLA_INFO_DATA);
+    auto peerInfo = request.begin(VETH_INFO_PEER);
+    request.raw(header).attribute(IFLA_IFNAME, peer);
+    request.end(peerInfo);
+    request.end(data);
+    request.end(linkInfo);
+    return send(request);
+  }
+
+  outcome::std_result<void> setUp(int index)
+  {
+    struct ifinfomsg header{};
+    header.ifi_index = index;
+    header.ifi_flags = IFF_UP;
+    header.ifi_change = IFF_UP;
+    Request request{RTM_NEWLINK, 0, header};
+    return send(request);
+  }
+
+  // a host route through index, posted
+  outcome::std_result<void> route(std::uint32_t destination, int index)
+  {
+    struct rtmsg header{};
+    header.rtm_family = AF_INET;
+    header.rtm_dst_len = 32;
+    header.rtm_table = RT_TABLE_MAIN;
+    header.rtm_protocol = RTPROT_STATIC;
+    header.rtm_scope = RT_SCOPE_LINK;
+    header.rtm_type = RTN_UNICAST;
+    Request request{RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL, header};
+    auto const networkOrder = htonl(destination);
+    request.attribute(RTA_DST, &networkOrder, sizeof(networkOrder)).attribute(RTA_OIF, static_cast<std::uint32_t>(index)).quiet();
+    auto const message = request.finish(++m_seq);
+    if (m_batch.size() + message.size() > BatchSize)
+    {
+      BOOST_OUTCOME_TRY(flush());
+    }
+    m_batch.insert(m_batch.end(), message.begin(), message.end());
+    return outcome::success();
+  }
+
+  outcome::std_result<void> flush()
+  {
+    if (!m_batch.empty() && ::send(m_socket, m_batch.data(), m_batch.size(), 0) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    m_batch.clear();
+    return outcome::success();
+  }
+
+private:
+  explicit Changes(int t_socket)
+    : m_socket{t_socket}
+  {
+  }
+
+  outcome::std_result<void> send(Request& request)
+  {
+    BOOST_OUTCOME_TRY(flush());
+    auto const message = request.finish(++m_seq);
+    if (::send(m_socket, message.data(), message.size(), 0) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    std::array<char, 8192> buffer;
+    for (;;)
+    {
+      auto length = recv(m_socket, buffer.data(), buffer.size(), 0);
+      if (length < 0)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+      auto remaining = static_cast<std::size_t>(length);
+      for (auto* nlh = reinterpret_cast<struct nlmsghdr*>(buffer.data()); NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining))
+      {
+        if (nlh->nlmsg_type != NLMSG_ERROR)
+        {
+          continue;
+        }
+        // a posted request only answers when it failed
+        auto const* error = static_cast<struct nlmsgerr const*>(NLMSG_DATA(nlh));
+        if (error->error != 0)
+        {
+          return static_cast<errno_errc>(-error->error);
+        }
+        if (nlh->nlmsg_seq == m_seq)
+        {
+          return outcome::success();
+        }
+      }
+    }
+  }
+
+  int m_socket;
+  std::uint32_t m_seq{0};
+  std::vector<char> m_batch;
+};
+
+outcome::std_result<void> setUp(Options const& options)
+{
+  BOOST_OUTCOME_TRY(auto changes, Changes::open());
+  auto const lo = static_cast<int>(if_nametoindex("lo"));
+  BOOST_OUTCOME_TRY(changes.setUp(lo));
+  std::vector<int> links;
+  for (std::size_t i = 0; i < options.links; ++i)
+  {
+    auto const name = fmt::format("names{}", i);
+    auto const peer = fmt::format("names{}p", i);
+    BOOST_OUTCOME_TRY(changes.createVeth(name, peer));
+    links.push_back(static_cast<int>(if_nametoindex(name.c_str())));
+    BOOST_OUTCOME_TRY(changes.setUp(links.back()));
+    BOOST_OUTCOME_TRY(changes.setUp(static_cast<int>(if_nametoindex(peer.c_str()))));
+  }
+  for (std::size_t n = 0; n < options.routes; ++n)
+  {
+    BOOST_OUTCOME_TRY(changes.route(RouteBase + static_cast<std::uint32_t>(n), links[n % links.size()]));
+  }
+  // waits for the posted routes
+  return changes.setUp(lo);
+}
+
+std::size_t resident()
+{
+  std::size_t size = 0;
+  std::size_t pages = 0;
+  if (auto* statm = std::fopen("/proc/self/statm", "r"); statm)
+  {
+    if (std::fscanf(statm, "%zu %zu", &size, &pages) != 2)
+    {
+      pages = 0;
+    }
+    std::fclose(statm);
+  }
+  return pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+struct Result
+{
+  std::size_t allocations{0};
+  std::size_t heap{0};
+  std::size_t resident{0};
+  Clock::duration time{};
+};
+
+// counts what happens in between
+class Counter
+{
+public:
+  Counter()
+    : m_allocations{allocations.load()}
+    , m_allocated{allocated.load()}
+    , m_resident{::resident()}
+    , m_start{Clock::now()}
+  {
+  }
+
+  [[nodiscard]] Result stop() const
+  {
+    return {allocations.load() - m_allocations, allocated.load() - m_allocated, ::resident() - std::min(::resident(), m_resident), Clock::now() - m_start};
+  }
+
+private:
+  std::size_t m_allocations;
+  std::size_t m_allocated;
+  std::size_t m_resident;
+  Clock::time_point m_start;
+};
+
+void print(std::string_view method, std::size_t perRoute, Result const& result)
+{
+  fmt::print("{:<12} {:>9} {:>10.2f} {:>12} {:>10.1f} {:>12.1f}\n", method, perRoute, std::chrono::duration<double>(result.time).count() * 1e3, result.allocations,
+      static_cast<double>(result.heap) / (1024 * 1024), static_cast<double>(result.resident) / (1024 * 1024));
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  auto options = parseOptions(argc, argv);
+  if (!options)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->unshare)
+  {
+    if (auto entered = enterNamespaces(); !entered)
+    {
+      fmt::print(stderr, "sysinfo-names: namespaces: {}\n", entered.error().message());
+      return EXIT_FAILURE;
+    }
+  }
+  if (auto prepared = setUp(*options); !prepared)
+  {
+    fmt::print(stderr, "sysinfo-names: set up: {}\n", prepared.error().message());
+    return EXIT_FAILURE;
+  }
+  auto socket = Netlink::Socket::open({});
+  if (!socket)
+  {
+    fmt::print(stderr, "sysinfo-names: open: {}\n", socket.error().message());
+    return EXIT_FAILURE;
+  }
+
+  std::optional<Netlink::Message::RouteRequest::Response_t> response;
+  Result dumped;
+  {
+    Counter const counter;
+    auto sent = socket.value().send_request<Netlink::Message::RouteRequest>(AF_INET);
+    auto received = sent ? socket.value().receive<Netlink::Message::RouteRequest>(Netlink::Socket::ReceiveMode::Wait) : sent.error();
+    if (!received)
+    {
+      fmt::print(stderr, "sysinfo-names: dump: {}\n", received.error().message());
+      return EXIT_FAILURE;
+    }
+    response = std::move(received.value());
+    dumped = counter.stop();
+  }
+
+  std::vector<std::string> strings;
+  Result copied;
+  {
+    Counter const counter;
+    strings.reserve(response->data.size());
+    for (auto const& route : response->data)
+    {
+      strings.emplace_back(route.interfaceName.view());
+    }
+    copied = counter.stop();
+  }
+
+  fmt::print("{} routes over {} links, {} names interned, {} bytes per route\n", response->data.size(), options->links, InterfaceName::interned(), sizeof(Route));
+  fmt::print("{:<12} {:>9} {:>10} {:>12} {:>10} {:>12}\n", "names", "B/route", "ms", "allocations", "heap MiB", "resident MiB");
+  print("dump", sizeof(InterfaceName), dumped);
+  print("std::string", sizeof(std::string), copied);
+  return EXIT_SUCCESS;
+}
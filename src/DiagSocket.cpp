@@ -0,0 +1,429 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/DiagSocket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <linux/sock_diag.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+namespace Attribute = wormhole::sysinfo::Netlink::Attribute;
+using DiagSocket = wormhole::sysinfo::Netlink::DiagSocket;
+
+using DiagSchema = Attribute::Schema<Attribute::Field<INET_DIAG_INFO, Attribute::Payload>>;
+
+constexpr std::size_t align(std::size_t length) noexcept
+{
+  return NLMSG_ALIGN(length);
+}
+
+template <typename T>
+void append(std::vector<std::byte>& buffer, T const& value)
+{
+  auto const offset = buffer.size();
+  buffer.resize(offset + align(sizeof(T)));
+  std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+/*
+ * every condition either steps to the next one or jumps 4 bytes past the end, which
+ * rejects the socket: the program accepts only when all of them hold.
+ */
+void appendCondition(std::vector<std::byte>& program, std::uint8_t code, std::uint16_t port, std::size_t length)
+{
+  auto const remaining = length - program.size();
+  append(program, inet_diag_bc_op{.code = code, .yes = 2 * sizeof(inet_diag_bc_op), .no = static_cast<std::uint16_t>(remaining + 4)});
+  append(program, inet_diag_bc_op{.code = 0, .yes = 0, .no = port});
+}
+
+std::vector<std::byte> compile(DiagSocket::Query const& query)
+{
+  struct Condition
+  {
+    std::uint8_t code;
+    std::uint16_t port;
+  };
+  std::vector<Condition> conditions;
+  auto const range = [&conditions](std::optional<DiagSocket::PortRange> const& ports, std::uint8_t ge, std::uint8_t le)
+  {
+    if (!ports)
+    {
+      return;
+    }
+    if (ports->first > 0)
+    {
+      conditions.push_back({ge, ports->first});
+    }
+    if (ports->last < 0xFFFF)
+    {
+      conditions.push_back({le, ports->last});
+    }
+  };
+  range(query.localPort, INET_DIAG_BC_S_GE, INET_DIAG_BC_S_LE);
+  range(query.remotePort, INET_DIAG_BC_D_GE, INET_DIAG_BC_D_LE);
+
+  std::vector<std::byte> program;
+  auto const length = conditions.size() * 2 * sizeof(inet_diag_bc_op);
+  program.reserve(length);
+  for (auto const& condition : conditions)
+  {
+    appendCondition(program, condition.code, condition.port, length);
+  }
+  return program;
+}
+
+DiagSocket::Sockets::Address address(std::uint32_t const (&words)[4])
+{
+  DiagSocket::Sockets::Address bytes;
+  std::memcpy(bytes.data(), words, bytes.size());
+  return bytes;
+}
+
+boost::asio::ip::address toAddress(std::uint8_t family, DiagSocket::Sockets::Address const& bytes)
+{
+  if (family == AF_INET6)
+  {
+    return boost::asio::ip::address_v6{bytes};
+  }
+  return boost::asio::ip::address_v4{{bytes[0], bytes[1], bytes[2], bytes[3]}};
+}
+
+// the fields of linux' struct tcp_info that are needed, glibc's copy ends before the byte counters
+struct TcpInfo
+{
+  std::uint64_t bytesAcked{0};
+  std::uint64_t bytesReceived{0};
+  std::uint32_t rtt{0};
+};
+// offsets in the kernel's struct tcp_info (include/uapi/linux/tcp.h), fixed by the ABI:
+// tcpi_total_retrans ends at 104, followed by the u64 tcpi_pacing_rate, tcpi_max_pacing_rate,
+// tcpi_bytes_acked (since 4.1) and tcpi_bytes_received
+constexpr std::size_t RttOffset = 68;
+constexpr std::size_t BytesAckedOffset = 120;
+constexpr std::size_t BytesReceivedOffset = 128;
+static_assert(offsetof(struct tcp_info, tcpi_rtt) == RttOffset, "glibc's tcp_info does not match the kernel's layout");
+static_assert(offsetof(struct tcp_info, tcpi_total_retrans) + sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t) == BytesAckedOffset,
+    "glibc's tcp_info does not match the kernel's layout");
+
+template <typename T>
+T field(Attribute::Payload payload, std::size_t offset) noexcept
+{
+  // older kernels send a shorter struct
+  if (payload.size() < offset + sizeof(T))
+  {
+    return 0;
+  }
+  return Attribute::Decoder<T>::decode(payload.subspan(offset)).value_or(0);
+}
+
+TcpInfo tcpInfo(Attribute::Payload payload) noexcept
+{
+  return {.bytesAcked = field<std::uint64_t>(payload, BytesAckedOffset),
+      .bytesReceived = field<std::uint64_t>(payload, BytesReceivedOffset),
+      .rtt = field<std::uint32_t>(payload, RttOffset)};
+}
+}  // namespace
+
+namespace wormhole::sysinfo::Netlink
+{
+std::size_t DiagSocket::Sockets::size() const noexcept
+{
+  return family.size();
+}
+
+DiagSocket::Entry DiagSocket::Sockets::entry(std::size_t i) const
+{
+  Entry entry{.family = family[i],
+      .state = state[i],
+      .local = toAddress(family[i], local[i]),
+      .localPort = localPort[i],
+      .remote = toAddress(family[i], remote[i]),
+      .remotePort = remotePort[i],
+      .interface = {static_cast<int>(interface[i])},
+      .inode = inode[i],
+      .uid = uid[i],
+      .receiveQueue = receiveQueue[i],
+      .sendQueue = sendQueue[i],
+      .cookie = cookie[i]};
+  if (i < bytesAcked.size())
+  {
+    entry.bytesAcked = bytesAcked[i];
+    entry.bytesReceived = bytesReceived[i];
+    entry.rtt = rtt[i];
+  }
+  return entry;
+}
+
+void DiagSocket::Sockets::clear() noexcept
+{
+  family.clear();
+  state.clear();
+  local.clear();
+  localPort.clear();
+  remote.clear();
+  remotePort.clear();
+  interface.clear();
+  inode.clear();
+  uid.clear();
+  receiveQueue.clear();
+  sendQueue.clear();
+  cookie.clear();
+  bytesAcked.clear();
+  bytesReceived.clear();
+  rtt.clear();
+}
+
+outcome::std_result<DiagSocket> DiagSocket::open()
+{
+  int diagSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+  if (diagSocket < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  sockaddr_nl saddr{};
+  saddr.nl_family = AF_NETLINK;
+  socklen_t length = sizeof(saddr);
+  if (bind(diagSocket, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) < 0 || getsockname(diagSocket, reinterpret_cast<struct sockaddr*>(&saddr), &length) < 0)
+  {
+    int err = errno;
+    close(diagSocket);
+    return static_cast<errno_errc>(err);
+  }
+  return DiagSocket{diagSocket, saddr.nl_pid};
+}
+
+DiagSocket::DiagSocket(int t_socket, std::uint32_t t_pid)
+  : m_pid{t_pid}
+  , m_socket{t_socket}
+  , m_buffer(DatagramSize)
+{
+}
+
+DiagSocket::DiagSocket(DiagSocket&& rhs) noexcept
+  : m_pid{rhs.m_pid}
+  , m_socket{std::exchange(rhs.m_socket, -1)}
+  , m_seqNum{rhs.m_seqNum}
+  , m_request{std::move(rhs.m_request)}
+  , m_buffer{std::move(rhs.m_buffer)}
+{
+}
+
+DiagSocket& DiagSocket::operator=(DiagSocket&& rhs) noexcept
+{
+  if (this != std::addressof(rhs))
+  {
+    if (m_socket >= 0)
+    {
+      close(m_socket);
+    }
+    m_pid = rhs.m_pid;
+    m_socket = std::exchange(rhs.m_socket, -1);
+    m_seqNum = rhs.m_seqNum;
+    m_request = std::move(rhs.m_request);
+    m_buffer = std::move(rhs.m_buffer);
+  }
+  return *this;
+}
+
+DiagSocket::~DiagSocket()
+{
+  if (m_socket >= 0)
+  {
+    close(m_socket);
+  }
+}
+
+int DiagSocket::native_handle() const noexcept
+{
+  return m_socket;
+}
+
+outcome::std_result<void> DiagSocket::send(int family, Query const& query)
+{
+  auto const program = compile(query);
+  m_request.clear();
+  append(m_request, nlmsghdr{.nlmsg_len = 0, .nlmsg_type = SOCK_DIAG_BY_FAMILY, .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP, .nlmsg_seq = ++m_seqNum, .nlmsg_pid = m_pid});
+  inet_diag_req_v2 request{};
+  request.sdiag_family = static_cast<std::uint8_t>(family);
+  request.sdiag_protocol = query.protocol;
+  request.idiag_ext = query.info ? static_cast<std::uint8_t>(1U << (INET_DIAG_INFO - 1)) : std::uint8_t{0};
+  request.idiag_states = query.states;
+  request.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+  request.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+  append(m_request, request);
+  if (!program.empty())
+  {
+    append(m_request, rtattr{.rta_len = static_cast<std::uint16_t>(RTA_LENGTH(program.size())), .rta_type = INET_DIAG_REQ_BYTECODE});
+    m_request.insert(m_request.end(), program.begin(), program.end());
+  }
+  auto const length = static_cast<std::uint32_t>(m_request.size());
+  std::memcpy(m_request.data() + offsetof(nlmsghdr, nlmsg_len), &length, sizeof(length));
+
+  sockaddr_nl kernel{};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(m_socket, m_request.data(), m_request.size(), 0, reinterpret_cast<struct sockaddr*>(&kernel), sizeof(kernel)) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  return outcome::success();
+}
+
+template <typename ROW>
+outcome::std_result<void> DiagSocket::dumpFamily(int family, Query const& query, ROW&& row)
+{
+  BOOST_OUTCOME_TRY(send(family, query));
+  auto const seq = m_seqNum;
+  for (;;)
+  {
+    auto received = recv(m_socket, m_buffer.data(), m_buffer.size(), 0);
+    if (received < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return static_cast<errno_errc>(errno);
+    }
+    auto length = static_cast<std::size_t>(received);
+    for (auto* header = reinterpret_cast<struct nlmsghdr*>(m_buffer.data()); NLMSG_OK(header, length); header = NLMSG_NEXT(header, length))
+    {
+      // what is left of an earlier dump that ended in an error
+      if (header->nlmsg_seq != seq || header->nlmsg_pid != m_pid)
+      {
+        continue;
+      }
+      if (header->nlmsg_type == NLMSG_DONE)
+      {
+        return outcome::success();
+      }
+      if (header->nlmsg_type == NLMSG_ERROR)
+      {
+        auto const* error = static_cast<struct nlmsgerr const*>(NLMSG_DATA(header));
+        if (error->error != 0)
+        {
+          return static_cast<errno_errc>(-error->error);
+        }
+        return SocketError::Error;
+      }
+      if (header->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+      {
+        continue;
+      }
+      if (header->nlmsg_len < NLMSG_LENGTH(sizeof(inet_diag_msg)))
+      {
+        return SocketError::WrongMessageLength;
+      }
+      auto const* message = static_cast<inet_diag_msg const*>(NLMSG_DATA(header));
+      Attribute::Payload info;
+      if (query.info)
+      {
+        auto values = DiagSchema::decode(Attribute::attributes<inet_diag_msg>(*header));
+        if (auto const& payload = values.get<INET_DIAG_INFO>(); payload)
+        {
+          info = *payload;
+        }
+      }
+      row(*message, info);
+    }
+  }
+}
+
+outcome::std_result<void> DiagSocket::dump(Query const& query, Sockets& sockets)
+{
+  if (query.family != AF_UNSPEC && query.family != AF_INET && query.family != AF_INET6)
+  {
+    return SocketError::InvalidFamily;
+  }
+  auto const collect = [&sockets, &query](inet_diag_msg const& message, Attribute::Payload info)
+  {
+    sockets.family.push_back(message.idiag_family);
+    sockets.state.push_back(message.idiag_state);
+    sockets.local.push_back(address(message.id.idiag_src));
+    sockets.localPort.push_back(ntohs(message.id.idiag_sport));
+    sockets.remote.push_back(address(message.id.idiag_dst));
+    sockets.remotePort.push_back(ntohs(message.id.idiag_dport));
+    sockets.interface.push_back(message.id.idiag_if);
+    sockets.inode.push_back(message.idiag_inode);
+    sockets.uid.push_back(message.idiag_uid);
+    sockets.receiveQueue.push_back(message.idiag_rqueue);
+    sockets.sendQueue.push_back(message.idiag_wqueue);
+    sockets.cookie.push_back(message.id.idiag_cookie[0] | (std::uint64_t{message.id.idiag_cookie[1]} << 32));
+    if (query.info)
+    {
+      auto const tcp = tcpInfo(info);
+      sockets.bytesAcked.push_back(tcp.bytesAcked);
+      sockets.bytesReceived.push_back(tcp.bytesReceived);
+      sockets.rtt.push_back(tcp.rtt);
+    }
+  };
+  if (query.family != AF_INET6)
+  {
+    BOOST_OUTCOME_TRY(dumpFamily(AF_INET, query, collect));
+  }
+  if (query.family != AF_INET)
+  {
+    BOOST_OUTCOME_TRY(dumpFamily(AF_INET6, query, collect));
+  }
+  return outcome::success();
+}
+
+outcome::std_result<DiagSocket::Sockets> DiagSocket::dump(Query const& query)
+{
+  Sockets sockets;
+  BOOST_OUTCOME_TRY(dump(query, sockets));
+  return sockets;
+}
+
+outcome::std_result<std::size_t> DiagSocket::dump(Query const& query, Handler const& handler)
+{
+  if (query.family != AF_UNSPEC && query.family != AF_INET && query.family != AF_INET6)
+  {
+    return SocketError::InvalidFamily;
+  }
+  std::size_t count = 0;
+  auto const stream = [&handler, &count](inet_diag_msg const& message, Attribute::Payload info)
+  {
+    Entry entry{.family = message.idiag_family,
+        .state = message.idiag_state,
+        .local = toAddress(message.idiag_family, address(message.id.idiag_src)),
+        .localPort = ntohs(message.id.idiag_sport),
+        .remote = toAddress(message.idiag_family, address(message.id.idiag_dst)),
+        .remotePort = ntohs(message.id.idiag_dport),
+        .interface = {static_cast<int>(message.id.idiag_if)},
+        .inode = message.idiag_inode,
+        .uid = message.idiag_uid,
+        .receiveQueue = message.idiag_rqueue,
+        .sendQueue = message.idiag_wqueue,
+        .cookie = message.id.idiag_cookie[0] | (std::uint64_t{message.id.idiag_cookie[1]} << 32)};
+    if (!info.empty())
+    {
+      auto const tcp = tcpInfo(info);
+      entry.bytesAcked = tcp.bytesAcked;
+      entry.bytesReceived = tcp.bytesReceived;
+      entry.rtt = tcp.rtt;
+    }
+    ++count;
+    handler(entry);
+  };
+  if (query.family != AF_INET6)
+  {
+    BOOST_OUTCOME_TRY(dumpFamily(AF_INET, query, stream));
+  }
+  if (query.family != AF_INET)
+  {
+    BOOST_OUTCOME_TRY(dumpFamily(AF_INET6, query, stream));
+  }
+  return count;
+}
+}  // namespace wormhole::sysinfo::Netlink
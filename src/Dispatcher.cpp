@@ -0,0 +1,580 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/Dispatcher.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "wormhole/sysinfo/helper.hpp"
+
+namespace
+{
+using namespace wormhole::sysinfo;
+using Event = Netlink::Dispatcher::Event;
+
+constexpr std::uint64_t mix(std::uint64_t hash, std::uint64_t value) noexcept
+{
+  hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+std::uint64_t hashAddress(std::uint64_t hash, boost::asio::ip::address const& address) noexcept
+{
+  if (address.is_v4())
+  {
+    return mix(hash, address.to_v4().to_uint());
+  }
+  for (auto const byte : address.to_v6().to_bytes())
+  {
+    hash = mix(hash, byte);
+  }
+  return hash;
+}
+
+std::uint64_t hashDestination(std::uint64_t hash, Route::Destination const& destination) noexcept
+{
+  return std::visit(helper::overloaded{[hash](Route::Default_t)
+                        {
+                          return mix(hash, 0);
+                        },
+                        [hash](auto const& network)
+                        {
+                          return mix(hashAddress(hash, network.address()), network.prefix_length());
+                        }},
+      destination.value);
+}
+
+// identity of the object an event is about, 0 for events that are never conflated (dumps)
+std::uint64_t objectHash(Event const& event) noexcept
+{
+  return std::visit(helper::overloaded{[](Address const& address)
+                        {
+                          return mix(hashAddress(1, address.address), static_cast<std::uint64_t>(address.interfaceIndex.value)) | 1;
+                        },
+                        [](Interface const& link)
+                        {
+                          return mix(2, static_cast<std::uint64_t>(link.index.value)) | 1;
+                        },
+                        [](Route const& route)
+                        {
+                          auto hash = mix(3, static_cast<std::uint64_t>(route.table));
+                          hash = mix(hash, route.priority);
+                          hash = mix(hash, route.tos);
+                          return hashDestination(hash, route.destination) | 1;
+                        },
+                        [](Rule const& rule)
+                        {
+                          return mix(mix(4, rule.priority), static_cast<std::uint64_t>(rule.family)) | 1;
+                        },
+                        [](Nexthop const& nexthop)
+                        {
+                          return mix(5, nexthop.id) | 1;
+                        },
+                        [](Qdisc const& qdisc)
+                        {
+                          return mix(mix(6, static_cast<std::uint64_t>(qdisc.interfaceIndex.value)), qdisc.handle) | 1;
+                        },
+                        [](TrafficClass const& trafficClass)
+                        {
+                          return mix(mix(7, static_cast<std::uint64_t>(trafficClass.interfaceIndex.value)), trafficClass.handle) | 1;
+                        },
+                        [](auto const&)
+                        {
+                          return std::uint64_t{0};
+                        }},
+      event);
+}
+
+bool sameObject(Event const& lhs, Event const& rhs) noexcept
+{
+  if (lhs.index() != rhs.index())
+  {
+    return false;
+  }
+  return std::visit(helper::overloaded{[&rhs](Address const& address)
+                        {
+                          auto const& other = std::get<Address>(rhs);
+                          return address.address == other.address && address.netmask == other.netmask && address.interfaceIndex == other.interfaceIndex;
+                        },
+                        [&rhs](Interface const& link)
+                        {
+                          return link.index == std::get<Interface>(rhs).index;
+                        },
+                        [&rhs](Route const& route)
+                        {
+                          auto const& other = std::get<Route>(rhs);
+                          return route.family == other.family && route.table == other.table && route.priority == other.priority && route.tos == other.tos && route.destination == other.destination;
+                        },
+                        [&rhs](Rule const& rule)
+                        {
+                          auto const& other = std::get<Rule>(rhs);
+                          return rule.family == other.family && rule.priority == other.priority && rule.table == other.table && rule.source == other.source && rule.destination == other.destination && rule.fwmark == other.fwmark && rule.fwmask == other.fwmask && rule.inputInterface == other.inputInterface && rule.outputInterface == other.outputInterface && rule.uidRange == other.uidRange && rule.ipProtocol == other.ipProtocol && rule.sourcePorts == other.sourcePorts && rule.destinationPorts == other.destinationPorts && rule.l3mdev == other.l3mdev && rule.tunnelId == other.tunnelId;
+                        },
+                        [&rhs](Nexthop const& nexthop)
+                        {
+                          return nexthop.id == std::get<Nexthop>(rhs).id;
+                        },
+                        [&rhs](Qdisc const& qdisc)
+                        {
+                          auto const& other = std::get<Qdisc>(rhs);
+                          return qdisc.interfaceIndex == other.interfaceIndex && qdisc.handle == other.handle;
+                        },
+                        [&rhs](TrafficClass const& trafficClass)
+                        {
+                          auto const& other = std::get<TrafficClass>(rhs);
+                          return trafficClass.interfaceIndex == other.interfaceIndex && trafficClass.handle == other.handle;
+                        },
+                        [](auto const&)
+                        {
+                          return false;
+                        }},
+      lhs);
+}
+}  // namespace
+
+namespace wormhole::sysinfo::Netlink
+{
+bool Dispatcher::Filter::matches(Event const& event) const noexcept
+{
+  auto const family_ = [this](int value)
+  {
+    return family == AF_UNSPEC || family == value;
+  };
+  auto const interface_ = [this](Interface::Index index)
+  {
+    return !interface || index == *interface;
+  };
+  return std::visit(helper::overloaded{[&](Address const& address)
+                        {
+                          return (kinds & Addresses) != 0 && family_(address.address.is_v6() ? AF_INET6 : AF_INET) && interface_(address.interfaceIndex);
+                        },
+                        [&](Interface const& link)
+                        {
+                          return (kinds & Links) != 0 && interface_(link.index);
+                        },
+                        [&](Route const& route)
+                        {
+                          if ((kinds & Routes) == 0 || !family_(route.family))
+                          {
+                            return false;
+                          }
+                          if (interface_(route.interfaceIndex))
+                          {
+                            return true;
+                          }
+                          return route.nexthops && std::any_of(route.nexthops->paths.begin(), route.nexthops->paths.end(), [&](NexthopGroup::Path const& path)
+                                                       {
+                                                         return interface_(path.interfaceIndex);
+                                                       });
+                        },
+                        [&](Rule const& rule)
+                        {
+                          return (kinds & Rules) != 0 && family_(rule.family) && !interface;
+                        },
+                        [&](Nexthop const& nexthop)
+                        {
+                          return (kinds & Nexthops) != 0 && (nexthop.family == AF_UNSPEC || family_(nexthop.family)) && interface_(nexthop.interfaceIndex);
+                        },
+                        [&](Qdisc const& qdisc)
+                        {
+                          return (kinds & TrafficControl) != 0 && interface_(qdisc.interfaceIndex);
+                        },
+                        [&](TrafficClass const& trafficClass)
+                        {
+                          return (kinds & TrafficControl) != 0 && interface_(trafficClass.interfaceIndex);
+                        },
+                        [this](auto const&)
+                        {
+                          return (kinds & Dumps) != 0;
+                        }},
+      event);
+}
+
+Dispatcher::Subscription::Subscription(Dispatcher* t_dispatcher, std::size_t t_slot)
+  : m_dispatcher{t_dispatcher}
+  , m_slot{t_slot}
+{
+}
+
+Dispatcher::Subscription::Subscription(Subscription&& rhs) noexcept
+  : m_dispatcher{std::exchange(rhs.m_dispatcher, nullptr)}
+  , m_slot{rhs.m_slot}
+  , m_selected{std::move(rhs.m_selected)}
+  , m_seen{std::move(rhs.m_seen)}
+{
+}
+
+Dispatcher::Subscription& Dispatcher::Subscription::operator=(Subscription&& rhs) noexcept
+{
+  if (this != std::addressof(rhs))
+  {
+    std::swap(m_dispatcher, rhs.m_dispatcher);
+    std::swap(m_slot, rhs.m_slot);
+    std::swap(m_selected, rhs.m_selected);
+    std::swap(m_seen, rhs.m_seen);
+  }
+  return *this;
+}
+
+Dispatcher::Subscription::~Subscription()
+{
+  if (m_dispatcher == nullptr)
+  {
+    return;
+  }
+  auto& consumer = m_dispatcher->m_consumers[m_slot];
+  consumer.state.store(State::Leaving, std::memory_order_release);
+  consumer.sequence.store(Idle, std::memory_order_seq_cst);
+  m_dispatcher->m_changes.fetch_add(1, std::memory_order_release);
+  m_dispatcher->progress();
+}
+
+Dispatcher::Subscription::Window Dispatcher::Subscription::acquire(std::size_t max)
+{
+  auto& consumer = m_dispatcher->m_consumers[m_slot];
+  auto sequence = consumer.sequence.load(std::memory_order_acquire);
+  for (;;)
+  {
+    auto const published = m_dispatcher->m_published.load(std::memory_order_acquire) & ~Stopped;
+    if (sequence >= published)
+    {
+      return {sequence, sequence, false};
+    }
+    auto const end = sequence + std::min<std::uint64_t>(max, published - sequence);
+    if (consumer.policy == Policy::Block)
+    {
+      return {sequence, end, false};
+    }
+    // fails when the reader just moved this subscription forward, retry from there
+    if (consumer.sequence.compare_exchange_weak(sequence, sequence | Busy, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+      return {sequence, end, true};
+    }
+  }
+}
+
+std::span<std::uint64_t const> Dispatcher::Subscription::select(Window window)
+{
+  auto const& consumer = m_dispatcher->m_consumers[m_slot];
+  m_selected.clear();
+  if (consumer.policy != Policy::Conflate)
+  {
+    for (auto sequence = window.first; sequence != window.end; ++sequence)
+    {
+      if (consumer.filter.matches(m_dispatcher->event(sequence)))
+      {
+        m_selected.push_back(sequence);
+      }
+    }
+    return m_selected;
+  }
+
+  // newest first, an event is skipped when a later one of the window is about the same object
+  auto const size = std::bit_ceil(std::max<std::size_t>(16, 2 * (window.end - window.first)));
+  m_seen.assign(size, 0);
+  auto const mask = size - 1;
+  for (auto sequence = window.end; sequence-- != window.first;)
+  {
+    auto const& event = m_dispatcher->event(sequence);
+    if (!consumer.filter.matches(event))
+    {
+      continue;
+    }
+    auto const hash = objectHash(event);
+    bool newer = false;
+    auto slot = hash & mask;
+    for (; hash != 0 && m_seen[slot] != 0; slot = (slot + 1) & mask)
+    {
+      if (sameObject(m_dispatcher->event(m_seen[slot] - 1), event))
+      {
+        newer = true;
+        break;
+      }
+    }
+    if (newer)
+    {
+      continue;
+    }
+    if (hash != 0)
+    {
+      m_seen[slot] = sequence + 1;
+    }
+    m_selected.push_back(sequence);
+  }
+  std::reverse(m_selected.begin(), m_selected.end());
+  return m_selected;
+}
+
+void Dispatcher::Subscription::release(Window window)
+{
+  if (window.first == window.end)
+  {
+    return;
+  }
+  m_dispatcher->m_consumers[m_slot].sequence.store(window.end, std::memory_order_seq_cst);
+  if (m_dispatcher->m_readerWaiting.load(std::memory_order_seq_cst))
+  {
+    m_dispatcher->progress();
+  }
+}
+
+void Dispatcher::Subscription::wait() const
+{
+  auto const sequence = m_dispatcher->m_consumers[m_slot].sequence.load(std::memory_order_acquire) & ~Busy;
+  auto const published = m_dispatcher->m_published.load(std::memory_order_acquire);
+  if ((published & Stopped) != 0 || (sequence != Idle && published > sequence))
+  {
+    return;
+  }
+  m_dispatcher->m_published.wait(published, std::memory_order_acquire);
+}
+
+std::uint64_t Dispatcher::Subscription::dropped() const noexcept
+{
+  return m_dispatcher->m_consumers[m_slot].dropped.load(std::memory_order_relaxed);
+}
+
+outcome::std_result<std::unique_ptr<Dispatcher>> Dispatcher::start(Socket socket, std::size_t capacity)
+{
+  int wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wakeFd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  std::unique_ptr<Dispatcher> dispatcher{new Dispatcher{std::move(socket), std::bit_ceil(std::max<std::size_t>(capacity, 2)), wakeFd}};
+  dispatcher->m_reader = std::thread{[raw = dispatcher.get()]()
+      {
+        raw->run();
+      }};
+  return dispatcher;
+}
+
+Dispatcher::Dispatcher(Socket t_socket, std::size_t t_capacity, int t_wakeFd)
+  : m_socket{std::move(t_socket)}
+  , m_wakeFd{t_wakeFd}
+  , m_ring(t_capacity)
+  , m_mask{t_capacity - 1}
+{
+}
+
+Dispatcher::~Dispatcher()
+{
+  stop();
+  close(m_wakeFd);
+}
+
+outcome::std_result<Dispatcher::Subscription> Dispatcher::subscribe(Filter filter, Policy policy)
+{
+  if ((m_published.load(std::memory_order_acquire) & Stopped) != 0)
+  {
+    return DispatcherError::Stopped;
+  }
+  for (std::size_t slot = 0; slot < m_consumers.size(); ++slot)
+  {
+    auto& consumer = m_consumers[slot];
+    auto expected = State::Free;
+    if (!consumer.state.compare_exchange_strong(expected, State::Claimed, std::memory_order_acq_rel))
+    {
+      continue;
+    }
+    consumer.sequence.store(Idle, std::memory_order_relaxed);
+    consumer.dropped.store(0, std::memory_order_relaxed);
+    consumer.policy = policy;
+    consumer.filter = std::move(filter);
+    consumer.state.store(State::Joining, std::memory_order_release);
+    m_changes.fetch_add(1, std::memory_order_release);
+    return Subscription{this, slot};
+  }
+  return DispatcherError::TooManySubscribers;
+}
+
+void Dispatcher::stop()
+{
+  m_stopping.store(true, std::memory_order_seq_cst);
+  std::uint64_t const one = 1;
+  static_cast<void>(write(m_wakeFd, &one, sizeof(one)));
+  progress();
+  if (m_reader.joinable())
+  {
+    m_reader.join();
+  }
+}
+
+bool Dispatcher::stopped() const noexcept
+{
+  return (m_published.load(std::memory_order_acquire) & Stopped) != 0;
+}
+
+std::uint64_t Dispatcher::published() const noexcept
+{
+  return m_published.load(std::memory_order_acquire) & ~Stopped;
+}
+
+std::uint64_t Dispatcher::noBuffers() const noexcept
+{
+  return m_noBuffers.load(std::memory_order_relaxed);
+}
+
+std::error_code Dispatcher::error() const noexcept
+{
+  if ((m_published.load(std::memory_order_acquire) & Stopped) == 0)
+  {
+    return {};
+  }
+  return m_error;
+}
+
+void Dispatcher::progress() noexcept
+{
+  m_progress.fetch_add(1, std::memory_order_release);
+  m_progress.notify_one();
+}
+
+void Dispatcher::run()
+{
+  std::array<struct pollfd, 2> fds{{{m_socket.native_handle(), POLLIN, 0}, {m_wakeFd, POLLIN, 0}}};
+  bool running = true;
+  while (running && !m_stopping.load(std::memory_order_acquire))
+  {
+    if (poll(fds.data(), fds.size(), -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      m_error = static_cast<errno_errc>(errno);
+      break;
+    }
+    if (fds[1].revents != 0)
+    {
+      break;
+    }
+    // drain the socket, the events of one recvmmsg batch are published back to back
+    while (running)
+    {
+      auto event = m_socket.receive(Socket::ReceiveMode::Nonblock);
+      if (!event && event.error() == static_cast<errno_errc>(EAGAIN))
+      {
+        break;
+      }
+      // a truncated datagram lost its events just like an overrun
+      if (!event && (event.error() == static_cast<errno_errc>(ENOBUFS) || event.error() == SocketError::Truncated))
+      {
+        m_noBuffers.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      if (!event)
+      {
+        m_error = event.error();
+        running = false;
+        break;
+      }
+      running = publish(std::move(event.value()));
+    }
+  }
+  m_published.fetch_or(Stopped, std::memory_order_release);
+  m_published.notify_all();
+}
+
+bool Dispatcher::publish(Event&& event)
+{
+  auto const next = m_next;
+  if (m_changes.load(std::memory_order_acquire) != 0)
+  {
+    admit(next);
+  }
+  if (next >= m_ring.size() && next - m_ring.size() >= m_gate && !gate(next))
+  {
+    return false;
+  }
+  m_ring[next & m_mask] = std::move(event);
+  m_next = next + 1;
+  m_published.store(m_next, std::memory_order_release);
+  m_published.notify_all();
+  return true;
+}
+
+void Dispatcher::admit(std::uint64_t next)
+{
+  for (auto& consumer : m_consumers)
+  {
+    switch (consumer.state.load(std::memory_order_acquire))
+    {
+      case State::Joining:
+        consumer.sequence.store(next, std::memory_order_release);
+        consumer.state.store(State::Active, std::memory_order_release);
+        m_changes.fetch_sub(1, std::memory_order_relaxed);
+        m_gate = std::min(m_gate, next);
+        break;
+      case State::Leaving:
+        consumer.state.store(State::Free, std::memory_order_release);
+        m_changes.fetch_sub(1, std::memory_order_relaxed);
+        break;
+      case State::Free:
+      case State::Claimed:
+      case State::Active:
+        break;
+    }
+  }
+}
+
+// makes sure nobody still reads the slot of next - capacity, false when stopped while waiting
+bool Dispatcher::gate(std::uint64_t next)
+{
+  auto const oldest = next - m_ring.size() + 1;  // oldest event still in the ring once next is written
+  auto lowest = next;
+  for (auto& consumer : m_consumers)
+  {
+    if (consumer.state.load(std::memory_order_acquire) != State::Active)
+    {
+      continue;
+    }
+    auto sequence = consumer.sequence.load(std::memory_order_seq_cst);
+    while ((sequence & ~Busy) < oldest)
+    {
+      if (consumer.policy != Policy::Block && (sequence & Busy) == 0)
+      {
+        if (consumer.sequence.compare_exchange_weak(sequence, oldest, std::memory_order_seq_cst, std::memory_order_seq_cst))
+        {
+          consumer.dropped.fetch_add(oldest - sequence, std::memory_order_relaxed);
+          sequence = oldest;
+        }
+        continue;
+      }
+
+      auto const seen = m_progress.load(std::memory_order_acquire);
+      m_readerWaiting.store(true, std::memory_order_seq_cst);
+      sequence = consumer.sequence.load(std::memory_order_seq_cst);
+      if ((sequence & ~Busy) < oldest && consumer.state.load(std::memory_order_acquire) == State::Active && !m_stopping.load(std::memory_order_seq_cst))
+      {
+        m_progress.wait(seen, std::memory_order_acquire);
+      }
+      m_readerWaiting.store(false, std::memory_order_relaxed);
+      if (m_stopping.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+      if (consumer.state.load(std::memory_order_acquire) != State::Active)
+      {
+        break;
+      }
+      sequence = consumer.sequence.load(std::memory_order_seq_cst);
+    }
+    if (consumer.state.load(std::memory_order_acquire) == State::Active)
+    {
+      lowest = std::min(lowest, sequence & ~Busy);
+    }
+  }
+  m_gate = lowest;
+  return true;
+}
+}  // namespace wormhole::sysinfo::Netlink
@@ -0,0 +1,41 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/DispatcherError.hpp"
+
+namespace
+{
+struct DispatcherError_cat : std::error_category
+{
+  [[nodiscard]] char const* name() const noexcept override
+  {
+    return "dispatcher";
+  }
+
+  [[nodiscard]] std::string message(int val) const override
+  {
+    switch (static_cast<wormhole::sysinfo::Netlink::DispatcherError>(val))
+    {
+      case wormhole::sysinfo::Netlink::DispatcherError::None:
+        return "None";
+      case wormhole::sysinfo::Netlink::DispatcherError::TooManySubscribers:
+        return "TooManySubscribers";
+      case wormhole::sysinfo::Netlink::DispatcherError::Stopped:
+        return "Stopped";
+    }
+    return "unknown";
+  }
+};
+const DispatcherError_cat dispatcherErrorCat;
+}  // namespace
+
+namespace wormhole::sysinfo::Netlink
+{
+std::error_code make_error_code(DispatcherError val)
+{
+  return {static_cast<int>(val), dispatcherErrorCat};
+}
+}  // namespace wormhole::sysinfo::Netlink
@@ -0,0 +1,220 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/DumpArena.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <string>
+
+#include "wormhole/sysinfo/errno_error.hpp"
+
+namespace
+{
+std::byte* alignUp(std::byte* pointer, std::size_t alignment) noexcept
+{
+  auto const value = reinterpret_cast<std::uintptr_t>(pointer);
+  return pointer + ((alignment - value % alignment) % alignment);
+}
+}  // namespace
+
+namespace wormhole::sysinfo::Netlink
+{
+DumpArena::~DumpArena()
+{
+  for (auto const& block : m_blocks)
+  {
+    release(block);
+  }
+  if (m_file >= 0)
+  {
+    close(m_file);
+  }
+}
+
+outcome::std_result<void> DumpArena::spill(std::string_view directory)
+{
+  if (m_file >= 0)
+  {
+    return outcome::success();
+  }
+  std::string path{directory};
+  if (path.empty())
+  {
+    auto const* tmp = std::getenv("TMPDIR");
+    path = tmp != nullptr && *tmp != '\0' ? tmp : "/tmp";
+  }
+  m_file = open(path.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (m_file < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  // the rest of the current heap block stays unused
+  m_cursor = nullptr;
+  m_end = nullptr;
+  return outcome::success();
+}
+
+void DumpArena::reset() noexcept
+{
+  std::size_t kept = 0;
+  std::erase_if(m_blocks, [&kept](Block const& block)
+      {
+        if (!block.mapped && kept + block.size <= MaxKeptSize)
+        {
+          kept += block.size;
+          return false;
+        }
+        release(block);
+        return true;
+      });
+  if (m_file >= 0)
+  {
+    close(m_file);
+    m_file = -1;
+  }
+  m_fileSize = 0;
+  m_spilled = 0;
+  m_used = 0;
+  m_block = 0;
+  m_cursor = m_blocks.empty() ? nullptr : m_blocks.front().data;
+  m_end = m_blocks.empty() ? nullptr : m_cursor + m_blocks.front().size;
+}
+
+std::size_t DumpArena::used() const noexcept
+{
+  return m_used;
+}
+
+std::size_t DumpArena::spilled() const noexcept
+{
+  return m_spilled;
+}
+
+bool DumpArena::spilling() const noexcept
+{
+  return m_file >= 0;
+}
+
+void* DumpArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+  auto* pointer = alignUp(m_cursor, alignment);
+  if (m_cursor == nullptr || pointer + bytes > m_end)
+  {
+    grow(bytes + alignment);
+    pointer = alignUp(m_cursor, alignment);
+  }
+  m_cursor = pointer + bytes;
+  m_used += bytes;
+  return pointer;
+}
+
+void DumpArena::do_deallocate(void*, std::size_t, std::size_t)
+{
+}
+
+bool DumpArena::do_is_equal(std::pmr::memory_resource const& other) const noexcept
+{
+  return this == &other;
+}
+
+void DumpArena::release(Block const& block) noexcept
+{
+  if (block.mapped)
+  {
+    munmap(block.data, block.size);
+  }
+  else
+  {
+    std::pmr::new_delete_resource()->deallocate(block.data, block.size, alignof(std::max_align_t));
+  }
+}
+
+void DumpArena::grow(std::size_t atLeast)
+{
+  // blocks kept by reset() first, a spilling arena takes no more heap
+  for (auto next = m_block + 1; m_file < 0 && next < m_blocks.size(); ++next)
+  {
+    if (m_blocks[next].size >= atLeast)
+    {
+      m_block = next;
+      m_cursor = m_blocks[next].data;
+      m_end = m_cursor + m_blocks[next].size;
+      return;
+    }
+  }
+
+  auto const page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  auto const size = std::max(m_nextBlock, (atLeast + page - 1) / page * page);
+  m_nextBlock = std::min(m_nextBlock * 2, MaxBlockSize);
+
+  if (m_file >= 0 && ftruncate(m_file, static_cast<off_t>(m_fileSize + size)) == 0)
+  {
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, static_cast<off_t>(m_fileSize));
+    if (data != MAP_FAILED)
+    {
+      m_fileSize += size;
+      m_spilled += size;
+      m_blocks.push_back({static_cast<std::byte*>(data), size, true});
+      m_block = m_blocks.size() - 1;
+      m_cursor = static_cast<std::byte*>(data);
+      m_end = m_cursor + size;
+      return;
+    }
+  }
+  // no spill file or it could not grow, the heap is all that is left
+  auto* data = static_cast<std::byte*>(std::pmr::new_delete_resource()->allocate(size, alignof(std::max_align_t)));
+  m_blocks.push_back({data, size, false});
+  m_block = m_blocks.size() - 1;
+  m_cursor = data;
+  m_end = data + size;
+}
+
+DumpArenaPool::DumpArenaPool()
+  : m_spare{std::make_shared<Spare>()}
+{
+}
+
+std::shared_ptr<DumpArena> DumpArenaPool::acquire() const
+{
+  std::unique_ptr<DumpArena> arena;
+  {
+    std::scoped_lock lock{m_spare->mutex};
+    arena = std::move(m_spare->arena);
+  }
+  if (arena)
+  {
+    arena->reset();
+  }
+  else
+  {
+    arena = std::make_unique<DumpArena>();
+  }
+  return {arena.release(), [spare = std::weak_ptr<Spare>{m_spare}](DumpArena* released) noexcept
+      {
+        release(spare, released);
+      }};
+}
+
+void DumpArenaPool::release(std::weak_ptr<Spare> const& spare, DumpArena* arena) noexcept
+{
+  std::unique_ptr<DumpArena> owned{arena};
+  if (auto pool = spare.lock(); pool)
+  {
+    std::scoped_lock lock{pool->mutex};
+    if (!pool->arena)
+    {
+      pool->arena = std::move(owned);
+    }
+  }
+}
+}  // namespace wormhole::sysinfo::Netlink
@@ -0,0 +1,1232 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/Export.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include <linux/pkt_sched.h>
+#include <unistd.h>
+
+#include <fmt/compile.h>
+
+using namespace std::literals;
+
+namespace
+{
+using namespace wormhole::sysinfo;
+using Export::Buffer;
+
+void append(Buffer& out, std::string_view text)
+{
+  out.append(text.data(), text.data() + text.size());
+}
+
+/*
+ * JSON
+ */
+void begin(Buffer& out, std::string_view object, Action action)
+{
+  append(out, R"({"object":")"sv);
+  append(out, object);
+  switch (action)
+  {
+    case Action::New:
+      append(out, R"(","event":"new")"sv);
+      break;
+    case Action::Del:
+      append(out, R"(","event":"del")"sv);
+      break;
+    case Action::Unknown:
+      append(out, R"(","event":"unknown")"sv);
+      break;
+  }
+}
+
+void end(Buffer& out)
+{
+  append(out, "}\n"sv);
+}
+
+void key(Buffer& out, std::string_view name)
+{
+  out.push_back(',');
+  out.push_back('"');
+  append(out, name);
+  append(out, R"(":)"sv);
+}
+
+void string(Buffer& out, std::string_view value)
+{
+  static constexpr auto hex = "0123456789abcdef"sv;
+  out.push_back('"');
+  for (char const c : value)
+  {
+    if (c == '"' || c == '\\')
+    {
+      out.push_back('\\');
+      out.push_back(c);
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      append(out, "\\u00"sv);
+      out.push_back(hex[static_cast<unsigned char>(c) >> 4]);
+      out.push_back(hex[static_cast<unsigned char>(c) & 0xF]);
+    }
+    else
+    {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+}
+
+template <typename T>
+  requires std::is_integral_v<T>
+void number(Buffer& out, T value)
+{
+  fmt::format_to(fmt::appender(out), FMT_COMPILE("{}"), value);
+}
+
+// values whose formatter only produces characters that need no escaping (addresses, prefixes, enum names)
+template <typename T>
+void text(Buffer& out, T const& value)
+{
+  out.push_back('"');
+  fmt::format_to(fmt::appender(out), FMT_COMPILE("{}"), value);
+  out.push_back('"');
+}
+
+void family(Buffer& out, int value)
+{
+  key(out, "family"sv);
+  switch (value)
+  {
+    case AF_INET:
+      append(out, R"("inet")"sv);
+      break;
+    case AF_INET6:
+      append(out, R"("inet6")"sv);
+      break;
+    case AF_UNSPEC:
+      append(out, R"("unspec")"sv);
+      break;
+    default:
+      out.push_back('"');
+      number(out, value);
+      out.push_back('"');
+      break;
+  }
+}
+
+void optionalAddress(Buffer& out, std::string_view name, boost::asio::ip::address const& address)
+{
+  if (!address.is_unspecified())
+  {
+    key(out, name);
+    text(out, address);
+  }
+}
+
+// tc notation, "8001:" or "1:10"
+void handle(Buffer& out, std::uint32_t value)
+{
+  if (TC_H_MIN(value) == 0)
+  {
+    fmt::format_to(fmt::appender(out), FMT_COMPILE(R"("{:x}:")"), TC_H_MAJ(value) >> 16);
+  }
+  else
+  {
+    fmt::format_to(fmt::appender(out), FMT_COMPILE(R"("{:x}:{:x}")"), TC_H_MAJ(value) >> 16, TC_H_MIN(value));
+  }
+}
+
+void trafficControl(Buffer& out, std::string_view object, TrafficControl const& tc)
+{
+  begin(out, object, tc.action);
+  key(out, "kind"sv);
+  string(out, tc.kind.view());
+  key(out, "handle"sv);
+  handle(out, tc.handle);
+  if (!tc.interfaceName.empty())
+  {
+    key(out, "dev"sv);
+    string(out, tc.interfaceName.view());
+  }
+  key(out, "ifindex"sv);
+  number(out, tc.interfaceIndex.value);
+  if (tc.parent == TC_H_ROOT)
+  {
+    append(out, R"(,"root":true)"sv);
+  }
+  else
+  {
+    key(out, "parent"sv);
+    handle(out, tc.parent);
+  }
+  key(out, "bytes"sv);
+  number(out, tc.stats.bytes);
+  key(out, "packets"sv);
+  number(out, tc.stats.packets);
+  key(out, "drops"sv);
+  number(out, tc.stats.drops);
+  key(out, "overlimits"sv);
+  number(out, tc.stats.overlimits);
+  key(out, "requeues"sv);
+  number(out, tc.stats.requeues);
+  key(out, "backlog"sv);
+  number(out, tc.stats.backlog);
+  key(out, "qlen"sv);
+  number(out, tc.stats.qlen);
+  end(out);
+}
+
+std::string_view scopeName(Scope scope)
+{
+  switch (scope)
+  {
+    case Scope::Universe:
+      return "global"sv;
+    case Scope::Site:
+      return "site"sv;
+    case Scope::Link:
+      return "link"sv;
+    case Scope::Host:
+      return "host"sv;
+    case Scope::Nowhere:
+      return "nowhere"sv;
+    case Scope::Unknown:
+      break;
+  }
+  return "unknown"sv;
+}
+
+/*
+ * binary
+ */
+template <typename T>
+  requires std::is_integral_v<T>
+void put(Buffer& out, T value)
+{
+  if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1)
+  {
+    value = std::byteswap(value);
+  }
+  auto const* bytes = reinterpret_cast<char const*>(&value);
+  out.append(bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+  requires std::is_enum_v<T>
+void put(Buffer& out, T value)
+{
+  put(out, static_cast<std::underlying_type_t<T>>(value));
+}
+
+template <std::size_t N>
+void put(Buffer& out, std::array<unsigned char, N> const& bytes)
+{
+  auto const* data = reinterpret_cast<char const*>(bytes.data());
+  out.append(data, data + N);
+}
+
+void put(Buffer& out, boost::asio::ip::address const& address)
+{
+  if (address.is_v6())
+  {
+    put(out, std::uint8_t{6});
+    put(out, address.to_v6().to_bytes());
+  }
+  else if (address.is_unspecified())
+  {
+    put(out, std::uint8_t{0});
+  }
+  else
+  {
+    put(out, std::uint8_t{4});
+    put(out, address.to_v4().to_bytes());
+  }
+}
+
+void put(Buffer& out, Route::Destination const& destination)
+{
+  std::visit(helper::overloaded{[&out](Route::Default_t)
+                 {
+                   put(out, std::uint8_t{0});
+                 },
+                 [&out](boost::asio::ip::network_v4 const& network)
+                 {
+                   put(out, std::uint8_t{4});
+                   put(out, network.address().to_bytes());
+                   put(out, static_cast<std::uint8_t>(network.prefix_length()));
+                 },
+                 [&out](boost::asio::ip::network_v6 const& network)
+                 {
+                   put(out, std::uint8_t{6});
+                   put(out, network.address().to_bytes());
+                   put(out, static_cast<std::uint8_t>(network.prefix_length()));
+                 }},
+      destination.value);
+}
+
+void put(Buffer& out, std::string_view text)
+{
+  auto const length = static_cast<std::uint16_t>(std::min<std::size_t>(text.size(), 0xFFFF));
+  put(out, length);
+  out.append(text.data(), text.data() + length);
+}
+
+template <typename FIELDS>
+void record(Buffer& out, Export::Binary::Kind kind, Action action, FIELDS&& fields)
+{
+  auto const start = out.size();
+  put(out, std::uint32_t{0});
+  put(out, kind);
+  put(out, static_cast<std::uint8_t>(action));
+  std::forward<FIELDS>(fields)();
+  auto length = static_cast<std::uint32_t>(out.size() - start - sizeof(std::uint32_t));
+  if constexpr (std::endian::native == std::endian::big)
+  {
+    length = std::byteswap(length);
+  }
+  std::memcpy(out.data() + start, &length, sizeof(length));
+}
+
+class Reader
+{
+public:
+  explicit Reader(std::span<std::byte const> t_data)
+    : m_data{t_data}
+  {
+  }
+
+  [[nodiscard]] bool failed() const noexcept
+  {
+    return m_error != Export::ExportError::None;
+  }
+  [[nodiscard]] Export::ExportError error() const noexcept
+  {
+    return m_error;
+  }
+
+  template <typename T>
+    requires std::is_integral_v<T>
+  T get()
+  {
+    T value{};
+    if (auto bytes = take(sizeof(T)); !bytes.empty())
+    {
+      std::memcpy(&value, bytes.data(), sizeof(T));
+      if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1)
+      {
+        value = std::byteswap(value);
+      }
+    }
+    return value;
+  }
+
+  template <typename T>
+    requires std::is_enum_v<T>
+  T get()
+  {
+    return static_cast<T>(get<std::underlying_type_t<T>>());
+  }
+
+  boost::asio::ip::address address()
+  {
+    switch (get<std::uint8_t>())
+    {
+      case 0:
+        return {};
+      case 4:
+        return bytes<boost::asio::ip::address_v4>();
+      case 6:
+        return bytes<boost::asio::ip::address_v6>();
+      default:
+        invalid();
+        return {};
+    }
+  }
+
+  Route::Destination destination()
+  {
+    Route::Destination destination;
+    switch (get<std::uint8_t>())
+    {
+      case 0:
+        break;
+      case 4:
+      {
+        auto const address = bytes<boost::asio::ip::address_v4>();
+        auto const length = get<std::uint8_t>();
+        if (length > 32)
+        {
+          invalid();
+          break;
+        }
+        destination.emplace<boost::asio::ip::network_v4>(address, length);
+        break;
+      }
+      case 6:
+      {
+        auto const address = bytes<boost::asio::ip::address_v6>();
+        auto const length = get<std::uint8_t>();
+        if (length > 128)
+        {
+          invalid();
+          break;
+        }
+        destination.emplace<boost::asio::ip::network_v6>(address, length);
+        break;
+      }
+      default:
+        invalid();
+        break;
+    }
+    return destination;
+  }
+
+  std::string_view string()
+  {
+    auto const length = get<std::uint16_t>();
+    auto const bytes = take(length);
+    return {reinterpret_cast<char const*>(bytes.data()), bytes.size()};
+  }
+
+  void invalid() noexcept
+  {
+    if (!failed())
+    {
+      m_error = Export::ExportError::InvalidValue;
+    }
+  }
+
+private:
+  template <typename ADDRESS>
+  ADDRESS bytes()
+  {
+    typename ADDRESS::bytes_type networkOrder{};
+    if (auto data = take(networkOrder.size()); !data.empty())
+    {
+      std::memcpy(networkOrder.data(), data.data(), networkOrder.size());
+    }
+    return ADDRESS{networkOrder};
+  }
+
+  std::span<std::byte const> take(std::size_t size) noexcept
+  {
+    if (failed() || m_data.size() < size)
+    {
+      m_error = failed() ? m_error : Export::ExportError::Truncated;
+      return {};
+    }
+    auto data = m_data.first(size);
+    m_data = m_data.subspan(size);
+    return data;
+  }
+
+  std::span<std::byte const> m_data;
+  Export::ExportError m_error{Export::ExportError::None};
+};
+
+void putTrafficControl(Buffer& out, TrafficControl const& tc)
+{
+  put(out, tc.interfaceIndex.value);
+  put(out, tc.interfaceName.view());
+  put(out, tc.handle);
+  put(out, tc.parent);
+  put(out, tc.kind.view());
+  put(out, tc.stats.bytes);
+  put(out, tc.stats.packets);
+  put(out, tc.stats.drops);
+  put(out, tc.stats.overlimits);
+  put(out, tc.stats.requeues);
+  put(out, tc.stats.backlog);
+  put(out, tc.stats.qlen);
+}
+
+void getTrafficControl(Reader& reader, TrafficControl& tc)
+{
+  tc.interfaceIndex.value = reader.get<int>();
+  tc.interfaceName = reader.string();
+  tc.handle = reader.get<std::uint32_t>();
+  tc.parent = reader.get<std::uint32_t>();
+  tc.kind = reader.string();
+  tc.stats.bytes = reader.get<std::uint64_t>();
+  tc.stats.packets = reader.get<std::uint64_t>();
+  tc.stats.drops = reader.get<std::uint32_t>();
+  tc.stats.overlimits = reader.get<std::uint32_t>();
+  tc.stats.requeues = reader.get<std::uint32_t>();
+  tc.stats.backlog = reader.get<std::uint32_t>();
+  tc.stats.qlen = reader.get<std::uint32_t>();
+}
+}  // namespace
+
+namespace wormhole::sysinfo::Export
+{
+namespace Json
+{
+void encode(Buffer& out, Address const& address)
+{
+  begin(out, "address"sv, address.action);
+  family(out, address.address.is_v6() ? AF_INET6 : AF_INET);
+  key(out, "address"sv);
+  text(out, address.address);
+  key(out, "prefixlen"sv);
+  number(out, address.netmask);
+  optionalAddress(out, "local"sv, address.local);
+  optionalAddress(out, "broadcast"sv, address.broadcast);
+  key(out, "scope"sv);
+  text(out, scopeName(address.scope));
+  key(out, "ifindex"sv);
+  number(out, address.interfaceIndex.value);
+  end(out);
+}
+
+void encode(Buffer& out, Interface const& interface)
+{
+  begin(out, "link"sv, interface.action);
+  key(out, "ifindex"sv);
+  number(out, interface.index.value);
+  key(out, "ifname"sv);
+  string(out, interface.name);
+  key(out, "link_type"sv);
+  text(out, interface.type);
+  key(out, "flags"sv);
+  number(out, interface.flags);
+  key(out, "operstate"sv);
+  text(out, interface.operState);
+  key(out, "carrier"sv);
+  append(out, interface.carrier ? "true"sv : "false"sv);
+  key(out, "mtu"sv);
+  number(out, interface.mtu);
+  end(out);
+}
+
+void encode(Buffer& out, Route const& route)
+{
+  begin(out, "route"sv, route.action);
+  family(out, route.family);
+  key(out, "type"sv);
+  text(out, route.type);
+  key(out, "table"sv);
+  text(out, route.table);
+  key(out, "dst"sv);
+  text(out, route.destination);
+  optionalAddress(out, "gateway"sv, route.gateway);
+  if (!route.interfaceName.empty())
+  {
+    key(out, "dev"sv);
+    string(out, route.interfaceName);
+  }
+  if (route.interfaceIndex.value != 0)
+  {
+    key(out, "oif"sv);
+    number(out, route.interfaceIndex.value);
+  }
+  optionalAddress(out, "src"sv, route.source);
+  key(out, "metric"sv);
+  number(out, route.priority);
+  if (route.tos != 0)
+  {
+    key(out, "tos"sv);
+    number(out, route.tos);
+  }
+  if (route.nexthopId != 0)
+  {
+    key(out, "nhid"sv);
+    number(out, route.nexthopId);
+  }
+  if (route.nexthops && !route.nexthops->paths.empty())
+  {
+    key(out, "nexthops"sv);
+    out.push_back('[');
+    bool first = true;
+    for (auto const& path : route.nexthops->paths)
+    {
+      append(out, first ? R"({"oif":)"sv : R"(,{"oif":)"sv);
+      first = false;
+      number(out, path.interfaceIndex.value);
+      optionalAddress(out, "gateway"sv, path.gateway);
+      key(out, "weight"sv);
+      number(out, path.weight);
+      if (path.id != 0)
+      {
+        key(out, "id"sv);
+        number(out, path.id);
+      }
+      out.push_back('}');
+    }
+    out.push_back(']');
+  }
+  end(out);
+}
+
+void encode(Buffer& out, Rule const& rule)
+{
+  begin(out, "rule"sv, rule.action);
+  family(out, rule.family);
+  key(out, "priority"sv);
+  number(out, rule.priority);
+  if (rule.invert)
+  {
+    append(out, R"(,"not":true)"sv);
+  }
+  if (!rule.source.IsDefaultRoute())
+  {
+    key(out, "src"sv);
+    text(out, rule.source);
+  }
+  if (!rule.destination.IsDefaultRoute())
+  {
+    key(out, "dst"sv);
+    text(out, rule.destination);
+  }
+  if (!rule.inputInterface.empty())
+  {
+    key(out, "iif"sv);
+    string(out, rule.inputInterface);
+  }
+  if (!rule.outputInterface.empty())
+  {
+    key(out, "oif"sv);
+    string(out, rule.outputInterface);
+  }
+  if (rule.fwmark != 0 || rule.fwmask != 0)
+  {
+    key(out, "fwmark"sv);
+    number(out, rule.fwmark);
+    key(out, "fwmask"sv);
+    number(out, rule.fwmask);
+  }
+  if (rule.tos != 0)
+  {
+    key(out, "tos"sv);
+    number(out, rule.tos);
+  }
+  key(out, "type"sv);
+  text(out, rule.type);
+  if (rule.type == Rule::Type::ToTable)
+  {
+    key(out, "table"sv);
+    text(out, rule.table);
+  }
+  if (rule.type == Rule::Type::Goto)
+  {
+    key(out, "goto"sv);
+    number(out, rule.gotoTarget);
+  }
+  if (rule.suppressPrefixLength)
+  {
+    key(out, "suppress_prefixlength"sv);
+    number(out, *rule.suppressPrefixLength);
+  }
+  if (rule.uidRange)
+  {
+    key(out, "uid_start"sv);
+    number(out, rule.uidRange->start);
+    key(out, "uid_end"sv);
+    number(out, rule.uidRange->end);
+  }
+  if (rule.ipProtocol != 0)
+  {
+    key(out, "ipproto"sv);
+    number(out, rule.ipProtocol);
+  }
+  if (rule.sourcePorts)
+  {
+    key(out, "sport_start"sv);
+    number(out, rule.sourcePorts->start);
+    key(out, "sport_end"sv);
+    number(out, rule.sourcePorts->end);
+  }
+  if (rule.destinationPorts)
+  {
+    key(out, "dport_start"sv);
+    number(out, rule.destinationPorts->start);
+    key(out, "dport_end"sv);
+    number(out, rule.destinationPorts->end);
+  }
+  if (rule.l3mdev)
+  {
+    append(out, R"(,"l3mdev":true)"sv);
+  }
+  if (rule.tunnelId != 0)
+  {
+    key(out, "tun_id"sv);
+    number(out, rule.tunnelId);
+  }
+  end(out);
+}
+
+void encode(Buffer& out, Nexthop const& nexthop)
+{
+  begin(out, "nexthop"sv, nexthop.action);
+  key(out, "id"sv);
+  number(out, nexthop.id);
+  family(out, nexthop.family);
+  optionalAddress(out, "gateway"sv, nexthop.gateway);
+  if (nexthop.interfaceIndex.value != 0)
+  {
+    key(out, "oif"sv);
+    number(out, nexthop.interfaceIndex.value);
+  }
+  if (nexthop.blackhole)
+  {
+    append(out, R"(,"blackhole":true)"sv);
+  }
+  if (!nexthop.group.empty())
+  {
+    key(out, "group"sv);
+    out.push_back('[');
+    bool first = true;
+    for (auto const& member : nexthop.group)
+    {
+      append(out, first ? R"({"id":)"sv : R"(,{"id":)"sv);
+      first = false;
+      number(out, member.id);
+      key(out, "weight"sv);
+      number(out, member.weight);
+      out.push_back('}');
+    }
+    out.push_back(']');
+  }
+  end(out);
+}
+
+void encode(Buffer& out, Qdisc const& qdisc)
+{
+  trafficControl(out, "qdisc"sv, qdisc);
+}
+
+void encode(Buffer& out, TrafficClass const& trafficClass)
+{
+  trafficControl(out, "class"sv, trafficClass);
+}
+}  // namespace Json
+
+namespace Binary
+{
+// address | u8 prefix length | broadcast | local | u8 scope | i32 interface index
+void encode(Buffer& out, Address const& address)
+{
+  record(out, Kind::Address, address.action, [&]()
+      {
+        put(out, address.address);
+        put(out, static_cast<std::uint8_t>(address.netmask));
+        put(out, address.broadcast);
+        put(out, address.local);
+        put(out, static_cast<std::uint8_t>(address.scope));
+        put(out, address.interfaceIndex.value);
+      });
+}
+
+// i32 index | u16 type | name | u32 flags | u8 operstate | u8 carrier | u32 mtu
+void encode(Buffer& out, Interface const& interface)
+{
+  record(out, Kind::Interface, interface.action, [&]()
+      {
+        put(out, interface.index.value);
+        put(out, interface.type);
+        put(out, std::string_view{interface.name});
+        put(out, interface.flags);
+        put(out, interface.operState);
+        put(out, static_cast<std::uint8_t>(interface.carrier));
+        put(out, interface.mtu);
+      });
+}
+
+// u8 family | u32 table | u8 type | destination | gateway | i32 oif | interface name | source
+// | u32 metric | u8 tos | u32 nexthop id | u16 path count | (u32 id | gateway | i32 oif | u32 weight)...
+void encode(Buffer& out, Route const& route)
+{
+  record(out, Kind::Route, route.action, [&]()
+      {
+        put(out, static_cast<std::uint8_t>(route.family));
+        put(out, route.table);
+        put(out, route.type);
+        put(out, route.destination);
+        put(out, route.gateway);
+        put(out, route.interfaceIndex.value);
+        put(out, std::string_view{route.interfaceName});
+        put(out, route.source);
+        put(out, route.priority);
+        put(out, route.tos);
+        put(out, route.nexthopId);
+        auto const paths = route.nexthops ? std::span{route.nexthops->paths} : std::span<NexthopGroup::Path const>{};
+        put(out, static_cast<std::uint16_t>(std::min<std::size_t>(paths.size(), 0xFFFF)));
+        for (auto const& path : paths.first(std::min<std::size_t>(paths.size(), 0xFFFF)))
+        {
+          put(out, path.id);
+          put(out, path.gateway);
+          put(out, path.interfaceIndex.value);
+          put(out, path.weight);
+        }
+      });
+}
+
+// u8 family | u32 priority | u8 type | u32 table | u32 goto | source | destination | iif | oif
+// | u32 fwmark | u32 fwmask | u8 tos | u8 invert | u8 has suppress prefix length | u32 suppress prefix length
+// | u8 has uid range | u32 uid start | u32 uid end | u8 ip protocol | u8 has sport | u16 sport start | u16 sport end
+// | u8 has dport | u16 dport start | u16 dport end | u8 l3mdev | u64 tun id
+void encode(Buffer& out, Rule const& rule)
+{
+  record(out, Kind::Rule, rule.action, [&]()
+      {
+        put(out, static_cast<std::uint8_t>(rule.family));
+        put(out, rule.priority);
+        put(out, rule.type);
+        put(out, rule.table);
+        put(out, rule.gotoTarget);
+        put(out, rule.source);
+        put(out, rule.destination);
+        put(out, std::string_view{rule.inputInterface});
+        put(out, std::string_view{rule.outputInterface});
+        put(out, rule.fwmark);
+        put(out, rule.fwmask);
+        put(out, rule.tos);
+        put(out, static_cast<std::uint8_t>(rule.invert));
+        put(out, static_cast<std::uint8_t>(rule.suppressPrefixLength.has_value()));
+        put(out, rule.suppressPrefixLength.value_or(0));
+        put(out, static_cast<std::uint8_t>(rule.uidRange.has_value()));
+        put(out, rule.uidRange.value_or(Rule::Range<std::uint32_t>{}).start);
+        put(out, rule.uidRange.value_or(Rule::Range<std::uint32_t>{}).end);
+        put(out, rule.ipProtocol);
+        for (auto const& ports : {rule.sourcePorts, rule.destinationPorts})
+        {
+          put(out, static_cast<std::uint8_t>(ports.has_value()));
+          put(out, ports.value_or(Rule::Range<std::uint16_t>{}).start);
+          put(out, ports.value_or(Rule::Range<std::uint16_t>{}).end);
+        }
+        put(out, static_cast<std::uint8_t>(rule.l3mdev));
+        put(out, rule.tunnelId);
+      });
+}
+
+// u32 id | u8 family | gateway | i32 oif | u8 blackhole | u16 member count | (u32 id | u32 weight)...
+void encode(Buffer& out, Nexthop const& nexthop)
+{
+  record(out, Kind::Nexthop, nexthop.action, [&]()
+      {
+        put(out, nexthop.id);
+        put(out, static_cast<std::uint8_t>(nexthop.family));
+        put(out, nexthop.gateway);
+        put(out, nexthop.interfaceIndex.value);
+        put(out, static_cast<std::uint8_t>(nexthop.blackhole));
+        auto const members = std::span{nexthop.group}.first(std::min<std::size_t>(nexthop.group.size(), 0xFFFF));
+        put(out, static_cast<std::uint16_t>(members.size()));
+        for (auto const& member : members)
+        {
+          put(out, member.id);
+          put(out, member.weight);
+        }
+      });
+}
+
+// i32 interface index | interface name | u32 handle | u32 parent | kind | u64 bytes | u64 packets
+// | u32 drops | u32 overlimits | u32 requeues | u32 backlog | u32 qlen
+void encode(Buffer& out, Qdisc const& qdisc)
+{
+  record(out, Kind::Qdisc, qdisc.action, [&]()
+      {
+        putTrafficControl(out, qdisc);
+      });
+}
+
+// same layout as Qdisc
+void encode(Buffer& out, TrafficClass const& trafficClass)
+{
+  record(out, Kind::TrafficClass, trafficClass.action, [&]()
+      {
+        putTrafficControl(out, trafficClass);
+      });
+}
+
+outcome::std_result<Record> decode(std::span<std::byte const>& input, std::pmr::polymorphic_allocator<> allocator)
+{
+  std::uint32_t length = 0;
+  if (input.size() < sizeof(length))
+  {
+    return ExportError::Truncated;
+  }
+  std::memcpy(&length, input.data(), sizeof(length));
+  if constexpr (std::endian::native == std::endian::big)
+  {
+    length = std::byteswap(length);
+  }
+  if (input.size() - sizeof(length) < length)
+  {
+    return ExportError::Truncated;
+  }
+
+  Reader reader{input.subspan(sizeof(length), length)};
+  auto const kind = reader.get<Kind>();
+  auto const action = static_cast<Action>(reader.get<std::uint8_t>());
+  if (action > Action::Del)
+  {
+    reader.invalid();
+  }
+
+  auto record = [&]() -> outcome::std_result<Record>
+  {
+    switch (kind)
+    {
+      case Kind::Address:
+      {
+        Address address;
+        address.action = action;
+        address.address = reader.address();
+        address.netmask = reader.get<std::uint8_t>();
+        address.broadcast = reader.address();
+        address.local = reader.address();
+        address.scope = static_cast<Scope>(reader.get<std::uint8_t>());
+        address.interfaceIndex.value = reader.get<int>();
+        return address;
+      }
+      case Kind::Interface:
+      {
+        Interface interface;
+        interface.action = action;
+        interface.index.value = reader.get<int>();
+        interface.type = reader.get<Interface::Type>();
+        interface.name = reader.string();
+        interface.flags = reader.get<std::uint32_t>();
+        interface.operState = reader.get<Interface::OperState>();
+        interface.carrier = reader.get<std::uint8_t>() != 0;
+        interface.mtu = reader.get<std::uint32_t>();
+        return interface;
+      }
+      case Kind::Route:
+      {
+        Route route;
+        route.action = action;
+        route.family = reader.get<std::uint8_t>();
+        route.table = reader.get<Route::Table>();
+        route.type = reader.get<Route::Type>();
+        route.destination = reader.destination();
+        route.gateway = reader.address();
+        route.interfaceIndex.value = reader.get<int>();
+        route.interfaceName = reader.string();
+        route.source = reader.address();
+        route.priority = reader.get<std::uint32_t>();
+        route.tos = reader.get<std::uint8_t>();
+        route.nexthopId = reader.get<std::uint32_t>();
+        if (auto const count = reader.get<std::uint16_t>(); count != 0 && !reader.failed())
+        {
+          auto group = std::make_shared<NexthopGroup>();
+          group->paths.resize(count);
+          for (auto& path : group->paths)
+          {
+            path.id = reader.get<std::uint32_t>();
+            path.gateway = reader.address();
+            path.interfaceIndex.value = reader.get<int>();
+            path.weight = reader.get<std::uint32_t>();
+          }
+          route.nexthops = std::move(group);
+        }
+        return route;
+      }
+      case Kind::Rule:
+      {
+        Rule rule{allocator};
+        rule.action = action;
+        rule.family = reader.get<std::uint8_t>();
+        rule.priority = reader.get<std::uint32_t>();
+        rule.type = reader.get<Rule::Type>();
+        rule.table = reader.get<Route::Table>();
+        rule.gotoTarget = reader.get<std::uint32_t>();
+        rule.source = reader.destination();
+        rule.destination = reader.destination();
+        rule.inputInterface = reader.string();
+        rule.outputInterface = reader.string();
+        rule.fwmark = reader.get<std::uint32_t>();
+        rule.fwmask = reader.get<std::uint32_t>();
+        rule.tos = reader.get<std::uint8_t>();
+        rule.invert = reader.get<std::uint8_t>() != 0;
+        auto const hasSuppress = reader.get<std::uint8_t>() != 0;
+        auto const suppress = reader.get<std::uint32_t>();
+        if (hasSuppress)
+        {
+          rule.suppressPrefixLength = suppress;
+        }
+        auto const hasUidRange = reader.get<std::uint8_t>() != 0;
+        Rule::Range<std::uint32_t> uidRange;
+        uidRange.start = reader.get<std::uint32_t>();
+        uidRange.end = reader.get<std::uint32_t>();
+        if (hasUidRange)
+        {
+          rule.uidRange = uidRange;
+        }
+        rule.ipProtocol = reader.get<std::uint8_t>();
+        for (auto* ports : {&rule.sourcePorts, &rule.destinationPorts})
+        {
+          auto const hasPorts = reader.get<std::uint8_t>() != 0;
+          Rule::Range<std::uint16_t> range;
+          range.start = reader.get<std::uint16_t>();
+          range.end = reader.get<std::uint16_t>();
+          if (hasPorts)
+          {
+            *ports = range;
+          }
+        }
+        rule.l3mdev = reader.get<std::uint8_t>() != 0;
+        rule.tunnelId = reader.get<std::uint64_t>();
+        return rule;
+      }
+      case Kind::Nexthop:
+      {
+        Nexthop nexthop;
+        nexthop.action = action;
+        nexthop.id = reader.get<std::uint32_t>();
+        nexthop.family = reader.get<std::uint8_t>();
+        nexthop.gateway = reader.address();
+        nexthop.interfaceIndex.value = reader.get<int>();
+        nexthop.blackhole = reader.get<std::uint8_t>() != 0;
+        if (auto const count = reader.get<std::uint16_t>(); count != 0 && !reader.failed())
+        {
+          nexthop.group.resize(count);
+          for (auto& member : nexthop.group)
+          {
+            member.id = reader.get<std::uint32_t>();
+            member.weight = reader.get<std::uint32_t>();
+          }
+        }
+        return nexthop;
+      }
+      case Kind::Qdisc:
+      {
+        Qdisc qdisc;
+        qdisc.action = action;
+        getTrafficControl(reader, qdisc);
+        return qdisc;
+      }
+      case Kind::TrafficClass:
+      {
+        TrafficClass trafficClass;
+        trafficClass.action = action;
+        getTrafficControl(reader, trafficClass);
+        return trafficClass;
+      }
+    }
+    return ExportError::UnknownRecord;
+  }();
+
+  if (record && reader.failed())
+  {
+    return reader.error();
+  }
+  if (record)
+  {
+    input = input.subspan(sizeof(length) + length);
+  }
+  return record;
+}
+}  // namespace Binary
+
+Writer::Writer(int t_fd, Format t_format)
+  : Writer{t_fd, t_format, Options{}}
+{
+}
+
+Writer::Writer(int t_fd, Format t_format, Options t_options)
+  : m_fd{t_fd}
+  , m_format{t_format}
+  , m_options{t_options}
+{
+  m_options.batchChunks = std::clamp<std::size_t>(m_options.batchChunks, 1, IOV_MAX);
+  m_chunks.resize(m_options.batchChunks);
+  for (auto& chunk : m_chunks)
+  {
+    chunk.reserve(m_options.chunkSize);
+  }
+  m_pending.reserve(m_options.batchChunks);
+}
+
+Writer::~Writer()
+{
+  static_cast<void>(flush());
+}
+
+outcome::std_result<void> Writer::write(Address const& address)
+{
+  return append(address);
+}
+
+outcome::std_result<void> Writer::write(Interface const& interface)
+{
+  return append(interface);
+}
+
+outcome::std_result<void> Writer::write(Route const& route)
+{
+  return append(route);
+}
+
+outcome::std_result<void> Writer::write(Rule const& rule)
+{
+  return append(rule);
+}
+
+outcome::std_result<void> Writer::write(Nexthop const& nexthop)
+{
+  return append(nexthop);
+}
+
+outcome::std_result<void> Writer::write(Qdisc const& qdisc)
+{
+  return append(qdisc);
+}
+
+outcome::std_result<void> Writer::write(TrafficClass const& trafficClass)
+{
+  return append(trafficClass);
+}
+
+outcome::std_result<std::size_t> Writer::write(Netlink::Message::ResponseTypes const& response)
+{
+  return std::visit(
+      [this](auto const& value) -> outcome::std_result<std::size_t>
+      {
+        if constexpr (requires { value.data; })
+        {
+          for (auto const& entry : value.data)
+          {
+            BOOST_OUTCOME_TRY(append(entry));
+          }
+          return value.data.size();
+        }
+        else
+        {
+          BOOST_OUTCOME_TRY(append(value));
+          return 1;
+        }
+      },
+      response);
+}
+
+outcome::std_result<void> Writer::flush()
+{
+  return writeBatch();
+}
+
+std::size_t Writer::buffered() const noexcept
+{
+  if (!m_pending.empty())
+  {
+    std::size_t size = 0;
+    for (auto const& iov : m_pending)
+    {
+      size += iov.iov_len;
+    }
+    return size;
+  }
+  std::size_t size = 0;
+  for (auto const& chunk : m_chunks)
+  {
+    size += chunk.size();
+  }
+  return size;
+}
+
+std::size_t Writer::written() const noexcept
+{
+  return m_written;
+}
+
+template <typename T>
+outcome::std_result<void> Writer::append(T const& entry)
+{
+  if (!m_pending.empty())
+  {
+    BOOST_OUTCOME_TRY(writeBatch());
+  }
+
+  auto& chunk = m_chunks[m_current];
+  switch (m_format)
+  {
+    case Format::JsonLines:
+      Json::encode(chunk, entry);
+      break;
+    case Format::Binary:
+      Binary::encode(chunk, entry);
+      break;
+    case Format::IpRoute:
+      fmt::format_to(fmt::appender(chunk), FMT_COMPILE("{:i}\n"), entry);
+      break;
+    case Format::Compact:
+      fmt::format_to(fmt::appender(chunk), FMT_COMPILE("{:c}\n"), entry);
+      break;
+  }
+
+  if (chunk.size() >= m_options.chunkSize && ++m_current == m_chunks.size())
+  {
+    // the entry is taken either way, a failed write shows up with the next entry or flush()
+    static_cast<void>(writeBatch());
+  }
+  return outcome::success();
+}
+
+outcome::std_result<void> Writer::writeBatch()
+{
+  if (m_pending.empty())
+  {
+    auto const used = std::min(m_current + 1, m_chunks.size());
+    for (auto& chunk : std::span{m_chunks}.first(used))
+    {
+      if (chunk.size() != 0)
+      {
+        m_pending.push_back({chunk.data(), chunk.size()});
+      }
+    }
+  }
+
+  while (!m_pending.empty())
+  {
+    auto const count = static_cast<int>(std::min<std::size_t>(m_pending.size(), IOV_MAX));
+    auto const result = ::writev(m_fd, m_pending.data(), count);
+    if (result < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (result < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    if (result == 0)
+    {
+      return static_cast<errno_errc>(EIO);
+    }
+
+    auto left = static_cast<std::size_t>(result);
+    m_written += left;
+    auto done = m_pending.begin();
+    while (done != m_pending.end() && left >= done->iov_len)
+    {
+      left -= done->iov_len;
+      ++done;
+    }
+    if (done != m_pending.end())
+    {
+      done->iov_base = static_cast<char*>(done->iov_base) + left;
+      done->iov_len -= left;
+    }
+    m_pending.erase(m_pending.begin(), done);
+  }
+
+  for (auto& chunk : m_chunks)
+  {
+    chunk.clear();
+  }
+  m_current = 0;
+  return outcome::success();
+}
+}  // namespace wormhole::sysinfo::Export
@@ -0,0 +1,43 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/ExportError.hpp"
+
+namespace
+{
+struct ExportError_cat : std::error_category
+{
+  [[nodiscard]] char const* name() const noexcept override
+  {
+    return "export";
+  }
+
+  [[nodiscard]] std::string message(int val) const override
+  {
+    switch (static_cast<wormhole::sysinfo::Export::ExportError>(val))
+    {
+      case wormhole::sysinfo::Export::ExportError::None:
+        return "None";
+      case wormhole::sysinfo::Export::ExportError::Truncated:
+        return "Truncated";
+      case wormhole::sysinfo::Export::ExportError::UnknownRecord:
+        return "UnknownRecord";
+      case wormhole::sysinfo::Export::ExportError::InvalidValue:
+        return "InvalidValue";
+    }
+    return "unknown";
+  }
+};
+const ExportError_cat exportErrorCat;
+}  // namespace
+
+namespace wormhole::sysinfo::Export
+{
+std::error_code make_error_code(ExportError val)
+{
+  return {static_cast<int>(val), exportErrorCat};
+}
+}  // namespace wormhole::sysinfo::Export
@@ -0,0 +1,246 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/FibLookup.hpp"
+
+#include <vector>
+
+#include "wormhole/sysinfo/errno_error.hpp"
+#include "wormhole/sysinfo/helper.hpp"
+
+namespace
+{
+using namespace wormhole::sysinfo;
+using IpAddress = boost::asio::ip::address;
+
+std::size_t combine(std::size_t seed, std::size_t value) noexcept
+{
+  return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+}
+
+std::size_t hashAddress(IpAddress const& address) noexcept
+{
+  if (address.is_v4())
+  {
+    return address.to_v4().to_uint();
+  }
+  std::size_t seed = 0;
+  for (auto byte : address.to_v6().to_bytes())
+  {
+    seed = combine(seed, byte);
+  }
+  return seed;
+}
+
+bool covers(Route const& route, IpAddress const& destination)
+{
+  return std::visit(helper::overloaded{[&](Route::Default_t)
+                        {
+                          return destination.is_v4() == (route.family == AF_INET);
+                        },
+                        [&](boost::asio::ip::network_v4 const& network)
+                        {
+                          return destination.is_v4() && boost::asio::ip::network_v4{destination.to_v4(), network.prefix_length()}.network() == network.network();
+                        },
+                        [&](boost::asio::ip::network_v6 const& network)
+                        {
+                          return destination.is_v6() && boost::asio::ip::network_v6{destination.to_v6(), network.prefix_length()}.network() == network.network();
+                        }},
+      route.destination.value);
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+std::size_t FibLookup::QueryHash::operator()(Query const& query) const noexcept
+{
+  auto seed = combine(hashAddress(query.destination), hashAddress(query.source));
+  return combine(combine(seed, static_cast<std::size_t>(query.outputInterface.value)), query.mark);
+}
+
+FibLookup::FibLookup(Netlink::Socket t_socket, std::size_t t_capacity)
+  : m_socket{std::move(t_socket)}
+  , m_capacity{std::max<std::size_t>(t_capacity, 1)}
+{
+}
+
+outcome::std_result<FibLookup> FibLookup::open()
+{
+  return open(Options{});
+}
+
+outcome::std_result<FibLookup> FibLookup::open(Options options)
+{
+  using Socket = Netlink::Socket;
+  static constexpr Socket::GroupList groups{Socket::GroupLink{}, Socket::GroupIpV4Route{}, Socket::GroupIpV6Route{}, Socket::GroupIpV4Rule{}, Socket::GroupIpV6Rule{}};
+  BOOST_OUTCOME_TRY(auto socket, Socket::open(groups));
+  if (options.receiveBuffer != 0)
+  {
+    BOOST_OUTCOME_TRY(socket.set_receive_buffer(options.receiveBuffer));
+  }
+  return FibLookup{std::move(socket), options.capacity};
+}
+
+outcome::std_result<void> FibLookup::lookup(std::span<Query const> queries, std::span<Result> results)
+{
+  if (results.size() < queries.size())
+  {
+    return static_cast<errno_errc>(EINVAL);
+  }
+  BOOST_OUTCOME_TRY(poll());
+
+  std::vector<Query> missed;
+  std::vector<std::size_t> positions;
+  for (std::size_t i = 0; i < queries.size(); ++i)
+  {
+    if (auto it = m_index.find(queries[i]); it != m_index.end())
+    {
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      results[i] = it->second->result;
+      ++m_hits;
+    }
+    else
+    {
+      missed.push_back(queries[i]);
+      positions.push_back(i);
+    }
+  }
+  if (missed.empty())
+  {
+    return outcome::success();
+  }
+
+  m_misses += missed.size();
+  std::vector<Result> answers(missed.size(), make_error_code(Netlink::SocketError::None));
+  BOOST_OUTCOME_TRY(m_socket.get_routes(missed, answers));
+  for (std::size_t i = 0; i < missed.size(); ++i)
+  {
+    results[positions[i]] = answers[i];
+    insert(missed[i], answers[i]);
+  }
+  // events that came with the replies may predate them, dropping the fresh answers is harmless;
+  // an overrun during the lookups surfaces here as ENOBUFS and empties the cache
+  BOOST_OUTCOME_TRY(poll());
+  return outcome::success();
+}
+
+FibLookup::Result FibLookup::lookup(Query const& query)
+{
+  Result result{make_error_code(Netlink::SocketError::None)};
+  BOOST_OUTCOME_TRY(lookup(std::span{&query, 1}, std::span{&result, 1}));
+  return result;
+}
+
+outcome::std_result<std::size_t> FibLookup::poll()
+{
+  std::size_t applied = 0;
+  for (;;)
+  {
+    auto event = m_socket.receive(Netlink::Socket::ReceiveMode::Nonblock);
+    if (!event && (event.error() == static_cast<errno_errc>(ENOBUFS) || event.error() == Netlink::SocketError::Truncated))
+    {
+      invalidate();  // events were lost, nothing cached can be trusted
+      continue;
+    }
+    if (!event && (event.error() == static_cast<errno_errc>(EAGAIN) || event.error() == static_cast<errno_errc>(EINTR)))
+    {
+      return applied;
+    }
+    if (!event)
+    {
+      return event.error();
+    }
+    apply(event.value());
+    ++applied;
+  }
+}
+
+void FibLookup::apply(Netlink::Message::ResponseTypes const& event)
+{
+  std::visit(helper::overloaded{[this](Route const& route)
+                 {
+                   erase([&route](Query const& query)
+                       {
+                         return covers(route, query.destination);
+                       });
+                 },
+                 [this](Rule const& rule)
+                 {
+                   erase([&rule](Query const& query)
+                       {
+                         return query.destination.is_v4() == (rule.family == AF_INET);
+                       });
+                 },
+                 [this](Interface const&)
+                 {
+                   invalidate();
+                 },
+                 [](auto const&)
+                 {
+                 }},
+      event);
+}
+
+void FibLookup::invalidate() noexcept
+{
+  m_index.clear();
+  m_entries.clear();
+}
+
+std::size_t FibLookup::size() const noexcept
+{
+  return m_entries.size();
+}
+
+std::size_t FibLookup::hits() const noexcept
+{
+  return m_hits;
+}
+
+std::size_t FibLookup::misses() const noexcept
+{
+  return m_misses;
+}
+
+Netlink::Socket& FibLookup::socket() noexcept
+{
+  return m_socket;
+}
+
+void FibLookup::insert(Query const& query, Result const& result)
+{
+  if (auto it = m_index.find(query); it != m_index.end())
+  {
+    it->second->result = result;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return;
+  }
+  if (m_entries.size() >= m_capacity)
+  {
+    m_index.erase(m_entries.back().query);
+    m_entries.pop_back();
+  }
+  m_entries.push_front({query, result});
+  m_index.emplace(query, m_entries.begin());
+}
+
+template <typename Predicate>
+void FibLookup::erase(Predicate&& predicate)
+{
+  for (auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    if (predicate(it->query))
+    {
+      m_index.erase(it->query);
+      it = m_entries.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,599 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/IndexedStore.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include <sys/socket.h>
+
+#include "wormhole/sysinfo/helper.hpp"
+
+namespace
+{
+using namespace wormhole::sysinfo;
+
+constexpr std::size_t MinBuckets = 16;
+
+constexpr std::uint64_t mix(std::uint64_t hash, std::uint64_t value) noexcept
+{
+  hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+constexpr std::uint64_t finish(std::uint64_t hash) noexcept
+{
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  return hash ^ (hash >> 33);
+}
+
+std::uint64_t hashAddress(std::uint64_t hash, boost::asio::ip::address const& address) noexcept
+{
+  if (address.is_v4())
+  {
+    return mix(hash, address.to_v4().to_uint());
+  }
+  auto const bytes = address.to_v6().to_bytes();
+  std::uint64_t words[2];
+  std::memcpy(words, bytes.data(), sizeof(words));
+  return mix(mix(hash, words[0]), words[1]);
+}
+
+std::uint64_t hashDestination(std::uint64_t hash, Route::Destination const& destination) noexcept
+{
+  return std::visit(helper::overloaded{[hash](Route::Default_t)
+                        {
+                          return mix(hash, 0);
+                        },
+                        [hash](auto const& network)
+                        {
+                          return mix(hashAddress(hash, network.address()), network.prefix_length());
+                        }},
+      destination.value);
+}
+
+// load factor stays below 3/4
+bool crowded(std::size_t used, std::size_t buckets) noexcept
+{
+  return (used + 1) * 4 > buckets * 3;
+}
+
+// whether home lies cyclically in (hole, position], the entry at position must then stay
+bool reachable(std::size_t home, std::size_t hole, std::size_t position) noexcept
+{
+  return hole <= position ? (hole < home && home <= position) : (hole < home || home <= position);
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+template <typename T>
+IndexedStore<T>::IndexedStore()
+{
+  clear();
+}
+
+template <typename T>
+IndexedStore<T>::IndexedStore(std::span<T const> t_entries)
+{
+  load(t_entries);
+}
+
+template <typename T>
+void IndexedStore<T>::load(std::span<T const> entries)
+{
+  clear();
+  reserve(entries.size());
+  for (auto const& entry : entries)
+  {
+    apply(entry);
+  }
+}
+
+template <typename T>
+void IndexedStore<T>::apply(T const& value)
+{
+  update(value, nullptr);
+}
+
+template <typename T>
+void IndexedStore<T>::apply(T const& value, NexthopStore const& nexthops)
+  requires IsRoute
+{
+  update(value, &nexthops);
+}
+
+template <typename T>
+void IndexedStore<T>::apply(Nexthop const& nexthop, NexthopStore const& nexthops)
+  requires IsRoute
+{
+  // the object and every group it is a member of may have changed their paths
+  auto ids = nexthops.groups(nexthop.id);
+  ids.push_back(nexthop.id);
+  for (auto const id : ids)
+  {
+    m_stale.clear();
+    for (auto node = range(3, {0, id, 0}).m_head; node != None; node = m_nodes[node].next)
+    {
+      auto const entry = m_nodes[node].entry;
+      if (m_slots[entry].paths != paths(m_slots[entry].value, &nexthops))
+      {
+        m_stale.push_back(entry);
+      }
+    }
+    for (auto const entry : m_stale)
+    {
+      unlink(entry);
+      m_slots[entry].paths = paths(m_slots[entry].value, &nexthops);
+      link(entry);
+    }
+  }
+}
+
+template <typename T>
+void IndexedStore<T>::update(T const& value, NexthopStore const* nexthops)
+{
+  auto const hash = identity(value);
+  auto entry = locate(value, hash);
+  if (value.action == Action::Del)
+  {
+    if (entry != None)
+    {
+      unlink(entry);
+      erasePrimary(entry);
+      auto& slot = m_slots[entry];
+      slot.paths = {};
+      slot.live = false;
+      slot.firstNode = m_freeSlot;
+      m_freeSlot = entry;
+      --m_size;
+    }
+    return;
+  }
+
+  if (entry != None)
+  {
+    unlink(entry);
+    m_slots[entry].value = value;
+    m_slots[entry].paths = paths(value, nexthops);
+    link(entry);
+    return;
+  }
+
+  if (crowded(m_size, m_primary.size()))
+  {
+    growPrimary();
+  }
+  if (m_freeSlot != None)
+  {
+    entry = m_freeSlot;
+    auto& slot = m_slots[entry];
+    m_freeSlot = slot.firstNode;
+    slot.value = value;
+    slot.paths = paths(value, nexthops);
+    slot.hash = hash;
+    slot.firstNode = None;
+    slot.live = true;
+  }
+  else
+  {
+    entry = static_cast<std::uint32_t>(m_slots.size());
+    m_slots.push_back({value, paths(value, nexthops), hash, None, true});
+  }
+  auto const mask = m_primary.size() - 1;
+  auto position = hash & mask;
+  while (m_primary[position] != None)
+  {
+    position = (position + 1) & mask;
+  }
+  m_primary[position] = entry;
+  ++m_size;
+  link(entry);
+}
+
+template <typename T>
+void IndexedStore<T>::clear()
+{
+  m_slots.clear();
+  m_freeSlot = None;
+  m_size = 0;
+  m_primary.assign(MinBuckets, None);
+  m_nodes.clear();
+  m_freeNode = None;
+  for (auto& index : m_indexes)
+  {
+    index.buckets.assign(MinBuckets, {});
+    index.used = 0;
+  }
+}
+
+template <typename T>
+void IndexedStore<T>::reserve(std::size_t count)
+{
+  m_slots.reserve(count);
+  m_nodes.reserve(count * IndexCount);
+  auto const buckets = std::bit_ceil(count * 4 / 3 + 1);
+  if (buckets > m_primary.size())
+  {
+    std::vector<std::uint32_t> primary(buckets, None);
+    m_primary.swap(primary);
+    for (auto const entry : primary)
+    {
+      if (entry != None)
+      {
+        auto position = m_slots[entry].hash & (buckets - 1);
+        while (m_primary[position] != None)
+        {
+          position = (position + 1) & (buckets - 1);
+        }
+        m_primary[position] = entry;
+      }
+    }
+  }
+}
+
+template <typename T>
+T const* IndexedStore<T>::find(T const& value) const
+{
+  auto const entry = locate(value, identity(value));
+  return entry == None ? nullptr : &m_slots[entry].value;
+}
+
+template <typename T>
+typename IndexedStore<T>::Range IndexedStore<T>::byInterface(Interface::Index index) const
+{
+  return range(0, interfaceKey(index));
+}
+
+template <typename T>
+typename IndexedStore<T>::Range IndexedStore<T>::byGateway(boost::asio::ip::address const& gateway) const
+  requires IsRoute
+{
+  return range(1, gatewayKey(gateway));
+}
+
+template <typename T>
+typename IndexedStore<T>::Range IndexedStore<T>::byTable(Route::Table table) const
+  requires IsRoute
+{
+  return range(2, {0, static_cast<std::uint32_t>(table), 0});
+}
+
+template <typename T>
+typename IndexedStore<T>::Range IndexedStore<T>::byNexthop(std::uint32_t id) const
+  requires IsRoute
+{
+  return range(3, {0, id, 0});
+}
+
+template <typename T>
+std::size_t IndexedStore<T>::size() const noexcept
+{
+  return m_size;
+}
+template <typename T>
+std::uint64_t IndexedStore<T>::identity(T const& value) noexcept
+{
+  if constexpr (IsRoute)
+  {
+    auto hash = mix(static_cast<std::uint64_t>(value.family), static_cast<std::uint64_t>(value.table));
+    hash = mix(hash, value.priority);
+    hash = mix(hash, value.tos);
+    return finish(hashDestination(hash, value.destination));
+  }
+  else
+  {
+    auto hash = mix(static_cast<std::uint64_t>(value.interfaceIndex.value), value.netmask);
+    return finish(hashAddress(hash, value.address));
+  }
+}
+
+template <typename T>
+bool IndexedStore<T>::same(T const& lhs, T const& rhs) noexcept
+{
+  if constexpr (IsRoute)
+  {
+    return lhs.family == rhs.family && lhs.table == rhs.table && lhs.priority == rhs.priority && lhs.tos == rhs.tos && lhs.destination == rhs.destination;
+  }
+  else
+  {
+    return lhs.interfaceIndex == rhs.interfaceIndex && lhs.netmask == rhs.netmask && lhs.address == rhs.address;
+  }
+}
+
+template <typename T>
+std::uint64_t IndexedStore<T>::hash(Key const& key) noexcept
+{
+  return finish(mix(mix(key.low, key.high), key.family));
+}
+
+template <typename T>
+typename IndexedStore<T>::Key IndexedStore<T>::interfaceKey(Interface::Index index) noexcept
+{
+  return {0, static_cast<std::uint32_t>(index.value), 0};
+}
+
+template <typename T>
+typename IndexedStore<T>::Key IndexedStore<T>::gatewayKey(boost::asio::ip::address const& gateway) noexcept
+{
+  if (gateway.is_v4())
+  {
+    return {0, gateway.to_v4().to_uint(), AF_INET};
+  }
+  Key key{.family = AF_INET6};
+  std::memcpy(&key.high, gateway.to_v6().to_bytes().data(), 2 * sizeof(std::uint64_t));
+  return key;
+}
+
+/*
+ * calls f(index, key) once per distinct key of every index, always in the same order
+ * for the same value, unlink() relies on it to pair keys with the entry's nodes.
+ */
+template <typename T>
+template <typename F>
+void IndexedStore<T>::keys(Slot const& slot, F&& f)
+{
+  auto const& value = slot.value;
+  if constexpr (IsRoute)
+  {
+    auto const paths = slot.paths ? std::span{slot.paths->paths} : std::span<NexthopGroup::Path const>{};
+
+    if (value.interfaceIndex.value != 0)
+    {
+      f(0, interfaceKey(value.interfaceIndex));
+    }
+    for (auto it = paths.begin(); it != paths.end(); ++it)
+    {
+      auto const index = it->interfaceIndex;
+      if (index.value != 0 && index != value.interfaceIndex && std::none_of(paths.begin(), it, [index](auto const& path)
+                                                                    {
+                                                                      return path.interfaceIndex == index;
+                                                                    }))
+      {
+        f(0, interfaceKey(index));
+      }
+    }
+
+    if (!value.gateway.is_unspecified())
+    {
+      f(1, gatewayKey(value.gateway));
+    }
+    for (auto it = paths.begin(); it != paths.end(); ++it)
+    {
+      auto const& gateway = it->gateway;
+      if (!gateway.is_unspecified() && gateway != value.gateway && std::none_of(paths.begin(), it, [&gateway](auto const& path)
+                                                                       {
+                                                                         return path.gateway == gateway;
+                                                                       }))
+      {
+        f(1, gatewayKey(gateway));
+      }
+    }
+
+    f(2, Key{0, static_cast<std::uint32_t>(value.table), 0});
+    if (value.nexthopId != 0)
+    {
+      f(3, Key{0, value.nexthopId, 0});
+    }
+  }
+  else if (value.interfaceIndex.value != 0)
+  {
+    f(0, interfaceKey(value.interfaceIndex));
+  }
+}
+
+// the object's current paths win over the ones the route came with
+template <typename T>
+typename IndexedStore<T>::Paths IndexedStore<T>::paths(T const& value, NexthopStore const* nexthops)
+{
+  if constexpr (IsRoute)
+  {
+    if (nexthops != nullptr && value.nexthopId != 0)
+    {
+      if (auto group = nexthops->find(value.nexthopId); group)
+      {
+        return group;
+      }
+    }
+    return value.nexthops;
+  }
+  else
+  {
+    return {};
+  }
+}
+
+template <typename T>
+std::uint32_t IndexedStore<T>::locate(T const& value, std::uint64_t hash) const noexcept
+{
+  auto const mask = m_primary.size() - 1;
+  for (auto position = hash & mask; m_primary[position] != None; position = (position + 1) & mask)
+  {
+    auto const& slot = m_slots[m_primary[position]];
+    if (slot.hash == hash && same(slot.value, value))
+    {
+      return m_primary[position];
+    }
+  }
+  return None;
+}
+
+template <typename T>
+void IndexedStore<T>::erasePrimary(std::uint32_t entry) noexcept
+{
+  auto const mask = m_primary.size() - 1;
+  auto hole = m_slots[entry].hash & mask;
+  while (m_primary[hole] != entry)
+  {
+    hole = (hole + 1) & mask;
+  }
+  for (auto position = (hole + 1) & mask; m_primary[position] != None; position = (position + 1) & mask)
+  {
+    if (!reachable(m_slots[m_primary[position]].hash & mask, hole, position))
+    {
+      m_primary[hole] = m_primary[position];
+      hole = position;
+    }
+  }
+  m_primary[hole] = None;
+}
+
+template <typename T>
+void IndexedStore<T>::growPrimary()
+{
+  reserve(m_primary.size());
+}
+
+template <typename T>
+typename IndexedStore<T>::Range IndexedStore<T>::range(std::size_t index, Key const& key) const noexcept
+{
+  auto const& buckets = m_indexes[index].buckets;
+  auto const mask = buckets.size() - 1;
+  for (auto position = hash(key) & mask; buckets[position].head != None; position = (position + 1) & mask)
+  {
+    if (buckets[position].key == key)
+    {
+      return {this, buckets[position].head, buckets[position].size};
+    }
+  }
+  return {this, None, 0};
+}
+
+template <typename T>
+typename IndexedStore<T>::Bucket& IndexedStore<T>::bucket(std::size_t index, Key const& key)
+{
+  auto& table = m_indexes[index];
+  auto mask = table.buckets.size() - 1;
+  auto position = hash(key) & mask;
+  for (; table.buckets[position].head != None; position = (position + 1) & mask)
+  {
+    if (table.buckets[position].key == key)
+    {
+      return table.buckets[position];
+    }
+  }
+
+  if (crowded(table.used, table.buckets.size()))
+  {
+    std::vector<Bucket> buckets(table.buckets.size() * 2);
+    table.buckets.swap(buckets);
+    mask = table.buckets.size() - 1;
+    for (auto const& moved : buckets)
+    {
+      if (moved.head != None)
+      {
+        auto target = hash(moved.key) & mask;
+        while (table.buckets[target].head != None)
+        {
+          target = (target + 1) & mask;
+        }
+        table.buckets[target] = moved;
+      }
+    }
+    for (position = hash(key) & mask; table.buckets[position].head != None; position = (position + 1) & mask)
+    {
+    }
+  }
+  ++table.used;
+  table.buckets[position].key = key;
+  return table.buckets[position];
+}
+
+template <typename T>
+void IndexedStore<T>::eraseBucket(Index& table, std::size_t hole) noexcept
+{
+  auto const mask = table.buckets.size() - 1;
+  for (auto position = (hole + 1) & mask; table.buckets[position].head != None; position = (position + 1) & mask)
+  {
+    if (!reachable(hash(table.buckets[position].key) & mask, hole, position))
+    {
+      table.buckets[hole] = table.buckets[position];
+      hole = position;
+    }
+  }
+  table.buckets[hole] = {};
+  --table.used;
+}
+
+template <typename T>
+void IndexedStore<T>::link(std::uint32_t entry)
+{
+  auto last = None;
+  keys(m_slots[entry], [&](std::size_t index, Key const& key)
+      {
+        auto const node = allocateNode();
+        auto& list = bucket(index, key);
+        m_nodes[node] = {entry, None, list.head, None};
+        if (list.head != None)
+        {
+          m_nodes[list.head].prev = node;
+        }
+        list.head = node;
+        ++list.size;
+        (last == None ? m_slots[entry].firstNode : m_nodes[last].sibling) = node;
+        last = node;
+      });
+}
+
+template <typename T>
+void IndexedStore<T>::unlink(std::uint32_t entry)
+{
+  auto node = m_slots[entry].firstNode;
+  keys(m_slots[entry], [&](std::size_t index, Key const& key)
+      {
+        auto& table = m_indexes[index];
+        auto const mask = table.buckets.size() - 1;
+        auto position = hash(key) & mask;
+        while (table.buckets[position].head == None || !(table.buckets[position].key == key))
+        {
+          position = (position + 1) & mask;
+        }
+        auto& list = table.buckets[position];
+
+        auto const current = m_nodes[node];
+        if (current.prev == None)
+        {
+          list.head = current.next;
+        }
+        else
+        {
+          m_nodes[current.prev].next = current.next;
+        }
+        if (current.next != None)
+        {
+          m_nodes[current.next].prev = current.prev;
+        }
+        if (--list.size == 0)
+        {
+          eraseBucket(table, position);
+        }
+
+        m_nodes[node].sibling = m_freeNode;
+        m_freeNode = node;
+        node = current.sibling;
+      });
+  m_slots[entry].firstNode = None;
+}
+
+template <typename T>
+std::uint32_t IndexedStore<T>::allocateNode()
+{
+  if (m_freeNode != None)
+  {
+    auto const node = m_freeNode;
+    m_freeNode = m_nodes[node].sibling;
+    return node;
+  }
+  m_nodes.emplace_back();
+  return static_cast<std::uint32_t>(m_nodes.size() - 1);
+}
+
+template class IndexedStore<Route>;
+template class IndexedStore<Address>;
+}  // namespace wormhole::sysinfo
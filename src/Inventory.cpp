@@ -0,0 +1,318 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/Inventory.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+#include "wormhole/sysinfo/errno_error.hpp"
+#include "wormhole/sysinfo/helper.hpp"
+
+namespace
+{
+using namespace wormhole::sysinfo;
+using Netlink::Message;
+using Netlink::Socket;
+
+template <typename T>
+constexpr bool Tracked = std::is_same_v<T, Interface> || std::is_same_v<T, Address> || std::is_same_v<T, Route>;
+
+struct Dumps
+{
+  std::optional<Message::LinkRequest::Response_t> links;
+  std::optional<Message::AddressRequest::Response_t> addressesV4;
+  std::optional<Message::AddressRequest::Response_t> addressesV6;
+  std::optional<Message::RouteRequest::Response_t> routesV4;
+  std::optional<Message::RouteRequest::Response_t> routesV6;
+};
+
+// a socket of its own without groups, nothing but the dump arrives on it
+template <typename Request>
+outcome::std_result<void> dump(int family, std::optional<typename Request::Response_t>& result)
+{
+  BOOST_OUTCOME_TRY(auto socket, Socket::open({}));
+  BOOST_OUTCOME_TRY(socket.send_request<Request>(family));
+  BOOST_OUTCOME_TRY(auto response, socket.receive<Request>(Socket::ReceiveMode::Wait));
+  result = std::move(response);
+  return outcome::success();
+}
+
+outcome::std_result<Dumps> dumpAll(std::size_t threads)
+{
+  Dumps dumps;
+  // the expensive ones first
+  std::array<std::function<outcome::std_result<void>()>, 5> const tasks{
+      [&dumps]
+      {
+        return dump<Message::RouteRequest>(AF_INET, dumps.routesV4);
+      },
+      [&dumps]
+      {
+        return dump<Message::RouteRequest>(AF_INET6, dumps.routesV6);
+      },
+      [&dumps]
+      {
+        return dump<Message::AddressRequest>(AF_INET6, dumps.addressesV6);
+      },
+      [&dumps]
+      {
+        return dump<Message::AddressRequest>(AF_INET, dumps.addressesV4);
+      },
+      [&dumps]
+      {
+        return dump<Message::LinkRequest>(AF_UNSPEC, dumps.links);
+      },
+  };
+  std::array<std::error_code, tasks.size()> errors;
+  std::atomic<std::size_t> next{0};
+  auto const worker = [&]
+  {
+    for (auto task = next++; task < tasks.size(); task = next++)
+    {
+      if (auto result = tasks[task](); !result)
+      {
+        errors[task] = result.error();
+      }
+    }
+  };
+
+  if (threads == 0)
+  {
+    threads = std::min<std::size_t>(tasks.size(), std::max(1U, std::thread::hardware_concurrency()));
+  }
+  {
+    std::vector<std::jthread> pool;
+    for (std::size_t i = 1; i < std::min(threads, tasks.size()); ++i)
+    {
+      pool.emplace_back(worker);
+    }
+    worker();
+  }
+
+  for (auto const& error : errors)
+  {
+    if (error)
+    {
+      return error;
+    }
+  }
+  return dumps;
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+Inventory::Inventory(Netlink::Socket t_socket)
+  : m_socket{std::move(t_socket)}
+{
+}
+
+outcome::std_result<Inventory> Inventory::load()
+{
+  return load(Options{});
+}
+
+outcome::std_result<Inventory> Inventory::load(Options options)
+{
+  static constexpr Socket::GroupList groups{Socket::GroupLink{}, Socket::GroupIpV4Address{}, Socket::GroupIpV6Address{}, Socket::GroupIpV4Route{},
+      Socket::GroupIpV6Route{}};
+  BOOST_OUTCOME_TRY(auto socket, Socket::open(groups));
+  if (options.receiveBuffer != 0)
+  {
+    BOOST_OUTCOME_TRY(socket.set_receive_buffer(options.receiveBuffer));
+  }
+  Inventory inventory{std::move(socket)};
+
+  std::vector<Message::ResponseTypes> pending;
+  for (;;)
+  {
+    ++inventory.m_rounds;
+    BOOST_OUTCOME_TRY(auto dumps, dumpAll(options.threads));
+
+    pending.clear();
+    bool overrun = false;
+    for (;;)
+    {
+      auto event = inventory.m_socket.receive(Socket::ReceiveMode::Nonblock);
+      if (!event && (event.error() == static_cast<errno_errc>(ENOBUFS) || event.error() == Netlink::SocketError::Truncated))
+      {
+        overrun = true;
+        continue;
+      }
+      if (!event && event.error() == static_cast<errno_errc>(EINTR))
+      {
+        continue;  // a signal is no sign that the queue is empty
+      }
+      if (!event && event.error() == static_cast<errno_errc>(EAGAIN))
+      {
+        break;
+      }
+      if (!event)
+      {
+        return event.error();
+      }
+      pending.push_back(std::move(event).value());
+    }
+    if (overrun)
+    {
+      if (inventory.m_rounds >= options.attempts)
+      {
+        return InventoryError::EventsLost;
+      }
+      continue;
+    }
+
+    auto& links = dumps.links->data;
+    inventory.m_links.assign(links.begin(), links.end());
+    std::ranges::sort(inventory.m_links, {}, &Interface::index);
+
+    auto& addressesV4 = dumps.addressesV4->data;
+    auto& addressesV6 = dumps.addressesV6->data;
+    inventory.m_addresses.clear();
+    inventory.m_addresses.reserve(addressesV4.size() + addressesV6.size());
+    for (auto const& address : addressesV4)
+    {
+      inventory.m_addresses.apply(address);
+    }
+    for (auto const& address : addressesV6)
+    {
+      inventory.m_addresses.apply(address);
+    }
+
+    auto& routesV4 = dumps.routesV4->data;
+    auto& routesV6 = dumps.routesV6->data;
+    inventory.m_routes.clear();
+    inventory.m_routes.reserve(routesV4.size() + routesV6.size());
+    for (auto const& route : routesV4)
+    {
+      inventory.m_routes.apply(route);
+    }
+    for (auto const& route : routesV6)
+    {
+      inventory.m_routes.apply(route);
+    }
+
+    // every change since the socket was opened, in order; replaying what a dump
+    // already shows is harmless since the last event of an object decides
+    for (auto const& event : pending)
+    {
+      inventory.apply(event);
+    }
+    inventory.m_reconciled = pending.size();
+    return inventory;
+  }
+}
+
+void Inventory::apply(Interface const& link)
+{
+  auto it = std::ranges::lower_bound(m_links, link.index, {}, &Interface::index);
+  bool const found = it != m_links.end() && it->index == link.index;
+  if (link.action == Action::Del)
+  {
+    if (found)
+    {
+      m_links.erase(it);
+    }
+    // the kernel flushes IPv4 routes through a vanished link without telling anyone
+    std::vector<Route> orphans;
+    for (auto const& route : m_routes.byInterface(link.index))
+    {
+      if (route.interfaceIndex == link.index)
+      {
+        orphans.push_back(route);
+        orphans.back().action = Action::Del;
+      }
+    }
+    for (auto const& route : orphans)
+    {
+      m_routes.apply(route);
+    }
+  }
+  else if (found)
+  {
+    *it = link;
+  }
+  else
+  {
+    m_links.insert(it, link);
+  }
+}
+
+void Inventory::apply(Address const& address)
+{
+  m_addresses.apply(address);
+}
+
+void Inventory::apply(Route const& route)
+{
+  m_routes.apply(route);
+}
+
+void Inventory::apply(Netlink::Message::ResponseTypes const& event)
+{
+  std::visit(helper::overloaded{[this](auto const& response)
+                 requires requires { response.data; }
+                 {
+                   for (auto const& entry : response.data)
+                   {
+                     if constexpr (Tracked<std::remove_cvref_t<decltype(entry)>>)
+                     {
+                       apply(entry);
+                     }
+                   }
+                 },
+                 [this](auto const& entry)
+                 {
+                   if constexpr (Tracked<std::remove_cvref_t<decltype(entry)>>)
+                   {
+                     apply(entry);
+                   }
+                 }},
+      event);
+}
+
+std::span<Interface const> Inventory::links() const noexcept
+{
+  return m_links;
+}
+
+Interface const* Inventory::link(Interface::Index index) const
+{
+  auto it = std::ranges::lower_bound(m_links, index, {}, &Interface::index);
+  return it != m_links.end() && it->index == index ? &*it : nullptr;
+}
+
+AddressStore const& Inventory::addresses() const noexcept
+{
+  return m_addresses;
+}
+
+RouteStore const& Inventory::routes() const noexcept
+{
+  return m_routes;
+}
+
+Netlink::Socket& Inventory::socket() noexcept
+{
+  return m_socket;
+}
+
+std::size_t Inventory::reconciled() const noexcept
+{
+  return m_reconciled;
+}
+
+std::size_t Inventory::rounds() const noexcept
+{
+  return m_rounds;
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,39 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/InventoryError.hpp"
+
+namespace
+{
+struct InventoryError_cat : std::error_category
+{
+  [[nodiscard]] char const* name() const noexcept override
+  {
+    return "inventory";
+  }
+
+  [[nodiscard]] std::string message(int val) const override
+  {
+    switch (static_cast<wormhole::sysinfo::InventoryError>(val))
+    {
+      case wormhole::sysinfo::InventoryError::None:
+        return "None";
+      case wormhole::sysinfo::InventoryError::EventsLost:
+        return "EventsLost";
+    }
+    return "unknown";
+  }
+};
+const InventoryError_cat inventoryErrorCat;
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+std::error_code make_error_code(InventoryError val)
+{
+  return {static_cast<int>(val), inventoryErrorCat};
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,612 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/Journal.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "wormhole/sysinfo/errno_error.hpp"
+#include "wormhole/sysinfo/helper.hpp"
+
+using namespace std::literals;
+
+namespace
+{
+using namespace wormhole::sysinfo;
+using Export::Journal;
+
+constexpr std::array<char, 8> Magic{'S', 'Y', 'S', 'I', 'N', 'F', 'O', 'J'};
+constexpr std::uint32_t Version = 1;
+constexpr std::size_t IndexEntrySize = 2 * sizeof(std::uint64_t);
+// i64 time | u32 record length
+constexpr std::size_t FramePrefix = sizeof(std::int64_t) + sizeof(std::uint32_t);
+
+template <typename T>
+void store(std::byte* out, T value) noexcept
+{
+  if constexpr (std::endian::native == std::endian::big)
+  {
+    value = std::byteswap(value);
+  }
+  std::memcpy(out, &value, sizeof(T));
+}
+
+template <typename T>
+T load(std::byte const* in) noexcept
+{
+  T value;
+  std::memcpy(&value, in, sizeof(T));
+  if constexpr (std::endian::native == std::endian::big)
+  {
+    value = std::byteswap(value);
+  }
+  return value;
+}
+
+std::int64_t nanoseconds(Journal::Clock::time_point time) noexcept
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::filesystem::path segmentPath(std::filesystem::path const& directory, std::uint64_t sequence, std::string_view extension)
+{
+  return directory / fmt::format("{:016x}{}", sequence, extension);
+}
+
+// sequences of the segments in directory, ascending
+outcome::std_result<std::vector<std::uint64_t>> sequences(std::filesystem::path const& directory)
+{
+  std::error_code error;
+  std::vector<std::uint64_t> found;
+  for (auto const& file : std::filesystem::directory_iterator{directory, error})
+  {
+    auto const name = file.path().filename().native();
+    if (name.size() != 16 + ".journal"sv.size() || !name.ends_with(".journal"sv))
+    {
+      continue;
+    }
+    std::uint64_t sequence = 0;
+    if (auto [end, ec] = std::from_chars(name.data(), name.data() + 16, sequence, 16); ec == std::errc{} && end == name.data() + 16)
+    {
+      found.push_back(sequence);
+    }
+  }
+  if (error)
+  {
+    return error;
+  }
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+// read only mapping of a whole file
+class Mapping
+{
+public:
+  static outcome::std_result<Mapping> open(std::filesystem::path const& path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0)
+    {
+      auto const error = errno;
+      close(fd);
+      return static_cast<errno_errc>(error);
+    }
+    Mapping mapping;
+    mapping.m_size = static_cast<std::size_t>(status.st_size);
+    if (mapping.m_size > 0)
+    {
+      void* data = mmap(nullptr, mapping.m_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED)
+      {
+        auto const error = errno;
+        close(fd);
+        return static_cast<errno_errc>(error);
+      }
+      mapping.m_data = static_cast<std::byte const*>(data);
+    }
+    close(fd);
+    return mapping;
+  }
+
+  Mapping() = default;
+  Mapping(Mapping const&) = delete;
+  Mapping(Mapping&& rhs) noexcept
+    : m_data{std::exchange(rhs.m_data, nullptr)}
+    , m_size{std::exchange(rhs.m_size, 0)}
+  {
+  }
+  Mapping& operator=(Mapping const&) = delete;
+  Mapping& operator=(Mapping&&) = delete;
+  ~Mapping()
+  {
+    if (m_data)
+    {
+      munmap(const_cast<std::byte*>(m_data), m_size);
+    }
+  }
+
+  [[nodiscard]] std::span<std::byte const> bytes() const noexcept
+  {
+    return {m_data, m_size};
+  }
+
+private:
+  std::byte const* m_data{nullptr};
+  std::size_t m_size{0};
+};
+
+// offset of the last indexed entry at or before from, the first entry without one
+std::size_t seek(std::filesystem::path const& index, std::int64_t from)
+{
+  auto mapping = Mapping::open(index);
+  if (!mapping)
+  {
+    return Journal::HeaderSize;
+  }
+  auto const bytes = mapping.value().bytes();
+  auto const count = bytes.size() / IndexEntrySize;
+  std::size_t first = 0;
+  std::size_t last = count;
+  while (first < last)
+  {
+    auto const middle = first + (last - first) / 2;
+    if (load<std::int64_t>(bytes.data() + middle * IndexEntrySize) <= from)
+    {
+      first = middle + 1;
+    }
+    else
+    {
+      last = middle;
+    }
+  }
+  if (first == 0)
+  {
+    return Journal::HeaderSize;
+  }
+  return load<std::size_t>(bytes.data() + (first - 1) * IndexEntrySize + sizeof(std::int64_t));
+}
+}  // namespace
+
+namespace wormhole::sysinfo::Export
+{
+outcome::std_result<std::unique_ptr<Journal>> Journal::open(std::filesystem::path const& directory)
+{
+  return open(directory, Options{});
+}
+
+outcome::std_result<std::unique_ptr<Journal>> Journal::open(std::filesystem::path const& directory, Options options)
+{
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error)
+  {
+    return error;
+  }
+  BOOST_OUTCOME_TRY(auto found, sequences(directory));
+  options.segmentSize = std::max<std::size_t>(options.segmentSize, 4096);
+  options.indexInterval = std::max<std::size_t>(options.indexInterval, 1);
+  std::unique_ptr<Journal> journal{new Journal{directory, options, {found.begin(), found.end()}}};
+  BOOST_OUTCOME_TRY(journal->start());
+  return journal;
+}
+
+Journal::Journal(std::filesystem::path t_directory, Options t_options, std::deque<std::uint64_t> t_sequences)
+  : m_directory{std::move(t_directory)}
+  , m_options{t_options}
+  , m_sequences{std::move(t_sequences)}
+  , m_committed{std::chrono::steady_clock::now()}
+{
+}
+
+Journal::~Journal()
+{
+  static_cast<void>(finish());
+}
+
+outcome::std_result<void> Journal::start()
+{
+  auto const sequence = m_sequences.empty() ? 1 : m_sequences.back() + 1;
+  auto const path = segmentPath(m_directory, sequence, ".journal"sv);
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  auto fail = [&](int error) -> outcome::std_result<void>
+  {
+    close(fd);
+    unlink(path.c_str());
+    return static_cast<errno_errc>(error);
+  };
+  // allocated up front, a full disk fails here with ENOSPC rather than as SIGBUS on a store through the map
+  if (int const error = posix_fallocate(fd, 0, static_cast<off_t>(m_options.segmentSize)); error != 0)
+  {
+    return fail(error);
+  }
+  void* map = mmap(nullptr, m_options.segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    return fail(errno);
+  }
+  int indexFd = ::open(segmentPath(m_directory, sequence, ".index"sv).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (indexFd < 0)
+  {
+    auto const error = errno;
+    munmap(map, m_options.segmentSize);
+    return fail(error);
+  }
+
+  m_last = std::max(m_last, nanoseconds(Clock::now()));
+  auto* header = static_cast<std::byte*>(map);
+  std::memcpy(header, Magic.data(), Magic.size());
+  store(header + 8, Version);
+  store(header + 12, static_cast<std::uint32_t>(HeaderSize));
+  store(header + 16, sequence);
+  store(header + 24, m_last);
+
+  m_segment.sequence = sequence;
+  m_segment.fd = fd;
+  m_segment.indexFd = indexFd;
+  m_segment.map = header;
+  m_segment.used = HeaderSize;
+  m_segment.synced = 0;
+  m_segment.nextIndex = HeaderSize;
+  m_sequences.push_back(sequence);
+  ++m_stats.segments;
+  retire();
+  return outcome::success();
+}
+
+outcome::std_result<void> Journal::finish()
+{
+  if (!m_segment.map)
+  {
+    return outcome::success();
+  }
+  auto committed = commit();
+  munmap(m_segment.map, m_options.segmentSize);
+  // readers see the end of the file instead of zeros
+  auto truncated = ftruncate(m_segment.fd, static_cast<off_t>(m_segment.used));
+  auto const error = errno;
+  close(m_segment.fd);
+  close(m_segment.indexFd);
+  m_segment = Segment{};
+  if (!committed)
+  {
+    return committed;
+  }
+  if (truncated < 0)
+  {
+    return static_cast<errno_errc>(error);
+  }
+  return outcome::success();
+}
+
+void Journal::retire()
+{
+  while (m_options.segments != 0 && m_sequences.size() > m_options.segments)
+  {
+    std::error_code ignored;
+    std::filesystem::remove(segmentPath(m_directory, m_sequences.front(), ".journal"sv), ignored);
+    std::filesystem::remove(segmentPath(m_directory, m_sequences.front(), ".index"sv), ignored);
+    m_sequences.pop_front();
+  }
+}
+
+template <typename T>
+outcome::std_result<void> Journal::write(T const& entry)
+{
+  m_scratch.clear();
+  Binary::encode(m_scratch, entry);
+  auto const size = sizeof(std::int64_t) + m_scratch.size();
+  if (size > m_options.segmentSize - HeaderSize)
+  {
+    return JournalError::RecordTooLarge;
+  }
+  if (!m_segment.map || m_segment.used + size > m_options.segmentSize)
+  {
+    BOOST_OUTCOME_TRY(finish());
+    BOOST_OUTCOME_TRY(start());
+  }
+
+  auto const time = std::max(m_last, nanoseconds(Clock::now()));
+  m_last = time;
+  if (m_segment.used >= m_segment.nextIndex)
+  {
+    auto const at = m_index.size();
+    m_index.resize(at + IndexEntrySize);
+    store(m_index.data() + at, time);
+    store<std::uint64_t>(m_index.data() + at + sizeof(std::int64_t), m_segment.used);
+    m_segment.nextIndex = m_segment.used + m_options.indexInterval;
+  }
+  auto* out = m_segment.map + m_segment.used;
+  std::memcpy(out + sizeof(std::int64_t), m_scratch.data(), m_scratch.size());
+  store(out, time);
+  m_segment.used += size;
+  ++m_stats.entries;
+  m_stats.bytes += size;
+
+  if (m_segment.used - m_segment.synced >= m_options.commitBytes || std::chrono::steady_clock::now() - m_committed >= m_options.commitInterval)
+  {
+    return commit();
+  }
+  return outcome::success();
+}
+
+outcome::std_result<void> Journal::append(Address const& address)
+{
+  return write(address);
+}
+
+outcome::std_result<void> Journal::append(Interface const& interface)
+{
+  return write(interface);
+}
+
+outcome::std_result<void> Journal::append(Route const& route)
+{
+  return write(route);
+}
+
+outcome::std_result<void> Journal::append(Rule const& rule)
+{
+  return write(rule);
+}
+
+outcome::std_result<void> Journal::append(Nexthop const& nexthop)
+{
+  return write(nexthop);
+}
+
+outcome::std_result<void> Journal::append(Qdisc const& qdisc)
+{
+  return write(qdisc);
+}
+
+outcome::std_result<void> Journal::append(TrafficClass const& trafficClass)
+{
+  return write(trafficClass);
+}
+
+outcome::std_result<std::size_t> Journal::append(Netlink::Message::ResponseTypes const& response)
+{
+  return std::visit(
+      [this](auto const& value) -> outcome::std_result<std::size_t>
+      {
+        if constexpr (requires { value.data; })
+        {
+          for (auto const& entry : value.data)
+          {
+            BOOST_OUTCOME_TRY(write(entry));
+          }
+          return value.data.size();
+        }
+        else
+        {
+          BOOST_OUTCOME_TRY(write(value));
+          return 1;
+        }
+      },
+      response);
+}
+
+outcome::std_result<void> Journal::commit()
+{
+  m_committed = std::chrono::steady_clock::now();
+  if (!m_segment.map || (m_segment.used == m_segment.synced && m_index.empty()))
+  {
+    return outcome::success();
+  }
+  if (m_segment.used > m_segment.synced)
+  {
+    static auto const page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto const begin = m_segment.synced / page * page;
+    if (msync(m_segment.map + begin, m_segment.used - begin, MS_SYNC) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+    m_segment.synced = m_segment.used;
+  }
+  // after the entries they point to
+  std::size_t written = 0;
+  while (written < m_index.size())
+  {
+    auto const result = ::write(m_segment.indexFd, m_index.data() + written, m_index.size() - written);
+    if (result < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      m_index.erase(m_index.begin(), m_index.begin() + static_cast<std::ptrdiff_t>(written));
+      return static_cast<errno_errc>(errno);
+    }
+    written += static_cast<std::size_t>(result);
+  }
+  m_index.clear();
+  ++m_stats.commits;
+  return outcome::success();
+}
+
+Journal::Options const& Journal::options() const noexcept
+{
+  return m_options;
+}
+
+Journal::Stats Journal::stats() const noexcept
+{
+  return m_stats;
+}
+
+void JournalReader::Mirror::apply(Binary::Record const& record)
+{
+  std::visit(helper::overloaded{[this](Interface const& link)
+                 {
+                   auto it = std::ranges::lower_bound(links, link.index, {}, &Interface::index);
+                   bool const found = it != links.end() && it->index == link.index;
+                   if (link.action == Action::Del)
+                   {
+                     if (found)
+                     {
+                       links.erase(it);
+                     }
+                     // as Inventory does: the kernel flushes IPv4 routes through a vanished link silently
+                     std::vector<Route> orphans;
+                     for (auto const& route : routes.byInterface(link.index))
+                     {
+                       if (route.interfaceIndex == link.index)
+                       {
+                         orphans.push_back(route);
+                         orphans.back().action = Action::Del;
+                       }
+                     }
+                     for (auto const& route : orphans)
+                     {
+                       routes.apply(route);
+                     }
+                   }
+                   else if (found)
+                   {
+                     *it = link;
+                   }
+                   else
+                   {
+                     links.insert(it, link);
+                   }
+                 },
+                 [this](Address const& address)
+                 {
+                   addresses.apply(address);
+                 },
+                 [this](Route const& route)
+                 {
+                   routes.apply(route, nexthops);
+                 },
+                 [this](Nexthop const& nexthop)
+                 {
+                   nexthops.apply(nexthop);
+                   routes.apply(nexthop, nexthops);
+                 },
+                 [](auto const&) {}},
+      record);
+}
+
+outcome::std_result<JournalReader> JournalReader::open(std::filesystem::path const& directory)
+{
+  BOOST_OUTCOME_TRY(auto found, sequences(directory));
+  std::vector<Segment> segments;
+  segments.reserve(found.size());
+  for (auto const sequence : found)
+  {
+    auto path = segmentPath(directory, sequence, ".journal"sv);
+    BOOST_OUTCOME_TRY(auto mapping, Mapping::open(path));
+    auto const bytes = mapping.bytes();
+    // a segment being created by a writer right now
+    if (bytes.size() < Journal::HeaderSize || std::ranges::all_of(bytes.first(Magic.size()), [](std::byte b)
+                                                  {
+                                                    return b == std::byte{0};
+                                                  }))
+    {
+      continue;
+    }
+    if (std::memcmp(bytes.data(), Magic.data(), Magic.size()) != 0)
+    {
+      return JournalError::NotAJournal;
+    }
+    segments.push_back({std::move(path), load<std::int64_t>(bytes.data() + 24)});
+  }
+  return JournalReader{std::move(segments)};
+}
+
+JournalReader::JournalReader(std::vector<Segment> t_segments)
+  : m_segments{std::move(t_segments)}
+{
+}
+
+outcome::std_result<std::size_t> JournalReader::replay(Journal::Clock::time_point from, Journal::Clock::time_point to, Handler const& handler) const
+{
+  if (from > to)
+  {
+    return JournalError::InvalidRange;
+  }
+  auto const first = nanoseconds(from);
+  auto const last = nanoseconds(to);
+  // entries of a segment are not older than its creation
+  auto segment = std::ranges::upper_bound(m_segments, first, {}, &Segment::created);
+  if (segment != m_segments.begin())
+  {
+    --segment;
+  }
+
+  std::size_t count = 0;
+  for (; segment != m_segments.end() && segment->created < last; ++segment)
+  {
+    BOOST_OUTCOME_TRY(auto mapping, Mapping::open(segment->path));
+    auto const bytes = mapping.bytes();
+    auto offset = seek(std::filesystem::path{segment->path}.replace_extension(".index"), first);
+    while (offset <= bytes.size() && bytes.size() - offset >= FramePrefix)
+    {
+      auto const time = load<std::int64_t>(bytes.data() + offset);
+      auto const length = load<std::uint32_t>(bytes.data() + offset + sizeof(std::int64_t));
+      auto const frame = FramePrefix + std::size_t{length};
+      // zeros past the last entry, or one cut short
+      if (length == 0 || bytes.size() - offset < frame)
+      {
+        break;
+      }
+      if (time >= last)
+      {
+        return count;
+      }
+      if (time >= first)
+      {
+        auto input = bytes.subspan(offset + sizeof(std::int64_t), frame - sizeof(std::int64_t));
+        auto record = Binary::decode(input);
+        if (!record)
+        {
+          break;
+        }
+        ++count;
+        handler(Journal::Clock::time_point{std::chrono::duration_cast<Journal::Clock::duration>(std::chrono::nanoseconds{time})}, std::move(record.value()));
+      }
+      offset += frame;
+    }
+  }
+  return count;
+}
+
+outcome::std_result<std::size_t> JournalReader::replay(Journal::Clock::time_point from, Journal::Clock::time_point to, Mirror& mirror) const
+{
+  return replay(from, to, [&mirror](Journal::Clock::time_point, Binary::Record&& record)
+      {
+        mirror.apply(record);
+      });
+}
+
+std::size_t JournalReader::segments() const noexcept
+{
+  return m_segments.size();
+}
+}  // namespace wormhole::sysinfo::Export
@@ -0,0 +1,43 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/JournalError.hpp"
+
+namespace
+{
+struct JournalError_cat : std::error_category
+{
+  [[nodiscard]] char const* name() const noexcept override
+  {
+    return "journal";
+  }
+
+  [[nodiscard]] std::string message(int val) const override
+  {
+    switch (static_cast<wormhole::sysinfo::Export::JournalError>(val))
+    {
+      case wormhole::sysinfo::Export::JournalError::None:
+        return "None";
+      case wormhole::sysinfo::Export::JournalError::NotAJournal:
+        return "NotAJournal";
+      case wormhole::sysinfo::Export::JournalError::RecordTooLarge:
+        return "RecordTooLarge";
+      case wormhole::sysinfo::Export::JournalError::InvalidRange:
+        return "InvalidRange";
+    }
+    return "unknown";
+  }
+};
+const JournalError_cat journalErrorCat;
+}  // namespace
+
+namespace wormhole::sysinfo::Export
+{
+std::error_code make_error_code(JournalError val)
+{
+  return {static_cast<int>(val), journalErrorCat};
+}
+}  // namespace wormhole::sysinfo::Export
@@ -0,0 +1,186 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/LinkStateTracker.hpp"
+
+#include <net/if.h>
+#include <algorithm>
+
+namespace wormhole::sysinfo
+{
+bool LinkStateTracker::State::adminUp() const noexcept
+{
+  return (flags & IFF_UP) != 0;
+}
+
+bool LinkStateTracker::State::running() const noexcept
+{
+  return present && adminUp() && carrier && (operState == Interface::OperState::Up || operState == Interface::OperState::Unknown);
+}
+
+void LinkStateTracker::subscribe(std::uint32_t edges, Callback callback)
+{
+  m_subscribers.push_back({edges, std::move(callback)});
+}
+
+std::uint32_t LinkStateTracker::apply(Interface const& link)
+{
+  if (link.index.value <= 0)
+  {
+    return 0;
+  }
+  auto const index = static_cast<std::size_t>(link.index.value);
+  if (index >= MaxCachedIndex)
+  {
+    if (link.action != Action::Del)
+    {
+      return update(index, m_sparse[index], State{link.flags, link.mtu, link.operState, link.carrier, true});
+    }
+    auto it = m_sparse.find(index);
+    if (it == m_sparse.end())
+    {
+      return 0;
+    }
+    auto const changed = update(index, it->second, State{});
+    m_sparse.erase(index);  // by key, a callback may have changed the map
+    return changed;
+  }
+  if (link.action == Action::Del)
+  {
+    return index < m_states.size() ? update(index, m_states[index], State{}) : 0;
+  }
+  if (index >= m_states.size())
+  {
+    m_states.resize(index + 1);
+  }
+  return update(index, m_states[index], State{link.flags, link.mtu, link.operState, link.carrier, true});
+}
+
+std::uint32_t LinkStateTracker::apply(Netlink::Message::ResponseTypes const& event)
+{
+  if (auto const* link = std::get_if<Interface>(&event); link)
+  {
+    return apply(*link);
+  }
+  return 0;
+}
+
+void LinkStateTracker::load(std::span<Interface const> links)
+{
+  std::vector<bool> seen;
+  std::vector<std::size_t> seenSparse;
+  for (auto const& link : links)
+  {
+    apply(link);
+    if (link.index.value > 0 && link.action != Action::Del)
+    {
+      auto const index = static_cast<std::size_t>(link.index.value);
+      if (index >= MaxCachedIndex)
+      {
+        seenSparse.push_back(index);
+        continue;
+      }
+      seen.resize(std::max(seen.size(), index + 1));
+      seen[index] = true;
+    }
+  }
+  for (std::size_t index = 0; index < m_states.size(); ++index)
+  {
+    if (m_states[index].present && (index >= seen.size() || !seen[index]))
+    {
+      update(index, m_states[index], State{});
+    }
+  }
+  std::sort(seenSparse.begin(), seenSparse.end());
+  std::vector<std::size_t> missing;
+  for (auto const& [index, state] : m_sparse)
+  {
+    if (!std::binary_search(seenSparse.begin(), seenSparse.end(), index))
+    {
+      missing.push_back(index);
+    }
+  }
+  for (auto const index : missing)
+  {
+    Interface removed;
+    removed.action = Action::Del;
+    removed.index = Interface::Index{static_cast<int>(index)};
+    apply(removed);
+  }
+}
+
+LinkStateTracker::State LinkStateTracker::state(Interface::Index index) const noexcept
+{
+  if (index.value <= 0)
+  {
+    return {};
+  }
+  auto const slot = static_cast<std::size_t>(index.value);
+  if (slot >= MaxCachedIndex)
+  {
+    auto it = m_sparse.find(slot);
+    return it != m_sparse.end() ? it->second : State{};
+  }
+  return slot < m_states.size() ? m_states[slot] : State{};
+}
+
+std::size_t LinkStateTracker::suppressed() const noexcept
+{
+  return m_suppressed;
+}
+
+std::uint32_t LinkStateTracker::edges(State const& previous, State const& current) noexcept
+{
+  std::uint32_t result = 0;
+  if (previous.present != current.present)
+  {
+    result |= current.present ? Edge::Added : Edge::Removed;
+  }
+  if (previous.adminUp() != current.adminUp())
+  {
+    result |= current.adminUp() ? Edge::AdminUp : Edge::AdminDown;
+  }
+  if (previous.running() != current.running())
+  {
+    result |= current.running() ? Edge::Up : Edge::Down;
+  }
+  if (previous.carrier != current.carrier)
+  {
+    result |= current.carrier ? Edge::CarrierUp : Edge::CarrierDown;
+  }
+  if (previous.operState != current.operState)
+  {
+    result |= Edge::OperState;
+  }
+  if (previous.mtu != current.mtu)
+  {
+    result |= Edge::Mtu;
+  }
+  return result;
+}
+
+std::uint32_t LinkStateTracker::update(std::size_t index, State& slot, State const& current)
+{
+  auto const previous = slot;
+  slot = current;
+  auto const changed = edges(previous, current);
+  if (changed == 0)
+  {
+    ++m_suppressed;
+    return 0;
+  }
+  Change const change{Interface::Index{static_cast<int>(index)}, changed, previous, current};
+  // by position, a callback may subscribe another one
+  for (std::size_t i = 0; i < m_subscribers.size(); ++i)
+  {
+    if ((m_subscribers[i].edges & changed) != 0)
+    {
+      m_subscribers[i].callback(change);
+    }
+  }
+  return changed;
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,76 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/Metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace wormhole::sysinfo::Netlink
+{
+std::uint64_t Histogram::Snapshot::percentile(double p) const noexcept
+{
+  if (count == 0)
+  {
+    return 0;
+  }
+  auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(p, 0.0, 100.0) / 100.0 * static_cast<double>(count)));
+  rank = std::max<std::uint64_t>(rank, 1);
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < counts.size(); ++i)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+    {
+      return std::min(bucketUpperBound(i), max);
+    }
+  }
+  return max;
+}
+
+double Histogram::Snapshot::mean() const noexcept
+{
+  return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+}
+
+Histogram::Snapshot Histogram::snapshot() const noexcept
+{
+  Snapshot result;
+  for (std::size_t i = 0; i < m_counts.size(); ++i)
+  {
+    result.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+  }
+  result.count = m_count.load(std::memory_order_relaxed);
+  result.sum = m_sum.load(std::memory_order_relaxed);
+  result.max = m_max.load(std::memory_order_relaxed);
+  return result;
+}
+
+Metrics::Snapshot Metrics::snapshot() const noexcept
+{
+  Snapshot result;
+  if constexpr (enabled)
+  {
+    result.datagrams = m_datagrams.load(std::memory_order_relaxed);
+    result.bytes = m_bytes.load(std::memory_order_relaxed);
+    result.parseErrors = m_parseErrors.load(std::memory_order_relaxed);
+    result.dumpInterrupted = m_dumpInterrupted.load(std::memory_order_relaxed);
+    result.dumpRestarted = m_dumpRestarted.load(std::memory_order_relaxed);
+    result.dumpPatched = m_dumpPatched.load(std::memory_order_relaxed);
+    result.dumpSpilled = m_dumpSpilled.load(std::memory_order_relaxed);
+    result.noBuffers = m_noBuffers.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < m_messages.size(); ++i)
+    {
+      result.messages[i] = m_messages[i].load(std::memory_order_relaxed);
+    }
+    result.receiveLatency = m_receiveLatency.snapshot();
+    result.parseTime = m_parseTime.snapshot();
+    result.dumpDuration = m_dumpDuration.snapshot();
+    result.dumpMemory = m_dumpMemory.snapshot();
+  }
+  return result;
+}
+}  // namespace wormhole::sysinfo::Netlink
@@ -7,19 +7,27 @@
 #include "wormhole/sysinfo/NetlinkSocket.hpp"
 
 #include <arpa/inet.h>
+#include <linux/fib_rules.h>
+#include <linux/gen_stats.h>
 #include <linux/rtnetlink.h>
 #include <net/if.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <cerrno>
+#include <cstring>
 #include <cstdlib>
 #include <ctime>
 
+#include <algorithm>
+#include <bit>
 #include <numeric>
+#include <ranges>
+#include <unordered_map>
 #include <variant>
 
 #include <fmt/color.h>
+#include <fmt/compile.h>
 #include <fmt/core.h>
 #include <boost/asio/ip/address.hpp>
 
@@ -27,11 +35,284 @@
 #include "wormhole/sysinfo/helper.hpp"
 #include "wormhole/sysinfo/types.hpp"
 
+#include "Probes.hpp"
+
+namespace
+{
+namespace Attribute = wormhole::sysinfo::Netlink::Attribute;
+using IpAddress = boost::asio::ip::address;
+
+// clang-format off
+using RouteAttributes = Attribute::Schema<
+    Attribute::Field<RTA_TABLE, std::uint32_t>,
+    Attribute::Field<RTA_DST, IpAddress>,
+    Attribute::Field<RTA_SRC, IpAddress>,
+    Attribute::Field<RTA_GATEWAY, IpAddress>,
+    Attribute::Field<RTA_OIF, std::uint32_t>,
+    Attribute::Field<RTA_PRIORITY, std::uint32_t>,
+    Attribute::Field<RTA_NH_ID, std::uint32_t>,
+    Attribute::Field<RTA_MULTIPATH, Attribute::Payload>>;
+using MultipathAttributes = Attribute::Schema<
+    Attribute::Field<RTA_GATEWAY, IpAddress>,
+    Attribute::Field<RTA_VIA, Attribute::Payload>>;
+using AddressAttributes = Attribute::Schema<
+    Attribute::Field<IFA_ADDRESS, IpAddress>,
+    Attribute::Field<IFA_LOCAL, IpAddress>,
+    Attribute::Field<IFA_BROADCAST, IpAddress>>;
+using LinkAttributes = Attribute::Schema<
+    Attribute::Field<IFLA_IFNAME, std::string_view>,
+    Attribute::Field<IFLA_MTU, std::uint32_t>,
+    Attribute::Field<IFLA_OPERSTATE, std::uint8_t>,
+    Attribute::Field<IFLA_CARRIER, std::uint8_t>>;
+using RuleAttributes = Attribute::Schema<
+    Attribute::Field<FRA_SRC, IpAddress>,
+    Attribute::Field<FRA_DST, IpAddress>,
+    Attribute::Field<FRA_PRIORITY, std::uint32_t>,
+    Attribute::Field<FRA_TABLE, std::uint32_t>,
+    Attribute::Field<FRA_GOTO, std::uint32_t>,
+    Attribute::Field<FRA_IIFNAME, std::string_view>,
+    Attribute::Field<FRA_OIFNAME, std::string_view>,
+    Attribute::Field<FRA_FWMARK, std::uint32_t>,
+    Attribute::Field<FRA_FWMASK, std::uint32_t>,
+    Attribute::Field<FRA_SUPPRESS_PREFIXLEN, std::int32_t>,
+    Attribute::Field<FRA_L3MDEV, std::uint8_t>,
+    Attribute::Field<FRA_UID_RANGE, Attribute::Payload>,
+    Attribute::Field<FRA_IP_PROTO, std::uint8_t>,
+    Attribute::Field<FRA_SPORT_RANGE, Attribute::Payload>,
+    Attribute::Field<FRA_DPORT_RANGE, Attribute::Payload>,
+    Attribute::Field<FRA_TUN_ID, std::uint64_t>>;
+using NexthopAttributes = Attribute::Schema<
+    Attribute::Field<NHA_ID, std::uint32_t>,
+    Attribute::Field<NHA_OIF, std::int32_t>,
+    Attribute::Field<NHA_GATEWAY, IpAddress>,
+    Attribute::Field<NHA_GROUP, Attribute::Payload>,
+    Attribute::Field<NHA_BLACKHOLE, Attribute::Payload>>;
+using TrafficControlAttributes = Attribute::Schema<
+    Attribute::Field<TCA_KIND, std::string_view>,
+    Attribute::Field<TCA_STATS2, Attribute::Payload>>;
+// nested in TCA_STATS2
+using StatsAttributes = Attribute::Schema<
+    Attribute::Field<TCA_STATS_BASIC, Attribute::Payload>,
+    Attribute::Field<TCA_STATS_QUEUE, Attribute::Payload>,
+    Attribute::Field<TCA_STATS_PKT64, std::uint64_t>>;
+// clang-format on
+
+void toPrefix(wormhole::sysinfo::Route::Destination& prefix, IpAddress const& address, std::uint8_t length)
+{
+  if (address.is_v4())
+  {
+    prefix.emplace<boost::asio::ip::network_v4>(address.to_v4(), length);
+  }
+  else
+  {
+    prefix.emplace<boost::asio::ip::network_v6>(address.to_v6(), length);
+  }
+}
+
+void appendAttribute(std::vector<char>& buffer, unsigned short type, void const* data, std::size_t length)
+{
+  auto const offset = buffer.size();
+  buffer.resize(offset + RTA_SPACE(length));
+  auto* attribute = reinterpret_cast<struct rtattr*>(buffer.data() + offset);
+  attribute->rta_type = type;
+  attribute->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+  std::memcpy(RTA_DATA(attribute), data, length);
+}
+
+void appendAddress(std::vector<char>& buffer, unsigned short type, IpAddress const& address)
+{
+  if (address.is_v4())
+  {
+    auto const bytes = address.to_v4().to_bytes();
+    appendAttribute(buffer, type, bytes.data(), bytes.size());
+  }
+  else
+  {
+    auto const bytes = address.to_v6().to_bytes();
+    appendAttribute(buffer, type, bytes.data(), bytes.size());
+  }
+}
+
+void appendRouteQuery(std::vector<char>& buffer, wormhole::sysinfo::Netlink::Socket::RouteQuery const& query, std::uint32_t seq, std::uint32_t pid)
+{
+  auto const offset = buffer.size();
+  buffer.resize(offset + NLMSG_SPACE(sizeof(struct rtmsg)));
+  auto const length = static_cast<unsigned char>(query.destination.is_v4() ? 32 : 128);
+  struct rtmsg request{};
+  request.rtm_family = static_cast<unsigned char>(query.destination.is_v4() ? AF_INET : AF_INET6);
+  request.rtm_dst_len = length;
+  request.rtm_flags = RTM_F_FIB_MATCH | RTM_F_LOOKUP_TABLE;
+  appendAddress(buffer, RTA_DST, query.destination);
+  if (!query.source.is_unspecified())
+  {
+    request.rtm_src_len = length;
+    appendAddress(buffer, RTA_SRC, query.source);
+  }
+  if (query.outputInterface.value != 0)
+  {
+    auto const oif = static_cast<std::uint32_t>(query.outputInterface.value);
+    appendAttribute(buffer, RTA_OIF, &oif, sizeof(oif));
+  }
+  if (query.mark != 0)
+  {
+    appendAttribute(buffer, RTA_MARK, &query.mark, sizeof(query.mark));
+  }
+
+  struct nlmsghdr header{};
+  header.nlmsg_len = static_cast<std::uint32_t>(buffer.size() - offset);
+  header.nlmsg_type = RTM_GETROUTE;
+  header.nlmsg_flags = NLM_F_REQUEST;
+  header.nlmsg_seq = seq;
+  header.nlmsg_pid = pid;
+  std::memcpy(buffer.data() + offset, &header, sizeof(header));
+  std::memcpy(buffer.data() + offset + NLMSG_HDRLEN, &request, sizeof(request));
+}
+
+std::size_t combine(std::size_t seed, std::size_t value) noexcept
+{
+  return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+}
+
+std::size_t hashAddress(IpAddress const& address) noexcept
+{
+  if (address.is_v4())
+  {
+    return address.to_v4().to_uint();
+  }
+  std::size_t seed = 0;
+  for (auto byte : address.to_v6().to_bytes())
+  {
+    seed = combine(seed, byte);
+  }
+  return seed;
+}
+
+// objects a multicast event replaces or deletes are identified as the kernel does it
+std::size_t identity(wormhole::sysinfo::Route const& route)
+{
+  auto seed = combine(static_cast<std::size_t>(route.family), static_cast<std::size_t>(route.table));
+  seed = combine(combine(seed, route.priority), route.tos);
+  return std::visit(wormhole::sysinfo::helper::overloaded{[seed](wormhole::sysinfo::Route::Default_t)
+                        {
+                          return seed;
+                        },
+                        [seed](auto const& network)
+                        {
+                          return combine(combine(seed, hashAddress(network.address())), network.prefix_length());
+                        }},
+      route.destination.value);
+}
+
+std::size_t identity(wormhole::sysinfo::Address const& address)
+{
+  return combine(combine(hashAddress(address.address), address.netmask), static_cast<std::size_t>(address.interfaceIndex.value));
+}
+
+std::size_t identity(wormhole::sysinfo::Interface const& link)
+{
+  return static_cast<std::size_t>(link.index.value);
+}
+
+bool sameObject(wormhole::sysinfo::Route const& lhs, wormhole::sysinfo::Route const& rhs)
+{
+  return lhs.family == rhs.family && lhs.table == rhs.table && lhs.priority == rhs.priority && lhs.tos == rhs.tos && lhs.destination == rhs.destination;
+}
+
+bool sameObject(wormhole::sysinfo::Address const& lhs, wormhole::sysinfo::Address const& rhs)
+{
+  return lhs.interfaceIndex == rhs.interfaceIndex && lhs.netmask == rhs.netmask && lhs.address == rhs.address;
+}
+
+bool sameObject(wormhole::sysinfo::Interface const& lhs, wormhole::sysinfo::Interface const& rhs)
+{
+  return lhs.index == rhs.index;
+}
+
+bool ofFamily(wormhole::sysinfo::Route const& route, int family)
+{
+  return family == AF_UNSPEC || route.family == family;
+}
+
+bool ofFamily(wormhole::sysinfo::Address const& address, int family)
+{
+  return family == AF_UNSPEC || (family == AF_INET) == address.address.is_v4();
+}
+
+bool ofFamily(wormhole::sysinfo::Interface const&, int)
+{
+  return true;
+}
+
+// applies the queued events of the dumped kind in order, the last event of an object decides
+template <typename T, typename EVENTS>
+void patchEntries(std::pmr::vector<T>& entries, EVENTS const& events, int family)
+{
+  auto const relevant = [family](auto const& event)
+  {
+    auto const* entry = std::get_if<T>(&event);
+    return entry != nullptr && ofFamily(*entry, family);
+  };
+  if (std::ranges::none_of(events, relevant))
+  {
+    return;
+  }
+
+  std::unordered_multimap<std::size_t, std::size_t> positions;
+  positions.reserve(entries.size());
+  for (std::size_t i = 0; i < entries.size(); ++i)
+  {
+    positions.emplace(identity(entries[i]), i);
+  }
+  std::vector<bool> erased(entries.size(), false);
+  for (auto const& event : events | std::views::filter(relevant))
+  {
+    auto const& entry = std::get<T>(event);
+    auto const key = identity(entry);
+    auto [begin, end] = positions.equal_range(key);
+    auto const found = std::find_if(begin, end, [&](auto const& position)
+        {
+          return !erased[position.second] && sameObject(entries[position.second], entry);
+        });
+    if (entry.action == wormhole::sysinfo::Action::Del)
+    {
+      if (found != end)
+      {
+        erased[found->second] = true;
+      }
+    }
+    else if (found != end)
+    {
+      entries[found->second] = entry;
+    }
+    else
+    {
+      positions.emplace(key, entries.size());
+      entries.push_back(entry);
+      erased.push_back(false);
+    }
+  }
+
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < entries.size(); ++i)
+  {
+    if (!erased[i])
+    {
+      if (kept != i)
+      {
+        entries[kept] = std::move(entries[i]);
+      }
+      ++kept;
+    }
+  }
+  entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(kept), entries.end());
+}
+}  // namespace
+
 namespace wormhole::sysinfo::Netlink
 {
 std::ostream& operator<<(std::ostream& str, Message::Id const& id)
 {
-  fmt::print(str, "{}:{}", id.seq, id.pid);
+  fmt::print(str, "{}", id);
   return str;
 }
 
@@ -45,6 +326,45 @@ Message::Header* Message::GetHeader()
   return &m_header;
 }
 
+std::size_t Message::Size() const
+{
+  return helper::visitOptional(
+      m_request, []()
+      {
+        return std::size_t{0};
+      },
+      [](auto const& item)
+      {
+        return item.Size();
+      });
+}
+
+Message::Allocator Message::GetAllocator() const
+{
+  return helper::visitOptional(
+      m_request, []()
+      {
+        return Allocator{};
+      },
+      [](auto const& item)
+      {
+        return item.GetAllocator();
+      });
+}
+
+DumpArena* Message::GetArena() const
+{
+  return helper::visitOptional(
+      m_request, []() -> DumpArena*
+      {
+        return nullptr;
+      },
+      [](auto const& item) -> DumpArena*
+      {
+        return &item.GetArena();
+      });
+}
+
 Message::Id Message::GetId() const
 {
   return helper::visitOptional(
@@ -58,6 +378,16 @@ Message::Id Message::GetId() const
       });
 }
 
+void Message::SetInterface(Interface::Index index)
+{
+  helper::visitOptional(
+      m_request, []() {},
+      [index](auto& item)
+      {
+        item.SetInterface(index);
+      });
+}
+
 outcome::std_result<Message::ResponseTypes> Message::GetResponse() &&
 {
   return helper::visitOptional(
@@ -71,6 +401,19 @@ outcome::std_result<Message::ResponseTypes> Message::GetResponse() &&
       });
 }
 
+outcome::std_result<Message::ResponseTypes> Message::TakePart()
+{
+  return helper::visitOptional(
+      m_request, []() -> outcome::std_result<ResponseTypes>
+      {
+        return SocketError::MessageTypeMismatch;
+      },
+      [](auto& item) -> outcome::std_result<ResponseTypes>
+      {
+        return item.TakePart();
+      });
+}
+
 outcome::std_result<Socket> Socket::open(std::span<Groups const> groups)
 {
   int nl_sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
@@ -79,36 +422,53 @@ outcome::std_result<Socket> Socket::open(std::span<Groups const> groups)
   {
     return static_cast<errno_errc>(errno);
   }
-  std::uint32_t nlGroups{0};
-  nlGroups = std::accumulate(groups.begin(), groups.end(), nlGroups, [](std::uint32_t g, Groups gs)
+  auto const mask = std::accumulate(groups.begin(), groups.end(), GroupMask{0}, [](GroupMask m, Groups const& group)
       {
-        return g | std::visit([]<std::uint32_t VAL>(RtNlMG<VAL>)
-                       {
-                         return VAL;
-                       },
-                       gs);
+        return m | group_mask(group);
       });
 
-  std::uint32_t pid = static_cast<uint32_t>(getpid());
   sockaddr_nl saddr{};
   saddr.nl_family = AF_NETLINK;
-  saddr.nl_pid = pid;
-  saddr.nl_groups = nlGroups;
+  saddr.nl_pid = 0;  // the kernel picks a free port id, a process may open any number of sockets
+  saddr.nl_groups = static_cast<std::uint32_t>(mask);
 
   /* Bind current process to the netlink socket */
-  if (bind(nl_sock, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) < 0)
+  socklen_t length = sizeof(saddr);
+  if (bind(nl_sock, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) < 0 || getsockname(nl_sock, reinterpret_cast<struct sockaddr*>(&saddr), &length) < 0)
   {
     int err = errno;
     close(nl_sock);
     return static_cast<errno_errc>(err);
   }
 
-  return Socket{nl_sock, pid};
+  Socket socket{nl_sock, saddr.nl_pid, mask & 0xFFFFFFFF};
+  BOOST_OUTCOME_TRY(socket.join_groups(groups));
+  return socket;
 }
 
 Socket::Socket(Socket&& rhs) noexcept
   : m_pid{rhs.m_pid}
+  , m_groups{rhs.m_groups}
   , m_socket{rhs.m_socket}
+  , m_seqNum{rhs.m_seqNum}
+  , m_activeRequest{std::move(rhs.m_activeRequest)}
+  , m_arenas{rhs.m_arenas}
+  , m_buffer{std::move(rhs.m_buffer)}
+  , m_eventBuffer{std::move(rhs.m_eventBuffer)}
+  , m_lookupBuffer{std::move(rhs.m_lookupBuffer)}
+  , m_events{std::move(rhs.m_events)}
+  , m_parts{std::move(rhs.m_parts)}
+  , m_requestStart{rhs.m_requestStart}
+  , m_nexthops{std::move(rhs.m_nexthops)}
+  , m_metrics{std::move(rhs.m_metrics)}
+  , m_retryPolicy{rhs.m_retryPolicy}
+  , m_retry{rhs.m_retry}
+  , m_budget{std::move(rhs.m_budget)}
+  , m_eventsLost{rhs.m_eventsLost}
+  , m_timestamps{rhs.m_timestamps}
+  , m_received{rhs.m_received}
+  , m_timestamp{rhs.m_timestamp}
+  , m_names{std::move(rhs.m_names)}
 {
   rhs.m_socket = -1;
 }
@@ -117,11 +477,42 @@ Socket& Socket::operator=(Socket&& rhs) noexcept
 {
   if (this != std::addressof(rhs))
   {
+    std::swap(m_pid, rhs.m_pid);
+    std::swap(m_groups, rhs.m_groups);
     std::swap(m_socket, rhs.m_socket);
+    std::swap(m_seqNum, rhs.m_seqNum);
+    std::swap(m_activeRequest, rhs.m_activeRequest);
+    std::swap(m_arenas, rhs.m_arenas);
+    std::swap(m_buffer, rhs.m_buffer);
+    std::swap(m_eventBuffer, rhs.m_eventBuffer);
+    std::swap(m_lookupBuffer, rhs.m_lookupBuffer);
+    std::swap(m_events, rhs.m_events);
+    std::swap(m_parts, rhs.m_parts);
+    std::swap(m_requestStart, rhs.m_requestStart);
+    std::swap(m_nexthops, rhs.m_nexthops);
+    std::swap(m_metrics, rhs.m_metrics);
+    std::swap(m_retryPolicy, rhs.m_retryPolicy);
+    std::swap(m_retry, rhs.m_retry);
+    std::swap(m_budget, rhs.m_budget);
+    std::swap(m_eventsLost, rhs.m_eventsLost);
+    std::swap(m_timestamps, rhs.m_timestamps);
+    std::swap(m_received, rhs.m_received);
+    std::swap(m_timestamp, rhs.m_timestamp);
+    std::swap(m_names, rhs.m_names);
   }
   return *this;
 }
 
+NexthopStore& Socket::nexthops() noexcept
+{
+  return m_nexthops;
+}
+
+NexthopStore const& Socket::nexthops() const noexcept
+{
+  return m_nexthops;
+}
+
 Socket::~Socket()
 {
   if (m_socket >= 0)
@@ -132,6 +523,71 @@ Socket::~Socket()
 
 outcome::std_result<Message::ResponseTypes> Socket::receive(ReceiveMode receiveMode)
 {
+  if (!m_parts.empty())
+  {
+    return pop(m_parts);
+  }
+  if (m_activeRequest)
+  {
+    return receiveDump(receiveMode);
+  }
+  if (std::exchange(m_eventsLost, false))
+  {
+    return static_cast<errno_errc>(ENOBUFS);
+  }
+  if (!m_events.empty())
+  {
+    return pop(m_events);
+  }
+  return receiveEvents(receiveMode);
+}
+
+void Socket::set_timestamps(bool enable) noexcept
+{
+  m_timestamps = enable;
+}
+
+Metrics::Clock::time_point Socket::timestamp() const noexcept
+{
+  return m_timestamp;
+}
+
+void Socket::stamp() noexcept
+{
+  m_received = m_timestamps ? Metrics::Clock::now() : Metrics::Clock::time_point{};
+}
+
+Message::ResponseTypes Socket::pop(std::deque<Queued>& queue)
+{
+  auto queued = std::move(queue.front());
+  queue.pop_front();
+  m_timestamp = queued.received;
+  return std::move(queued.value);
+}
+
+void Socket::set_retry_policy(RetryPolicy policy) noexcept
+{
+  m_retryPolicy = policy;
+}
+
+void Socket::set_memory_budget(MemoryBudget budget)
+{
+  m_budget = std::move(budget);
+}
+
+outcome::std_result<Message::ResponseTypes> Socket::receiveDump(ReceiveMode receiveMode)
+{
+  if (m_retry.waiting)
+  {
+    if (receiveMode == ReceiveMode::Nonblock && Metrics::Clock::now() < m_retry.resendAt)
+    {
+      return static_cast<errno_errc>(EAGAIN);
+    }
+    std::this_thread::sleep_until(m_retry.resendAt);
+    m_retry.waiting = false;
+    BOOST_OUTCOME_TRY(send(m_retry.make(m_arenas, m_retry.family, m_retry.interface, ++m_seqNum, m_pid)));
+  }
+
   Message::SockAddressNl nladdr{};
   std::array<Message::IoVec, 1> iov{{}};
   Message::Header msg_header{};
@@ -140,113 +596,611 @@ outcome::std_result<Message::ResponseTypes> Socket::receive(ReceiveMode receiveM
   msg_header.msg_iov = iov.data();
   msg_header.msg_iovlen = iov.size();
 
-  std::optional<Message::ResponseTypes> response;
-  do
+  for (;;)
+  {
+    iov[0].iov_base = nullptr;
+    iov[0].iov_len = 0;
+    int flags = MSG_PEEK | MSG_TRUNC;
+    if (receiveMode == ReceiveMode::Nonblock)
+    {
+      flags |= MSG_DONTWAIT;
+    }
+    ssize_t len = recvmsg(m_socket, &msg_header, flags);
+    if (len < 0)
+    {
+      return receiveError(errno);
+    }
+
+    auto& buffer = m_buffer;
+    buffer.resize(static_cast<size_t>(len));
+
+    iov[0].iov_base = buffer.data();
+    iov[0].iov_len = static_cast<size_t>(len);
+
+    auto receiveStart = Metrics::now();
+    len = recvmsg(m_socket, &msg_header, 0);
+    stamp();
+    m_metrics->receiveLatency(receiveStart);
+    if (len < 0)
+    {
+      return receiveError(errno);
+    }
+    buffer.resize(static_cast<size_t>(len));
+    m_metrics->datagram(buffer.size());
+
+    auto* nlHeader = reinterpret_cast<struct nlmsghdr*>(buffer.data());
+    auto nlHeaderLen = buffer.size();
+    WORMHOLE_SYSINFO_PROBE3(datagram, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, nlHeaderLen);
+
+    auto const active = m_activeRequest->GetId();
+    for (; NLMSG_OK(nlHeader, nlHeaderLen); nlHeader = NLMSG_NEXT(nlHeader, nlHeaderLen))
+    {
+      m_metrics->message(nlHeader->nlmsg_type);
+      bool const ours = nlHeader->nlmsg_pid == m_pid;
+      if (ours && nlHeader->nlmsg_seq != active.seq)
+      {
+        continue;  // rest of an abandoned attempt
+      }
+      if (ours && (nlHeader->nlmsg_flags & NLM_F_DUMP_INTR) && !m_retry.interrupted)
+      {
+        m_retry.interrupted = true;
+        m_metrics->dumpInterrupted();
+        WORMHOLE_SYSINFO_PROBE3(error, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, static_cast<int>(SocketError::Interrupted));
+      }
+      if (nlHeader->nlmsg_type == NLMSG_DONE)
+      {
+        BOOST_OUTCOME_TRY(auto response, finishDump(*nlHeader, receiveMode));
+        if (m_parts.empty())
+        {
+          m_timestamp = m_received;
+          return response;
+        }
+        m_parts.push_back({std::move(response), m_received});
+        return receive(receiveMode);
+      }
+      if (nlHeader->nlmsg_type == NLMSG_ERROR)
+      {
+        WORMHOLE_SYSINFO_PROBE3(error, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, static_cast<int>(SocketError::Error));
+        PopRequest(active);
+        m_parts.clear();
+        return SocketError::Error;
+      }
+      if (nlHeader->nlmsg_type == NLMSG_NOOP)
+      {
+        return SocketError::Noop;
+      }
+      if (ours && ((m_retry.interrupted && !patchable()) || m_retry.overBudget))
+      {
+        continue;  // going to be dumped again or dropped, not worth parsing
+      }
+
+      auto parseStart = Metrics::now();
+      auto event = dispatch(*nlHeader);
+      m_metrics->parseTime(parseStart);
+      if (!event)
+      {
+        m_metrics->parseError();
+        WORMHOLE_SYSINFO_PROBE3(error, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, event.error().value());
+        return event.error();
+      }
+      if (event.value())
+      {
+        m_events.push_back({std::move(*event.value()), m_received});
+      }
+      else if (ours)
+      {
+        BOOST_OUTCOME_TRY(enforceBudget());
+      }
+    }
+    if (!m_parts.empty())
+    {
+      return receive(receiveMode);
+    }
+  }
+}
+
+outcome::std_result<Message::ResponseTypes> Socket::finishDump(struct nlmsghdr& header, ReceiveMode receiveMode)
+{
+  if (m_retry.overBudget)
+  {
+    recordMemory();
+    PopRequest(m_activeRequest->GetId());
+    return SocketError::OverBudget;
+  }
+  if (!m_retry.interrupted)
+  {
+    recordMemory();
+    return HandleDone(header);
+  }
+  if (patchable())
+  {
+    recordMemory();
+    BOOST_OUTCOME_TRY(auto response, HandleDone(header));
+    if (m_retry.streamed)
+    {
+      return response;  // the events follow it
+    }
+    patch(response);
+    m_metrics->dumpPatched();
+    return response;
+  }
+
+  if (m_retry.streamed || ++m_retry.attempt >= m_retryPolicy.attempts)
+  {
+    recordMemory();
+    PopRequest(m_activeRequest->GetId());
+    m_parts.clear();
+    return SocketError::Interrupted;
+  }
+  m_metrics->dumpRestarted();
+  m_retry.backoff = m_retry.attempt == 1 ? m_retryPolicy.backoff : std::min(m_retry.backoff * 2, m_retryPolicy.maxBackoff);
+  m_retry.resendAt = Metrics::Clock::now() + m_retry.backoff;
+  m_retry.waiting = true;
+  m_retry.interrupted = false;
+  m_retry.lostEvents = false;
+  return receiveDump(receiveMode);
+}
+
+outcome::std_result<void> Socket::enforceBudget()
+{
+  auto* arena = m_activeRequest->GetArena();
+  if (m_budget.bytes == 0 || arena == nullptr || arena->used() <= m_budget.bytes)
+  {
+    return outcome::success();
+  }
+  switch (m_budget.overflow)
+  {
+    case MemoryBudget::Overflow::Spill:
+      if (!arena->spilling())
+      {
+        if (auto spilled = arena->spill(m_budget.directory); !spilled)
+        {
+          m_retry.overBudget = true;  // no place to spill to, fail instead
+          return spilled.error();
+        }
+      }
+      break;
+    case MemoryBudget::Overflow::Stream:
+    {
+      m_retry.peak = std::max(m_retry.peak, arena->used());
+      m_retry.streamed = true;
+      BOOST_OUTCOME_TRY(auto part, m_activeRequest->TakePart());
+      m_parts.push_back({std::move(part), m_received});
+      break;
+    }
+    case MemoryBudget::Overflow::Fail:
+      m_retry.overBudget = true;
+      break;
+  }
+  return outcome::success();
+}
+
+void Socket::recordMemory() noexcept
+{
+  if (auto const* arena = m_activeRequest->GetArena(); arena != nullptr)
+  {
+    m_retry.peak = std::max(m_retry.peak, arena->used());
+    if (arena->spilling())
+    {
+      m_metrics->dumpSpilled();
+    }
+  }
+  m_metrics->dumpMemory(m_retry.peak);
+}
+
+void Socket::patch(Message::ResponseTypes& response) const
+{
+  std::visit(helper::overloaded{[this](auto& dump)
+                 requires requires { dump.data; }
+                 {
+                   if constexpr (requires { identity(dump.data.front()); })
+                   {
+                     patchEntries(dump.data, m_events | std::views::transform(&Queued::value), m_retry.family);
+                   }
+                 },
+                 [](auto&)
+                 {
+                 }},
+      response);
+}
+
+bool Socket::patchable() const noexcept
+{
+  return m_retryPolicy.mode == RetryPolicy::Mode::Patch && m_retry.groups != 0 && (m_groups & m_retry.groups) == m_retry.groups && !m_retry.lostEvents;
+}
+
+outcome::std_result<Message::ResponseTypes> Socket::receiveEvents(ReceiveMode receiveMode)
+{
+  m_eventBuffer.resize(EventBatch * EventDatagramSize);
+  std::array<Message::IoVec, EventBatch> iov;
+  std::array<struct mmsghdr, EventBatch> headers{};
+  for (std::size_t i = 0; i < EventBatch; ++i)
+  {
+    iov[i].iov_base = m_eventBuffer.data() + i * EventDatagramSize;
+    iov[i].iov_len = EventDatagramSize;
+    headers[i].msg_hdr.msg_iov = &iov[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  bool truncated = false;
+  while (m_events.empty() && !truncated)
+  {
+    auto receiveStart = Metrics::now();
+    int count = recvmmsg(m_socket, headers.data(), EventBatch, receiveMode == ReceiveMode::Wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+    stamp();
+    m_metrics->receiveLatency(receiveStart);
+    if (count < 0)
+    {
+      return receiveError(errno);
+    }
+
+    for (auto const& header : std::span{headers}.first(static_cast<std::size_t>(count)))
+    {
+      auto* nlHeader = static_cast<struct nlmsghdr*>(header.msg_hdr.msg_iov->iov_base);
+      std::size_t nlHeaderLen = header.msg_len;
+      m_metrics->datagram(nlHeaderLen);
+      WORMHOLE_SYSINFO_PROBE3(datagram, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, nlHeaderLen);
+      if (header.msg_hdr.msg_flags & MSG_TRUNC)
+      {
+        m_metrics->parseError();
+        WORMHOLE_SYSINFO_PROBE3(error, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, static_cast<int>(SocketError::Truncated));
+        truncated = true;
+        continue;
+      }
+      // a message that does not parse costs only itself, the rest of the batch is still delivered
+      for (; NLMSG_OK(nlHeader, nlHeaderLen); nlHeader = NLMSG_NEXT(nlHeader, nlHeaderLen))
+      {
+        m_metrics->message(nlHeader->nlmsg_type);
+        auto parseStart = Metrics::now();
+        auto event = dispatch(*nlHeader);
+        m_metrics->parseTime(parseStart);
+        if (!event)
+        {
+          m_metrics->parseError();
+          WORMHOLE_SYSINFO_PROBE3(error, nlHeader->nlmsg_seq, nlHeader->nlmsg_type, event.error().value());
+          continue;
+        }
+        if (event.value())
+        {
+          m_events.push_back({std::move(*event.value()), m_received});
+        }
+      }
+    }
+  }
+
+  if (truncated)
+  {
+    return SocketError::Truncated;
+  }
+  return pop(m_events);
+}
+
+outcome::std_result<void> Socket::get_routes(std::span<RouteQuery const> queries, std::span<outcome::std_result<Route>> results)
+{
+  if (m_activeRequest)
+  {
+    return make_error_code(SocketError::Busy);
+  }
+  if (results.size() < queries.size())
+  {
+    return static_cast<errno_errc>(EINVAL);
+  }
+
+  int receiveBuffer = 0;
+  socklen_t length = sizeof(receiveBuffer);
+  if (getsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, &length) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  // a reply takes about a KiB of the receive buffer, more in flight get dropped
+  auto window = std::clamp<std::size_t>(static_cast<std::size_t>(receiveBuffer) / 1024, 1, LookupWindow);
+
+  m_eventBuffer.resize(EventBatch * EventDatagramSize);
+  std::array<Message::IoVec, EventBatch> iov;
+  std::array<struct mmsghdr, EventBatch> headers{};
+  for (std::size_t i = 0; i < EventBatch; ++i)
+  {
+    iov[i].iov_base = m_eventBuffer.data() + i * EventDatagramSize;
+    iov[i].iov_len = EventDatagramSize;
+    headers[i].msg_hdr.msg_iov = &iov[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  std::vector<std::size_t> todo(queries.size());
+  std::iota(todo.begin(), todo.end(), std::size_t{0});
+  std::vector<bool> answered;
+  for (std::size_t next = 0; next < todo.size();)
+  {
+    auto const count = std::min(window, todo.size() - next);
+    auto const first = m_seqNum + 1;
+    m_lookupBuffer.clear();
+    for (auto index : std::span{todo}.subspan(next, count))
+    {
+      appendRouteQuery(m_lookupBuffer, queries[index], ++m_seqNum, m_pid);
+    }
+
+    Message::SockAddressNl kernel{};
+    kernel.nl_family = AF_NETLINK;
+    Message::IoVec request{m_lookupBuffer.data(), m_lookupBuffer.size()};
+    Message::Header header{.msg_name = &kernel, .msg_namelen = sizeof(kernel), .msg_iov = &request, .msg_iovlen = 1, .msg_control = nullptr, .msg_controllen = 0, .msg_flags = 0};
+    if (sendmsg(m_socket, &header, 0) < 0)
+    {
+      return static_cast<errno_errc>(errno);
+    }
+
+    answered.assign(count, false);
+    std::size_t pending = count;
+    bool overrun = false;
+    while (pending > 0)
+    {
+      auto receiveStart = Metrics::now();
+      int received = recvmmsg(m_socket, headers.data(), EventBatch, overrun ? MSG_DONTWAIT : MSG_WAITFORONE, nullptr);
+      stamp();
+      m_metrics->receiveLatency(receiveStart);
+      if (received < 0)
+      {
+        if (errno == ENOBUFS)
+        {
+          // replies were dropped, collect the rest and ask again for the missing ones;
+          // multicast events went with them, which the kernel reports only this once
+          m_metrics->noBuffers();
+          overrun = true;
+          m_eventsLost = m_eventsLost || m_groups != 0;
+          continue;
+        }
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        if (errno == EAGAIN && overrun)
+        {
+          break;
+        }
+        return receiveError(errno).error();
+      }
+
+      for (auto const& datagram : std::span{headers}.first(static_cast<std::size_t>(received)))
+      {
+        auto* nlHeader = static_cast<struct nlmsghdr*>(datagram.msg_hdr.msg_iov->iov_base);
+        std::size_t nlHeaderLen = datagram.msg_len;
+        m_metrics->datagram(nlHeaderLen);
+        for (; NLMSG_OK(nlHeader, nlHeaderLen); nlHeader = NLMSG_NEXT(nlHeader, nlHeaderLen))
+        {
+          m_metrics->message(nlHeader->nlmsg_type);
+          if (nlHeader->nlmsg_pid != m_pid)
+          {
+            auto event = dispatch(*nlHeader);
+            if (!event)
+            {
+              m_metrics->parseError();
+              continue;
+            }
+            if (event.value())
+            {
+              m_events.push_back({std::move(*event.value()), m_received});
+            }
+            continue;
+          }
+          auto const slot = nlHeader->nlmsg_seq - first;
+          if (nlHeader->nlmsg_seq < first || slot >= count || answered[slot])
+          {
+            continue;  // reply to a round that overran
+          }
+          auto& result = results[todo[next + slot]];
+          if (nlHeader->nlmsg_type == NLMSG_ERROR)
+          {
+            auto const* error = static_cast<struct nlmsgerr const*>(NLMSG_DATA(nlHeader));
+            result = error->error != 0 ? make_error_code(static_cast<errno_errc>(-error->error)) : make_error_code(SocketError::Error);
+          }
+          else if (nlHeader->nlmsg_type == RTM_NEWROUTE)
+          {
+            auto parseStart = Metrics::now();
+            result = parse_route(*nlHeader, *static_cast<struct rtmsg*>(NLMSG_DATA(nlHeader)));
+            m_metrics->parseTime(parseStart);
+          }
+          else
+          {
+            continue;
+          }
+          answered[slot] = true;
+          --pending;
+        }
+      }
+    }
+
+    if (pending == 0)
+    {
+      next += count;
+      continue;
+    }
+    window = std::max<std::size_t>(window / 2, 1);
+    std::vector<std::size_t> missing;
+    for (std::size_t slot = 0; slot < count; ++slot)
+    {
+      if (!answered[slot])
+      {
+        missing.push_back(todo[next + slot]);
+      }
+    }
+    std::ranges::copy(missing, todo.begin() + static_cast<std::ptrdiff_t>(next + count - missing.size()));
+    next += count - missing.size();
+  }
+  return outcome::success();
+}
+
+int Socket::native_handle() const noexcept
+{
+  return m_socket;
+}
+
+std::uint32_t Socket::port_id() const noexcept
+{
+  return m_pid;
+}
+
+std::optional<Metrics::Clock::time_point> Socket::resend_at() const noexcept
+{
+  if (m_retry.waiting)
+  {
+    return m_retry.resendAt;
+  }
+  return std::nullopt;
+}
+
+outcome::std_result<void> Socket::set_receive_buffer(int bytes)
+{
+  if (setsockopt(m_socket, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) == 0)
+  {
+    return outcome::success();
+  }
+  if (setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  return outcome::success();
+}
+
+outcome::std_result<void> Socket::join_groups(std::span<Groups const> groups)
+{
+  for (auto const& group : groups)
   {
-    iov[0].iov_base = nullptr;
-    iov[0].iov_len = 0;
-    int flags = MSG_PEEK | MSG_TRUNC;
-    if (receiveMode == ReceiveMode::Nonblock)
-    {
-      flags |= MSG_DONTWAIT;
-    }
-    ssize_t len = recvmsg(m_socket, &msg_header, flags);
-    if (len < 0)
+    if ((m_groups & group_mask(group)) != 0)
     {
-      return static_cast<errno_errc>(errno);
+      continue;
     }
-
-    std::vector<char> buffer;
-    buffer.resize(static_cast<size_t>(len));
-
-    iov[0].iov_base = buffer.data();
-    iov[0].iov_len = static_cast<size_t>(len);
-
-    len = recvmsg(m_socket, &msg_header, 0);
-    if (len < 0)
+    int const number = std::countr_zero(group_mask(group)) + 1;
+    if (setsockopt(m_socket, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &number, sizeof(number)) < 0)
     {
       return static_cast<errno_errc>(errno);
     }
-    buffer.resize(static_cast<size_t>(len));
-
-    auto* nlHeader = reinterpret_cast<struct nlmsghdr*>(buffer.data());
-    auto nlHeaderLen = buffer.size();
+    m_groups |= group_mask(group);
+  }
+  return outcome::success();
+}
 
-    if (nlHeader->nlmsg_flags & NLM_F_DUMP_INTR)
+outcome::std_result<void> Socket::leave_groups(std::span<Groups const> groups)
+{
+  for (auto const& group : groups)
+  {
+    if ((m_groups & group_mask(group)) == 0)
     {
-      return SocketError::Interrupted;
+      continue;
     }
-    if (nlHeader->nlmsg_type == NLMSG_ERROR)
+    int const number = std::countr_zero(group_mask(group)) + 1;
+    if (setsockopt(m_socket, SOL_NETLINK, NETLINK_DROP_MEMBERSHIP, &number, sizeof(number)) < 0)
     {
-      return SocketError::Error;
+      return static_cast<errno_errc>(errno);
     }
-    if (nlHeader->nlmsg_type == NLMSG_NOOP)
+    m_groups &= ~group_mask(group);
+    if (group_mask(group) == group_mask(GroupLink{}))
     {
-      return SocketError::Noop;
+      m_names.clear();
     }
-    if (nlHeader->nlmsg_type == NLMSG_DONE)
+    // events of the dump were missed, it can't be patched any more
+    if (m_activeRequest && (m_retry.groups & group_mask(group)) != 0)
     {
-      return HandleDone(*nlHeader);
+      m_retry.lostEvents = true;
     }
-    for (; NLMSG_OK(nlHeader, nlHeaderLen); nlHeader = NLMSG_NEXT(nlHeader, nlHeaderLen))
+  }
+  return outcome::success();
+}
+
+Socket::GroupMask Socket::groups() const noexcept
+{
+  return m_groups;
+}
+
+bool Socket::joined(Groups const& group) const noexcept
+{
+  return (m_groups & group_mask(group)) != 0;
+}
+
+Socket::Socket(int t_socket, std::uint32_t t_pid, GroupMask t_groups)
+  : m_pid{t_pid}
+  , m_groups{t_groups}
+  , m_socket{t_socket}
+  , m_metrics{std::make_unique<Metrics>()}
+{
+}
+
+Metrics::Snapshot Socket::metrics() const noexcept
+{
+  return m_metrics ? m_metrics->snapshot() : Metrics::Snapshot{};
+}
+
+outcome::std_result<std::optional<Message::ResponseTypes>> Socket::dispatch(struct nlmsghdr& header)
+{
+  auto lift = [](auto&& event) -> outcome::std_result<std::optional<Message::ResponseTypes>>
+  {
+    BOOST_OUTCOME_TRY(auto item, std::move(event));
+    if (item)
     {
-      if (nlHeader->nlmsg_type == NLMSG_DONE)
-      {
-        if (response)
-        {
-          return std::move(*response);
-        }
-        return HandleDone(*nlHeader);
-      }
-      if (nlHeader->nlmsg_type == RTM_NEWROUTE || nlHeader->nlmsg_type == RTM_DELROUTE)
-      {
-        auto& rtMsg = *reinterpret_cast<struct rtmsg*>(NLMSG_DATA(nlHeader));
-        BOOST_OUTCOME_TRY(auto r, HandleRoute(*nlHeader, rtMsg));
-        if (r && !response)
-        {
-          response.emplace(std::move(*r));
-        }
-        continue;
-      }
-      else if (nlHeader->nlmsg_type == RTM_NEWADDR || nlHeader->nlmsg_type == RTM_DELADDR)
-      {
-        auto& ifAddrMsg = *reinterpret_cast<struct ifaddrmsg*>(NLMSG_DATA(nlHeader));
-        BOOST_OUTCOME_TRY(auto a, HandleAddress(*nlHeader, ifAddrMsg));
-        if (a && !response)
-        {
-          response.emplace(std::move(*a));
-        }
-        continue;
-      }
-      else if (nlHeader->nlmsg_type == RTM_NEWLINK || nlHeader->nlmsg_type == RTM_DELLINK)
-      {
-        auto& ifLinkMsg = *reinterpret_cast<struct ifinfomsg*>(NLMSG_DATA(nlHeader));
-        BOOST_OUTCOME_TRY(auto l, HandleLink(*nlHeader, ifLinkMsg));
-        if (l && !response)
-        {
-          response.emplace(std::move(*l));
-        }
-        continue;
-      }
+      return Message::ResponseTypes{std::move(*item)};
     }
-  } while (m_activeRequest);
+    return std::nullopt;
+  };
+  switch (header.nlmsg_type)
+  {
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+      WORMHOLE_SYSINFO_PROBE3(route, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleRoute(header, *reinterpret_cast<struct rtmsg*>(NLMSG_DATA(&header))));
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+      WORMHOLE_SYSINFO_PROBE3(address, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleAddress(header, *reinterpret_cast<struct ifaddrmsg*>(NLMSG_DATA(&header))));
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+      WORMHOLE_SYSINFO_PROBE3(link, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleLink(header, *reinterpret_cast<struct ifinfomsg*>(NLMSG_DATA(&header))));
+    case RTM_NEWRULE:
+    case RTM_DELRULE:
+      WORMHOLE_SYSINFO_PROBE3(rule, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleRule(header, *reinterpret_cast<struct fib_rule_hdr*>(NLMSG_DATA(&header))));
+    case RTM_NEWNEXTHOP:
+    case RTM_DELNEXTHOP:
+      WORMHOLE_SYSINFO_PROBE3(nexthop, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleNexthop(header, *reinterpret_cast<struct nhmsg*>(NLMSG_DATA(&header))));
+    case RTM_NEWQDISC:
+    case RTM_DELQDISC:
+      WORMHOLE_SYSINFO_PROBE3(qdisc, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleTrafficControl<Qdisc, Message::QdiscRequest>(header, *reinterpret_cast<struct tcmsg*>(NLMSG_DATA(&header))));
+    case RTM_NEWTCLASS:
+    case RTM_DELTCLASS:
+      WORMHOLE_SYSINFO_PROBE3(tclass, header.nlmsg_seq, header.nlmsg_type, header.nlmsg_len);
+      return lift(HandleTrafficControl<TrafficClass, Message::TrafficClassRequest>(header, *reinterpret_cast<struct tcmsg*>(NLMSG_DATA(&header))));
+  }
+  return std::nullopt;
+}
 
-  if (response)
+Message::Allocator Socket::allocatorFor(struct nlmsghdr const& header) const
+{
+  if (header.nlmsg_pid == m_pid && m_activeRequest && m_activeRequest->GetId() == Message::Id{header.nlmsg_seq, header.nlmsg_pid})
   {
-    return std::move(*response);
+    return m_activeRequest->GetAllocator();
   }
-  return SocketError::Error;
+  return {};
 }
 
-Socket::Socket(int t_socket, std::uint32_t t_pid)
-  : m_pid{t_pid}
-  , m_socket{t_socket}
+outcome::std_result<Message::ResponseTypes> Socket::receiveError(int error)
 {
+  WORMHOLE_SYSINFO_PROBE3(error, 0, 0, error);
+  if (error == ENOBUFS)
+  {
+    m_metrics->noBuffers();
+    m_retry.lostEvents = m_activeRequest != nullptr;
+  }
+  return static_cast<errno_errc>(error);
 }
 
 outcome::std_result<Message::Id> Socket::send(std::unique_ptr<Message> msgPtr)
 {
+  if (!joined(GroupLink{}))
+  {
+    m_names.clear();  // nothing told us about renames since the last dump
+  }
   m_activeRequest = std::move(msgPtr);
+  m_requestStart = Metrics::now();
   auto currentId = m_activeRequest->GetId();
   ssize_t sent = sendmsg(m_socket, m_activeRequest->GetHeader(), 0);
 
@@ -257,18 +1211,37 @@ outcome::std_result<Message::Id> Socket::send(std::unique_ptr<Message> msgPtr)
   return currentId;
 }
 
-outcome::std_result<Route> Socket::parse_route(struct nlmsghdr& header, struct rtmsg& rtMsg)
+InterfaceName Socket::interfaceName(std::uint32_t index)
 {
-  auto rtLen = RTM_PAYLOAD(&header);
-  auto tb = parse_rtattr<RTA_MAX>(RTM_RTA(&rtMsg), rtLen);
-
-  auto table = rtm_get_table<RTA_MAX>(rtMsg, tb);
+  // kept current by link events, without them it lasts for one dump
+  bool const cached = index < MaxCachedIndex && (m_activeRequest || joined(GroupLink{}));
+  if (cached && index < m_names.size() && !m_names[index].empty())
+  {
+    return m_names[index];
+  }
+  std::array<char, IF_NAMESIZE> buffer;
+  InterfaceName name;
+  if (auto const* found = if_indextoname(index, buffer.data()); found)
+  {
+    name = std::string_view{found};
+  }
+  if (cached)
+  {
+    m_names.resize(std::max<std::size_t>(m_names.size(), index + 1));
+    m_names[index] = name;
+  }
+  return name;
+}
 
+outcome::std_result<Route> Socket::parse_route(struct nlmsghdr& header, struct rtmsg& rtMsg)
+{
   if (rtMsg.rtm_family != AF_INET && rtMsg.rtm_family != AF_INET6)
   {
     return SocketError::InvalidFamily;
   }
 
+  auto tb = RouteAttributes::decode(Attribute::attributes<struct rtmsg>(header));
+
   Route entry;
   entry.action = [&header]()
   {
@@ -282,46 +1255,49 @@ outcome::std_result<Route> Socket::parse_route(struct nlmsghdr& header, struct r
     }
     return Action::Unknown;
   }();
-  entry.table = [&table]()
+  entry.family = rtMsg.rtm_family;
+  entry.table = static_cast<Route::Table>(tb.get<RTA_TABLE>().value_or(rtMsg.rtm_table));
+  entry.type = static_cast<Route::Type>(rtMsg.rtm_type);
+  entry.tos = rtMsg.rtm_tos;
+
+  if (auto const& dst = tb.get<RTA_DST>(); dst)
   {
-    switch (table)
-    {
-      case RT_TABLE_MAIN:
-        return Route::Table::Main;
-      case RT_TABLE_LOCAL:
-        return Route::Table::Local;
-    }
-    return Route::Table::Default;
-  }();
+    toPrefix(entry.destination, *dst, rtMsg.rtm_dst_len);
+  }
 
-  if (tb[RTA_DST])
+  if (auto const& gateway = tb.get<RTA_GATEWAY>(); gateway)
   {
-    if (rtMsg.rtm_family == AF_INET)
-    {
-      entry.destination.emplace<boost::asio::ip::network_v4>(Address::convertAddress(rtMsg.rtm_family, RTA_DATA(tb[RTA_DST])).to_v4(), rtMsg.rtm_dst_len);
-    }
-    else if (rtMsg.rtm_family == AF_INET6)
-    {
-      entry.destination.emplace<boost::asio::ip::network_v6>(Address::convertAddress(rtMsg.rtm_family, RTA_DATA(tb[RTA_DST])).to_v6(), rtMsg.rtm_dst_len);
-    }
+    entry.gateway = *gateway;
   }
 
-  if (tb[RTA_GATEWAY])
+  if (auto const& oif = tb.get<RTA_OIF>(); oif)
   {
-    entry.gateway = Address::convertAddress(rtMsg.rtm_family, RTA_DATA(tb[RTA_GATEWAY]));
+    entry.interfaceIndex = Interface::Index{static_cast<int>(*oif)};
+    entry.interfaceName = interfaceName(*oif);
   }
 
-  if (tb[RTA_OIF])
+  if (auto const& priority = tb.get<RTA_PRIORITY>(); priority)
   {
-    char if_nam_buf[IF_NAMESIZE];
-    unsigned int ifidx = *reinterpret_cast<uint32_t*>(RTA_DATA(tb[RTA_OIF]));
+    entry.priority = *priority;
+  }
 
-    entry.interfaceName = if_indextoname(ifidx, if_nam_buf);
+  if (auto const& nhid = tb.get<RTA_NH_ID>(); nhid)
+  {
+    entry.nexthopId = *nhid;
+  }
+  // with nexthop_compat_mode 1, the default, a route on a nexthop object comes with its paths as well
+  if (auto const& multipath = tb.get<RTA_MULTIPATH>(); multipath)
+  {
+    entry.nexthops = parse_multipath(*multipath);
+  }
+  else if (entry.nexthopId != 0 && entry.interfaceIndex.value == 0)
+  {
+    entry.nexthops = m_nexthops.find(entry.nexthopId);  // as far as the socket has seen the object
   }
 
-  if (tb[RTA_SRC])
+  if (auto const& src = tb.get<RTA_SRC>(); src)
   {
-    entry.source = Address::convertAddress(rtMsg.rtm_family, RTA_DATA(tb[RTA_SRC]));
+    entry.source = *src;
   }
 
   return entry;
@@ -329,8 +1305,7 @@ outcome::std_result<Route> Socket::parse_route(struct nlmsghdr& header, struct r
 
 outcome::std_result<Address> Socket::parse_address(struct nlmsghdr& header, struct ifaddrmsg& msg)
 {
-  auto rtLen = IFA_PAYLOAD(&header);
-  auto tb = parse_rtattr<IFA_MAX>(IFA_RTA(&msg), rtLen);
+  auto tb = AddressAttributes::decode(Attribute::attributes<struct ifaddrmsg>(header));
 
   Address entry;
   entry.action = [&header]()
@@ -346,6 +1321,7 @@ outcome::std_result<Address> Socket::parse_address(struct nlmsghdr& header, stru
     return Action::Unknown;
   }();
   entry.netmask = msg.ifa_prefixlen;
+  entry.interfaceIndex = Interface::Index{static_cast<int>(msg.ifa_index)};
   entry.scope = [](std::uint32_t scope)
   {
     switch (scope)
@@ -365,19 +1341,19 @@ outcome::std_result<Address> Socket::parse_address(struct nlmsghdr& header, stru
     return Scope::Unknown;
   }(msg.ifa_scope);
 
-  if (tb[IFA_ADDRESS])
+  if (auto const& address = tb.get<IFA_ADDRESS>(); address)
   {
-    entry.address = Address::convertAddress(msg.ifa_family, RTA_DATA(tb[IFA_ADDRESS]));
+    entry.address = *address;
   }
 
-  if (tb[IFA_LOCAL])
+  if (auto const& local = tb.get<IFA_LOCAL>(); local)
   {
-    entry.local = Address::convertAddress(msg.ifa_family, RTA_DATA(tb[IFA_LOCAL]));
+    entry.local = *local;
   }
 
-  if (tb[IFA_BROADCAST])
+  if (auto const& broadcast = tb.get<IFA_BROADCAST>(); broadcast)
   {
-    entry.broadcast = Address::convertAddress(msg.ifa_family, RTA_DATA(tb[IFA_BROADCAST]));
+    entry.broadcast = *broadcast;
   }
 
   return entry;
@@ -385,8 +1361,7 @@ outcome::std_result<Address> Socket::parse_address(struct nlmsghdr& header, stru
 
 outcome::std_result<Interface> Socket::parse_link(struct nlmsghdr& header, struct ifinfomsg& msg)
 {
-  auto rtLen = IFLA_PAYLOAD(&header);
-  auto tb = parse_rtattr<IFLA_MAX>(IFLA_RTA(&msg), rtLen);
+  auto tb = LinkAttributes::decode(Attribute::attributes<struct ifinfomsg>(header));
 
   Interface entry;
   entry.action = [&header]()
@@ -403,41 +1378,285 @@ outcome::std_result<Interface> Socket::parse_link(struct nlmsghdr& header, struc
   }();
   entry.index = Interface::Index{msg.ifi_index};
   entry.type = static_cast<Interface::Type>(msg.ifi_type);
+  entry.flags = msg.ifi_flags;
+
+  if (auto const& name = tb.get<IFLA_IFNAME>(); name)
+  {
+    entry.name = *name;
+  }
+  if (msg.ifi_index > 0 && static_cast<std::size_t>(msg.ifi_index) < m_names.size())
+  {
+    m_names[static_cast<std::size_t>(msg.ifi_index)] = entry.action == Action::Del ? InterfaceName{} : entry.name;
+  }
+  if (auto const& mtu = tb.get<IFLA_MTU>(); mtu)
+  {
+    entry.mtu = *mtu;
+  }
+  if (auto const& operState = tb.get<IFLA_OPERSTATE>(); operState && *operState <= static_cast<std::uint8_t>(Interface::OperState::Up))
+  {
+    entry.operState = static_cast<Interface::OperState>(*operState);
+  }
+  // kernels without IFLA_CARRIER only have IFF_RUNNING
+  auto const& carrier = tb.get<IFLA_CARRIER>();
+  entry.carrier = carrier ? *carrier != 0 : (msg.ifi_flags & IFF_RUNNING) != 0;
+
+  return entry;
+}
+
+outcome::std_result<Rule> Socket::parse_rule(struct nlmsghdr& header, struct fib_rule_hdr& msg, Message::Allocator allocator)
+{
+  if (header.nlmsg_len < NLMSG_LENGTH(sizeof(msg)))
+  {
+    return SocketError::WrongMessageLength;
+  }
+  if (msg.family != AF_INET && msg.family != AF_INET6)
+  {
+    return SocketError::InvalidFamily;
+  }
+
+  auto tb = RuleAttributes::decode(Attribute::attributes<struct fib_rule_hdr>(header));
+
+  Rule entry{allocator};
+  entry.action = [&header]()
+  {
+    if (header.nlmsg_type == RTM_NEWRULE)
+    {
+      return Action::New;
+    }
+    else if (header.nlmsg_type == RTM_DELRULE)
+    {
+      return Action::Del;
+    }
+    return Action::Unknown;
+  }();
+  entry.family = msg.family;
+  entry.type = static_cast<Rule::Type>(msg.action);
+  entry.table = static_cast<Route::Table>(msg.table);
+  entry.tos = msg.tos;
+  entry.invert = (msg.flags & FIB_RULE_INVERT) != 0;
 
-  if (tb[IFLA_IFNAME])
+  if (auto const& src = tb.get<FRA_SRC>(); src)
+  {
+    toPrefix(entry.source, *src, msg.src_len);
+  }
+  if (auto const& dst = tb.get<FRA_DST>(); dst)
+  {
+    toPrefix(entry.destination, *dst, msg.dst_len);
+  }
+  if (auto const& priority = tb.get<FRA_PRIORITY>(); priority)
+  {
+    entry.priority = *priority;
+  }
+  if (auto const& table = tb.get<FRA_TABLE>(); table)
+  {
+    entry.table = static_cast<Route::Table>(*table);
+  }
+  if (auto const& gotoTarget = tb.get<FRA_GOTO>(); gotoTarget)
+  {
+    entry.gotoTarget = *gotoTarget;
+  }
+  if (auto const& iifname = tb.get<FRA_IIFNAME>(); iifname)
+  {
+    entry.inputInterface = *iifname;
+  }
+  if (auto const& oifname = tb.get<FRA_OIFNAME>(); oifname)
+  {
+    entry.outputInterface = *oifname;
+  }
+  if (auto const& fwmark = tb.get<FRA_FWMARK>(); fwmark)
+  {
+    entry.fwmark = *fwmark;
+    entry.fwmask = 0xFFFFFFFF;
+  }
+  if (auto const& fwmask = tb.get<FRA_FWMASK>(); fwmask)
+  {
+    entry.fwmask = *fwmask;
+  }
+  if (auto const& suppress = tb.get<FRA_SUPPRESS_PREFIXLEN>(); suppress && *suppress >= 0)
+  {
+    entry.suppressPrefixLength = static_cast<std::uint32_t>(*suppress);
+  }
+  if (auto const& l3mdev = tb.get<FRA_L3MDEV>(); l3mdev)
+  {
+    entry.l3mdev = *l3mdev != 0;
+  }
+  if (auto const& uidRange = tb.get<FRA_UID_RANGE>(); uidRange && uidRange->size() >= sizeof(struct fib_rule_uid_range))
+  {
+    struct fib_rule_uid_range range;
+    std::memcpy(&range, uidRange->data(), sizeof(range));
+    entry.uidRange = Rule::Range<std::uint32_t>{range.start, range.end};
+  }
+  if (auto const& ipProtocol = tb.get<FRA_IP_PROTO>(); ipProtocol)
+  {
+    entry.ipProtocol = *ipProtocol;
+  }
+  // host byte order, unlike the ports of a packet
+  auto portRange = [](std::optional<Attribute::Payload> const& payload) -> std::optional<Rule::Range<std::uint16_t>>
+  {
+    if (!payload || payload->size() < sizeof(struct fib_rule_port_range))
+    {
+      return std::nullopt;
+    }
+    struct fib_rule_port_range range;
+    std::memcpy(&range, payload->data(), sizeof(range));
+    return Rule::Range<std::uint16_t>{range.start, range.end};
+  };
+  entry.sourcePorts = portRange(tb.get<FRA_SPORT_RANGE>());
+  entry.destinationPorts = portRange(tb.get<FRA_DPORT_RANGE>());
+  if (auto const& tunnelId = tb.get<FRA_TUN_ID>(); tunnelId)
   {
-    entry.name = reinterpret_cast<char const*>(RTA_DATA(tb[IFLA_IFNAME]));
+    entry.tunnelId = *tunnelId;  // network byte order
+    if constexpr (std::endian::native == std::endian::little)
+    {
+      entry.tunnelId = std::byteswap(entry.tunnelId);
+    }
   }
 
   return entry;
 }
 
-template <std::size_t MAX>
-Socket::AttrTable<MAX> Socket::parse_rtattr(struct rtattr* rta, std::size_t len)
+outcome::std_result<Nexthop> Socket::parse_nexthop(struct nlmsghdr& header, struct nhmsg& msg)
 {
-  AttrTable<MAX> tb{};
-  while (RTA_OK(rta, len))
+  if (header.nlmsg_len < NLMSG_LENGTH(sizeof(msg)))
+  {
+    return SocketError::WrongMessageLength;
+  }
+  auto tb = NexthopAttributes::decode(Attribute::attributes<struct nhmsg>(header));
+
+  Nexthop entry;
+  entry.action = [&header]()
   {
-    if (rta->rta_type < tb.size())
+    if (header.nlmsg_type == RTM_NEWNEXTHOP)
     {
-      tb[rta->rta_type] = rta;
+      return Action::New;
+    }
+    else if (header.nlmsg_type == RTM_DELNEXTHOP)
+    {
+      return Action::Del;
     }
+    return Action::Unknown;
+  }();
+  entry.family = msg.nh_family;
+  entry.blackhole = tb.get<NHA_BLACKHOLE>().has_value();
 
-    rta = RTA_NEXT(rta, len);
+  if (auto const& id = tb.get<NHA_ID>(); id)
+  {
+    entry.id = *id;
+  }
+  if (auto const& oif = tb.get<NHA_OIF>(); oif)
+  {
+    entry.interfaceIndex = Interface::Index{*oif};
+  }
+  if (auto const& gateway = tb.get<NHA_GATEWAY>(); gateway)
+  {
+    entry.gateway = *gateway;
+  }
+  if (auto const& group = tb.get<NHA_GROUP>(); group)
+  {
+    auto count = group->size() / sizeof(struct nexthop_grp);
+    entry.group.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      struct nexthop_grp member;
+      std::memcpy(&member, group->data() + i * sizeof(member), sizeof(member));
+      entry.group.push_back({member.id, std::uint32_t{member.weight} + 1});
+    }
   }
-  return tb;
+
+  return entry;
 }
-template <std::size_t MAX>
-uint32_t Socket::rtm_get_table(struct rtmsg& r, AttrTable<MAX> const& tb)
+
+outcome::std_result<void> Socket::parse_traffic_control(struct nlmsghdr& header, struct tcmsg& msg, TrafficControl& object)
 {
-  uint32_t table = r.rtm_table;
+  if (header.nlmsg_len < NLMSG_LENGTH(sizeof(msg)))
+  {
+    return SocketError::WrongMessageLength;
+  }
+  auto tb = TrafficControlAttributes::decode(Attribute::attributes<struct tcmsg>(header));
 
-  if (tb[RTA_TABLE])
+  object.action = [&header]()
+  {
+    switch (header.nlmsg_type)
+    {
+      case RTM_NEWQDISC:
+      case RTM_NEWTCLASS:
+        return Action::New;
+      case RTM_DELQDISC:
+      case RTM_DELTCLASS:
+        return Action::Del;
+    }
+    return Action::Unknown;
+  }();
+  object.interfaceIndex = Interface::Index{msg.tcm_ifindex};
+  object.interfaceName = interfaceName(static_cast<std::uint32_t>(msg.tcm_ifindex));
+  object.handle = msg.tcm_handle;
+  object.parent = msg.tcm_parent;
+  if (auto const& kind = tb.get<TCA_KIND>(); kind)
+  {
+    object.kind = *kind;
+  }
+  if (auto const& stats2 = tb.get<TCA_STATS2>(); stats2)
   {
-    table = *reinterpret_cast<uint32_t*>(RTA_DATA(tb[RTA_TABLE]));
+    auto stats = StatsAttributes::decode(*stats2);
+    // struct gnet_stats_basic starts with bytes as u64 and packets as u32, only those 12 bytes are read
+    if (auto const& basic = stats.get<TCA_STATS_BASIC>(); basic && basic->size() >= sizeof(std::uint64_t) + sizeof(std::uint32_t))
+    {
+      std::uint32_t packets;
+      std::memcpy(&object.stats.bytes, basic->data(), sizeof(std::uint64_t));
+      std::memcpy(&packets, basic->data() + sizeof(std::uint64_t), sizeof(packets));
+      object.stats.packets = packets;
+    }
+    if (auto const& packets = stats.get<TCA_STATS_PKT64>(); packets)
+    {
+      object.stats.packets = *packets;
+    }
+    if (auto const& queue = stats.get<TCA_STATS_QUEUE>(); queue && queue->size() >= sizeof(struct gnet_stats_queue))
+    {
+      struct gnet_stats_queue values;
+      std::memcpy(&values, queue->data(), sizeof(values));
+      object.stats.qlen = values.qlen;
+      object.stats.backlog = values.backlog;
+      object.stats.drops = values.drops;
+      object.stats.requeues = values.requeues;
+      object.stats.overlimits = values.overlimits;
+    }
   }
+  return outcome::success();
+}
+
+NexthopStore::Group Socket::parse_multipath(Attribute::Payload multipath)
+{
+  NexthopGroup group;
+  while (multipath.size() >= sizeof(struct rtnexthop))
+  {
+    struct rtnexthop rtnh;
+    std::memcpy(&rtnh, multipath.data(), sizeof(rtnh));
+    if (rtnh.rtnh_len < sizeof(rtnh) || rtnh.rtnh_len > multipath.size())
+    {
+      break;
+    }
+
+    NexthopGroup::Path path;
+    path.interfaceIndex = Interface::Index{rtnh.rtnh_ifindex};
+    path.weight = std::uint32_t{rtnh.rtnh_hops} + 1;
 
-  return table;
+    auto tb = MultipathAttributes::decode(multipath.subspan(RTNH_LENGTH(0), rtnh.rtnh_len - RTNH_LENGTH(0)));
+    if (auto const& gateway = tb.get<RTA_GATEWAY>(); gateway)
+    {
+      path.gateway = *gateway;
+    }
+    else if (auto const& via = tb.get<RTA_VIA>(); via && via->size() > sizeof(__kernel_sa_family_t))
+    {
+      if (auto address = Attribute::Decoder<IpAddress>::decode(via->subspan(sizeof(__kernel_sa_family_t))); address)
+      {
+        path.gateway = *address;
+      }
+    }
+    group.paths.push_back(std::move(path));
+
+    multipath = multipath.subspan(std::min<std::size_t>(RTNH_ALIGN(rtnh.rtnh_len), multipath.size()));
+  }
+  return m_nexthops.intern(std::move(group));
 }
 
 outcome::std_result<Message::ResponseTypes> Socket::HandleDone(struct nlmsghdr& header)
@@ -445,6 +1664,8 @@ outcome::std_result<Message::ResponseTypes> Socket::HandleDone(struct nlmsghdr&
   auto req = PopRequest(Message::Id{header.nlmsg_seq, header.nlmsg_pid});
   if (req)
   {
+    m_metrics->dumpDuration(m_requestStart);
+    WORMHOLE_SYSINFO_PROBE2(done, header.nlmsg_seq, req->Size());
     return std::move(*req).GetResponse();
   }
   else
@@ -455,6 +1676,10 @@ outcome::std_result<Message::ResponseTypes> Socket::HandleDone(struct nlmsghdr&
 
 outcome::std_result<std::optional<Route>> Socket::HandleRoute(struct nlmsghdr& header, struct rtmsg& rtMsg)
 {
+  if (rtMsg.rtm_family != AF_INET && rtMsg.rtm_family != AF_INET6)
+  {
+    return std::nullopt;
+  }
   BOOST_OUTCOME_TRY(auto route, parse_route(header, rtMsg));
   if (header.nlmsg_pid != m_pid)
   {
@@ -489,6 +1714,49 @@ outcome::std_result<std::optional<Interface>> Socket::HandleLink(struct nlmsghdr
   return std::nullopt;
 }
 
+outcome::std_result<std::optional<Rule>> Socket::HandleRule(struct nlmsghdr& header, struct fib_rule_hdr& ruleMsg)
+{
+  if (ruleMsg.family != AF_INET && ruleMsg.family != AF_INET6)
+  {
+    return std::nullopt;
+  }
+  BOOST_OUTCOME_TRY(auto rule, parse_rule(header, ruleMsg, allocatorFor(header)));
+  if (header.nlmsg_pid != m_pid)
+  {
+    return rule;
+  }
+
+  BOOST_OUTCOME_TRY(addResponse<Message::RuleRequest>({header.nlmsg_seq, header.nlmsg_pid}, std::move(rule)));
+  return std::nullopt;
+}
+
+outcome::std_result<std::optional<Nexthop>> Socket::HandleNexthop(struct nlmsghdr& header, struct nhmsg& nhMsg)
+{
+  BOOST_OUTCOME_TRY(auto nexthop, parse_nexthop(header, nhMsg));
+  m_nexthops.apply(nexthop);
+  if (header.nlmsg_pid != m_pid)
+  {
+    return nexthop;
+  }
+
+  BOOST_OUTCOME_TRY(addResponse<Message::NexthopRequest>({header.nlmsg_seq, header.nlmsg_pid}, std::move(nexthop)));
+  return std::nullopt;
+}
+
+template <typename T, typename Request>
+outcome::std_result<std::optional<T>> Socket::HandleTrafficControl(struct nlmsghdr& header, struct tcmsg& tcMsg)
+{
+  T object;
+  BOOST_OUTCOME_TRY(parse_traffic_control(header, tcMsg, object));
+  if (header.nlmsg_pid != m_pid)
+  {
+    return object;
+  }
+
+  BOOST_OUTCOME_TRY(addResponse<Request>({header.nlmsg_seq, header.nlmsg_pid}, std::move(object)));
+  return std::nullopt;
+}
+
 template <typename Request, typename T>
 outcome::std_result<void> Socket::addResponse(Message::Id id, T&& t)
 {
@@ -512,3 +1780,10 @@ std::unique_ptr<Message> Socket::PopRequest(Message::Id const& id)
   return std::move(m_activeRequest);
 }
 }  // namespace wormhole::sysinfo::Netlink
+
+fmt::format_context::iterator fmt::formatter<wormhole::sysinfo::Netlink::Message::Id>::format(wormhole::sysinfo::Netlink::Message::Id const& id, format_context& ctx) const
+{
+  std::array<char, 24> buffer;
+  auto result = fmt::format_to_n(buffer.data(), buffer.size(), FMT_COMPILE("{}:{}"), id.seq, id.pid);
+  return formatter<std::string_view>::format({buffer.data(), result.size}, ctx);
+}
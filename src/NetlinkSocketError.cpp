@@ -43,6 +43,10 @@ struct NetlinkSocketError_cat : std::error_category
         return "UnhandledMessageType";
       case wormhole::sysinfo::Netlink::SocketError::MessageTypeMismatch:
         return "MessageTypeMismatch";
+      case wormhole::sysinfo::Netlink::SocketError::OverBudget:
+        return "OverBudget";
+      case wormhole::sysinfo::Netlink::SocketError::Truncated:
+        return "Truncated";
     }
     return "unknown";
   }
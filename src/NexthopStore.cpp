@@ -0,0 +1,203 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/NexthopStore.hpp"
+
+#include <algorithm>
+
+namespace
+{
+std::size_t combine(std::size_t seed, std::size_t value) noexcept
+{
+  return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+}
+
+std::size_t hashAddress(boost::asio::ip::address const& address) noexcept
+{
+  if (address.is_v4())
+  {
+    return address.to_v4().to_uint();
+  }
+  std::size_t seed = 0;
+  for (auto byte : address.to_v6().to_bytes())
+  {
+    seed = combine(seed, byte);
+  }
+  return seed;
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+NexthopStore::NexthopStore()
+  : m_interned{std::make_shared<Interned>()}
+{
+}
+
+NexthopStore::Group NexthopStore::intern(NexthopGroup group)
+{
+  auto const key = hash(group);
+  std::scoped_lock lock{m_interned->mutex};
+  auto [begin, end] = m_interned->entries.equal_range(key);
+  for (auto it = begin; it != end; ++it)
+  {
+    // compared before lock(): a reference dropped here could be the last one, its deleter would wait for the mutex
+    if (*it->second.group == group)
+    {
+      if (auto existing = it->second.weak.lock(); existing)
+      {
+        return existing;
+      }
+    }
+  }
+  Group shared{new NexthopGroup const{std::move(group)}, [interned = std::weak_ptr<Interned>{m_interned}, key](NexthopGroup const* released) noexcept
+      {
+        release(interned, key, released);
+      }};
+  m_interned->entries.emplace(key, Interned::Entry{shared.get(), shared});
+  return shared;
+}
+
+void NexthopStore::apply(Nexthop const& nexthop)
+{
+  if (auto it = m_objects.find(nexthop.id); it != m_objects.end())
+  {
+    for (auto const& member : it->second.group)
+    {
+      auto [begin, end] = m_members.equal_range(member.id);
+      auto edge = std::find_if(begin, end, [id = nexthop.id](auto const& item)
+          {
+            return item.second == id;
+          });
+      if (edge != end)
+      {
+        m_members.erase(edge);
+      }
+    }
+  }
+
+  if (nexthop.action == Action::Del)
+  {
+    m_objects.erase(nexthop.id);
+    m_groups.erase(nexthop.id);
+  }
+  else
+  {
+    auto& object = m_objects.insert_or_assign(nexthop.id, nexthop).first->second;
+    object.action = Action::New;
+    for (auto const& member : object.group)
+    {
+      m_members.emplace(member.id, nexthop.id);
+    }
+    m_groups.insert_or_assign(nexthop.id, expand(nexthop.id));
+  }
+
+  for (auto id : groups(nexthop.id))
+  {
+    refresh(id);
+  }
+}
+
+NexthopStore::Group NexthopStore::find(std::uint32_t id) const
+{
+  if (auto it = m_groups.find(id); it != m_groups.end())
+  {
+    return it->second;
+  }
+  return nullptr;
+}
+
+NexthopStore::Group NexthopStore::resolve(Route const& route) const
+{
+  // a nexthop object may have changed since the route was parsed, the store knows its current paths
+  if (route.nexthopId != 0)
+  {
+    if (auto group = find(route.nexthopId))
+    {
+      return group;
+    }
+  }
+  return route.nexthops;
+}
+
+std::vector<std::uint32_t> NexthopStore::groups(std::uint32_t id) const
+{
+  auto [begin, end] = m_members.equal_range(id);
+  std::vector<std::uint32_t> dependents;
+  std::transform(begin, end, std::back_inserter(dependents), [](auto const& item)
+      {
+        return item.second;
+      });
+  return dependents;
+}
+
+std::size_t NexthopStore::size() const
+{
+  std::scoped_lock lock{m_interned->mutex};
+  return m_interned->entries.size();
+}
+
+std::size_t NexthopStore::hash(NexthopGroup const& group) noexcept
+{
+  std::size_t seed = group.paths.size();
+  for (auto const& path : group.paths)
+  {
+    seed = combine(seed, path.id);
+    seed = combine(seed, hashAddress(path.gateway));
+    seed = combine(seed, static_cast<std::size_t>(path.interfaceIndex.value));
+    seed = combine(seed, path.weight);
+  }
+  return seed;
+}
+
+void NexthopStore::release(std::weak_ptr<Interned> const& table, std::size_t key, NexthopGroup const* group) noexcept
+{
+  if (auto interned = table.lock(); interned)
+  {
+    std::scoped_lock lock{interned->mutex};
+    auto [begin, end] = interned->entries.equal_range(key);
+    auto it = std::find_if(begin, end, [group](auto const& item)
+        {
+          return item.second.group == group;
+        });
+    if (it != end)
+    {
+      interned->entries.erase(it);
+    }
+  }
+  delete group;
+}
+
+NexthopStore::Group NexthopStore::expand(std::uint32_t id)
+{
+  auto const& object = m_objects.at(id);
+  NexthopGroup group;
+  if (object.group.empty())
+  {
+    if (!object.blackhole)
+    {
+      group.paths.push_back({object.id, object.gateway, object.interfaceIndex, 1});
+    }
+    return intern(std::move(group));
+  }
+  for (auto const& member : object.group)
+  {
+    if (auto it = m_objects.find(member.id); it != m_objects.end() && it->second.group.empty() && !it->second.blackhole)
+    {
+      group.paths.push_back({member.id, it->second.gateway, it->second.interfaceIndex, member.weight});
+    }
+  }
+  return intern(std::move(group));
+}
+
+void NexthopStore::refresh(std::uint32_t id)
+{
+  if (m_objects.contains(id))
+  {
+    m_groups.insert_or_assign(id, expand(id));
+  }
+}
+}  // namespace wormhole::sysinfo
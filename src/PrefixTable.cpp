@@ -0,0 +1,412 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/PrefixTable.hpp"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+#include <utility>
+
+#include "wormhole/sysinfo/helper.hpp"
+
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#  define WORMHOLE_SYSINFO_X86 1
+#else
+#  define WORMHOLE_SYSINFO_X86 0
+#endif
+
+namespace
+{
+using namespace wormhole::sysinfo;
+using KeyV6 = std::array<std::uint64_t, 2>;
+
+constexpr std::size_t MinCapacity = 8;
+
+std::uint32_t hashV4(std::uint32_t key, std::uint32_t shift) noexcept
+{
+  return (key * 0x9E3779B1u) >> shift;
+}
+
+std::uint64_t hashV6(KeyV6 const& key, std::uint32_t shift) noexcept
+{
+  return ((key[0] ^ std::rotl(key[1], 32)) * 0x9E3779B97F4A7C15ull) >> shift;
+}
+
+KeyV6 toKey(PrefixTable::AddressV6 const& address) noexcept
+{
+  KeyV6 key;
+  std::memcpy(key.data(), address.data(), sizeof(key));
+  return key;
+}
+
+KeyV6 maskV6(KeyV6 const& key, KeyV6 const& netmask) noexcept
+{
+  return {key[0] & netmask[0], key[1] & netmask[1]};
+}
+
+std::uint32_t netmaskV4(std::uint32_t length) noexcept
+{
+  return htonl(length == 0 ? 0 : ~std::uint32_t{0} << (32 - length));
+}
+
+KeyV6 netmaskV6(std::uint32_t length) noexcept
+{
+  PrefixTable::AddressV6 bytes{};
+  for (std::uint32_t i = 0; i < bytes.size(); ++i)
+  {
+    auto bits = std::min<std::uint32_t>(8, length - std::min(length, i * 8));
+    bytes[i] = static_cast<std::uint8_t>(0xFF00u >> bits);
+  }
+  return toKey(bytes);
+}
+
+std::uint32_t hashOf(auto const& level, std::uint32_t key) noexcept
+{
+  return hashV4(key, level.shift);
+}
+
+std::uint64_t hashOf(auto const& level, KeyV6 const& key) noexcept
+{
+  return hashV6(key, level.shift);
+}
+
+template <typename LEVEL, typename KEY>
+void place(LEVEL& level, KEY const& key, std::uint32_t value)
+{
+  auto slot = hashOf(level, key);
+  while (level.values[slot] != 0 && level.keys[slot] != key)
+  {
+    slot = (slot + 1) & level.slotMask;
+  }
+  if (level.values[slot] == 0)
+  {
+    ++level.count;
+  }
+  level.keys[slot] = key;
+  level.values[slot] = value + 1;
+}
+
+template <typename LEVEL>
+void resize(LEVEL& level, std::size_t capacity)
+{
+  auto keys = std::exchange(level.keys, {});
+  auto values = std::exchange(level.values, {});
+  constexpr std::uint32_t bits = sizeof(level.slotMask) * 8;
+  level.keys.resize(capacity);
+  level.values.resize(capacity, 0);
+  level.slotMask = static_cast<decltype(level.slotMask)>(capacity - 1);
+  level.shift = bits - static_cast<std::uint32_t>(std::countr_zero(capacity));
+  level.count = 0;
+  for (std::size_t i = 0; i < values.size(); ++i)
+  {
+    if (values[i] != 0)
+    {
+      place(level, keys[i], values[i] - 1);
+    }
+  }
+}
+
+template <typename LEVEL, typename KEY>
+void insertInto(std::vector<LEVEL>& levels, std::uint32_t length, KEY const& key, std::uint32_t value)
+{
+  auto it = std::lower_bound(levels.begin(), levels.end(), length, [](LEVEL const& level, std::uint32_t l)
+      {
+        return level.length > l;
+      });
+  if (it == levels.end() || it->length != length)
+  {
+    LEVEL level;
+    level.length = length;
+    if constexpr (std::is_same_v<KEY, std::uint32_t>)
+    {
+      level.netmask = netmaskV4(length);
+    }
+    else
+    {
+      level.netmask = netmaskV6(length);
+    }
+    resize(level, MinCapacity);
+    it = levels.insert(it, std::move(level));
+  }
+  if ((it->count + 1) * 2 > it->values.size())
+  {
+    resize(*it, it->values.size() * 2);
+  }
+  place(*it, key, value);
+}
+
+template <typename LEVEL>
+std::uint32_t findV4(std::span<LEVEL const> levels, std::uint32_t address) noexcept
+{
+  for (auto const& level : levels)
+  {
+    auto key = address & level.netmask;
+    for (auto slot = hashV4(key, level.shift); level.values[slot] != 0; slot = (slot + 1) & level.slotMask)
+    {
+      if (level.keys[slot] == key)
+      {
+        return level.values[slot] - 1;
+      }
+    }
+  }
+  return PrefixTable::NoMatch;
+}
+
+template <typename LEVEL>
+std::uint32_t findV6(std::span<LEVEL const> levels, KeyV6 const& address) noexcept
+{
+  for (auto const& level : levels)
+  {
+    auto key = maskV6(address, level.netmask);
+    for (auto slot = hashV6(key, level.shift); level.values[slot] != 0; slot = (slot + 1) & level.slotMask)
+    {
+      if (level.keys[slot] == key)
+      {
+        return level.values[slot] - 1;
+      }
+    }
+  }
+  return PrefixTable::NoMatch;
+}
+
+template <typename LEVEL>
+void lookupV4Scalar(std::span<LEVEL const> levels, PrefixTable::AddressV4 const* addresses, std::uint32_t* values, std::size_t count) noexcept
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    values[i] = findV4(levels, addresses[i]);
+  }
+}
+
+template <typename LEVEL>
+void lookupV6Scalar(std::span<LEVEL const> levels, PrefixTable::AddressV6 const* addresses, std::uint32_t* values, std::size_t count) noexcept
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    values[i] = findV6(levels, toKey(addresses[i]));
+  }
+}
+
+#if WORMHOLE_SYSINFO_X86
+// eight addresses per step, every lane probes its own slot chain through gathers
+template <typename LEVEL>
+__attribute__((target("avx2"))) void lookupV4Avx2(std::span<LEVEL const> levels, PrefixTable::AddressV4 const* addresses, std::uint32_t* values, std::size_t count) noexcept
+{
+  constexpr std::size_t Lanes = 8;
+  auto const zero = _mm256_setzero_si256();
+  auto const one = _mm256_set1_epi32(1);
+  auto const golden = _mm256_set1_epi32(static_cast<int>(0x9E3779B1u));
+  std::size_t i = 0;
+  for (; i + Lanes <= count; i += Lanes)
+  {
+    auto const address = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(addresses + i));
+    auto result = _mm256_set1_epi32(-1);
+    auto pending = _mm256_set1_epi32(-1);
+    for (auto const& level : levels)
+    {
+      if (_mm256_testz_si256(pending, pending))
+      {
+        break;
+      }
+      auto const* keys = reinterpret_cast<int const*>(level.keys.data());
+      auto const* slotValues = reinterpret_cast<int const*>(level.values.data());
+      auto const slotMask = _mm256_set1_epi32(static_cast<int>(level.slotMask));
+      auto const key = _mm256_and_si256(address, _mm256_set1_epi32(static_cast<int>(level.netmask)));
+      auto slot = _mm256_srl_epi32(_mm256_mullo_epi32(key, golden), _mm_cvtsi32_si128(static_cast<int>(level.shift)));
+      auto probing = pending;
+      while (!_mm256_testz_si256(probing, probing))
+      {
+        auto const slotKey = _mm256_mask_i32gather_epi32(zero, keys, slot, probing, 4);
+        auto const slotValue = _mm256_mask_i32gather_epi32(zero, slotValues, slot, probing, 4);
+        auto const occupied = _mm256_andnot_si256(_mm256_cmpeq_epi32(slotValue, zero), probing);
+        auto const hit = _mm256_and_si256(occupied, _mm256_cmpeq_epi32(slotKey, key));
+        result = _mm256_blendv_epi8(result, _mm256_sub_epi32(slotValue, one), hit);
+        pending = _mm256_andnot_si256(hit, pending);
+        probing = _mm256_andnot_si256(hit, occupied);
+        slot = _mm256_and_si256(_mm256_add_epi32(slot, one), slotMask);
+      }
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), result);
+  }
+  lookupV4Scalar(levels, addresses + i, values + i, count - i);
+}
+
+// one address per step, masking and key comparison on full 128 bit registers
+template <typename LEVEL>
+__attribute__((target("sse4.1"))) void lookupV6Sse41(std::span<LEVEL const> levels, PrefixTable::AddressV6 const* addresses, std::uint32_t* values, std::size_t count) noexcept
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    auto const address = _mm_loadu_si128(reinterpret_cast<__m128i const*>(addresses[i].data()));
+    values[i] = PrefixTable::NoMatch;
+    for (auto const& level : levels)
+    {
+      auto const key = _mm_and_si128(address, _mm_loadu_si128(reinterpret_cast<__m128i const*>(level.netmask.data())));
+      KeyV6 const hashKey{static_cast<std::uint64_t>(_mm_extract_epi64(key, 0)), static_cast<std::uint64_t>(_mm_extract_epi64(key, 1))};
+      auto slot = hashV6(hashKey, level.shift);
+      for (; level.values[slot] != 0; slot = (slot + 1) & level.slotMask)
+      {
+        auto const diff = _mm_xor_si128(key, _mm_loadu_si128(reinterpret_cast<__m128i const*>(level.keys[slot].data())));
+        if (_mm_testz_si128(diff, diff))
+        {
+          break;
+        }
+      }
+      if (level.values[slot] != 0)
+      {
+        values[i] = level.values[slot] - 1;
+        break;
+      }
+    }
+  }
+}
+#endif
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+PrefixTable PrefixTable::fromRoutes(std::span<Route const> routes, Route::Table table)
+{
+  std::vector<std::uint32_t> order;
+  for (std::uint32_t i = 0; i < routes.size(); ++i)
+  {
+    if (routes[i].table == table && routes[i].action != Action::Del)
+    {
+      order.push_back(i);
+    }
+  }
+  // insert the preferred route of a prefix last
+  std::stable_sort(order.begin(), order.end(), [&routes](std::uint32_t lhs, std::uint32_t rhs)
+      {
+        return routes[lhs].priority > routes[rhs].priority;
+      });
+
+  PrefixTable prefixes;
+  for (auto index : order)
+  {
+    std::visit(helper::overloaded{[&](Route::Default_t)
+                   {
+                     if (routes[index].family == AF_INET6)
+                     {
+                       prefixes.insert(boost::asio::ip::network_v6{}, index);
+                     }
+                     else
+                     {
+                       prefixes.insert(boost::asio::ip::network_v4{}, index);
+                     }
+                   },
+                   [&](auto const& network)
+                   {
+                     prefixes.insert(network, index);
+                   }},
+        routes[index].destination.value);
+  }
+  return prefixes;
+}
+
+PrefixTable PrefixTable::fromAddresses(std::span<Address const> addresses)
+{
+  PrefixTable prefixes;
+  for (std::uint32_t i = 0; i < addresses.size(); ++i)
+  {
+    auto const& address = addresses[i].local.is_unspecified() ? addresses[i].address : addresses[i].local;
+    if (address.is_v4())
+    {
+      prefixes.insert(boost::asio::ip::network_v4{address.to_v4(), 32}, i);
+    }
+    else
+    {
+      prefixes.insert(boost::asio::ip::network_v6{address.to_v6(), 128}, i);
+    }
+  }
+  return prefixes;
+}
+
+void PrefixTable::insert(boost::asio::ip::network_v4 const& network, std::uint32_t value)
+{
+  auto length = static_cast<std::uint32_t>(network.prefix_length());
+  insertInto(m_v4, length, htonl(network.network().to_uint()) & netmaskV4(length), value);
+}
+
+void PrefixTable::insert(boost::asio::ip::network_v6 const& network, std::uint32_t value)
+{
+  auto length = static_cast<std::uint32_t>(network.prefix_length());
+  insertInto(m_v6, length, maskV6(toKey(network.network().to_bytes()), netmaskV6(length)), value);
+}
+
+std::size_t PrefixTable::lookup(std::span<AddressV4 const> addresses, std::span<std::uint32_t> values) const
+{
+  auto count = std::min(addresses.size(), values.size());
+  std::span<LevelV4 const> levels{m_v4};
+#if WORMHOLE_SYSINFO_X86
+  if (isa() == Isa::Avx2)
+  {
+    lookupV4Avx2(levels, addresses.data(), values.data(), count);
+    return count;
+  }
+#endif
+  lookupV4Scalar(levels, addresses.data(), values.data(), count);
+  return count;
+}
+
+std::size_t PrefixTable::lookup(std::span<AddressV6 const> addresses, std::span<std::uint32_t> values) const
+{
+  auto count = std::min(addresses.size(), values.size());
+  std::span<LevelV6 const> levels{m_v6};
+#if WORMHOLE_SYSINFO_X86
+  if (isa() != Isa::Scalar)
+  {
+    lookupV6Sse41(levels, addresses.data(), values.data(), count);
+    return count;
+  }
+#endif
+  lookupV6Scalar(levels, addresses.data(), values.data(), count);
+  return count;
+}
+
+std::uint32_t PrefixTable::lookup(boost::asio::ip::address const& address) const
+{
+  if (address.is_v4())
+  {
+    return findV4(std::span<LevelV4 const>{m_v4}, htonl(address.to_v4().to_uint()));
+  }
+  return findV6(std::span<LevelV6 const>{m_v6}, toKey(address.to_v6().to_bytes()));
+}
+
+std::size_t PrefixTable::size() const noexcept
+{
+  auto count = [](std::size_t sum, auto const& level)
+  {
+    return sum + level.count;
+  };
+  return std::accumulate(m_v4.begin(), m_v4.end(), std::size_t{0}, count) + std::accumulate(m_v6.begin(), m_v6.end(), std::size_t{0}, count);
+}
+
+PrefixTable::Isa PrefixTable::isa() noexcept
+{
+  static Isa const detected = []()
+  {
+#if WORMHOLE_SYSINFO_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+      return Isa::Avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+      return Isa::Sse41;
+    }
+#endif
+    return Isa::Scalar;
+  }();
+  return detected;
+}
+}  // namespace wormhole::sysinfo
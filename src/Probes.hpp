@@ -0,0 +1,80 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+/*
+ * USDT probes in the SystemTap sdt note format (same layout as <sys/sdt.h>),
+ * usable from perf/bpftrace as usdt:<binary>:sysinfo:<name>.
+ * a probe is a single nop, there is no runtime dependency and no semaphore.
+ * every argument is passed as unsigned 64 bit value.
+ */
+
+#ifndef WORMHOLE_SYSINFO_PROBES
+#  define WORMHOLE_SYSINFO_PROBES 1
+#endif
+
+#if WORMHOLE_SYSINFO_PROBES && defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+#  define WORMHOLE_SYSINFO_PROBE_NOTE(name, args, ...)                                     \
+    __asm__ __volatile__("990: nop\n"                                                      \
+                         ".pushsection .note.stapsdt,\"?\",\"note\"\n"                     \
+                         ".balign 4\n"                                                     \
+                         ".4byte 992f-991f, 994f-993f, 3\n"                                \
+                         "991: .asciz \"stapsdt\"\n"                                       \
+                         "992: .balign 4\n"                                                \
+                         "993: .8byte 990b\n"                                              \
+                         ".8byte _.stapsdt.base\n"                                         \
+                         ".8byte 0\n"                                                      \
+                         ".asciz \"sysinfo\"\n"                                            \
+                         ".asciz \"" #name "\"\n"                                          \
+                         ".asciz \"" args "\"\n"                                           \
+                         "994: .balign 4\n"                                                \
+                         ".popsection\n"                                                   \
+                         ".ifndef _.stapsdt.base\n"                                        \
+                         ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+                         ".weak _.stapsdt.base\n"                                          \
+                         ".hidden _.stapsdt.base\n"                                        \
+                         "_.stapsdt.base: .space 1\n"                                      \
+                         ".size _.stapsdt.base, 1\n"                                       \
+                         ".popsection\n"                                                   \
+                         ".endif\n"                                                        \
+                         :                                                                 \
+                         : __VA_ARGS__)
+#  define WORMHOLE_SYSINFO_PROBE_ARG(arg) "nor"(::wormhole::sysinfo::probe::argument(arg))
+
+namespace wormhole::sysinfo::probe
+{
+template <typename T>
+constexpr std::uint64_t argument(T value) noexcept
+{
+  if constexpr (std::is_same_v<T, std::uint64_t>)
+  {
+    return value;
+  }
+  else
+  {
+    return static_cast<std::uint64_t>(value);
+  }
+}
+}  // namespace wormhole::sysinfo::probe
+
+#  define WORMHOLE_SYSINFO_PROBE2(name, a1, a2) \
+    WORMHOLE_SYSINFO_PROBE_NOTE(name, "8@%0 8@%1", WORMHOLE_SYSINFO_PROBE_ARG(a1), WORMHOLE_SYSINFO_PROBE_ARG(a2))
+#  define WORMHOLE_SYSINFO_PROBE3(name, a1, a2, a3) \
+    WORMHOLE_SYSINFO_PROBE_NOTE(name, "8@%0 8@%1 8@%2", WORMHOLE_SYSINFO_PROBE_ARG(a1), WORMHOLE_SYSINFO_PROBE_ARG(a2), WORMHOLE_SYSINFO_PROBE_ARG(a3))
+#else
+#  define WORMHOLE_SYSINFO_PROBE2(name, a1, a2) \
+    do                                          \
+    {                                           \
+    } while (false)
+#  define WORMHOLE_SYSINFO_PROBE3(name, a1, a2, a3) \
+    do                                              \
+    {                                               \
+    } while (false)
+#endif
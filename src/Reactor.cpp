@@ -0,0 +1,396 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/Reactor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <limits>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace wormhole::sysinfo::Netlink
+{
+outcome::std_result<std::unique_ptr<Reactor>> Reactor::open()
+{
+  return open(Options{});
+}
+
+outcome::std_result<std::unique_ptr<Reactor>> Reactor::open(Options options)
+{
+  int epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  int wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wakeFd < 0)
+  {
+    auto const error = errno;
+    close(epoll);
+    return static_cast<errno_errc>(error);
+  }
+  // level triggered, stop() is seen by every round until it is read
+  struct epoll_event wake{.events = EPOLLIN, .data = {.u64 = WakeToken}};
+  if (epoll_ctl(epoll, EPOLL_CTL_ADD, wakeFd, &wake) < 0)
+  {
+    auto const error = errno;
+    close(wakeFd);
+    close(epoll);
+    return static_cast<errno_errc>(error);
+  }
+  options.budget = std::max<std::size_t>(options.budget, 1);
+  return std::unique_ptr<Reactor>{new Reactor{options, epoll, wakeFd}};
+}
+
+Reactor::Reactor(Options t_options, int t_epoll, int t_wakeFd)
+  : m_options{t_options}
+  , m_epoll{t_epoll}
+  , m_wakeFd{t_wakeFd}
+{
+}
+
+Reactor::~Reactor()
+{
+  close(m_wakeFd);
+  close(m_epoll);
+}
+
+outcome::std_result<Reactor::Handle> Reactor::add(Socket& socket, SocketHandler handler)
+{
+  Entry entry;
+  entry.fd = socket.native_handle();
+  entry.socket = &socket;
+  entry.socketHandler = std::move(handler);
+  BOOST_OUTCOME_TRY(auto handle, insert(entry.fd, EPOLLIN, std::move(entry)));
+  // events the socket queued before are invisible to epoll
+  schedule(handle.value);
+  return handle;
+}
+
+outcome::std_result<Reactor::Handle> Reactor::add(int fd, FdHandler handler, std::uint32_t events)
+{
+  Entry entry;
+  entry.fd = fd;
+  entry.fdHandler = std::move(handler);
+  return insert(fd, events, std::move(entry));
+}
+
+outcome::std_result<Reactor::Handle> Reactor::insert(int fd, std::uint32_t events, Entry entry)
+{
+  if (m_free.empty())
+  {
+    m_free.push_back(static_cast<std::uint32_t>(m_entries.size()));
+    m_entries.emplace_back().generation = 1;
+  }
+  auto const slot = m_free.back();
+  entry.generation = m_entries[slot].generation;
+  std::uint64_t const token = (std::uint64_t{entry.generation} << 32) | slot;
+  struct epoll_event event{.events = events | EPOLLET, .data = {.u64 = token}};
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  m_free.pop_back();
+  m_entries[slot] = std::move(entry);
+  ++m_size;
+  return Handle{token};
+}
+
+outcome::std_result<void> Reactor::remove(Handle handle)
+{
+  auto* entry = lookup(handle.value);
+  if (!entry)
+  {
+    return ReactorError::UnknownHandle;
+  }
+  // a descriptor closed before is gone from the set already
+  if (epoll_ctl(m_epoll, EPOLL_CTL_DEL, entry->fd, nullptr) < 0 && errno != EBADF && errno != ENOENT)
+  {
+    return static_cast<errno_errc>(errno);
+  }
+  ++entry->generation;
+  entry->fd = -1;
+  entry->ready = false;
+  entry->resendAt.reset();
+  --m_size;
+  auto const slot = static_cast<std::uint32_t>(handle.value & 0xFFFFFFFF);
+  // the handler may be the one running
+  m_retired.push_back(slot);
+  if (!m_polling)
+  {
+    release();
+  }
+  return outcome::success();
+}
+
+Reactor::Entry* Reactor::lookup(std::uint64_t token) noexcept
+{
+  auto const slot = token & 0xFFFFFFFF;
+  if (slot >= m_entries.size())
+  {
+    return nullptr;
+  }
+  auto& entry = m_entries[slot];
+  if (entry.fd < 0 || entry.generation != static_cast<std::uint32_t>(token >> 32))
+  {
+    return nullptr;
+  }
+  return &entry;
+}
+
+void Reactor::schedule(std::uint64_t token)
+{
+  if (auto* entry = lookup(token); entry && !entry->ready)
+  {
+    entry->ready = true;
+    m_ready.push_back(token);
+  }
+}
+
+std::size_t Reactor::drain(std::uint64_t token)
+{
+  std::size_t handled = 0;
+  for (;;)
+  {
+    // looked up again after every handler, it may have removed its socket
+    auto* entry = lookup(token);
+    if (!entry)
+    {
+      break;
+    }
+    if (handled == m_options.budget)
+    {
+      schedule(token);
+      m_deferred.fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+    auto result = entry->socket->receive(Socket::ReceiveMode::Nonblock);
+    if (!result && result.error() == make_error_code(static_cast<errno_errc>(EAGAIN)))
+    {
+      // edge triggered: epoll reports the socket again once new data arrives, a restarted
+      // dump waiting for its backoff is rescheduled by expire()
+      if (auto const resendAt = entry->socket->resend_at(); resendAt && !entry->resendAt)
+      {
+        entry->resendAt = resendAt;
+        m_waiting.push_back(token);
+      }
+      break;
+    }
+    ++handled;
+    entry->socketHandler(*entry->socket, std::move(result));
+  }
+  m_dispatched.fetch_add(handled, std::memory_order_relaxed);
+  return handled;
+}
+
+std::size_t Reactor::serve()
+{
+  std::size_t handled = 0;
+  m_round.swap(m_ready);
+  for (auto const token : m_round)
+  {
+    if (auto* entry = lookup(token); entry)
+    {
+      entry->ready = false;
+      handled += drain(token);
+    }
+  }
+  m_round.clear();
+  return handled;
+}
+
+void Reactor::expire()
+{
+  if (m_waiting.empty())
+  {
+    return;
+  }
+  auto const now = Metrics::Clock::now();
+  std::erase_if(m_waiting,
+      [this, now](std::uint64_t token)
+      {
+        auto* entry = lookup(token);
+        if (!entry || !entry->resendAt)
+        {
+          return true;
+        }
+        if (*entry->resendAt > now)
+        {
+          return false;
+        }
+        entry->resendAt.reset();
+        schedule(token);
+        return true;
+      });
+}
+
+int Reactor::waitTimeout(std::optional<Metrics::Clock::time_point> deadline) const noexcept
+{
+  for (auto const token : m_waiting)
+  {
+    auto const slot = token & 0xFFFFFFFF;
+    if (auto const& entry = m_entries[slot]; entry.resendAt && (!deadline || *entry.resendAt < *deadline))
+    {
+      deadline = entry.resendAt;
+    }
+  }
+  if (!deadline)
+  {
+    return -1;
+  }
+  auto const left = std::chrono::ceil<std::chrono::milliseconds>(*deadline - Metrics::Clock::now()).count();
+  return static_cast<int>(std::clamp<decltype(left)>(left, 0, std::numeric_limits<int>::max()));
+}
+
+void Reactor::release()
+{
+  for (auto const slot : m_retired)
+  {
+    auto& entry = m_entries[slot];
+    auto const generation = entry.generation;
+    entry = Entry{};
+    entry.generation = generation;
+    m_free.push_back(slot);
+  }
+  m_retired.clear();
+}
+
+outcome::std_result<std::size_t> Reactor::poll(std::optional<std::chrono::milliseconds> timeout)
+{
+  if (m_polling)
+  {
+    return ReactorError::Running;
+  }
+  if (m_stopping.load(std::memory_order_acquire))
+  {
+    return 0;
+  }
+  struct Round
+  {
+    Reactor& reactor;
+    explicit Round(Reactor& t_reactor)
+      : reactor{t_reactor}
+    {
+      reactor.m_polling = true;
+    }
+    ~Round()
+    {
+      reactor.m_polling = false;
+      reactor.release();
+    }
+  } const round{*this};
+
+  std::optional<Metrics::Clock::time_point> deadline;
+  if (timeout)
+  {
+    deadline = Metrics::Clock::now() + *timeout;
+  }
+  std::array<struct epoll_event, EventBatch> events{};
+  std::size_t handled = 0;
+  for (;;)
+  {
+    auto const wait = m_options.mode == Mode::BusyPoll || !m_ready.empty() ? 0 : waitTimeout(deadline);
+    int count = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), wait);
+    if (count < 0)
+    {
+      if (errno != EINTR)
+      {
+        return static_cast<errno_errc>(errno);
+      }
+      count = 0;
+    }
+    if (count > 0)
+    {
+      m_wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+    for (auto const& event : std::span{events.data(), static_cast<std::size_t>(count)})
+    {
+      if (event.data.u64 == WakeToken)
+      {
+        std::uint64_t value;
+        static_cast<void>(read(m_wakeFd, &value, sizeof(value)));
+        continue;
+      }
+      auto* entry = lookup(event.data.u64);
+      if (!entry)
+      {
+        continue;
+      }
+      if (entry->socket)
+      {
+        schedule(event.data.u64);
+      }
+      else
+      {
+        ++handled;
+        m_dispatched.fetch_add(1, std::memory_order_relaxed);
+        entry->fdHandler(entry->fd, event.events);
+      }
+    }
+    expire();
+    handled += serve();
+    if (count > 0 || handled > 0 || m_options.mode == Mode::Block || m_stopping.load(std::memory_order_relaxed) || (deadline && Metrics::Clock::now() >= *deadline))
+    {
+      break;
+    }
+    m_spins.fetch_add(1, std::memory_order_relaxed);
+  }
+  return handled;
+}
+
+outcome::std_result<void> Reactor::run()
+{
+  if (m_options.cpu >= 0)
+  {
+    if (m_options.cpu >= CPU_SETSIZE)
+    {
+      return static_cast<errno_errc>(EINVAL);
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(static_cast<std::size_t>(m_options.cpu), &cpus);
+    if (auto const error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); error != 0)
+    {
+      return static_cast<errno_errc>(error);
+    }
+  }
+  while (!m_stopping.load(std::memory_order_acquire))
+  {
+    BOOST_OUTCOME_TRY(poll());
+  }
+  return outcome::success();
+}
+
+void Reactor::stop()
+{
+  m_stopping.store(true, std::memory_order_release);
+  std::uint64_t one = 1;
+  static_cast<void>(write(m_wakeFd, &one, sizeof(one)));
+}
+
+Reactor::Options const& Reactor::options() const noexcept
+{
+  return m_options;
+}
+
+Reactor::Stats Reactor::stats() const noexcept
+{
+  return {.wakeups = m_wakeups.load(std::memory_order_relaxed),
+      .spins = m_spins.load(std::memory_order_relaxed),
+      .dispatched = m_dispatched.load(std::memory_order_relaxed),
+      .deferred = m_deferred.load(std::memory_order_relaxed)};
+}
+
+std::size_t Reactor::size() const noexcept
+{
+  return m_size;
+}
+}  // namespace wormhole::sysinfo::Netlink
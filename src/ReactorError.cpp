@@ -0,0 +1,41 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/ReactorError.hpp"
+
+namespace
+{
+struct ReactorError_cat : std::error_category
+{
+  [[nodiscard]] char const* name() const noexcept override
+  {
+    return "reactor";
+  }
+
+  [[nodiscard]] std::string message(int val) const override
+  {
+    switch (static_cast<wormhole::sysinfo::Netlink::ReactorError>(val))
+    {
+      case wormhole::sysinfo::Netlink::ReactorError::None:
+        return "None";
+      case wormhole::sysinfo::Netlink::ReactorError::UnknownHandle:
+        return "UnknownHandle";
+      case wormhole::sysinfo::Netlink::ReactorError::Running:
+        return "Running";
+    }
+    return "unknown";
+  }
+};
+const ReactorError_cat reactorErrorCat;
+}  // namespace
+
+namespace wormhole::sysinfo::Netlink
+{
+std::error_code make_error_code(ReactorError val)
+{
+  return {static_cast<int>(val), reactorErrorCat};
+}
+}  // namespace wormhole::sysinfo::Netlink
@@ -0,0 +1,514 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/RouteFingerprint.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <thread>
+
+#include <sys/socket.h>
+
+#include "wormhole/sysinfo/helper.hpp"
+
+namespace
+{
+using namespace wormhole::sysinfo;
+
+constexpr std::size_t MinRoutesPerThread = 16384;
+constexpr std::uint64_t HighSeed = 0x6A09E667F3BCC908ULL;
+constexpr std::uint64_t LowSeed = 0xBB67AE8584CAA73BULL;
+
+// splitmix64 per word, sums of different route sets only match on a real collision
+constexpr std::uint64_t absorb(std::uint64_t hash, std::uint64_t value) noexcept
+{
+  hash += value + 0x9E3779B97F4A7C15ULL;
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+  return hash ^ (hash >> 31);
+}
+
+constexpr std::uint64_t mask(std::size_t length) noexcept
+{
+  return length == 0 ? 0 : ~std::uint64_t{0} << (64 - length);
+}
+
+std::pair<std::uint64_t, std::uint64_t> words(boost::asio::ip::address_v6 const& address) noexcept
+{
+  auto const bytes = address.to_bytes();
+  std::uint64_t high = 0;
+  std::uint64_t low = 0;
+  for (std::size_t i = 0; i < 8; ++i)
+  {
+    high = high << 8 | bytes[i];
+    low = low << 8 | bytes[i + 8];
+  }
+  return {high, low};
+}
+
+std::uint64_t absorbAddress(std::uint64_t hash, boost::asio::ip::address const& address) noexcept
+{
+  if (address.is_v4())
+  {
+    return absorb(absorb(hash, 4), address.to_v4().to_uint());
+  }
+  auto const [high, low] = words(address.to_v6());
+  return absorb(absorb(absorb(hash, 6), high), low);
+}
+
+std::uint64_t lane(Route const& route, std::uint64_t hash) noexcept
+{
+  hash = absorb(hash, static_cast<std::uint64_t>(route.family));
+  hash = absorb(hash, static_cast<std::uint64_t>(route.table));
+  hash = absorb(hash, static_cast<std::uint64_t>(route.type));
+  hash = std::visit(helper::overloaded{[hash](Route::Default_t)
+                        {
+                          return absorb(hash, 0);
+                        },
+                        [hash](auto const& network)
+                        {
+                          return absorb(absorbAddress(hash, boost::asio::ip::address{network.network()}), network.prefix_length() + 1);
+                        }},
+      route.destination.value);
+  hash = absorbAddress(hash, route.gateway);
+  std::string_view const name{route.interfaceName};
+  hash = absorb(hash, name.size());
+  for (std::size_t i = 0; i < name.size(); i += sizeof(std::uint64_t))
+  {
+    std::uint64_t word = 0;
+    std::memcpy(&word, name.data() + i, std::min(sizeof(word), name.size() - i));
+    hash = absorb(hash, word);
+  }
+  hash = absorbAddress(hash, route.source);
+  hash = absorb(hash, route.priority);
+  hash = absorb(hash, route.tos);
+  // paths are summed up, their order does not matter
+  std::uint64_t paths = 0;
+  if (route.nexthops)
+  {
+    for (auto const& path : route.nexthops->paths)
+    {
+      paths += absorb(absorbAddress(hash, path.gateway), path.weight);
+    }
+  }
+  return absorb(hash, paths);
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+RouteFingerprint::Digest& RouteFingerprint::Digest::operator+=(Digest const& rhs) noexcept
+{
+  high += rhs.high;
+  low += rhs.low;
+  routes += rhs.routes;
+  return *this;
+}
+
+RouteFingerprint::Digest& RouteFingerprint::Digest::operator-=(Digest const& rhs) noexcept
+{
+  high -= rhs.high;
+  low -= rhs.low;
+  routes -= rhs.routes;
+  return *this;
+}
+
+std::size_t RouteFingerprint::Hash::operator()(Node const& node) const noexcept
+{
+  auto hash = absorb(node.bits, node.table);
+  return absorb(hash, std::uint64_t{node.length} << 8 | node.family);
+}
+
+std::size_t RouteFingerprint::Hash::operator()(Identity const& identity) const noexcept
+{
+  auto hash = absorb(absorb(identity.high, identity.low), std::uint64_t{identity.table} << 32 | identity.priority);
+  return absorb(hash, std::uint64_t{identity.length} << 16 | std::uint64_t{identity.family} << 8 | identity.tos);
+}
+
+RouteFingerprint::RouteFingerprint(std::span<Route const> routes)
+{
+  load(routes);
+}
+
+void RouteFingerprint::load(std::span<Route const> routes, std::size_t threads)
+{
+  clear();
+  if (threads == 0)
+  {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  threads = std::clamp<std::size_t>(routes.size() / MinRoutesPerThread, 1, threads);
+
+  struct Part
+  {
+    Nodes nodes;
+    std::vector<std::pair<Identity, Digest>> routes;
+  };
+  std::vector<Part> parts(threads);
+  auto const hash = [&](std::size_t part)
+  {
+    auto& [nodes, hashed] = parts[part];
+    auto const chunk = routes.subspan(routes.size() * part / threads, routes.size() * (part + 1) / threads - routes.size() * part / threads);
+    hashed.reserve(chunk.size());
+    for (auto const& route : chunk)
+    {
+      if (route.action == Action::Del || (route.family != AF_INET && route.family != AF_INET6))
+      {
+        continue;
+      }
+      auto const& [id, value] = hashed.emplace_back(identity(route), digest(route));
+      nodes[node(id, depth(id))] += value;
+    }
+  };
+  {
+    std::vector<std::jthread> pool;
+    for (std::size_t part = 1; part < threads; ++part)
+    {
+      pool.emplace_back(hash, part);
+    }
+    hash(0);
+  }
+
+  m_nodes = std::move(parts.front().nodes);
+  for (auto& part : std::span{parts}.subspan(1))
+  {
+    for (auto const& [node, value] : part.nodes)
+    {
+      m_nodes[node] += value;
+    }
+    part.nodes.clear();
+  }
+  // routes were only added to their deepest node, every level adds up into the one above
+  std::vector<std::pair<Node, Digest>> level;
+  for (auto length = LeafLengthV6; length >= Stride; length -= Stride)
+  {
+    level.clear();
+    for (auto const& entry : m_nodes)
+    {
+      if (entry.first.length == length)
+      {
+        level.push_back(entry);
+      }
+    }
+    for (auto const& [key, value] : level)
+    {
+      auto parent = key;
+      parent.length = static_cast<std::uint8_t>(length - Stride);
+      parent.bits &= mask(parent.length);
+      m_nodes[parent] += value;
+    }
+  }
+  reserve(routes.size());
+  for (auto const& part : parts)
+  {
+    for (auto const& [id, value] : part.routes)
+    {
+      m_total += value;
+      auto [slot, claimed] = claim(id);
+      // the later of two routes the kernel could not tell apart wins, as with apply()
+      if (!claimed)
+      {
+        subtract(m_nodes, id, slot->value);
+        m_total -= slot->value;
+      }
+      slot->value = value;
+    }
+  }
+}
+
+void RouteFingerprint::apply(Route const& route)
+{
+  if (route.family != AF_INET && route.family != AF_INET6)
+  {
+    return;
+  }
+  auto const id = identity(route);
+  if (route.action == Action::Del)
+  {
+    if (auto* slot = find(id); slot)
+    {
+      subtract(m_nodes, id, slot->value);
+      m_total -= slot->value;
+      erase(slot);
+    }
+    return;
+  }
+  if (route.action != Action::New)
+  {
+    return;
+  }
+  auto const value = digest(route);
+  auto [slot, claimed] = claim(id);
+  if (!claimed)
+  {
+    if (slot->value == value)
+    {
+      return;
+    }
+    subtract(m_nodes, id, slot->value);
+    m_total -= slot->value;
+  }
+  slot->value = value;
+  add(m_nodes, id, value);
+  m_total += value;
+}
+
+void RouteFingerprint::clear() noexcept
+{
+  m_nodes.clear();
+  m_slots.clear();
+  m_size = 0;
+  m_total = {};
+}
+
+RouteFingerprint::Digest RouteFingerprint::total() const noexcept
+{
+  return m_total;
+}
+
+RouteFingerprint::Digest RouteFingerprint::table(int family, Route::Table table) const
+{
+  return range(Prefix{table, {}, family});
+}
+
+RouteFingerprint::Digest RouteFingerprint::range(Prefix const& prefix) const
+{
+  if (auto const key = node(prefix); key)
+  {
+    if (auto it = m_nodes.find(*key); it != m_nodes.end())
+    {
+      return it->second;
+    }
+  }
+  return {};
+}
+
+std::vector<std::pair<RouteFingerprint::Prefix, RouteFingerprint::Digest>> RouteFingerprint::children(Prefix const& prefix) const
+{
+  std::vector<std::pair<Prefix, Digest>> result;
+  auto const parent = node(prefix);
+  if (!parent || parent->length + Stride > (parent->family == AF_INET ? LeafLengthV4 : LeafLengthV6))
+  {
+    return result;
+  }
+  auto const length = static_cast<std::uint8_t>(parent->length + Stride);
+  for (std::uint64_t child = 0; child < (1U << Stride); ++child)
+  {
+    Node key{parent->bits | child << (64 - length), parent->table, length, parent->family};
+    auto it = m_nodes.find(key);
+    if (it == m_nodes.end())
+    {
+      continue;
+    }
+    Prefix childPrefix{prefix.table, {}, parent->family};
+    if (parent->family == AF_INET)
+    {
+      childPrefix.destination.emplace<boost::asio::ip::network_v4>(boost::asio::ip::address_v4{static_cast<std::uint32_t>(key.bits >> 32)}, length);
+    }
+    else
+    {
+      boost::asio::ip::address_v6::bytes_type bytes{};
+      for (std::size_t i = 0; i < 8; ++i)
+      {
+        bytes[i] = static_cast<unsigned char>(key.bits >> (56 - 8 * i));
+      }
+      childPrefix.destination.emplace<boost::asio::ip::network_v6>(boost::asio::ip::address_v6{bytes}, length);
+    }
+    result.emplace_back(std::move(childPrefix), it->second);
+  }
+  return result;
+}
+
+std::vector<Route::Table> RouteFingerprint::tables(int family) const
+{
+  std::vector<Route::Table> result;
+  for (auto const& [key, value] : m_nodes)
+  {
+    if (key.length == 0 && key.family == family)
+    {
+      result.push_back(static_cast<Route::Table>(key.table));
+    }
+  }
+  std::ranges::sort(result);
+  return result;
+}
+
+std::size_t RouteFingerprint::size() const noexcept
+{
+  return m_size;
+}
+
+RouteFingerprint::Digest RouteFingerprint::digest(Route const& route) noexcept
+{
+  return {lane(route, HighSeed), lane(route, LowSeed), 1};
+}
+
+RouteFingerprint::Identity RouteFingerprint::identity(Route const& route) noexcept
+{
+  Identity id{0, 0, static_cast<std::uint32_t>(route.table), route.priority, 0, static_cast<std::uint8_t>(route.family), route.tos};
+  std::visit(helper::overloaded{[](Route::Default_t)
+                 {
+                 },
+                 [&id](boost::asio::ip::network_v4 const& network)
+                 {
+                   id.high = std::uint64_t{network.network().to_uint()} << 32;
+                   id.length = static_cast<std::uint8_t>(network.prefix_length());
+                 },
+                 [&id](boost::asio::ip::network_v6 const& network)
+                 {
+                   std::tie(id.high, id.low) = words(network.network());
+                   id.length = static_cast<std::uint8_t>(network.prefix_length());
+                 }},
+      route.destination.value);
+  return id;
+}
+
+std::optional<RouteFingerprint::Node> RouteFingerprint::node(Prefix const& prefix) noexcept
+{
+  auto const level = [](std::size_t length, std::size_t leaf)
+  {
+    return static_cast<std::uint8_t>(std::min(length / Stride * Stride, leaf));
+  };
+  auto const table = static_cast<std::uint32_t>(prefix.table);
+  return std::visit(helper::overloaded{[&](Route::Default_t) -> std::optional<Node>
+                        {
+                          if (prefix.family != AF_INET && prefix.family != AF_INET6)
+                          {
+                            return std::nullopt;
+                          }
+                          return Node{0, table, 0, static_cast<std::uint8_t>(prefix.family)};
+                        },
+                        [&](boost::asio::ip::network_v4 const& network) -> std::optional<Node>
+                        {
+                          auto const length = level(network.prefix_length(), LeafLengthV4);
+                          return Node{(std::uint64_t{network.network().to_uint()} << 32) & mask(length), table, length, AF_INET};
+                        },
+                        [&](boost::asio::ip::network_v6 const& network) -> std::optional<Node>
+                        {
+                          auto const length = level(network.prefix_length(), LeafLengthV6);
+                          return Node{words(network.network()).first & mask(length), table, length, AF_INET6};
+                        }},
+      prefix.destination.value);
+}
+
+RouteFingerprint::Node RouteFingerprint::node(Identity const& id, std::size_t length) noexcept
+{
+  return {id.high & mask(length), id.table, static_cast<std::uint8_t>(length), id.family};
+}
+
+std::size_t RouteFingerprint::depth(Identity const& id) noexcept
+{
+  return std::min<std::size_t>(id.length / Stride * Stride, id.family == AF_INET ? LeafLengthV4 : LeafLengthV6);
+}
+
+template <typename F>
+void RouteFingerprint::path(Identity const& id, F&& f)
+{
+  for (std::size_t length = 0; length <= depth(id); length += Stride)
+  {
+    f(node(id, length));
+  }
+}
+
+void RouteFingerprint::add(Nodes& nodes, Identity const& id, Digest const& value)
+{
+  path(id,
+      [&](Node const& key)
+      {
+        nodes[key] += value;
+      });
+}
+
+void RouteFingerprint::subtract(Nodes& nodes, Identity const& id, Digest const& value)
+{
+  path(id,
+      [&](Node const& key)
+      {
+        auto it = nodes.find(key);
+        if (it == nodes.end())
+        {
+          return;
+        }
+        it->second -= value;
+        if (it->second.routes == 0)
+        {
+          nodes.erase(it);
+        }
+      });
+}
+
+RouteFingerprint::Slot* RouteFingerprint::find(Identity const& id) noexcept
+{
+  if (m_slots.empty())
+  {
+    return nullptr;
+  }
+  auto const slotMask = m_slots.size() - 1;
+  for (auto position = Hash{}(id) & slotMask; m_slots[position].id.family != 0; position = (position + 1) & slotMask)
+  {
+    if (m_slots[position].id == id)
+    {
+      return &m_slots[position];
+    }
+  }
+  return nullptr;
+}
+
+std::pair<RouteFingerprint::Slot*, bool> RouteFingerprint::claim(Identity const& id)
+{
+  reserve(m_size + 1);
+  auto const slotMask = m_slots.size() - 1;
+  auto position = Hash{}(id) & slotMask;
+  for (; m_slots[position].id.family != 0; position = (position + 1) & slotMask)
+  {
+    if (m_slots[position].id == id)
+    {
+      return {&m_slots[position], false};
+    }
+  }
+  m_slots[position].id = id;
+  ++m_size;
+  return {&m_slots[position], true};
+}
+
+void RouteFingerprint::erase(Slot* slot) noexcept
+{
+  // backward shift, no tombstones
+  auto const slotMask = m_slots.size() - 1;
+  auto hole = static_cast<std::size_t>(slot - m_slots.data());
+  for (auto next = (hole + 1) & slotMask; m_slots[next].id.family != 0; next = (next + 1) & slotMask)
+  {
+    auto const home = Hash{}(m_slots[next].id) & slotMask;
+    if (((next - home) & slotMask) >= ((next - hole) & slotMask))
+    {
+      m_slots[hole] = m_slots[next];
+      hole = next;
+    }
+  }
+  m_slots[hole] = {};
+  --m_size;
+}
+
+void RouteFingerprint::reserve(std::size_t routes)
+{
+  // at most three quarters full
+  auto const needed = std::bit_ceil(std::max<std::size_t>(routes + routes / 3 + 1, 16));
+  if (needed <= m_slots.size())
+  {
+    return;
+  }
+  auto old = std::exchange(m_slots, std::vector<Slot>(needed));
+  m_size = 0;
+  for (auto const& slot : old)
+  {
+    if (slot.id.family != 0)
+    {
+      claim(slot.id).first->value = slot.value;
+    }
+  }
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,407 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/RouteResolver.hpp"
+
+#include <algorithm>
+
+#include "wormhole/sysinfo/helper.hpp"
+
+namespace
+{
+using namespace wormhole::sysinfo;
+
+std::vector<Rule> defaultRules(int family)
+{
+  auto makeRule = [family](std::uint32_t priority, Route::Table table)
+  {
+    Rule rule;
+    rule.family = family;
+    rule.priority = priority;
+    rule.table = table;
+    return rule;
+  };
+  std::vector<Rule> rules{makeRule(0, Route::Table::Local), makeRule(32766, Route::Table::Main)};
+  if (family == AF_INET)
+  {
+    rules.push_back(makeRule(32767, Route::Table::Default));
+  }
+  return rules;
+}
+
+bool sameSelector(Rule const& lhs, Rule const& rhs)
+{
+  return lhs.priority == rhs.priority && lhs.type == rhs.type && lhs.table == rhs.table && lhs.gotoTarget == rhs.gotoTarget && lhs.source == rhs.source && lhs.destination == rhs.destination && lhs.inputInterface == rhs.inputInterface && lhs.outputInterface == rhs.outputInterface && lhs.fwmark == rhs.fwmark && lhs.fwmask == rhs.fwmask && lhs.tos == rhs.tos && lhs.invert == rhs.invert && lhs.uidRange == rhs.uidRange && lhs.ipProtocol == rhs.ipProtocol && lhs.sourcePorts == rhs.sourcePorts && lhs.destinationPorts == rhs.destinationPorts && lhs.l3mdev == rhs.l3mdev && lhs.tunnelId == rhs.tunnelId;
+}
+
+// kernel keeps aliases of one prefix sorted by tos (descending) and priority
+bool routeOrder(Route const& lhs, Route const& rhs)
+{
+  if (lhs.tos != rhs.tos)
+  {
+    return lhs.tos > rhs.tos;
+  }
+  return lhs.priority < rhs.priority;
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+RouteResolver::RouteResolver()
+  : m_rulesV4{defaultRules(AF_INET)}
+  , m_rulesV6{defaultRules(AF_INET6)}
+{
+}
+
+RouteResolver::RouteResolver(std::span<Rule const> t_rules, std::span<Route const> t_routes)
+  : RouteResolver{}
+{
+  for (int family : {AF_INET, AF_INET6})
+  {
+    if (std::ranges::any_of(t_rules, [family](Rule const& rule)
+            {
+              return rule.family == family;
+            }))
+    {
+      rules(family).clear();
+    }
+  }
+  for (auto const& rule : t_rules)
+  {
+    apply(rule);
+  }
+  for (auto const& route : t_routes)
+  {
+    apply(route);
+  }
+}
+
+void RouteResolver::apply(Rule const& rule)
+{
+  if (rule.family != AF_INET && rule.family != AF_INET6)
+  {
+    return;
+  }
+  auto& list = rules(rule.family);
+  if (rule.action == Action::Del)
+  {
+    auto it = std::ranges::find_if(list, [&rule](Rule const& item)
+        {
+          return sameSelector(item, rule);
+        });
+    if (it != list.end())
+    {
+      list.erase(it);
+    }
+    return;
+  }
+  auto pos = std::ranges::upper_bound(list, rule.priority, {}, &Rule::priority);
+  list.insert(pos, rule)->action = Action::New;
+}
+
+void RouteResolver::apply(Route const& route)
+{
+  if (route.family != AF_INET && route.family != AF_INET6)
+  {
+    return;
+  }
+  auto key = makeKey(route.destination);
+  auto& prefixIndex = *index(route.table, route.family);
+  auto& aliases = prefixIndex.routes[key];
+
+  auto it = std::ranges::find_if(aliases, [&route](Route const& item)
+      {
+        return item.tos == route.tos && item.priority == route.priority;
+      });
+  if (route.action == Action::Del)
+  {
+    if (it != aliases.end())
+    {
+      aliases.erase(it);
+      --prefixIndex.lengthCount[key.length];
+    }
+  }
+  else if (it != aliases.end())
+  {
+    *it = route;
+  }
+  else
+  {
+    aliases.insert(std::ranges::upper_bound(aliases, route, routeOrder), route);
+    ++prefixIndex.lengthCount[key.length];
+  }
+
+  if (aliases.empty())
+  {
+    prefixIndex.routes.erase(key);
+  }
+
+  auto populated = std::ranges::binary_search(prefixIndex.lengths, key.length, std::greater<>{});
+  if (populated != (prefixIndex.lengthCount[key.length] > 0))
+  {
+    if (populated)
+    {
+      std::erase(prefixIndex.lengths, key.length);
+    }
+    else
+    {
+      prefixIndex.lengths.insert(std::ranges::upper_bound(prefixIndex.lengths, key.length, std::greater<>{}), key.length);
+    }
+  }
+}
+
+outcome::std_result<Route const*> RouteResolver::resolve(Flow const& flow) const
+{
+  if (!flow.source.is_unspecified() && flow.source.is_v4() != flow.destination.is_v4())
+  {
+    return ResolverError::InvalidFamily;
+  }
+  int const family = flow.destination.is_v4() ? AF_INET : AF_INET6;
+  std::size_t const hostLength = family == AF_INET ? 32 : 128;
+  auto const destination = makeKey(flow.destination, hostLength);
+  auto const source = makeKey(flow.source, hostLength);
+
+  auto const& list = rules(family);
+  for (std::size_t i = 0; i < list.size(); ++i)
+  {
+    auto const& rule = list[i];
+    BOOST_OUTCOME_TRY(auto selected, matches(rule, flow, destination, source));
+    if (!selected)
+    {
+      continue;
+    }
+    switch (rule.type)
+    {
+      case Rule::Type::Goto:
+      {
+        auto target = std::find_if(list.begin() + static_cast<std::ptrdiff_t>(i) + 1, list.end(), [&rule](Rule const& item)
+            {
+              return item.priority == rule.gotoTarget;
+            });
+        if (target != list.end())
+        {
+          i = static_cast<std::size_t>(target - list.begin()) - 1;
+        }
+        continue;
+      }
+      case Rule::Type::Blackhole:
+        return ResolverError::Blackhole;
+      case Rule::Type::Unreachable:
+        return ResolverError::Unreachable;
+      case Rule::Type::Prohibit:
+        return ResolverError::Prohibit;
+      case Rule::Type::ToTable:
+        break;
+      case Rule::Type::Nop:
+      case Rule::Type::Unspec:
+        continue;
+    }
+
+    auto const* prefixIndex = index(rule.table, family);
+    if (!prefixIndex)
+    {
+      continue;
+    }
+    auto const* route = lookup(*prefixIndex, destination, flow);
+    if (!route)
+    {
+      continue;
+    }
+    switch (route->type)
+    {
+      case Route::Type::Throw:
+        continue;
+      case Route::Type::Blackhole:
+        return ResolverError::Blackhole;
+      case Route::Type::Unreachable:
+        return ResolverError::Unreachable;
+      case Route::Type::Prohibit:
+        return ResolverError::Prohibit;
+      default:
+        break;
+    }
+    if (rule.suppressPrefixLength && route->destination.PrefixLength() <= *rule.suppressPrefixLength)
+    {
+      continue;
+    }
+    return route;
+  }
+  return ResolverError::NoRoute;
+}
+
+std::size_t RouteResolver::KeyHash::operator()(Key const& key) const noexcept
+{
+  auto h = key.high * 0x9E3779B97F4A7C15ull;
+  h ^= (key.low + 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2));
+  h ^= key.length * 0x165667B19E3779F9ull;
+  return static_cast<std::size_t>(h ^ (h >> 29));
+}
+
+RouteResolver::Key RouteResolver::mask(Key key, std::size_t length)
+{
+  key.length = length;
+  if (length == 0)
+  {
+    key.high = 0;
+    key.low = 0;
+  }
+  else if (length <= 64)
+  {
+    key.high &= ~std::uint64_t{0} << (64 - length);
+    key.low = 0;
+  }
+  else if (length < 128)
+  {
+    key.low &= ~std::uint64_t{0} << (128 - length);
+  }
+  return key;
+}
+
+RouteResolver::Key RouteResolver::makeKey(boost::asio::ip::address const& address, std::size_t length)
+{
+  Key key{0, 0, length};
+  if (address.is_v4())
+  {
+    key.high = std::uint64_t{address.to_v4().to_uint()} << 32;
+  }
+  else if (address.is_v6())
+  {
+    auto bytes = address.to_v6().to_bytes();
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+      key.high = (key.high << 8) | bytes[i];
+      key.low = (key.low << 8) | bytes[i + 8];
+    }
+  }
+  return mask(key, length);
+}
+
+RouteResolver::Key RouteResolver::makeKey(Route::Destination const& destination)
+{
+  return std::visit(helper::overloaded{[](Route::Default_t)
+                        {
+                          return Key{0, 0, 0};
+                        },
+                        [](auto const& network)
+                        {
+                          return makeKey(network.network(), network.prefix_length());
+                        }},
+      destination.value);
+}
+
+outcome::std_result<bool> RouteResolver::matches(Rule const& rule, Flow const& flow, Key const& destination, Key const& source)
+{
+  auto selects = [&]()
+  {
+    if (!rule.inputInterface.empty() && rule.inputInterface != flow.inputInterface)
+    {
+      return false;
+    }
+    if (!rule.outputInterface.empty() && rule.outputInterface != flow.outputInterface)
+    {
+      return false;
+    }
+    if ((rule.fwmark ^ flow.mark) & rule.fwmask)
+    {
+      return false;
+    }
+    if (rule.tos != 0 && rule.tos != flow.tos)
+    {
+      return false;
+    }
+    if (rule.uidRange && !rule.uidRange->contains(flow.uid))
+    {
+      return false;
+    }
+    if (rule.ipProtocol != 0 && rule.ipProtocol != flow.protocol)
+    {
+      return false;
+    }
+    if (rule.sourcePorts && !rule.sourcePorts->contains(flow.sourcePort))
+    {
+      return false;
+    }
+    if (rule.destinationPorts && !rule.destinationPorts->contains(flow.destinationPort))
+    {
+      return false;
+    }
+    if (!rule.destination.IsDefaultRoute())
+    {
+      auto selector = makeKey(rule.destination);
+      if (selector != mask(destination, selector.length))
+      {
+        return false;
+      }
+    }
+    if (!rule.source.IsDefaultRoute())
+    {
+      auto selector = makeKey(rule.source);
+      if (selector != mask(source, selector.length))
+      {
+        return false;
+      }
+    }
+    return true;
+  }();
+  // the VRF and tunnel of the packet are unknown, only a mismatch of another selector decides
+  if (selects && (rule.l3mdev || rule.tunnelId != 0))
+  {
+    return ResolverError::Unsupported;
+  }
+  return rule.invert ? !selects : selects;
+}
+
+Route const* RouteResolver::lookup(PrefixIndex const& prefixIndex, Key const& destination, Flow const& flow)
+{
+  for (auto length : prefixIndex.lengths)
+  {
+    auto it = prefixIndex.routes.find(mask(destination, length));
+    if (it == prefixIndex.routes.end())
+    {
+      continue;
+    }
+    for (auto const& route : it->second)
+    {
+      if (route.tos != 0 && route.tos != flow.tos)
+      {
+        continue;
+      }
+      if (!flow.outputInterface.empty() && !route.interfaceName.empty() && route.interfaceName != flow.outputInterface)
+      {
+        continue;
+      }
+      return &route;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<Rule>& RouteResolver::rules(int family)
+{
+  return family == AF_INET ? m_rulesV4 : m_rulesV6;
+}
+
+std::vector<Rule> const& RouteResolver::rules(int family) const
+{
+  return family == AF_INET ? m_rulesV4 : m_rulesV6;
+}
+
+RouteResolver::PrefixIndex* RouteResolver::index(Route::Table table, int family)
+{
+  auto& tableIndex = m_tables[static_cast<std::uint32_t>(table)];
+  return family == AF_INET ? &tableIndex.v4 : &tableIndex.v6;
+}
+
+RouteResolver::PrefixIndex const* RouteResolver::index(Route::Table table, int family) const
+{
+  auto it = m_tables.find(static_cast<std::uint32_t>(table));
+  if (it == m_tables.end())
+  {
+    return nullptr;
+  }
+  return family == AF_INET ? &it->second.v4 : &it->second.v6;
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,49 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/RouteResolverError.hpp"
+
+namespace
+{
+struct RouteResolverError_cat : std::error_category
+{
+  [[nodiscard]] char const* name() const noexcept override
+  {
+    return "routeresolver";
+  }
+
+  [[nodiscard]] std::string message(int val) const override
+  {
+    switch (static_cast<wormhole::sysinfo::ResolverError>(val))
+    {
+      case wormhole::sysinfo::ResolverError::None:
+        return "None";
+      case wormhole::sysinfo::ResolverError::NoRoute:
+        return "NoRoute";
+      case wormhole::sysinfo::ResolverError::Blackhole:
+        return "Blackhole";
+      case wormhole::sysinfo::ResolverError::Unreachable:
+        return "Unreachable";
+      case wormhole::sysinfo::ResolverError::Prohibit:
+        return "Prohibit";
+      case wormhole::sysinfo::ResolverError::InvalidFamily:
+        return "InvalidFamily";
+      case wormhole::sysinfo::ResolverError::Unsupported:
+        return "Unsupported";
+    }
+    return "unknown";
+  }
+};
+const RouteResolverError_cat routeResolverErrorCat;
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+std::error_code make_error_code(ResolverError val)
+{
+  return {static_cast<int>(val), routeResolverErrorCat};
+}
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,188 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#include "wormhole/sysinfo/TrafficControlPoller.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <tuple>
+
+#include "wormhole/sysinfo/errno_error.hpp"
+
+namespace wormhole::sysinfo
+{
+namespace
+{
+auto key(TrafficControlPoller::Sample const& sample) noexcept
+{
+  return std::tuple{sample.entry.interfaceIndex, sample.object, sample.entry.handle, sample.entry.parent};
+}
+
+bool before(TrafficControlPoller::Sample const& lhs, TrafficControlPoller::Sample const& rhs) noexcept
+{
+  return key(lhs) < key(rhs);
+}
+
+// false if the counters went backwards, the object was deleted and created again in between
+bool difference(TrafficStats const& previous, TrafficStats const& current, TrafficStats& delta) noexcept
+{
+  if (current.bytes < previous.bytes)
+  {
+    return false;
+  }
+  delta.bytes = current.bytes - previous.bytes;
+  // without TCA_STATS_PKT64 the kernel's packet counter is 32 bits wide
+  delta.packets = current.packets >= previous.packets ? current.packets - previous.packets : static_cast<std::uint32_t>(current.packets - previous.packets);
+  delta.drops = current.drops - previous.drops;
+  delta.overlimits = current.overlimits - previous.overlimits;
+  delta.requeues = current.requeues - previous.requeues;
+  return true;
+}
+}  // namespace
+
+outcome::std_result<TrafficControlPoller> TrafficControlPoller::open()
+{
+  return open(Options{});
+}
+
+outcome::std_result<TrafficControlPoller> TrafficControlPoller::open(Options options)
+{
+  std::array<Netlink::Socket::Groups, 1> const groups{Netlink::Socket::GroupLink{}};
+  BOOST_OUTCOME_TRY(auto socket, Netlink::Socket::open(groups));
+  return TrafficControlPoller{std::move(socket), options};
+}
+
+TrafficControlPoller::TrafficControlPoller(Netlink::Socket t_socket, Options t_options)
+  : m_socket{std::move(t_socket)}
+  , m_options{t_options}
+{
+}
+
+outcome::std_result<std::span<TrafficControlPoller::Sample const>> TrafficControlPoller::sample()
+{
+  BOOST_OUTCOME_TRY(drain());
+  std::swap(m_previous, m_current);
+  auto const now = Netlink::Metrics::Clock::now();
+  if (auto collected = collect(); !collected)
+  {
+    // the last complete sample stays, the next one is compared to it
+    std::swap(m_previous, m_current);
+    return collected.error();
+  }
+  std::sort(m_current.begin(), m_current.end(), before);
+  join();
+  m_interval = m_sampled == Netlink::Metrics::Clock::time_point{} ? Netlink::Metrics::Clock::duration{} : now - m_sampled;
+  m_sampled = now;
+  return samples();
+}
+
+outcome::std_result<void> TrafficControlPoller::drain()
+{
+  // link events only update the socket's name cache
+  for (;;)
+  {
+    auto event = m_socket.receive(Netlink::Socket::ReceiveMode::Nonblock);
+    if (event)
+    {
+      continue;
+    }
+    if (event.error() == make_error_code(static_cast<errno_errc>(EAGAIN)))
+    {
+      return outcome::success();
+    }
+    // an overrun clears the cache, the names are looked up again
+    if (event.error() != make_error_code(static_cast<errno_errc>(ENOBUFS)) && event.error() != Netlink::SocketError::Truncated)
+    {
+      return event.error();
+    }
+  }
+}
+
+outcome::std_result<void> TrafficControlPoller::collect()
+{
+  m_current.clear();
+  BOOST_OUTCOME_TRY(dump<Netlink::Message::QdiscRequest>(Object::Qdisc, Interface::Index{0}));
+  if (!m_options.classes)
+  {
+    return outcome::success();
+  }
+  // the kernel dumps classes of one interface only
+  m_interfaces.clear();
+  for (auto const& sample : m_current)
+  {
+    if (sample.entry.kind != "noqueue")
+    {
+      m_interfaces.push_back(sample.entry.interfaceIndex);
+    }
+  }
+  std::sort(m_interfaces.begin(), m_interfaces.end());
+  m_interfaces.erase(std::unique(m_interfaces.begin(), m_interfaces.end()), m_interfaces.end());
+  for (auto const interface : m_interfaces)
+  {
+    BOOST_OUTCOME_TRY(dump<Netlink::Message::TrafficClassRequest>(Object::Class, interface));
+  }
+  return outcome::success();
+}
+
+template <typename Request>
+outcome::std_result<void> TrafficControlPoller::dump(Object object, Interface::Index interface)
+{
+  BOOST_OUTCOME_TRY(m_socket.send_request<Request>(AF_UNSPEC, interface));
+  for (;;)
+  {
+    BOOST_OUTCOME_TRY(auto event, m_socket.receive(Netlink::Socket::ReceiveMode::Wait));
+    auto* response = std::get_if<typename Request::Response_t>(&event);
+    if (!response)
+    {
+      continue;  // a link event
+    }
+    for (auto const& entry : response->data)
+    {
+      auto& sample = m_current.emplace_back();
+      sample.object = object;
+      sample.entry = entry;
+    }
+    if (!response->more)
+    {
+      return outcome::success();
+    }
+  }
+}
+
+void TrafficControlPoller::join()
+{
+  auto previous = m_previous.cbegin();
+  for (auto& sample : m_current)
+  {
+    previous = std::lower_bound(previous, m_previous.cend(), sample, before);
+    auto const& stats = sample.entry.stats;
+    sample.delta = TrafficStats{};
+    sample.added = previous == m_previous.cend() || key(*previous) != key(sample) || previous->entry.kind != sample.entry.kind || !difference(previous->entry.stats, stats, sample.delta);
+    if (sample.added)
+    {
+      sample.delta = TrafficStats{};
+    }
+    sample.delta.qlen = stats.qlen;
+    sample.delta.backlog = stats.backlog;
+  }
+}
+
+std::span<TrafficControlPoller::Sample const> TrafficControlPoller::samples() const noexcept
+{
+  return m_current;
+}
+
+Netlink::Metrics::Clock::duration TrafficControlPoller::interval() const noexcept
+{
+  return m_interval;
+}
+
+Netlink::Socket& TrafficControlPoller::socket() noexcept
+{
+  return m_socket;
+}
+}  // namespace wormhole::sysinfo
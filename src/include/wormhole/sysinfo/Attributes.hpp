@@ -0,0 +1,234 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <boost/asio/ip/address.hpp>
+
+namespace wormhole::sysinfo::Netlink::Attribute
+{
+using Payload = std::span<std::byte const>;
+
+/*
+ * converts the payload of one attribute into T.
+ * a payload that does not fit T decodes to std::nullopt.
+ */
+template <typename T>
+struct Decoder;
+
+template <typename T>
+  requires std::is_integral_v<T> || std::is_enum_v<T>
+struct Decoder<T>
+{
+  static std::optional<T> decode(Payload payload) noexcept
+  {
+    if (payload.size() < sizeof(T))
+    {
+      return std::nullopt;
+    }
+    T value;
+    std::memcpy(&value, payload.data(), sizeof(T));
+    return value;
+  }
+};
+
+template <>
+struct Decoder<Payload>
+{
+  static std::optional<Payload> decode(Payload payload) noexcept
+  {
+    return payload;
+  }
+};
+
+template <>
+struct Decoder<std::string_view>
+{
+  static std::optional<std::string_view> decode(Payload payload) noexcept
+  {
+    auto const* data = reinterpret_cast<char const*>(payload.data());
+    return std::string_view{data, strnlen(data, payload.size())};
+  }
+};
+
+template <>
+struct Decoder<boost::asio::ip::address_v4>
+{
+  static std::optional<boost::asio::ip::address_v4> decode(Payload payload) noexcept
+  {
+    boost::asio::ip::address_v4::bytes_type networkOrder;
+    if (payload.size() != networkOrder.size())
+    {
+      return std::nullopt;
+    }
+    std::memcpy(networkOrder.data(), payload.data(), networkOrder.size());
+    return boost::asio::ip::make_address_v4(networkOrder);
+  }
+};
+
+template <>
+struct Decoder<boost::asio::ip::address_v6>
+{
+  static std::optional<boost::asio::ip::address_v6> decode(Payload payload) noexcept
+  {
+    boost::asio::ip::address_v6::bytes_type networkOrder;
+    if (payload.size() != networkOrder.size())
+    {
+      return std::nullopt;
+    }
+    std::memcpy(networkOrder.data(), payload.data(), networkOrder.size());
+    return boost::asio::ip::make_address_v6(networkOrder);
+  }
+};
+
+template <>
+struct Decoder<boost::asio::ip::address>
+{
+  static std::optional<boost::asio::ip::address> decode(Payload payload) noexcept
+  {
+    if (auto v4 = Decoder<boost::asio::ip::address_v4>::decode(payload); v4)
+    {
+      return boost::asio::ip::address{*v4};
+    }
+    if (auto v6 = Decoder<boost::asio::ip::address_v6>::decode(payload); v6)
+    {
+      return boost::asio::ip::address{*v6};
+    }
+    return std::nullopt;
+  }
+};
+
+template <std::uint16_t TYPE, typename T>
+struct Field
+{
+  static constexpr std::uint16_t type = TYPE;
+  using value_type = T;
+};
+
+/*
+ * decoder generated from a list of fields.
+ * only the declared attributes get a slot, everything else is skipped with a
+ * single table lookup. the walk stops as soon as every field was seen once.
+ * of an attribute repeated in a message the first one wins, as with iproute2's
+ * parse_rtattr (the kernel's nla_parse keeps the last).
+ *
+ *   using Schema = Attribute::Schema<Attribute::Field<RTA_DST, boost::asio::ip::address>,
+ *                                    Attribute::Field<RTA_OIF, std::uint32_t>>;
+ *   auto values = Schema::decode(Attribute::attributes<struct rtmsg>(header));
+ *   if (auto const& oif = values.get<RTA_OIF>(); oif) ...
+ */
+template <typename... FIELDS>
+class Schema
+{
+public:
+  static constexpr std::size_t size = sizeof...(FIELDS);
+  static_assert(size > 0 && size < 255, "a schema needs between 1 and 254 fields");
+
+  class Values
+  {
+  public:
+    template <std::uint16_t TYPE>
+    [[nodiscard]] auto const& get() const noexcept
+    {
+      return std::get<indexOf(TYPE)>(m_fields);
+    }
+    template <std::uint16_t TYPE>
+    [[nodiscard]] auto& get() noexcept
+    {
+      return std::get<indexOf(TYPE)>(m_fields);
+    }
+
+  private:
+    friend class Schema;
+    std::tuple<std::optional<typename FIELDS::value_type>...> m_fields;
+  };
+
+  static Values decode(Payload attributes) noexcept
+  {
+    static_assert(((slots[FIELDS::type] == indexOf(FIELDS::type) + 1) && ...), "attribute types of a schema must be unique");
+    Values values;
+    std::bitset<size> seen;
+    while (attributes.size() >= sizeof(struct rtattr))
+    {
+      struct rtattr header;
+      std::memcpy(&header, attributes.data(), sizeof(header));
+      if (header.rta_len < sizeof(header) || header.rta_len > attributes.size())
+      {
+        break;
+      }
+      std::size_t const type = header.rta_type & NLA_TYPE_MASK;
+      if (type <= MaxType && slots[type] != 0 && !seen.test(slots[type] - 1U))
+      {
+        store(values, slots[type], attributes.subspan(HeaderLength, header.rta_len - HeaderLength), std::index_sequence_for<FIELDS...>{});
+        if (seen.set(slots[type] - 1U).all())
+        {
+          break;
+        }
+      }
+      attributes = attributes.subspan(std::min(align(header.rta_len), attributes.size()));
+    }
+    return values;
+  }
+
+private:
+  static constexpr std::size_t HeaderLength = (sizeof(struct rtattr) + RTA_ALIGNTO - 1) & ~std::size_t{RTA_ALIGNTO - 1};
+  static constexpr std::size_t MaxType = std::max({std::size_t{FIELDS::type}...});
+
+  static constexpr std::size_t align(std::size_t length) noexcept
+  {
+    return (length + RTA_ALIGNTO - 1) & ~std::size_t{RTA_ALIGNTO - 1};
+  }
+
+  static constexpr std::size_t indexOf(std::uint16_t type) noexcept
+  {
+    constexpr std::array<std::uint16_t, size> types{FIELDS::type...};
+    return static_cast<std::size_t>(std::find(types.begin(), types.end(), type) - types.begin());
+  }
+
+  // attribute type -> field index + 1, 0 for attributes nobody asked for
+  static constexpr auto slots = []()
+  {
+    std::array<std::uint8_t, MaxType + 1> table{};
+    std::uint8_t slot = 0;
+    ((table[FIELDS::type] = ++slot), ...);
+    return table;
+  }();
+
+  template <std::size_t... I>
+  static void store(Values& values, std::uint8_t slot, Payload payload, std::index_sequence<I...>) noexcept
+  {
+    static_cast<void>(((slot == I + 1 && (std::get<I>(values.m_fields) = Decoder<typename FIELDS::value_type>::decode(payload), true)) || ...));
+  }
+};
+
+// attributes following the family specific HEADER of a netlink message
+template <typename HEADER>
+Payload attributes(struct nlmsghdr const& header) noexcept
+{
+  constexpr std::size_t offset = NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(HEADER));
+  if (header.nlmsg_len < offset)
+  {
+    return {};
+  }
+  return {reinterpret_cast<std::byte const*>(&header) + offset, header.nlmsg_len - offset};
+}
+}  // namespace wormhole::sysinfo::Netlink::Attribute
@@ -0,0 +1,151 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <linux/inet_diag.h>
+#include <netinet/in.h>
+
+#include "NetlinkSocket.hpp"
+
+namespace wormhole::sysinfo::Netlink
+{
+/*
+ * inventory of the host's internet sockets from NETLINK_SOCK_DIAG (inet_diag), the
+ * netlink side of ss(8) and a replacement for reading /proc/net/tcp{,6}: the kernel
+ * filters by state, and by port with a bytecode program, before anything is copied,
+ * and hands out binary records instead of text to be parsed.
+ * a dump is collected into columns (one vector per field, Sockets) or streamed one
+ * Entry at a time without being stored. AF_UNSPEC dumps IPv4 and then IPv6.
+ */
+class DiagSocket final
+{
+public:
+  static constexpr std::size_t DatagramSize = 64 * 1024;
+
+  // kernel socket states (include/net/tcp_states.h) as bits of Query::states
+  struct State
+  {
+    static constexpr std::uint32_t Established = 1U << 1;
+    static constexpr std::uint32_t SynSent = 1U << 2;
+    static constexpr std::uint32_t SynReceived = 1U << 3;
+    static constexpr std::uint32_t FinWait1 = 1U << 4;
+    static constexpr std::uint32_t FinWait2 = 1U << 5;
+    static constexpr std::uint32_t TimeWait = 1U << 6;
+    static constexpr std::uint32_t Close = 1U << 7;
+    static constexpr std::uint32_t CloseWait = 1U << 8;
+    static constexpr std::uint32_t LastAck = 1U << 9;
+    static constexpr std::uint32_t Listen = 1U << 10;
+    static constexpr std::uint32_t Closing = 1U << 11;
+    static constexpr std::uint32_t NewSynReceived = 1U << 12;
+    static constexpr std::uint32_t All = ((1U << 13) - 1) & ~1U;
+  };
+
+  struct PortRange
+  {
+    std::uint16_t first{0};
+    std::uint16_t last{0xFFFF};
+
+    bool operator==(PortRange const&) const noexcept = default;
+  };
+
+  struct Query
+  {
+    std::uint8_t protocol{IPPROTO_TCP};
+    int family{AF_UNSPEC};
+    std::uint32_t states{State::All};
+    // compiled into a bytecode filter, both have to match
+    std::optional<PortRange> localPort;
+    std::optional<PortRange> remotePort;
+    bool info{false};  // tcp_info: bytes acked and received, rtt; TCP only
+  };
+
+  struct Entry
+  {
+    std::uint8_t family{AF_INET};
+    std::uint8_t state{0};
+    boost::asio::ip::address local;
+    std::uint16_t localPort{0};
+    boost::asio::ip::address remote;
+    std::uint16_t remotePort{0};
+    Interface::Index interface{0};  // bound to, 0 for any
+    std::uint32_t inode{0};
+    std::uint32_t uid{0};
+    std::uint32_t receiveQueue{0};  // listeners: accept backlog
+    std::uint32_t sendQueue{0};
+    std::uint64_t cookie{0};
+    // with Query::info
+    std::uint64_t bytesAcked{0};
+    std::uint64_t bytesReceived{0};
+    std::uint32_t rtt{0};  // microseconds
+  };
+
+  // struct of arrays, row i of every column is one socket; addresses in network order, IPv4 in the first 4 bytes
+  struct Sockets
+  {
+    using Address = std::array<std::uint8_t, 16>;
+
+    std::vector<std::uint8_t> family;
+    std::vector<std::uint8_t> state;
+    std::vector<Address> local;
+    std::vector<std::uint16_t> localPort;
+    std::vector<Address> remote;
+    std::vector<std::uint16_t> remotePort;
+    std::vector<std::uint32_t> interface;
+    std::vector<std::uint32_t> inode;
+    std::vector<std::uint32_t> uid;
+    std::vector<std::uint32_t> receiveQueue;
+    std::vector<std::uint32_t> sendQueue;
+    std::vector<std::uint64_t> cookie;
+    // empty without Query::info
+    std::vector<std::uint64_t> bytesAcked;
+    std::vector<std::uint64_t> bytesReceived;
+    std::vector<std::uint32_t> rtt;
+
+    [[nodiscard]] std::size_t size() const noexcept;
+    [[nodiscard]] Entry entry(std::size_t) const;
+    void clear() noexcept;
+  };
+
+  using Handler = std::function<void(Entry const&)>;
+
+  static outcome::std_result<DiagSocket> open();
+
+  DiagSocket(DiagSocket const&) = delete;
+  DiagSocket(DiagSocket&&) noexcept;
+  DiagSocket& operator=(DiagSocket const&) = delete;
+  DiagSocket& operator=(DiagSocket&&) noexcept;
+  ~DiagSocket();
+
+  outcome::std_result<Sockets> dump(Query const&);
+  // appends to sockets, which keeps its capacity between dumps
+  outcome::std_result<void> dump(Query const&, Sockets& sockets);
+  // returns the number of entries handed to handler
+  outcome::std_result<std::size_t> dump(Query const&, Handler const& handler);
+
+  [[nodiscard]] int native_handle() const noexcept;
+
+private:
+  DiagSocket(int t_socket, std::uint32_t t_pid);
+
+  // calls row(inet_diag_msg const&, tcp_info payload) for every socket of family
+  template <typename ROW>
+  outcome::std_result<void> dumpFamily(int family, Query const&, ROW&& row);
+  outcome::std_result<void> send(int family, Query const&);
+
+  std::uint32_t m_pid;
+  int m_socket;
+  std::uint32_t m_seqNum{0};
+  std::vector<std::byte> m_request;
+  std::vector<std::byte> m_buffer;
+};
+}  // namespace wormhole::sysinfo::Netlink
@@ -0,0 +1,201 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DispatcherError.hpp"
+#include "NetlinkSocket.hpp"
+
+namespace wormhole::sysinfo::Netlink
+{
+/*
+ * fans the events of one socket out to many subscribers.
+ * a reader thread owns the socket and publishes every event into a ring, each
+ * subscriber follows the ring with its own sequence (disruptor style) and reads
+ * the events in place. no locks on either side; a slot is reused once every
+ * subscriber moved past it, what happens when one did not depends on its policy:
+ *   Block     the reader waits for the subscriber
+ *   Drop      the subscriber is moved forward to the oldest event still in the ring,
+ *             the skipped events are counted in dropped()
+ *   Conflate  like Drop, and every poll delivers only the newest event per object
+ *             (route, address, link, rule, nexthop) out of its backlog
+ * Drop and Conflate subscribers hold the reader back only while a poll() runs.
+ * a subscription belongs to one thread and must not outlive its dispatcher.
+ */
+class Dispatcher final
+{
+public:
+  using Event = Message::ResponseTypes;
+  static constexpr std::size_t MaxSubscribers = 64;
+  static constexpr std::size_t DefaultCapacity = 4096;
+  static constexpr std::size_t DefaultBatch = 256;
+
+  enum struct Policy
+  {
+    Block,
+    Drop,
+    Conflate
+  };
+
+  struct Filter
+  {
+    static constexpr std::uint32_t Addresses = 1U << 0;
+    static constexpr std::uint32_t Links = 1U << 1;
+    static constexpr std::uint32_t Routes = 1U << 2;
+    static constexpr std::uint32_t Rules = 1U << 3;
+    static constexpr std::uint32_t Nexthops = 1U << 4;
+    static constexpr std::uint32_t Dumps = 1U << 5;
+    static constexpr std::uint32_t TrafficControl = 1U << 6;  // qdiscs and classes
+    static constexpr std::uint32_t All = (1U << 7) - 1;
+
+    std::uint32_t kinds{All};
+    int family{AF_UNSPEC};
+    // routes through it (oif or any path), its addresses, nexthops, qdiscs and classes and the link itself; rules never match
+    std::optional<Interface::Index> interface;
+
+    [[nodiscard]] bool matches(Event const&) const noexcept;
+  };
+
+  class Subscription
+  {
+  public:
+    Subscription(Subscription const&) = delete;
+    Subscription(Subscription&&) noexcept;
+    Subscription& operator=(Subscription const&) = delete;
+    Subscription& operator=(Subscription&&) noexcept;
+    ~Subscription();
+
+    // calls handler(Event const&) for up to max new events that pass the filter, returns their number
+    template <typename HANDLER>
+    std::size_t poll(HANDLER&& handler, std::size_t max = DefaultBatch)
+    {
+      struct Release
+      {
+        Subscription& subscription;
+        Window window;
+        ~Release()
+        {
+          subscription.release(window);
+        }
+      } const guard{*this, acquire(max)};
+      auto const selected = select(guard.window);
+      for (auto const sequence : selected)
+      {
+        handler(m_dispatcher->event(sequence));
+      }
+      return selected.size();
+    }
+
+    // blocks until poll() may find new events or the dispatcher stopped
+    void wait() const;
+
+    [[nodiscard]] std::uint64_t dropped() const noexcept;
+
+  private:
+    friend class Dispatcher;
+    struct Window
+    {
+      std::uint64_t first{0};
+      std::uint64_t end{0};
+      bool busy{false};
+    };
+
+    Subscription(Dispatcher* t_dispatcher, std::size_t t_slot);
+
+    Window acquire(std::size_t max);
+    std::span<std::uint64_t const> select(Window);
+    void release(Window);
+
+    Dispatcher* m_dispatcher;
+    std::size_t m_slot;
+    std::vector<std::uint64_t> m_selected;
+    std::vector<std::uint64_t> m_seen;  // conflation: open addressing set of sequences, 0 is free
+  };
+
+  // capacity is rounded up to a power of two
+  static outcome::std_result<std::unique_ptr<Dispatcher>> start(Socket, std::size_t capacity = DefaultCapacity);
+
+  Dispatcher(Dispatcher const&) = delete;
+  Dispatcher(Dispatcher&&) = delete;
+  Dispatcher& operator=(Dispatcher const&) = delete;
+  Dispatcher& operator=(Dispatcher&&) = delete;
+  ~Dispatcher();
+
+  // a new subscription sees the events published after the next one the reader gets
+  outcome::std_result<Subscription> subscribe(Filter, Policy = Policy::Block);
+  void stop();
+
+  [[nodiscard]] bool stopped() const noexcept;  // the reader ended, subscriptions will not see new events
+  [[nodiscard]] std::uint64_t published() const noexcept;
+  [[nodiscard]] std::uint64_t noBuffers() const noexcept;
+  // why the reader thread ended on its own, only meaningful once it stopped
+  [[nodiscard]] std::error_code error() const noexcept;
+
+private:
+  enum struct State : std::uint8_t
+  {
+    Free,
+    Claimed,
+    Joining,
+    Active,
+    Leaving
+  };
+  struct alignas(64) Consumer
+  {
+    std::atomic<std::uint64_t> sequence{Idle};  // next event to read, Busy while a Drop / Conflate poll runs
+    std::atomic<State> state{State::Free};
+    std::atomic<std::uint64_t> dropped{0};
+    Policy policy{Policy::Block};
+    Filter filter;
+  };
+  static constexpr std::uint64_t Busy = std::uint64_t{1} << 63;
+  static constexpr std::uint64_t Idle = Busy - 1;  // before the reader admitted a consumer
+  static constexpr std::uint64_t Stopped = std::uint64_t{1} << 63;
+
+  Dispatcher(Socket t_socket, std::size_t t_capacity, int t_wakeFd);
+
+  void run();
+  bool publish(Event&&);
+  void admit(std::uint64_t next);
+  bool gate(std::uint64_t next);
+  void progress() noexcept;
+
+  Event const& event(std::uint64_t sequence) const noexcept
+  {
+    return m_ring[sequence & m_mask];
+  }
+
+  Socket m_socket;
+  int m_wakeFd;
+  std::vector<Event> m_ring;
+  std::uint64_t m_mask;
+  std::array<Consumer, MaxSubscribers> m_consumers;
+
+  alignas(64) std::atomic<std::uint64_t> m_published{0};  // | Stopped once the reader ended
+  alignas(64) std::atomic<std::uint32_t> m_changes{0};     // consumers waiting to join or leave
+  std::atomic<bool> m_readerWaiting{false};
+  std::atomic<std::uint32_t> m_progress{0};
+  std::atomic<bool> m_stopping{false};
+  std::atomic<std::uint64_t> m_noBuffers{0};
+
+  // reader thread only
+  std::uint64_t m_next{0};
+  std::uint64_t m_gate{0};  // lowest consumer sequence seen by the last gate()
+  std::error_code m_error;
+
+  std::thread m_reader;
+};
+}  // namespace wormhole::sysinfo::Netlink
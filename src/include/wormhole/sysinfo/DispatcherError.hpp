@@ -0,0 +1,25 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <system_error>
+
+namespace wormhole::sysinfo::Netlink
+{
+enum class DispatcherError
+{
+  None,
+  TooManySubscribers,
+  Stopped,
+};
+std::error_code make_error_code(DispatcherError);
+}  // namespace wormhole::sysinfo::Netlink
+
+template <>
+struct std::is_error_code_enum<wormhole::sysinfo::Netlink::DispatcherError> : true_type
+{
+};
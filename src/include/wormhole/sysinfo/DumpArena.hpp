@@ -0,0 +1,102 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <boost/outcome.hpp>
+
+namespace outcome = BOOST_OUTCOME_V2_NAMESPACE;
+
+namespace wormhole::sysinfo::Netlink
+{
+/*
+ * memory of one dump response: entries, their strings and the vector holding them.
+ * a bump allocator over blocks that double up to MaxBlockSize, nothing is freed before
+ * the arena goes away or is reset. every byte handed out is counted.
+ * after spill() further blocks are pages of an unlinked temporary file mapped into
+ * memory, which the kernel writes back instead of keeping them resident.
+ */
+class DumpArena final : public std::pmr::memory_resource
+{
+public:
+  static constexpr std::size_t MinBlockSize = 64 * 1024;
+  static constexpr std::size_t MaxBlockSize = 4 * 1024 * 1024;
+  static constexpr std::size_t MaxKeptSize = 2 * MaxBlockSize;  // heap blocks surviving reset()
+
+  DumpArena() = default;
+  DumpArena(DumpArena const&) = delete;
+  DumpArena& operator=(DumpArena const&) = delete;
+  ~DumpArena() override;
+
+  // an empty directory picks $TMPDIR, /tmp without it
+  outcome::std_result<void> spill(std::string_view directory);
+  // forgets everything handed out and stops spilling, heap blocks up to MaxKeptSize are
+  // reused before new ones are allocated
+  void reset() noexcept;
+
+  // bytes handed out
+  [[nodiscard]] std::size_t used() const noexcept;
+  // bytes in blocks from the file
+  [[nodiscard]] std::size_t spilled() const noexcept;
+  [[nodiscard]] bool spilling() const noexcept;
+
+private:
+  struct Block
+  {
+    std::byte* data;
+    std::size_t size;
+    bool mapped;
+  };
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void*, std::size_t, std::size_t) override;
+  [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+
+  static void release(Block const&) noexcept;
+  void grow(std::size_t atLeast);
+
+  std::vector<Block> m_blocks;
+  std::size_t m_block{0};  // the one m_cursor points into
+  std::byte* m_cursor{nullptr};
+  std::byte* m_end{nullptr};
+  std::size_t m_nextBlock{MinBlockSize};
+  std::size_t m_used{0};
+  std::size_t m_spilled{0};
+  int m_file{-1};
+  std::size_t m_fileSize{0};
+};
+
+/*
+ * the spare arena of a socket's dumps: an arena comes back when the last copy of the
+ * response it backs is released, on any thread, and is reset by the next acquire().
+ * dumping the same tables over and over reuses one arena. copies share the spare.
+ */
+class DumpArenaPool final
+{
+public:
+  DumpArenaPool();
+
+  [[nodiscard]] std::shared_ptr<DumpArena> acquire() const;
+
+private:
+  struct Spare
+  {
+    std::mutex mutex;
+    std::unique_ptr<DumpArena> arena;
+  };
+
+  static void release(std::weak_ptr<Spare> const&, DumpArena*) noexcept;
+
+  std::shared_ptr<Spare> m_spare;
+};
+}  // namespace wormhole::sysinfo::Netlink
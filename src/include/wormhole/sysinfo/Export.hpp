@@ -0,0 +1,137 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+#include <variant>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <fmt/format.h>
+
+#include "ExportError.hpp"
+#include "NetlinkSocket.hpp"
+#include "types.hpp"
+
+namespace wormhole::sysinfo::Export
+{
+using Buffer = fmt::memory_buffer;
+
+/*
+ * one JSON object per line, keys follow `ip -json` where there is an equivalent:
+ *   {"object":"route","event":"new","family":"inet","type":"unicast","table":"main","dst":"10.0.0.0/8","gateway":"10.0.0.1","dev":"eth0","oif":2,"metric":0}
+ * fields without a value (no gateway, no nexthop id, ...) are left out.
+ */
+namespace Json
+{
+void encode(Buffer&, Address const&);
+void encode(Buffer&, Interface const&);
+void encode(Buffer&, Route const&);
+void encode(Buffer&, Rule const&);
+void encode(Buffer&, Nexthop const&);
+void encode(Buffer&, Qdisc const&);
+void encode(Buffer&, TrafficClass const&);
+}  // namespace Json
+
+/*
+ * length prefixed records, all integers little endian:
+ *   u32 length of the rest | u8 kind | u8 action | fields of the kind
+ * decoders skip bytes past the fields they know, so fields can be appended to a kind.
+ * addresses are u8 family (0 unspecified, 4, 6) followed by 4 / 16 bytes network order,
+ * destinations an address followed by u8 prefix length, strings u16 length and bytes.
+ * the layout of every kind is documented next to its encoder.
+ */
+namespace Binary
+{
+enum struct Kind : std::uint8_t
+{
+  Address = 1,
+  Interface = 2,
+  Route = 3,
+  Rule = 4,
+  Nexthop = 5,
+  Qdisc = 6,
+  TrafficClass = 7,
+};
+using Record = std::variant<Address, Interface, Route, Rule, Nexthop, Qdisc, TrafficClass>;
+
+void encode(Buffer&, Address const&);
+void encode(Buffer&, Interface const&);
+void encode(Buffer&, Route const&);
+void encode(Buffer&, Rule const&);
+void encode(Buffer&, Nexthop const&);
+void encode(Buffer&, Qdisc const&);
+void encode(Buffer&, TrafficClass const&);
+
+// decodes the record at the front of input and advances input past it
+outcome::std_result<Record> decode(std::span<std::byte const>& input, std::pmr::polymorphic_allocator<> = {});
+}  // namespace Binary
+
+enum struct Format
+{
+  JsonLines,
+  Binary,
+  IpRoute,  // one `{:i}` line per entry
+  Compact,  // one `{:c}` line per entry
+};
+
+/*
+ * encodes entries straight into a set of reused chunks and hands full batches of
+ * chunks to the kernel with a single writev.
+ * if the fd does not take everything (EAGAIN on a nonblocking fd, EINTR, ...) the
+ * remaining bytes stay queued, write() then fails without taking the entry until
+ * flush() got rid of them.
+ */
+class Writer final
+{
+public:
+  struct Options
+  {
+    std::size_t chunkSize{64 * 1024};
+    std::size_t batchChunks{16};
+  };
+
+  Writer(int t_fd, Format t_format);
+  Writer(int t_fd, Format t_format, Options t_options);
+  Writer(Writer const&) = delete;
+  Writer(Writer&&) noexcept = default;
+  Writer& operator=(Writer const&) = delete;
+  Writer& operator=(Writer&&) noexcept = default;
+  ~Writer();  // flushes, errors are lost
+
+  outcome::std_result<void> write(Address const&);
+  outcome::std_result<void> write(Interface const&);
+  outcome::std_result<void> write(Route const&);
+  outcome::std_result<void> write(Rule const&);
+  outcome::std_result<void> write(Nexthop const&);
+  outcome::std_result<void> write(Qdisc const&);
+  outcome::std_result<void> write(TrafficClass const&);
+  // every entry of a dump or the single entry of an event, returns the number of entries written
+  outcome::std_result<std::size_t> write(Netlink::Message::ResponseTypes const&);
+
+  outcome::std_result<void> flush();
+
+  [[nodiscard]] std::size_t buffered() const noexcept;
+  [[nodiscard]] std::size_t written() const noexcept;
+
+private:
+  template <typename T>
+  outcome::std_result<void> append(T const&);
+  outcome::std_result<void> writeBatch();
+
+  int m_fd;
+  Format m_format;
+  Options m_options;
+  std::vector<Buffer> m_chunks;
+  std::size_t m_current{0};
+  std::vector<struct iovec> m_pending;  // not yet written part of the batch handed to writev
+  std::size_t m_written{0};
+};
+}  // namespace wormhole::sysinfo::Export
@@ -0,0 +1,82 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <list>
+#include <span>
+#include <unordered_map>
+
+#include "NetlinkSocket.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * the kernel's own answer to "route to X" with an LRU cache in front of it.
+ * queries missing the cache go to the kernel in one pipelined batch (Socket::get_routes),
+ * answers are cached, "no route" errors included.
+ * the lookup socket is joined to the route, rule and link groups and its events are
+ * applied before every lookup: a route event drops the cached answers for destinations
+ * inside its prefix, a rule event those of its family, a link event all of them.
+ */
+class FibLookup final
+{
+public:
+  using Query = Netlink::Socket::RouteQuery;
+  using Result = outcome::std_result<Route>;
+
+  struct Options
+  {
+    std::size_t capacity{4096};  // cached answers
+    int receiveBuffer{0};        // 0 keeps the default, more of it means larger batches
+  };
+
+  static outcome::std_result<FibLookup> open();
+  static outcome::std_result<FibLookup> open(Options);
+
+  // results[i] answers queries[i]
+  outcome::std_result<void> lookup(std::span<Query const> queries, std::span<Result> results);
+  // failures of the socket and "no route" alike end up in the error
+  Result lookup(Query const&);
+
+  // reads the pending events without blocking, returns how many were applied
+  outcome::std_result<std::size_t> poll();
+  // for events read from another socket
+  void apply(Netlink::Message::ResponseTypes const&);
+  void invalidate() noexcept;
+
+  [[nodiscard]] std::size_t size() const noexcept;
+  [[nodiscard]] std::size_t hits() const noexcept;
+  [[nodiscard]] std::size_t misses() const noexcept;
+
+  Netlink::Socket& socket() noexcept;
+
+private:
+  struct QueryHash
+  {
+    std::size_t operator()(Query const&) const noexcept;
+  };
+  struct Entry
+  {
+    Query query;
+    Result result;
+  };
+  using Entries = std::list<Entry>;
+
+  FibLookup(Netlink::Socket t_socket, std::size_t t_capacity);
+
+  void insert(Query const&, Result const&);
+  template <typename Predicate>
+  void erase(Predicate&&);
+
+  Netlink::Socket m_socket;
+  std::size_t m_capacity;
+  Entries m_entries;  // most recently used first
+  std::unordered_map<Query, Entries::iterator, QueryHash> m_index;
+  std::size_t m_hits{0};
+  std::size_t m_misses{0};
+};
+}  // namespace wormhole::sysinfo
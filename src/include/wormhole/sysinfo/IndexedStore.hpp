@@ -0,0 +1,241 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <vector>
+
+#include "NexthopStore.hpp"
+#include "types.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * routes or addresses kept current from dumps and New / Del events, with secondary
+ * indexes for the questions a health checker asks all the time:
+ *   routes      byInterface (oif or any path), byGateway (gateway or any path), byTable,
+ *               byNexthop (RTA_NH_ID)
+ *   addresses   byInterface
+ * every index is an open addressing table from key to an intrusive list of members,
+ * so a query is one probe and walking the returned range allocates nothing.
+ * an entry is identified like the kernel does it: routes by family, table, destination,
+ * tos and metric, addresses by address, prefix length and interface.
+ * ranges and pointers stay valid until the next apply() / load().
+ * a route on a kernel nexthop object is indexed by its paths as well. with
+ * nexthop_compat_mode 0 the kernel sends neither the paths nor route events when the
+ * object changes: apply such routes together with the NexthopStore holding the objects
+ * and call apply(Nexthop, store) after every store.apply(), the routes using the object
+ * are indexed again then.
+ */
+template <typename T>
+class IndexedStore
+{
+  static constexpr bool IsRoute = std::same_as<T, Route>;
+
+public:
+  static constexpr std::size_t IndexCount = IsRoute ? 4 : 1;
+
+  class Range : public std::ranges::view_interface<Range>
+  {
+  public:
+    class iterator
+    {
+    public:
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using iterator_concept = std::forward_iterator_tag;
+
+      iterator() = default;
+
+      T const& operator*() const noexcept
+      {
+        return m_store->m_slots[m_store->m_nodes[m_node].entry].value;
+      }
+      T const* operator->() const noexcept
+      {
+        return &**this;
+      }
+      iterator& operator++() noexcept
+      {
+        m_node = m_store->m_nodes[m_node].next;
+        return *this;
+      }
+      iterator operator++(int) noexcept
+      {
+        auto copy = *this;
+        ++*this;
+        return copy;
+      }
+      bool operator==(iterator const& other) const noexcept
+      {
+        return m_node == other.m_node;
+      }
+
+    private:
+      friend class Range;
+      iterator(IndexedStore const* t_store, std::uint32_t t_node)
+        : m_store{t_store}
+        , m_node{t_node}
+      {
+      }
+
+      IndexedStore const* m_store{nullptr};
+      std::uint32_t m_node{None};
+    };
+
+    Range() = default;
+
+    iterator begin() const noexcept
+    {
+      return {m_store, m_head};
+    }
+    iterator end() const noexcept
+    {
+      return {m_store, None};
+    }
+    std::size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+  private:
+    friend class IndexedStore;
+    Range(IndexedStore const* t_store, std::uint32_t t_head, std::uint32_t t_size)
+      : m_store{t_store}
+      , m_head{t_head}
+      , m_size{t_size}
+    {
+    }
+
+    IndexedStore const* m_store{nullptr};
+    std::uint32_t m_head{None};
+    std::uint32_t m_size{0};
+  };
+
+  IndexedStore();
+  explicit IndexedStore(std::span<T const>);
+
+  // replaces the content
+  void load(std::span<T const>);
+  void apply(T const&);
+  // the paths of a route with a nexthop id are taken from nexthops
+  void apply(T const&, NexthopStore const& nexthops)
+    requires IsRoute;
+  void apply(Nexthop const&, NexthopStore const& nexthops)
+    requires IsRoute;
+  void clear();
+  void reserve(std::size_t);
+
+  [[nodiscard]] T const* find(T const&) const;
+  [[nodiscard]] Range byInterface(Interface::Index) const;
+  [[nodiscard]] Range byGateway(boost::asio::ip::address const&) const
+    requires IsRoute;
+  [[nodiscard]] Range byTable(Route::Table) const
+    requires IsRoute;
+  [[nodiscard]] Range byNexthop(std::uint32_t id) const
+    requires IsRoute;
+
+  template <typename F>
+  void forEach(F&& f) const
+  {
+    for (auto const& slot : m_slots)
+    {
+      if (slot.live)
+      {
+        f(slot.value);
+      }
+    }
+  }
+
+  [[nodiscard]] std::size_t size() const noexcept;
+
+private:
+  static constexpr std::uint32_t None = 0xFFFFFFFF;
+
+  struct Key
+  {
+    std::uint64_t high{0};
+    std::uint64_t low{0};
+    std::uint32_t family{0};
+
+    bool operator==(Key const&) const noexcept = default;
+  };
+  struct NoPaths
+  {
+  };
+  using Paths = std::conditional_t<IsRoute, NexthopStore::Group, NoPaths>;
+  struct Slot
+  {
+    T value;
+    [[no_unique_address]] Paths paths;  // the route's own or those of its nexthop object
+    std::uint64_t hash{0};
+    std::uint32_t firstNode{None};  // memberships in all indexes, chained through Node::sibling
+    bool live{false};
+  };
+  struct Node
+  {
+    std::uint32_t entry;
+    std::uint32_t prev;
+    std::uint32_t next;
+    std::uint32_t sibling;  // next membership of the entry, next free node
+  };
+  struct Bucket
+  {
+    Key key;
+    std::uint32_t head{None};
+    std::uint32_t size{0};
+  };
+  struct Index
+  {
+    std::vector<Bucket> buckets;
+    std::size_t used{0};
+  };
+
+  static std::uint64_t identity(T const&) noexcept;
+  static bool same(T const&, T const&) noexcept;
+  static std::uint64_t hash(Key const&) noexcept;
+  static Key interfaceKey(Interface::Index) noexcept;
+  static Key gatewayKey(boost::asio::ip::address const&) noexcept;
+  template <typename F>
+  static void keys(Slot const&, F&&);
+  static Paths paths(T const&, NexthopStore const*);
+
+  void update(T const&, NexthopStore const*);
+
+  std::uint32_t locate(T const&, std::uint64_t hash) const noexcept;
+  void erasePrimary(std::uint32_t entry) noexcept;
+  void growPrimary();
+
+  Range range(std::size_t index, Key const&) const noexcept;
+  Bucket& bucket(std::size_t index, Key const&);
+  void eraseBucket(Index&, std::size_t position) noexcept;
+
+  void link(std::uint32_t entry);
+  void unlink(std::uint32_t entry);
+  std::uint32_t allocateNode();
+
+  std::vector<Slot> m_slots;
+  std::uint32_t m_freeSlot{None};  // chained through Slot::firstNode
+  std::size_t m_size{0};
+  std::vector<std::uint32_t> m_primary;  // entry per bucket, None if free
+  std::vector<Node> m_nodes;
+  std::uint32_t m_freeNode{None};
+  std::array<Index, IndexCount> m_indexes;
+  std::vector<std::uint32_t> m_stale;
+};
+
+using RouteStore = IndexedStore<Route>;
+using AddressStore = IndexedStore<Address>;
+
+extern template class IndexedStore<Route>;
+extern template class IndexedStore<Address>;
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,67 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "IndexedStore.hpp"
+#include "InventoryError.hpp"
+#include "NetlinkSocket.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * snapshot of links, addresses and routes of both families.
+ * load() opens one socket per dump and runs the dumps concurrently on a small pool of
+ * threads. a socket joined to the multicast groups of all of them is opened before the
+ * first dump starts, every change racing with the dumps is queued there and replayed on
+ * top of the merged dumps, which leaves the snapshot at the state of the moment the
+ * queue was drained. if that socket overran the dumps are repeated.
+ * the socket stays with the inventory, keep passing its events to apply() to stay current.
+ */
+class Inventory final
+{
+public:
+  struct Options
+  {
+    std::size_t threads{0};   // 0: one per dump, at most the number of cpus
+    std::size_t attempts{3};  // dump rounds before a multicast overrun is an error
+    int receiveBuffer{0};     // of the multicast socket, 0 keeps the default
+  };
+
+  static outcome::std_result<Inventory> load();
+  static outcome::std_result<Inventory> load(Options);
+
+  void apply(Interface const&);
+  void apply(Address const&);
+  void apply(Route const&);
+  // events and dumps of links, addresses and routes, everything else is ignored
+  void apply(Netlink::Message::ResponseTypes const&);
+
+  // sorted by index
+  [[nodiscard]] std::span<Interface const> links() const noexcept;
+  [[nodiscard]] Interface const* link(Interface::Index) const;
+  [[nodiscard]] AddressStore const& addresses() const noexcept;
+  [[nodiscard]] RouteStore const& routes() const noexcept;
+
+  Netlink::Socket& socket() noexcept;
+  // events replayed on top of the dumps of the last round
+  [[nodiscard]] std::size_t reconciled() const noexcept;
+  [[nodiscard]] std::size_t rounds() const noexcept;
+
+private:
+  explicit Inventory(Netlink::Socket t_socket);
+
+  Netlink::Socket m_socket;
+  std::vector<Interface> m_links;
+  AddressStore m_addresses;
+  RouteStore m_routes;
+  std::size_t m_reconciled{0};
+  std::size_t m_rounds{0};
+};
+}  // namespace wormhole::sysinfo
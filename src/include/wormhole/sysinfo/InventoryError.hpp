@@ -0,0 +1,24 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <system_error>
+
+namespace wormhole::sysinfo
+{
+enum class InventoryError
+{
+  None,
+  EventsLost,  // the multicast socket overran in every attempt
+};
+std::error_code make_error_code(InventoryError);
+}  // namespace wormhole::sysinfo
+
+template <>
+struct std::is_error_code_enum<wormhole::sysinfo::InventoryError> : true_type
+{
+};
@@ -0,0 +1,161 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Export.hpp"
+#include "IndexedStore.hpp"
+#include "JournalError.hpp"
+#include "NexthopStore.hpp"
+
+namespace wormhole::sysinfo::Export
+{
+/*
+ * append only history of events in a directory of segment files, for post-mortems.
+ * a segment is created at its full size and memory mapped, an entry is copied into the
+ * mapping, no system call per event:
+ *   segment  <sequence, 16 hex digits>.journal
+ *            64 byte header: "SYSINFOJ" | u32 version | u32 header size | u64 sequence | i64 created
+ *            entries: i64 time | Binary record, up to the first zero length
+ *   index    <sequence>.index, (i64 time | u64 offset) of the first entry after every indexInterval bytes
+ * times are nanoseconds since the epoch, never decreasing within one Journal.
+ * group commit: appended entries are msync'ed and the index entries written once
+ * commitBytes were appended or commitInterval passed since the last commit, checked
+ * with every append; call commit() from a timer to bound the time on a quiet journal.
+ * a full segment is truncated to what it holds and the next one is started, with
+ * Options::segments set the oldest segments are deleted beyond that number.
+ * every open() starts a new segment, the tail of one cut short by a crash is skipped
+ * by readers.
+ */
+class Journal final
+{
+public:
+  using Clock = std::chrono::system_clock;
+  static constexpr std::size_t HeaderSize = 64;
+
+  struct Options
+  {
+    std::size_t segmentSize{64 * 1024 * 1024};
+    std::size_t indexInterval{64 * 1024};
+    std::size_t commitBytes{1024 * 1024};
+    std::chrono::milliseconds commitInterval{100};
+    std::size_t segments{0};  // kept, 0 keeps all
+  };
+
+  struct Stats
+  {
+    std::uint64_t entries{0};
+    std::uint64_t bytes{0};
+    std::uint64_t commits{0};
+    std::uint64_t segments{0};  // started by this journal
+  };
+
+  static outcome::std_result<std::unique_ptr<Journal>> open(std::filesystem::path const& directory);
+  static outcome::std_result<std::unique_ptr<Journal>> open(std::filesystem::path const& directory, Options);
+
+  Journal(Journal const&) = delete;
+  Journal(Journal&&) = delete;
+  Journal& operator=(Journal const&) = delete;
+  Journal& operator=(Journal&&) = delete;
+  ~Journal();  // commits, errors are lost
+
+  outcome::std_result<void> append(Address const&);
+  outcome::std_result<void> append(Interface const&);
+  outcome::std_result<void> append(Route const&);
+  outcome::std_result<void> append(Rule const&);
+  outcome::std_result<void> append(Nexthop const&);
+  outcome::std_result<void> append(Qdisc const&);
+  outcome::std_result<void> append(TrafficClass const&);
+  // every entry of a dump or the single entry of an event, returns the number of entries appended
+  outcome::std_result<std::size_t> append(Netlink::Message::ResponseTypes const&);
+
+  outcome::std_result<void> commit();
+
+  [[nodiscard]] Options const& options() const noexcept;
+  [[nodiscard]] Stats stats() const noexcept;
+
+private:
+  struct Segment
+  {
+    std::uint64_t sequence{0};
+    int fd{-1};
+    int indexFd{-1};
+    std::byte* map{nullptr};
+    std::size_t used{0};
+    std::size_t synced{0};
+    std::size_t nextIndex{0};
+  };
+
+  Journal(std::filesystem::path t_directory, Options t_options, std::deque<std::uint64_t> t_sequences);
+
+  template <typename T>
+  outcome::std_result<void> write(T const&);
+  outcome::std_result<void> start();
+  outcome::std_result<void> finish();
+  void retire();
+
+  std::filesystem::path m_directory;
+  Options m_options;
+  std::deque<std::uint64_t> m_sequences;  // segments in the directory, oldest first
+  Segment m_segment;
+  Buffer m_scratch;
+  std::vector<std::byte> m_index;  // index entries of the current segment not yet written
+  std::int64_t m_last{0};
+  std::chrono::steady_clock::time_point m_committed;
+  Stats m_stats;
+};
+
+/*
+ * reads the segments of a journal directory, also while a Journal appends to it.
+ * replay() finds the first segment by the creation times in the headers and the first
+ * entry inside it with the segment's index, then decodes forward.
+ */
+class JournalReader final
+{
+public:
+  using Handler = std::function<void(Journal::Clock::time_point, Binary::Record&&)>;
+
+  // links, addresses, routes and nexthops rebuilt from the journaled events
+  struct Mirror
+  {
+    std::vector<Interface> links;  // sorted by index
+    AddressStore addresses;
+    RouteStore routes;
+    NexthopStore nexthops;
+
+    void apply(Binary::Record const&);
+  };
+
+  static outcome::std_result<JournalReader> open(std::filesystem::path const& directory);
+
+  // entries with from <= time < to in the order they were appended, returns their number
+  outcome::std_result<std::size_t> replay(Journal::Clock::time_point from, Journal::Clock::time_point to, Handler const&) const;
+  // the state at to is the mirror of a replay from a time with a complete dump (or from the beginning)
+  outcome::std_result<std::size_t> replay(Journal::Clock::time_point from, Journal::Clock::time_point to, Mirror&) const;
+
+  [[nodiscard]] std::size_t segments() const noexcept;
+
+private:
+  struct Segment
+  {
+    std::filesystem::path path;
+    std::int64_t created{0};
+  };
+
+  explicit JournalReader(std::vector<Segment> t_segments);
+
+  std::vector<Segment> m_segments;  // by sequence
+};
+}  // namespace wormhole::sysinfo::Export
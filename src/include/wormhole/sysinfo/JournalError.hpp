@@ -0,0 +1,26 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <system_error>
+
+namespace wormhole::sysinfo::Export
+{
+enum class JournalError
+{
+  None,
+  NotAJournal,     // a segment without the journal's header
+  RecordTooLarge,  // does not fit into an empty segment
+  InvalidRange,    // replay from after to
+};
+std::error_code make_error_code(JournalError);
+}  // namespace wormhole::sysinfo::Export
+
+template <>
+struct std::is_error_code_enum<wormhole::sysinfo::Export::JournalError> : true_type
+{
+};
@@ -0,0 +1,97 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "NetlinkSocket.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * state of every link by ifindex, fed with link events (and dumps) from any socket.
+ * every RTM_NEWLINK is compared with what is known about its link; callbacks only see
+ * edges: admin up/down, running/not running, carrier gained/lost, mtu changed, added and
+ * removed. notifications that change none of these (repeats, renames, statistics) are
+ * dropped after one array lookup (a hash lookup for ifindexes from MaxCachedIndex on).
+ */
+class LinkStateTracker final
+{
+public:
+  static constexpr std::size_t MaxCachedIndex = 65536;
+
+  struct State
+  {
+    std::uint32_t flags{0};
+    std::uint32_t mtu{0};
+    Interface::OperState operState{Interface::OperState::Unknown};
+    bool carrier{false};
+    bool present{false};
+
+    [[nodiscard]] bool adminUp() const noexcept;
+    // admin up with carrier, operstate up or unknown (loopback, bridges, tunnels)
+    [[nodiscard]] bool running() const noexcept;
+
+    bool operator==(State const&) const noexcept = default;
+  };
+
+  struct Edge
+  {
+    static constexpr std::uint32_t Added = 1U << 0;
+    static constexpr std::uint32_t Removed = 1U << 1;
+    static constexpr std::uint32_t AdminUp = 1U << 2;
+    static constexpr std::uint32_t AdminDown = 1U << 3;
+    static constexpr std::uint32_t Up = 1U << 4;
+    static constexpr std::uint32_t Down = 1U << 5;
+    static constexpr std::uint32_t CarrierUp = 1U << 6;
+    static constexpr std::uint32_t CarrierDown = 1U << 7;
+    static constexpr std::uint32_t OperState = 1U << 8;
+    static constexpr std::uint32_t Mtu = 1U << 9;
+    static constexpr std::uint32_t All = (1U << 10) - 1;
+  };
+
+  struct Change
+  {
+    Interface::Index index;
+    std::uint32_t edges;
+    State previous;
+    State current;
+  };
+  using Callback = std::function<void(Change const&)>;
+
+  // callback is called for changes with any of edges, in the order of subscription
+  void subscribe(std::uint32_t edges, Callback callback);
+
+  // returns the edges of the change, 0 for a duplicate
+  std::uint32_t apply(Interface const&);
+  std::uint32_t apply(Netlink::Message::ResponseTypes const&);
+  // links of a dump, links missing from it are removed
+  void load(std::span<Interface const>);
+
+  [[nodiscard]] State state(Interface::Index) const noexcept;
+  [[nodiscard]] std::size_t suppressed() const noexcept;
+
+private:
+  struct Subscriber
+  {
+    std::uint32_t edges;
+    Callback callback;
+  };
+
+  static std::uint32_t edges(State const& previous, State const& current) noexcept;
+  std::uint32_t update(std::size_t index, State& slot, State const& current);
+
+  std::vector<State> m_states;                      // by ifindex, below MaxCachedIndex
+  std::unordered_map<std::size_t, State> m_sparse;  // the links from MaxCachedIndex on, erased when removed
+  std::vector<Subscriber> m_subscribers;
+  std::size_t m_suppressed{0};
+};
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,235 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+#include <linux/rtnetlink.h>
+
+#ifndef WORMHOLE_SYSINFO_METRICS
+#  define WORMHOLE_SYSINFO_METRICS 1
+#endif
+
+namespace wormhole::sysinfo::Netlink
+{
+/*
+ * HDR style histogram: values below 2^SubBucketBits are counted exactly,
+ * above that every power of two is split into 2^SubBucketBits linear sub buckets.
+ */
+class Histogram
+{
+public:
+  static constexpr std::size_t SubBucketBits = 3;
+  static constexpr std::size_t SubBucketCount = std::size_t{1} << SubBucketBits;
+  static constexpr std::size_t BucketCount = (65 - SubBucketBits) * SubBucketCount;
+
+  struct Snapshot
+  {
+    std::array<std::uint64_t, BucketCount> counts{};
+    std::uint64_t count{0};
+    std::uint64_t sum{0};
+    std::uint64_t max{0};
+
+    [[nodiscard]] std::uint64_t percentile(double) const noexcept;
+    [[nodiscard]] double mean() const noexcept;
+  };
+
+  static constexpr std::size_t bucketIndex(std::uint64_t value) noexcept
+  {
+    if (value < SubBucketCount)
+    {
+      return value;
+    }
+    std::size_t exponent = 63 - static_cast<unsigned>(std::countl_zero(value));
+    std::size_t sub = (value >> (exponent - SubBucketBits)) & (SubBucketCount - 1);
+    return (exponent - SubBucketBits + 1) * SubBucketCount + sub;
+  }
+  static constexpr std::uint64_t bucketUpperBound(std::size_t index) noexcept
+  {
+    if (index < SubBucketCount)
+    {
+      return index;
+    }
+    auto exponent = index / SubBucketCount + SubBucketBits - 1;
+    auto sub = index % SubBucketCount;
+    auto shift = exponent - SubBucketBits;
+    return ((SubBucketCount + sub) << shift) + ((std::uint64_t{1} << shift) - 1);
+  }
+
+  void record(std::uint64_t value) noexcept
+  {
+    m_counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    auto max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  [[nodiscard]] Snapshot snapshot() const noexcept;
+
+private:
+  std::array<std::atomic<std::uint64_t>, BucketCount> m_counts{};
+  std::atomic<std::uint64_t> m_count{0};
+  std::atomic<std::uint64_t> m_sum{0};
+  std::atomic<std::uint64_t> m_max{0};
+};
+
+class Metrics
+{
+public:
+  static constexpr bool enabled = WORMHOLE_SYSINFO_METRICS != 0;
+  using Clock = std::chrono::steady_clock;
+  static constexpr std::size_t MessageTypeCount = RTM_MAX + 1;
+
+  struct Snapshot
+  {
+    std::uint64_t datagrams{0};
+    std::uint64_t bytes{0};
+    std::uint64_t parseErrors{0};
+    std::uint64_t dumpInterrupted{0};
+    std::uint64_t dumpRestarted{0};
+    std::uint64_t dumpPatched{0};
+    std::uint64_t dumpSpilled{0};
+    std::uint64_t noBuffers{0};
+    std::array<std::uint64_t, MessageTypeCount> messages{};
+    Histogram::Snapshot receiveLatency;
+    Histogram::Snapshot parseTime;
+    Histogram::Snapshot dumpDuration;
+    Histogram::Snapshot dumpMemory;  // peak bytes of a response
+  };
+
+  static Clock::time_point now() noexcept
+  {
+    if constexpr (enabled)
+    {
+      return Clock::now();
+    }
+    else
+    {
+      return {};
+    }
+  }
+
+  void datagram(std::size_t bytes) noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_datagrams.fetch_add(1, std::memory_order_relaxed);
+      m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+  }
+  void message(std::uint16_t type) noexcept
+  {
+    if constexpr (enabled)
+    {
+      if (type < MessageTypeCount)
+      {
+        m_messages[type].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  void parseError() noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_parseErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void dumpInterrupted() noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_dumpInterrupted.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void dumpRestarted() noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_dumpRestarted.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void dumpPatched() noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_dumpPatched.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void dumpSpilled() noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_dumpSpilled.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void noBuffers() noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_noBuffers.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void receiveLatency(Clock::time_point start) noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_receiveLatency.record(elapsed(start));
+    }
+  }
+  void parseTime(Clock::time_point start) noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_parseTime.record(elapsed(start));
+    }
+  }
+  void dumpDuration(Clock::time_point start) noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_dumpDuration.record(elapsed(start));
+    }
+  }
+
+  void dumpMemory(std::size_t bytes) noexcept
+  {
+    if constexpr (enabled)
+    {
+      m_dumpMemory.record(bytes);
+    }
+  }
+
+  [[nodiscard]] Snapshot snapshot() const noexcept;
+
+private:
+  static std::uint64_t elapsed(Clock::time_point start) noexcept
+  {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+  }
+
+  std::atomic<std::uint64_t> m_datagrams{0};
+  std::atomic<std::uint64_t> m_bytes{0};
+  std::atomic<std::uint64_t> m_parseErrors{0};
+  std::atomic<std::uint64_t> m_dumpInterrupted{0};
+  std::atomic<std::uint64_t> m_dumpRestarted{0};
+  std::atomic<std::uint64_t> m_dumpPatched{0};
+  std::atomic<std::uint64_t> m_dumpSpilled{0};
+  std::atomic<std::uint64_t> m_noBuffers{0};
+  std::array<std::atomic<std::uint64_t>, MessageTypeCount> m_messages{};
+  Histogram m_receiveLatency;
+  Histogram m_parseTime;
+  Histogram m_dumpDuration;
+  Histogram m_dumpMemory;
+};
+}  // namespace wormhole::sysinfo::Netlink
@@ -6,17 +6,29 @@
 
 #pragma once
 
+#include <chrono>
 #include <deque>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <span>
+#include <string>
 #include <thread>
 #include <variant>
 #include <vector>
 
+#include <linux/fib_rules.h>
+#include <linux/nexthop.h>
+#include <linux/pkt_sched.h>
 #include <linux/rtnetlink.h>
 #include <boost/outcome.hpp>
 #include <condition_variable>
 
+#include "Attributes.hpp"
+#include "DumpArena.hpp"
+#include "Metrics.hpp"
 #include "NetlinkSocketError.hpp"
+#include "NexthopStore.hpp"
 #include "errno_error.hpp"
 #include "helper.hpp"
 #include "types.hpp"
@@ -43,11 +55,15 @@ public:
     friend std::ostream& operator<<(std::ostream&, Id const&);
   };
 
+  using Allocator = std::pmr::polymorphic_allocator<>;
+
   template <typename T>
   struct Response
   {
     Id id;
+    std::shared_ptr<std::pmr::memory_resource> arena;  // backs data, released with the last copy
     T data;
+    bool more{false};  // one part of a streamed dump, further parts follow
   };
 
   template <typename DATA, std::uint16_t RT_TYPE, typename RESPONSE>
@@ -56,8 +72,11 @@ public:
     using Data_t = DATA;
     using ResponseData_t = RESPONSE;
     using Response_t = Response<ResponseData_t>;
-    Request(int family, std::uint16_t flags, std::uint32_t seq, std::uint32_t pid /*, Handler_t handler*/)
+    Request(DumpArenaPool const& t_arenas, int family, std::uint16_t flags, std::uint32_t seq, std::uint32_t pid /*, Handler_t handler*/)
       : nlh{.nlmsg_len = NLMSG_LENGTH(sizeof(DATA)), .nlmsg_type = RT_TYPE, .nlmsg_flags = flags, .nlmsg_seq = seq, .nlmsg_pid = pid}
+      , arenas{t_arenas}
+      , arena{arenas.acquire()}
+      , response{arena.get()}
     {
       setFamily(data, family);
     }
@@ -67,14 +86,49 @@ public:
       return {nlh.nlmsg_seq, nlh.nlmsg_pid};
     }
 
+    // the interface a dump is restricted to, where the kernel supports it
+    void SetInterface(Interface::Index index)
+    {
+      if constexpr (std::is_same_v<DATA, struct tcmsg>)
+      {
+        data.tcm_ifindex = index.value;
+      }
+    }
+
     void AddItem(typename ResponseData_t::value_type val)
     {
       response.push_back(std::move(val));
     }
 
+    std::size_t Size() const noexcept
+    {
+      return response.size();
+    }
+
+    Allocator GetAllocator() const noexcept
+    {
+      return arena.get();
+    }
+
+    DumpArena& GetArena() const noexcept
+    {
+      return *arena;
+    }
+
     Response_t GetResponse() &&
     {
-      return {GetId(), std::move(response)};
+      return {GetId(), std::move(arena), std::move(response), false};
+    }
+
+    // hands out what was collected so far and continues with an empty arena
+    Response_t TakePart()
+    {
+      Response_t part{GetId(), std::move(arena), std::move(response), true};
+      arena = arenas.acquire();
+      // assignment would keep the allocator of the arena just handed out
+      std::destroy_at(&response);
+      std::construct_at(&response, arena.get());
+      return part;
     }
 
     std::array<IoVec, 2> GetIov()
@@ -90,30 +144,49 @@ public:
   private:
     static void setFamily(struct rtmsg& d, int family)
     {
-      d.rtm_family = family;
+      d.rtm_family = static_cast<unsigned char>(family);
     }
     static void setFamily(struct ifaddrmsg& d, int family)
     {
-      d.ifa_family = family;
+      d.ifa_family = static_cast<std::uint8_t>(family);
     }
     static void setFamily(struct ifinfomsg& d, int family)
     {
-      d.ifi_family = family;
+      d.ifi_family = static_cast<unsigned char>(family);
+    }
+    static void setFamily(struct fib_rule_hdr& d, int family)
+    {
+      d.family = static_cast<std::uint8_t>(family);
+    }
+    static void setFamily(struct nhmsg& d, int family)
+    {
+      d.nh_family = static_cast<unsigned char>(family);
+    }
+    static void setFamily(struct tcmsg& d, int family)
+    {
+      d.tcm_family = static_cast<unsigned char>(family);
     }
 
     NetlinkMessageHeader nlh;
     Data_t data{};
+    DumpArenaPool arenas;
+    std::shared_ptr<DumpArena> arena;
     ResponseData_t response;
   };
-  using AddressRequest = Request<struct ifaddrmsg, RTM_GETADDR, std::vector<Address>>;
-  using LinkRequest = Request<struct ifinfomsg, RTM_GETLINK, std::vector<Interface>>;
-  using RouteRequest = Request<struct rtmsg, RTM_GETROUTE, std::vector<Route>>;
+  using AddressRequest = Request<struct ifaddrmsg, RTM_GETADDR, std::pmr::vector<Address>>;
+  using LinkRequest = Request<struct ifinfomsg, RTM_GETLINK, std::pmr::vector<Interface>>;
+  using RouteRequest = Request<struct rtmsg, RTM_GETROUTE, std::pmr::vector<Route>>;
+  using RuleRequest = Request<struct fib_rule_hdr, RTM_GETRULE, std::pmr::vector<Rule>>;
+  using NexthopRequest = Request<struct nhmsg, RTM_GETNEXTHOP, std::pmr::vector<Nexthop>>;
+  // every interface's qdiscs; classes are dumped per interface only, see send_request
+  using QdiscRequest = Request<struct tcmsg, RTM_GETQDISC, std::pmr::vector<Qdisc>>;
+  using TrafficClassRequest = Request<struct tcmsg, RTM_GETTCLASS, std::pmr::vector<TrafficClass>>;
 
   template <typename TYPE>
-  Message(std::in_place_type_t<TYPE>, int family, std::uint16_t flags, std::uint32_t seq, std::uint32_t pid)
+  Message(std::in_place_type_t<TYPE>, DumpArenaPool const& arenas, int family, std::uint16_t flags, std::uint32_t seq, std::uint32_t pid)
     : m_iov{{}}
-    , m_header{.msg_name = &m_addr, .msg_namelen = sizeof(m_addr), .msg_iov = m_iov.data(), .msg_iovlen = m_iov.size()}
-    , m_request{std::in_place_type_t<TYPE>{}, family, flags, seq, pid}
+    , m_header{.msg_name = &m_addr, .msg_namelen = sizeof(m_addr), .msg_iov = m_iov.data(), .msg_iovlen = m_iov.size(), .msg_control = nullptr, .msg_controllen = 0, .msg_flags = 0}
+    , m_request{std::in_place_type_t<TYPE>{}, arenas, family, flags, seq, pid}
   {
     auto& msg = std::get<TYPE>(m_request);
     m_iov = msg.GetIov();
@@ -129,6 +202,10 @@ public:
   SockAddressNl& GetAddress();
   Header* GetHeader();
   [[nodiscard]] Id GetId() const;
+  [[nodiscard]] std::size_t Size() const;
+  [[nodiscard]] Allocator GetAllocator() const;
+  [[nodiscard]] DumpArena* GetArena() const;
+  void SetInterface(Interface::Index);
 
   template <typename REQ, typename RES>
   outcome::std_result<void> AddResponse(RES&& response)
@@ -140,32 +217,76 @@ public:
     }
     return SocketError::MessageTypeMismatch;
   }
-  using ResponseTypes = std::variant<AddressRequest::Response_t, LinkRequest::Response_t, RouteRequest::Response_t, Address, Interface, Route>;
+  using ResponseTypes = std::variant<AddressRequest::Response_t, LinkRequest::Response_t, RouteRequest::Response_t, RuleRequest::Response_t, NexthopRequest::Response_t,
+      QdiscRequest::Response_t, TrafficClassRequest::Response_t, Address, Interface, Route, Rule, Nexthop, Qdisc, TrafficClass>;
   outcome::std_result<ResponseTypes> GetResponse() &&;
+  outcome::std_result<ResponseTypes> TakePart();
 
 private:
   SockAddressNl m_addr{};
   std::array<IoVec, 2> m_iov{{}};
   Header m_header{};
 
-  std::variant<std::monostate, LinkRequest, RouteRequest, AddressRequest> m_request;
+  std::variant<std::monostate, LinkRequest, RouteRequest, AddressRequest, RuleRequest, NexthopRequest, QdiscRequest, TrafficClassRequest> m_request;
 };
 
 class Socket final
 {
 public:
-  template <std::uint32_t VAL>
-  using RtNlMG = std::integral_constant<std::uint32_t, VAL>;
+  template <unsigned GROUP>
+  using RtNlGroup = std::integral_constant<unsigned, GROUP>;
   // clang-format off
-  struct GroupLink : RtNlMG<RTMGRP_LINK> {};
-  struct GroupIpV4Route : RtNlMG<RTMGRP_IPV4_ROUTE> {};
-  struct GroupIpV6Route : RtNlMG<RTMGRP_IPV6_ROUTE> {};
-  struct GroupIpV4Address : RtNlMG<RTMGRP_IPV4_IFADDR> {};
-  struct GroupIpV6Address : RtNlMG<RTMGRP_IPV6_IFADDR> {};
+  struct GroupLink : RtNlGroup<RTNLGRP_LINK> {};
+  struct GroupNotify : RtNlGroup<RTNLGRP_NOTIFY> {};
+  struct GroupNeighbour : RtNlGroup<RTNLGRP_NEIGH> {};
+  struct GroupTrafficControl : RtNlGroup<RTNLGRP_TC> {};
+  struct GroupIpV4Address : RtNlGroup<RTNLGRP_IPV4_IFADDR> {};
+  struct GroupIpV4MulticastRoute : RtNlGroup<RTNLGRP_IPV4_MROUTE> {};
+  struct GroupIpV4Route : RtNlGroup<RTNLGRP_IPV4_ROUTE> {};
+  struct GroupIpV4Rule : RtNlGroup<RTNLGRP_IPV4_RULE> {};
+  struct GroupIpV6Address : RtNlGroup<RTNLGRP_IPV6_IFADDR> {};
+  struct GroupIpV6MulticastRoute : RtNlGroup<RTNLGRP_IPV6_MROUTE> {};
+  struct GroupIpV6Route : RtNlGroup<RTNLGRP_IPV6_ROUTE> {};
+  struct GroupIpV6Interface : RtNlGroup<RTNLGRP_IPV6_IFINFO> {};
+  struct GroupIpV6Prefix : RtNlGroup<RTNLGRP_IPV6_PREFIX> {};
+  struct GroupIpV6Rule : RtNlGroup<RTNLGRP_IPV6_RULE> {};
+  struct GroupNdUserOption : RtNlGroup<RTNLGRP_ND_USEROPT> {};
+  struct GroupPhonetAddress : RtNlGroup<RTNLGRP_PHONET_IFADDR> {};
+  struct GroupPhonetRoute : RtNlGroup<RTNLGRP_PHONET_ROUTE> {};
+  struct GroupDcb : RtNlGroup<RTNLGRP_DCB> {};
+  struct GroupIpV4Netconf : RtNlGroup<RTNLGRP_IPV4_NETCONF> {};
+  struct GroupIpV6Netconf : RtNlGroup<RTNLGRP_IPV6_NETCONF> {};
+  struct GroupMdb : RtNlGroup<RTNLGRP_MDB> {};
+  struct GroupMplsRoute : RtNlGroup<RTNLGRP_MPLS_ROUTE> {};
+  struct GroupNamespaceId : RtNlGroup<RTNLGRP_NSID> {};
+  struct GroupMplsNetconf : RtNlGroup<RTNLGRP_MPLS_NETCONF> {};
+  struct GroupIpV4MulticastRouteReport : RtNlGroup<RTNLGRP_IPV4_MROUTE_R> {};
+  struct GroupIpV6MulticastRouteReport : RtNlGroup<RTNLGRP_IPV6_MROUTE_R> {};
+  struct GroupNexthop : RtNlGroup<RTNLGRP_NEXTHOP> {};
+  struct GroupBridgeVlan : RtNlGroup<RTNLGRP_BRVLAN> {};
+  struct GroupMctpAddress : RtNlGroup<RTNLGRP_MCTP_IFADDR> {};
+  struct GroupTunnel : RtNlGroup<RTNLGRP_TUNNEL> {};
+  struct GroupStats : RtNlGroup<RTNLGRP_STATS> {};
   // clang-format on
 
-  using Groups = std::variant<GroupLink, GroupIpV4Route, GroupIpV6Route, GroupIpV4Address, GroupIpV6Address>;
+  // groups up to 32 are bound with the socket, the ones above are joined with NETLINK_ADD_MEMBERSHIP
+  using Groups = std::variant<GroupLink, GroupNotify, GroupNeighbour, GroupTrafficControl, GroupIpV4Address, GroupIpV4MulticastRoute, GroupIpV4Route, GroupIpV4Rule, GroupIpV6Address,
+      GroupIpV6MulticastRoute, GroupIpV6Route, GroupIpV6Interface, GroupIpV6Prefix, GroupIpV6Rule, GroupNdUserOption, GroupPhonetAddress, GroupPhonetRoute, GroupDcb, GroupIpV4Netconf,
+      GroupIpV6Netconf, GroupMdb, GroupMplsRoute, GroupNamespaceId, GroupMplsNetconf, GroupIpV4MulticastRouteReport, GroupIpV6MulticastRouteReport, GroupNexthop, GroupBridgeVlan,
+      GroupMctpAddress, GroupTunnel, GroupStats>;
   using GroupList = std::initializer_list<Groups>;
+  // bit group - 1 for every group
+  using GroupMask = std::uint64_t;
+  static_assert(RTNLGRP_MAX <= 64);
+
+  static constexpr GroupMask group_mask(Groups const& group) noexcept
+  {
+    return std::visit([]<unsigned GROUP>(RtNlGroup<GROUP>)
+        {
+          return GroupMask{1} << (GROUP - 1);
+        },
+        group);
+  }
 
   static outcome::std_result<Socket> open(std::span<Groups const>);
 
@@ -175,17 +296,77 @@ public:
   Socket& operator=(Socket&&) noexcept;
   ~Socket();
 
+  /*
+   * changes the groups of an open socket, e.g. to cut wakeups during a burst of changes
+   * nobody needs to see. events queued before leave_groups() are still received.
+   * leaving a group announcing the objects of a running dump keeps it from being patched.
+   * join_groups() stops at the first failure, the groups joined before it stay joined.
+   */
+  outcome::std_result<void> join_groups(std::span<Groups const>);
+  outcome::std_result<void> leave_groups(std::span<Groups const>);
+  [[nodiscard]] GroupMask groups() const noexcept;
+  [[nodiscard]] bool joined(Groups const&) const noexcept;
+
+  /*
+   * what receive() does with a dump the kernel marked NLM_F_DUMP_INTR:
+   *   Restart  drop what was collected and dump again after a backoff that doubles
+   *            with every retry up to maxBackoff
+   *   Patch    keep the interrupted dump and apply the multicast events queued since it
+   *            was requested, which leaves it consistent. needs the socket to be in the
+   *            groups announcing the dumped objects and no ENOBUFS meanwhile, restarts otherwise
+   * after attempts dumps receive() gives up with SocketError::Interrupted.
+   * while a restart waits for its backoff a Nonblock receive() fails with EAGAIN.
+   */
+  struct RetryPolicy
+  {
+    enum struct Mode
+    {
+      Restart,
+      Patch
+    };
+    Mode mode{Mode::Restart};
+    std::size_t attempts{1};
+    std::chrono::milliseconds backoff{1};
+    std::chrono::milliseconds maxBackoff{100};
+  };
+  void set_retry_policy(RetryPolicy) noexcept;
+
+  /*
+   * bytes the response of a dump may take, entries and everything they point to.
+   * once a dump goes beyond it:
+   *   Spill   it continues in memory mapped from an unlinked file in directory
+   *   Stream  receive() hands out what was collected as a Response with more set and
+   *           continues with an empty one. parts can't be taken back: a streamed dump is
+   *           never restarted, when interrupted it fails unless the retry policy patches,
+   *           then the events queued meanwhile follow its last part
+   *   Fail    the rest of the dump is skipped, receive() fails with SocketError::OverBudget
+   * applies to the requests sent after it, bytes 0 is no limit.
+   */
+  struct MemoryBudget
+  {
+    enum struct Overflow
+    {
+      Spill,
+      Stream,
+      Fail
+    };
+    std::size_t bytes{0};
+    Overflow overflow{Overflow::Fail};
+    std::string directory;  // of the spill file, empty picks $TMPDIR or /tmp
+  };
+  void set_memory_budget(MemoryBudget);
+
+  // interface restricts a TrafficClassRequest, which the kernel only answers for one interface
   template <typename Request>
-  outcome::std_result<Message::Id> send_request(int family)
+  outcome::std_result<Message::Id> send_request(int family, Interface::Index interface = Interface::Index{0})
   {
     if (m_activeRequest)
     {
       return make_error_code(SocketError::Busy);
     }
 
-    auto msgPtr = std::make_unique<Message>(std::in_place_type_t<Request>{}, family, NLM_F_DUMP | NLM_F_REQUEST, ++m_seqNum, static_cast<uint32_t>(m_pid));
-
-    return send(std::move(msgPtr));
+    m_retry = {.make = &makeRequest<Request>, .family = family, .interface = interface, .groups = announcedBy<Request>(family)};
+    return send(m_retry.make(m_arenas, family, interface, ++m_seqNum, m_pid));
   }
 
   enum struct ReceiveMode
@@ -193,6 +374,14 @@ public:
     Wait,
     Nonblock
   };
+  // without an active request up to EventBatch datagrams are read with one recvmmsg,
+  // their events are queued and handed out by the following calls.
+  // events arriving during a dump are queued as well and handed out after its response.
+  // a datagram beyond EventDatagramSize is cut short by the kernel and lost, receive() then
+  // fails with SocketError::Truncated, events were lost as with ENOBUFS. the events of the
+  // batch that fit are handed out by the following calls
+  static constexpr std::size_t EventBatch = 16;
+  static constexpr std::size_t EventDatagramSize = 64 * 1024;
   outcome::std_result<Message::ResponseTypes> receive(ReceiveMode);
   template <typename Request>
   outcome::std_result<typename Request::Response_t> receive(ReceiveMode mode)
@@ -200,44 +389,179 @@ public:
     BOOST_OUTCOME_TRY(auto r, receive(mode));
     if (auto* response = std::get_if<typename Request::Response_t>(&r); response)
     {
-      return *response;
+      return std::move(*response);
     }
     return SocketError::MessageTypeMismatch;
   }
 
+  /*
+   * the kernel's route for a flow: RTM_GETROUTE without NLM_F_DUMP, policy rules and marks
+   * included. the answer is the FIB entry that matched (RTM_F_FIB_MATCH). the queries go out with as few sendmsg as the receive buffer has room for
+   * their replies and are matched to them by sequence number. results[i] answers queries[i],
+   * with the errno of the kernel's reply when it has no route. events arriving meanwhile are queued.
+   * an overrun meanwhile also lost events of the joined groups, the next receive() fails with ENOBUFS.
+   */
+  struct RouteQuery
+  {
+    boost::asio::ip::address destination;
+    boost::asio::ip::address source;  // unspecified for any
+    Interface::Index outputInterface{0};
+    std::uint32_t mark{0};
+
+    bool operator==(RouteQuery const&) const noexcept = default;
+  };
+  static constexpr std::size_t LookupWindow = 1024;
+  outcome::std_result<void> get_routes(std::span<RouteQuery const> queries, std::span<outcome::std_result<Route>> results);
+
+  /*
+   * stamps every datagram with the time the call receiving it returned. netlink never
+   * hands out SO_TIMESTAMPNS control messages, this is as close to the kernel as it gets.
+   */
+  void set_timestamps(bool) noexcept;
+  // of the datagram the last result of receive() came with, the clock's epoch without set_timestamps
+  [[nodiscard]] Metrics::Clock::time_point timestamp() const noexcept;
+
+  NexthopStore& nexthops() noexcept;
+  NexthopStore const& nexthops() const noexcept;
+
+  [[nodiscard]] Metrics::Snapshot metrics() const noexcept;
+
+  [[nodiscard]] int native_handle() const noexcept;
+  // the address the kernel assigned at bind(), the nlmsg_pid of our requests
+  [[nodiscard]] std::uint32_t port_id() const noexcept;
+  // when a restarted dump waiting for its backoff is sent, a Nonblock receive() fails with EAGAIN until then
+  [[nodiscard]] std::optional<Metrics::Clock::time_point> resend_at() const noexcept;
+  // SO_RCVBUFFORCE when permitted, SO_RCVBUF otherwise
+  outcome::std_result<void> set_receive_buffer(int bytes);
+
 private:
-  explicit Socket(int t_socket, std::uint32_t t_pid);
+  struct Retry
+  {
+    std::unique_ptr<Message> (*make)(DumpArenaPool const& arenas, int family, Interface::Index interface, std::uint32_t seq, std::uint32_t pid){nullptr};
+    int family{AF_UNSPEC};
+    Interface::Index interface{0};
+    GroupMask groups{0};  // announcing changes of the dumped objects, 0 if there are none
+    std::size_t attempt{0};
+    bool interrupted{false};
+    bool lostEvents{false};
+    bool waiting{false};  // for the backoff before the next attempt
+    std::chrono::milliseconds backoff{0};
+    Metrics::Clock::time_point resendAt{};
+    bool overBudget{false};
+    bool streamed{false};
+    std::size_t peak{0};  // bytes of the response, the largest part when streamed
+  };
+
+  struct Queued
+  {
+    Message::ResponseTypes value;
+    Metrics::Clock::time_point received;
+  };
+
+  explicit Socket(int t_socket, std::uint32_t t_pid, GroupMask t_groups);
+
+  template <typename Request>
+  static std::unique_ptr<Message> makeRequest(DumpArenaPool const& arenas, int family, Interface::Index interface, std::uint32_t seq, std::uint32_t pid)
+  {
+    auto message = std::make_unique<Message>(std::in_place_type_t<Request>{}, arenas, family, NLM_F_DUMP | NLM_F_REQUEST, seq, pid);
+    message->SetInterface(interface);
+    return message;
+  }
+  template <typename Request>
+  static constexpr GroupMask announcedBy(int family) noexcept
+  {
+    auto const pick = [family](Groups v4, Groups v6)
+    {
+      return family == AF_INET ? group_mask(v4) : family == AF_INET6 ? group_mask(v6) : group_mask(v4) | group_mask(v6);
+    };
+    if constexpr (std::is_same_v<Request, Message::RouteRequest>)
+    {
+      return pick(GroupIpV4Route{}, GroupIpV6Route{});
+    }
+    else if constexpr (std::is_same_v<Request, Message::AddressRequest>)
+    {
+      return pick(GroupIpV4Address{}, GroupIpV6Address{});
+    }
+    else if constexpr (std::is_same_v<Request, Message::LinkRequest>)
+    {
+      return group_mask(GroupLink{});
+    }
+    else if constexpr (std::is_same_v<Request, Message::RuleRequest>)
+    {
+      return pick(GroupIpV4Rule{}, GroupIpV6Rule{});
+    }
+    else if constexpr (std::is_same_v<Request, Message::NexthopRequest>)
+    {
+      return group_mask(GroupNexthop{});
+    }
+    return 0;
+  }
 
   outcome::std_result<Message::Id> send(std::unique_ptr<Message>);
 
   outcome::std_result<Route> parse_route(struct nlmsghdr&, struct rtmsg& r);
   outcome::std_result<Address> parse_address(struct nlmsghdr&, struct ifaddrmsg&);
   outcome::std_result<Interface> parse_link(struct nlmsghdr&, struct ifinfomsg&);
-
-  template <std::size_t MAX>
-  using AttrTable = std::array<struct rtattr*, MAX + 1>;
-  template <std::size_t MAX>
-  AttrTable<MAX> parse_rtattr(struct rtattr* rta, std::size_t len);
-  template <std::size_t MAX>
-  uint32_t rtm_get_table(struct rtmsg& r, AttrTable<MAX> const&);
+  outcome::std_result<Rule> parse_rule(struct nlmsghdr&, struct fib_rule_hdr&, Message::Allocator);
+  outcome::std_result<Nexthop> parse_nexthop(struct nlmsghdr&, struct nhmsg&);
+  outcome::std_result<void> parse_traffic_control(struct nlmsghdr&, struct tcmsg&, TrafficControl&);
+  NexthopStore::Group parse_multipath(Attribute::Payload);
+
+  outcome::std_result<std::optional<Message::ResponseTypes>> dispatch(struct nlmsghdr&);
+  Message::Allocator allocatorFor(struct nlmsghdr const&) const;
+  outcome::std_result<Message::ResponseTypes> receiveError(int error);
+  void stamp() noexcept;
+  InterfaceName interfaceName(std::uint32_t index);
+  Message::ResponseTypes pop(std::deque<Queued>&);
+  outcome::std_result<Message::ResponseTypes> receiveEvents(ReceiveMode);
+  outcome::std_result<Message::ResponseTypes> receiveDump(ReceiveMode);
+  outcome::std_result<Message::ResponseTypes> finishDump(struct nlmsghdr&, ReceiveMode);
+  outcome::std_result<void> enforceBudget();
+  void recordMemory() noexcept;
+  [[nodiscard]] bool patchable() const noexcept;
+  void patch(Message::ResponseTypes&) const;
 
   outcome::std_result<Message::ResponseTypes> HandleDone(struct nlmsghdr&);
   outcome::std_result<std::optional<Route>> HandleRoute(struct nlmsghdr&, struct rtmsg&);
   outcome::std_result<std::optional<Address>> HandleAddress(struct nlmsghdr&, struct ifaddrmsg&);
   outcome::std_result<std::optional<Interface>> HandleLink(struct nlmsghdr&, struct ifinfomsg&);
+  outcome::std_result<std::optional<Rule>> HandleRule(struct nlmsghdr&, struct fib_rule_hdr&);
+  outcome::std_result<std::optional<Nexthop>> HandleNexthop(struct nlmsghdr&, struct nhmsg&);
+  template <typename T, typename Request>
+  outcome::std_result<std::optional<T>> HandleTrafficControl(struct nlmsghdr&, struct tcmsg&);
 
   template <typename Request, typename T>
   outcome::std_result<void> addResponse(Message::Id id, T&& t);
   std::unique_ptr<Message> PopRequest(Message::Id const&);
 
-  const std::uint32_t m_pid;
+  std::uint32_t m_pid;
+  GroupMask m_groups;
   int m_socket;
   std::uint32_t m_seqNum{0};
   std::unique_ptr<Message> m_activeRequest;
+  DumpArenaPool m_arenas;  // a released response's arena backs the next dump
+  std::vector<char> m_buffer;
+  std::vector<char> m_eventBuffer;
+  std::vector<char> m_lookupBuffer;
+  std::deque<Queued> m_events;
+  std::deque<Queued> m_parts;  // of a streamed dump, handed out before anything else
+  Metrics::Clock::time_point m_requestStart;
+  NexthopStore m_nexthops;
+  std::unique_ptr<Metrics> m_metrics;
+  RetryPolicy m_retryPolicy;
+  Retry m_retry;
+  MemoryBudget m_budget;
+  bool m_eventsLost{false};  // by an overrun in get_routes, reported by the next receive()
+  bool m_timestamps{false};
+  Metrics::Clock::time_point m_received;   // of the datagram being parsed
+  Metrics::Clock::time_point m_timestamp;  // of the last result handed out
+  static constexpr std::uint32_t MaxCachedIndex = 65536;
+  std::vector<InterfaceName> m_names;  // by ifindex
 };
 }  // namespace wormhole::sysinfo::Netlink
 
 template <>
-struct fmt::formatter<wormhole::sysinfo::Netlink::Message::Id> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Netlink::Message::Id> : formatter<std::string_view>
 {
+  format_context::iterator format(wormhole::sysinfo::Netlink::Message::Id const&, format_context&) const;
 };
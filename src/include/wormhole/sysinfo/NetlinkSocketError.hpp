@@ -24,6 +24,8 @@ enum class SocketError
   MessageIdMismatch,
   MessageTypeMismatch,
   UnhandledMessageType,
+  OverBudget,
+  Truncated,
 };
 std::error_code make_error_code(SocketError);
 }  // namespace wormhole::sysinfo::Netlink
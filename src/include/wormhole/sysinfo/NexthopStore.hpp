@@ -0,0 +1,68 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * shared, deduplicated nexthop groups.
+ * RTA_MULTIPATH paths are interned by content, kernel nexthop objects (RTA_NH_ID)
+ * are expanded once per id, so every route referencing a group shares one object.
+ * the last release of a group, on any thread and also after the store is gone, erases
+ * it from the interned table; copies of a store share that table.
+ */
+class NexthopStore
+{
+public:
+  using Group = std::shared_ptr<NexthopGroup const>;
+
+  NexthopStore();
+
+  Group intern(NexthopGroup);
+  void apply(Nexthop const&);
+
+  [[nodiscard]] Group find(std::uint32_t id) const;
+  // the current group of an RTA_NH_ID route, else the paths the route came with
+  [[nodiscard]] Group resolve(Route const&) const;
+  // ids of the group objects having id as a member
+  [[nodiscard]] std::vector<std::uint32_t> groups(std::uint32_t id) const;
+
+  // interned groups still referenced
+  [[nodiscard]] std::size_t size() const;
+
+private:
+  struct Interned
+  {
+    struct Entry
+    {
+      NexthopGroup const* group;  // alive while the entry is, the deleter erases it first
+      std::weak_ptr<NexthopGroup const> weak;
+    };
+
+    std::mutex mutex;
+    std::unordered_multimap<std::size_t, Entry> entries;
+  };
+
+  static std::size_t hash(NexthopGroup const&) noexcept;
+  static void release(std::weak_ptr<Interned> const&, std::size_t key, NexthopGroup const*) noexcept;
+
+  Group expand(std::uint32_t id);
+  void refresh(std::uint32_t id);
+
+  std::unordered_map<std::uint32_t, Nexthop> m_objects;
+  std::unordered_map<std::uint32_t, Group> m_groups;
+  std::unordered_multimap<std::uint32_t, std::uint32_t> m_members;
+  std::shared_ptr<Interned> m_interned;
+};
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,81 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "types.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * batch longest prefix match on raw addresses.
+ * every populated prefix length is one open addressing hash table, probed from the
+ * longest length down. lookups run through an AVX2 (IPv4) / SSE4.1 (IPv6) kernel
+ * when the CPU supports it and fall back to scalar code otherwise.
+ * membership tests are the special case of a table holding only host prefixes.
+ */
+class PrefixTable
+{
+public:
+  using AddressV4 = std::uint32_t;  // network byte order, as in sockaddr_in / netlink
+  using AddressV6 = std::array<std::uint8_t, 16>;
+  static constexpr std::uint32_t NoMatch = 0xFFFFFFFF;
+
+  enum struct Isa
+  {
+    Scalar,
+    Sse41,
+    Avx2
+  };
+
+  // value of a route is its index in routes, for equal prefixes the lowest metric wins
+  static PrefixTable fromRoutes(std::span<Route const> routes, Route::Table = Route::Table::Main);
+  // host prefix of every local address, value is its index in addresses
+  static PrefixTable fromAddresses(std::span<Address const> addresses);
+
+  void insert(boost::asio::ip::network_v4 const&, std::uint32_t value);
+  void insert(boost::asio::ip::network_v6 const&, std::uint32_t value);
+
+  // writes the value of the longest matching prefix or NoMatch, returns the number of lookups done
+  std::size_t lookup(std::span<AddressV4 const>, std::span<std::uint32_t> values) const;
+  std::size_t lookup(std::span<AddressV6 const>, std::span<std::uint32_t> values) const;
+  [[nodiscard]] std::uint32_t lookup(boost::asio::ip::address const&) const;
+
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  static Isa isa() noexcept;
+
+private:
+  struct LevelV4
+  {
+    std::uint32_t netmask{0};  // network byte order
+    std::uint32_t length{0};
+    std::uint32_t shift{32};
+    std::uint32_t slotMask{0};
+    std::size_t count{0};
+    std::vector<std::uint32_t> keys;
+    std::vector<std::uint32_t> values;  // value + 1, 0 marks a free slot
+  };
+  struct LevelV6
+  {
+    std::array<std::uint64_t, 2> netmask{};
+    std::uint32_t length{0};
+    std::uint32_t shift{64};
+    std::uint64_t slotMask{0};
+    std::size_t count{0};
+    std::vector<std::array<std::uint64_t, 2>> keys;
+    std::vector<std::uint32_t> values;
+  };
+
+  std::vector<LevelV4> m_v4;  // longest prefix first
+  std::vector<LevelV6> m_v6;
+};
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,145 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <sys/epoll.h>
+
+#include "NetlinkSocket.hpp"
+#include "ReactorError.hpp"
+
+namespace wormhole::sysinfo::Netlink
+{
+/*
+ * one thread serving many sockets (and other file descriptors) out of one epoll set.
+ * descriptors are registered edge triggered: a readable socket is drained with
+ * Nonblock receive() calls, each result goes to its handler, until the kernel has
+ * nothing more (EAGAIN). a socket that still has data after budget results is moved
+ * to the back of a ready list and continues in the next round, so one busy socket
+ * cannot starve the others. a raw descriptor's handler is called once per edge and
+ * has to read until EAGAIN itself.
+ *   Block     epoll_wait sleeps until a descriptor becomes readable
+ *   BusyPoll  epoll_wait never sleeps, the thread spins on the ready list; the wakeup
+ *             costs no scheduler round trip, the core is busy all the time
+ * with a cpu set, run() pins its thread to that cpu first.
+ * everything but stop() belongs to the thread calling poll() / run(); handlers may add
+ * and remove registrations, their own included. a socket must stay in place while
+ * it is registered.
+ */
+class Reactor final
+{
+public:
+  using Event = Message::ResponseTypes;
+  using SocketHandler = std::function<void(Socket&, outcome::std_result<Event>&&)>;
+  using FdHandler = std::function<void(int fd, std::uint32_t events)>;
+  static constexpr std::size_t DefaultBudget = 256;
+  static constexpr std::size_t EventBatch = 64;
+
+  enum struct Mode
+  {
+    Block,
+    BusyPoll
+  };
+
+  struct Options
+  {
+    Mode mode{Mode::Block};
+    int cpu{-1};  // run() pins its thread to it, -1 leaves the affinity alone
+    std::size_t budget{DefaultBudget};  // results per socket and round
+  };
+
+  struct Handle
+  {
+    std::uint64_t value{0};  // slot in the lower, generation in the upper half
+
+    bool operator==(Handle const&) const noexcept = default;
+  };
+
+  struct Stats
+  {
+    std::uint64_t wakeups{0};     // epoll_wait calls that returned descriptors
+    std::uint64_t spins{0};       // busy polls that found nothing
+    std::uint64_t dispatched{0};  // handler calls
+    std::uint64_t deferred{0};    // sockets moved to the ready list over budget
+  };
+
+  static outcome::std_result<std::unique_ptr<Reactor>> open();
+  static outcome::std_result<std::unique_ptr<Reactor>> open(Options);
+
+  Reactor(Reactor const&) = delete;
+  Reactor(Reactor&&) = delete;
+  Reactor& operator=(Reactor const&) = delete;
+  Reactor& operator=(Reactor&&) = delete;
+  ~Reactor();
+
+  outcome::std_result<Handle> add(Socket&, SocketHandler);
+  outcome::std_result<Handle> add(int fd, FdHandler, std::uint32_t events = EPOLLIN);
+  outcome::std_result<void> remove(Handle);
+
+  // one round: waits up to timeout (Block) or spins until it ends (BusyPoll) for readable
+  // descriptors and serves them, returns the number of handler calls
+  outcome::std_result<std::size_t> poll(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+  // rounds until stop()
+  outcome::std_result<void> run();
+  // from any thread, ends run() and the poll() in progress
+  void stop();
+
+  [[nodiscard]] Options const& options() const noexcept;
+  [[nodiscard]] Stats stats() const noexcept;
+  [[nodiscard]] std::size_t size() const noexcept;
+
+private:
+  struct Entry
+  {
+    std::uint32_t generation{0};
+    int fd{-1};
+    Socket* socket{nullptr};
+    SocketHandler socketHandler;
+    FdHandler fdHandler;
+    bool ready{false};  // on the ready list
+    std::optional<Metrics::Clock::time_point> resendAt;  // a dump restart waiting for its backoff
+  };
+  static constexpr std::uint64_t WakeToken = ~std::uint64_t{0};
+
+  Reactor(Options t_options, int t_epoll, int t_wakeFd);
+
+  outcome::std_result<Handle> insert(int fd, std::uint32_t events, Entry entry);
+  Entry* lookup(std::uint64_t token) noexcept;
+  void schedule(std::uint64_t token);
+  std::size_t drain(std::uint64_t token);
+  std::size_t serve();
+  int waitTimeout(std::optional<Metrics::Clock::time_point> deadline) const noexcept;
+  void expire();
+  void release();
+
+  Options m_options;
+  int m_epoll;
+  int m_wakeFd;
+  std::deque<Entry> m_entries;  // handlers may add while one of them runs
+  std::vector<std::uint32_t> m_free;
+  std::vector<std::uint32_t> m_retired;  // removed during a round, free after it
+  std::vector<std::uint64_t> m_ready;    // sockets with data left after their budget, in order
+  std::vector<std::uint64_t> m_round;
+  std::vector<std::uint64_t> m_waiting;  // sockets with a resendAt
+  std::size_t m_size{0};
+  bool m_polling{false};
+  std::atomic<bool> m_stopping{false};
+
+  std::atomic<std::uint64_t> m_wakeups{0};
+  std::atomic<std::uint64_t> m_spins{0};
+  std::atomic<std::uint64_t> m_dispatched{0};
+  std::atomic<std::uint64_t> m_deferred{0};
+};
+}  // namespace wormhole::sysinfo::Netlink
@@ -0,0 +1,141 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * order independent fingerprints of routing tables, kept current from New / Del events.
+ * a route hashes to 128 bits over what is the same on every node that has it: family,
+ * table, type, destination, gateway, interface name, source, metric, tos and the paths
+ * (gateway and weight, in any order, those of the nexthop object for a route using one).
+ * ifindexes and nexthop ids are local and left out. with nexthop_compat_mode 0 the kernel
+ * sends no route events when an object changes, the routes keep the paths they came with.
+ * a fingerprint is the sum of the hashes of its routes, so an event adds or subtracts one.
+ * per table there is a tree over the destination: every Stride bits of prefix split a node
+ * into 16 children, down to LeafLengthV4 / LeafLengthV6. a node holds the routes inside
+ * its prefix that are at least as long; longer routes end in the leaf above them.
+ * nodes comparing equal on two hosts have (all but certainly) the same routes, so two
+ * hosts compare table() first and descend into children() only where they differ.
+ * an event updates one node per level, 7 for IPv4 and 17 for IPv6.
+ */
+class RouteFingerprint final
+{
+public:
+  static constexpr std::size_t Stride = 4;
+  static constexpr std::size_t LeafLengthV4 = 24;
+  static constexpr std::size_t LeafLengthV6 = 64;
+
+  struct Digest
+  {
+    std::uint64_t high{0};
+    std::uint64_t low{0};
+    std::uint64_t routes{0};
+
+    Digest& operator+=(Digest const&) noexcept;
+    Digest& operator-=(Digest const&) noexcept;
+    bool operator==(Digest const&) const noexcept = default;
+  };
+
+  // a node; the prefix length is rounded down to a multiple of Stride, at most the leaf length
+  struct Prefix
+  {
+    Route::Table table{Route::Table::Main};
+    Route::Destination destination;  // the default route is the root of the table in family
+    int family{AF_INET};
+
+    bool operator==(Prefix const&) const = default;
+  };
+
+  RouteFingerprint() = default;
+  explicit RouteFingerprint(std::span<Route const>);
+
+  // replaces the content, hashing on up to threads threads (0: one per cpu)
+  void load(std::span<Route const>, std::size_t threads = 0);
+  void apply(Route const&);
+  void clear() noexcept;
+
+  // every table of both families
+  [[nodiscard]] Digest total() const noexcept;
+  [[nodiscard]] Digest table(int family, Route::Table) const;
+  [[nodiscard]] Digest range(Prefix const&) const;
+  // children holding routes with their digests, none below a leaf
+  [[nodiscard]] std::vector<std::pair<Prefix, Digest>> children(Prefix const&) const;
+  // tables holding routes of family
+  [[nodiscard]] std::vector<Route::Table> tables(int family) const;
+
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  // the hash of one route, as it is summed up
+  static Digest digest(Route const&) noexcept;
+
+private:
+  struct Node
+  {
+    std::uint64_t bits;  // leading bits of the destination, IPv4 in the upper half
+    std::uint32_t table;
+    std::uint8_t length;
+    std::uint8_t family;
+
+    bool operator==(Node const&) const noexcept = default;
+  };
+  // how the kernel tells routes apart: family, table, destination, tos and metric
+  struct Identity
+  {
+    std::uint64_t high;
+    std::uint64_t low;
+    std::uint32_t table;
+    std::uint32_t priority;
+    std::uint8_t length;
+    std::uint8_t family;
+    std::uint8_t tos;
+
+    bool operator==(Identity const&) const noexcept = default;
+  };
+  struct Hash
+  {
+    std::size_t operator()(Node const&) const noexcept;
+    std::size_t operator()(Identity const&) const noexcept;
+  };
+  using Nodes = std::unordered_map<Node, Digest, Hash>;
+  // open addressing, a family of 0 marks a free slot
+  struct Slot
+  {
+    Identity id;
+    Digest value;
+  };
+
+  static Identity identity(Route const&) noexcept;
+  static std::optional<Node> node(Prefix const&) noexcept;
+  static Node node(Identity const&, std::size_t length) noexcept;
+  static std::size_t depth(Identity const&) noexcept;
+  template <typename F>
+  static void path(Identity const&, F&&);
+  static void add(Nodes&, Identity const&, Digest const&);
+  static void subtract(Nodes&, Identity const&, Digest const&);
+
+  Slot* find(Identity const&) noexcept;
+  // the slot of id, second is true if it was free before
+  std::pair<Slot*, bool> claim(Identity const&);
+  void erase(Slot*) noexcept;
+  void reserve(std::size_t routes);
+
+  Nodes m_nodes;
+  std::vector<Slot> m_slots;  // routes by identity
+  std::size_t m_size{0};
+  Digest m_total;
+};
+}  // namespace wormhole::sysinfo
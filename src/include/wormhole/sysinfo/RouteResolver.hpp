@@ -0,0 +1,97 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <array>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/outcome.hpp>
+
+#include "RouteResolverError.hpp"
+#include "types.hpp"
+
+namespace outcome = BOOST_OUTCOME_V2_NAMESPACE;
+
+namespace wormhole::sysinfo
+{
+/*
+ * user space replica of the kernel FIB lookup: rules are evaluated in priority order
+ * and every table is indexed by prefix length, longest prefix first.
+ * returned routes stay valid until the next apply().
+ * a rule selecting by l3mdev or tun_id depends on the VRF or tunnel of the packet, a Flow
+ * reaching one of them fails with ResolverError::Unsupported.
+ */
+class RouteResolver
+{
+public:
+  struct Flow
+  {
+    boost::asio::ip::address destination;
+    boost::asio::ip::address source;
+    std::string_view inputInterface;  // "lo" for locally generated traffic
+    std::string_view outputInterface;
+    std::uint32_t mark{0};
+    std::uint8_t tos{0};
+    std::uint32_t uid{0};
+    std::uint8_t protocol{0};  // IPPROTO_*
+    std::uint16_t sourcePort{0};
+    std::uint16_t destinationPort{0};
+  };
+
+  RouteResolver();
+  RouteResolver(std::span<Rule const> rules, std::span<Route const> routes);
+
+  void apply(Rule const&);
+  void apply(Route const&);
+
+  [[nodiscard]] outcome::std_result<Route const*> resolve(Flow const&) const;
+
+private:
+  struct Key
+  {
+    std::uint64_t high;
+    std::uint64_t low;
+    std::size_t length;
+
+    bool operator==(Key const&) const noexcept = default;
+  };
+  struct KeyHash
+  {
+    std::size_t operator()(Key const&) const noexcept;
+  };
+
+  struct PrefixIndex
+  {
+    std::unordered_map<Key, std::vector<Route>, KeyHash> routes;
+    std::array<std::size_t, 129> lengthCount{};
+    std::vector<std::size_t> lengths;
+  };
+  struct TableIndex
+  {
+    PrefixIndex v4;
+    PrefixIndex v6;
+  };
+
+  static Key mask(Key, std::size_t length);
+  static Key makeKey(boost::asio::ip::address const&, std::size_t length);
+  static Key makeKey(Route::Destination const&);
+  static outcome::std_result<bool> matches(Rule const&, Flow const&, Key const& destination, Key const& source);
+  static Route const* lookup(PrefixIndex const&, Key const& destination, Flow const&);
+
+  std::vector<Rule>& rules(int family);
+  std::vector<Rule> const& rules(int family) const;
+  PrefixIndex* index(Route::Table, int family);
+  PrefixIndex const* index(Route::Table, int family) const;
+
+  std::vector<Rule> m_rulesV4;
+  std::vector<Rule> m_rulesV6;
+  std::unordered_map<std::uint32_t, TableIndex> m_tables;
+};
+}  // namespace wormhole::sysinfo
@@ -0,0 +1,29 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <system_error>
+
+namespace wormhole::sysinfo
+{
+enum class ResolverError
+{
+  None,
+  NoRoute,
+  Blackhole,
+  Unreachable,
+  Prohibit,
+  InvalidFamily,
+  Unsupported,
+};
+std::error_code make_error_code(ResolverError);
+}  // namespace wormhole::sysinfo
+
+template <>
+struct std::is_error_code_enum<wormhole::sysinfo::ResolverError> : true_type
+{
+};
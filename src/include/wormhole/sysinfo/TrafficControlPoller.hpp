@@ -0,0 +1,77 @@
+/*
+ * This file is distributed under the MIT License.
+ * See "LICENSE" for details.
+ * Copyright 2023, Dennis Börm (allspark@wormhole.eu)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "NetlinkSocket.hpp"
+
+namespace wormhole::sysinfo
+{
+/*
+ * statistics of every qdisc, and optionally every class, of the host sampled at an
+ * interval: sample() dumps them (RTM_GETQDISC, RTM_GETTCLASS per interface with a queue)
+ * and joins the dump with the previous one to get per-interval deltas, no state is
+ * parsed from text as `tc -s` would. both sample vectors and the socket's dump arena are
+ * reused: the arena goes back to the socket as soon as a response is copied into a sample.
+ * the socket joins the link group only to keep its interface names current, the events
+ * are drained before every dump.
+ */
+class TrafficControlPoller final
+{
+public:
+  struct Options
+  {
+    bool classes{false};  // one more dump per interface that has a queue
+  };
+
+  enum struct Object : std::uint8_t
+  {
+    Qdisc,
+    Class
+  };
+
+  struct Sample
+  {
+    Object object{Object::Qdisc};
+    TrafficControl entry;  // stats are totals since the qdisc or class was created
+    // counters since the previous sample (modulo 2^32 / 2^64), qlen and backlog as they are now
+    TrafficStats delta;
+    bool added{false};  // not in the previous sample or created again since, only the gauges are in delta
+  };
+
+  static outcome::std_result<TrafficControlPoller> open();
+  static outcome::std_result<TrafficControlPoller> open(Options);
+
+  // sorted by interface, object, handle and parent; valid until the next sample()
+  outcome::std_result<std::span<Sample const>> sample();
+
+  [[nodiscard]] std::span<Sample const> samples() const noexcept;
+  // between the last two samples, zero after the first
+  [[nodiscard]] Netlink::Metrics::Clock::duration interval() const noexcept;
+  Netlink::Socket& socket() noexcept;
+
+private:
+  TrafficControlPoller(Netlink::Socket t_socket, Options t_options);
+
+  outcome::std_result<void> drain();
+  outcome::std_result<void> collect();
+  template <typename Request>
+  outcome::std_result<void> dump(Object object, Interface::Index interface);
+  void join();
+
+  Netlink::Socket m_socket;
+  Options m_options;
+  std::vector<Sample> m_previous;
+  std::vector<Sample> m_current;
+  std::vector<Interface::Index> m_interfaces;
+  Netlink::Metrics::Clock::time_point m_sampled{};
+  Netlink::Metrics::Clock::duration m_interval{};
+};
+}  // namespace wormhole::sysinfo
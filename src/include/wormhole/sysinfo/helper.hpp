@@ -38,6 +38,17 @@ auto visitOptional(std::variant<std::monostate, Ts...> const& variant, DEF&& def
       variant);
 }
 
+template <typename... Ts, typename DEF, typename... CBs>
+auto visitOptional(std::variant<std::monostate, Ts...>& variant, DEF&& def, CBs&&... cbs)
+{
+  return std::visit(overloaded{[&](std::monostate)
+                        {
+                          return std::forward<DEF>(def)();
+                        },
+                        std::forward<CBs>(cbs)...},
+      variant);
+}
+
 template <typename... Ts, typename DEF, typename... CBs>
 auto visitOptional(std::variant<std::monostate, Ts...>&& variant, DEF&& def, CBs&&... cbs)
 {
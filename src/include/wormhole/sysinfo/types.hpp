@@ -6,11 +6,22 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
 
+#include <linux/fib_rules.h>
+#include <linux/rtnetlink.h>
 #include <net/if_arp.h>
 
+#include <fmt/format.h>
 #include <fmt/ostream.h>
 #include <boost/asio/ip/address.hpp>
 #include <boost/asio/ip/network_v4.hpp>
@@ -37,24 +48,52 @@ enum struct Scope
 };
 std::ostream& operator<<(std::ostream&, Scope const&);
 
-struct Address
+/*
+ * an interface name as the id of its interned copy: equal names have equal ids in the
+ * whole process, so a route carries 4 bytes instead of a string and parsing one allocates
+ * nothing. the interned names are kept inline in fixed size entries (IF_NAMESIZE), longer
+ * names are cut. every copy counts as a reference, the entry of a name without references
+ * is reused, so names of short-lived interfaces (veth of containers) don't pile up.
+ * more than a million names in use at once throws std::length_error.
+ */
+class InterfaceName
 {
-  Address() = default;
-  Address(boost::asio::ip::address t_address, boost::asio::ip::address_v4 const& t_netmask);
-  Address(boost::asio::ip::address t_address, boost::asio::ip::address_v6 const& t_netmask);
-  Address(boost::asio::ip::address t_address, boost::asio::ip::address const& t_netmask);
-  Address(boost::asio::ip::address t_address, std::size_t t_netmask);
+public:
+  static constexpr std::size_t Capacity = 16;  // IF_NAMESIZE, terminator included
 
-  static boost::asio::ip::address convertAddress(int family, void* data);
+  constexpr InterfaceName() noexcept = default;
+  explicit InterfaceName(std::string_view);
+  InterfaceName(InterfaceName const&) noexcept;
+  InterfaceName(InterfaceName&&) noexcept;
+  InterfaceName& operator=(InterfaceName const&) noexcept;
+  InterfaceName& operator=(InterfaceName&&) noexcept;
+  ~InterfaceName();
+  InterfaceName& operator=(std::string_view);
 
-  Action action{Action::New};
-  boost::asio::ip::address address;
-  std::size_t netmask;
-  boost::asio::ip::address broadcast;
-  boost::asio::ip::address local;
-  Scope scope{Scope::Nowhere};
+  [[nodiscard]] std::string_view view() const noexcept;
+  operator std::string_view() const noexcept
+  {
+    return view();
+  }
+  [[nodiscard]] bool empty() const noexcept
+  {
+    return m_id == 0;
+  }
+  [[nodiscard]] std::uint32_t id() const noexcept
+  {
+    return m_id;
+  }
+  // distinct names in use
+  static std::size_t interned();
 
-  friend std::ostream& operator<<(std::ostream& str, Address const& addr);
+  bool operator==(InterfaceName const&) const noexcept = default;
+  friend bool operator==(InterfaceName const& lhs, std::string_view rhs) noexcept
+  {
+    return lhs.view() == rhs;
+  }
+
+private:
+  std::uint32_t m_id{0};
 };
 
 struct Interface
@@ -63,6 +102,8 @@ struct Interface
   {
     int value;
 
+    auto operator<=>(Index const&) const noexcept = default;
+
     friend std::ostream& operator<<(std::ostream&, Index);
   };
   enum struct Type : unsigned short
@@ -74,34 +115,129 @@ struct Interface
     Unknown = ARPHRD_VOID,
     None = ARPHRD_NONE,
   };
+  // RFC 2863 operational state, IF_OPER_*
+  enum struct OperState : std::uint8_t
+  {
+    Unknown,
+    NotPresent,
+    Down,
+    LowerLayerDown,
+    Testing,
+    Dormant,
+    Up
+  };
   Interface() = default;
   explicit Interface(std::string_view t_name);
 
   Action action{Action::New};
   Index index;
   Type type;
-  std::string name;
+  InterfaceName name;
+  std::uint32_t flags{0};  // IFF_*
+  OperState operState{OperState::Unknown};
+  bool carrier{false};
+  std::uint32_t mtu{0};
 
   friend std::ostream& operator<<(std::ostream&, Type);
   friend std::ostream& operator<<(std::ostream&, Interface const&);
 };
 
+struct Address
+{
+  Address() = default;
+  Address(boost::asio::ip::address t_address, boost::asio::ip::address_v4 const& t_netmask);
+  Address(boost::asio::ip::address t_address, boost::asio::ip::address_v6 const& t_netmask);
+  Address(boost::asio::ip::address t_address, boost::asio::ip::address const& t_netmask);
+  Address(boost::asio::ip::address t_address, std::size_t t_netmask);
+
+  static boost::asio::ip::address convertAddress(int family, void* data);
+
+  Action action{Action::New};
+  boost::asio::ip::address address;
+  std::size_t netmask;
+  boost::asio::ip::address broadcast;
+  boost::asio::ip::address local;
+  Scope scope{Scope::Nowhere};
+  Interface::Index interfaceIndex{0};
+
+  friend std::ostream& operator<<(std::ostream& str, Address const& addr);
+};
+
+struct NexthopGroup
+{
+  struct Path
+  {
+    std::uint32_t id{0};
+    boost::asio::ip::address gateway;
+    Interface::Index interfaceIndex{0};
+    std::uint32_t weight{1};
+
+    bool operator==(Path const&) const = default;
+  };
+
+  std::vector<Path> paths;
+
+  bool operator==(NexthopGroup const&) const = default;
+
+  friend std::ostream& operator<<(std::ostream&, NexthopGroup const&);
+};
+
+struct Nexthop
+{
+  struct Member
+  {
+    std::uint32_t id;
+    std::uint32_t weight;
+
+    bool operator==(Member const&) const noexcept = default;
+  };
+
+  Action action{Action::New};
+  std::uint32_t id{0};
+  int family{AF_UNSPEC};
+  boost::asio::ip::address gateway;
+  Interface::Index interfaceIndex{0};
+  bool blackhole{false};
+  std::vector<Member> group;
+
+  friend std::ostream& operator<<(std::ostream&, Nexthop const&);
+};
+
 struct Route
 {
-  enum struct Table
+  enum struct Table : std::uint32_t
+  {
+    Unspec = RT_TABLE_UNSPEC,
+    Default = RT_TABLE_DEFAULT,
+    Main = RT_TABLE_MAIN,
+    Local = RT_TABLE_LOCAL,
+  };
+  enum struct Type : std::uint8_t
   {
-    Default,
-    Main,
-    Local,
+    Unspec = RTN_UNSPEC,
+    Unicast = RTN_UNICAST,
+    Local = RTN_LOCAL,
+    Broadcast = RTN_BROADCAST,
+    Anycast = RTN_ANYCAST,
+    Multicast = RTN_MULTICAST,
+    Blackhole = RTN_BLACKHOLE,
+    Unreachable = RTN_UNREACHABLE,
+    Prohibit = RTN_PROHIBIT,
+    Throw = RTN_THROW,
+    Nat = RTN_NAT,
   };
   struct Default_t
   {
+    bool operator==(Default_t const&) const noexcept = default;
+
     friend std::ostream& operator<<(std::ostream&, Default_t const&);
   };
   struct Destination
   {
     std::variant<Default_t, boost::asio::ip::network_v4, boost::asio::ip::network_v6> value;
 
+    bool operator==(Destination const&) const = default;
+
     template <typename T, typename... ARGs>
     decltype(auto) emplace(ARGs&&... args)
     {
@@ -111,72 +247,330 @@ struct Route
     {
       return std::holds_alternative<Default_t>(value);
     }
+    std::size_t PrefixLength() const noexcept;
 
     friend std::ostream& operator<<(std::ostream&, Destination const&);
   };
 
   Action action{Action::New};
-  Table table{Table::Default};
+  int family{AF_UNSPEC};
+  Table table{Table::Main};
+  Type type{Type::Unicast};
   Destination destination;
   boost::asio::ip::address gateway;
-  std::string interfaceName;
+  Interface::Index interfaceIndex{0};
+  InterfaceName interfaceName;
   boost::asio::ip::address source;
+  std::uint32_t priority{0};
+  std::uint8_t tos{0};
+  std::uint32_t nexthopId{0};
+  std::shared_ptr<NexthopGroup const> nexthops;  // with a nexthopId, a copy as of parsing, NexthopStore::resolve
 
   friend std::ostream& operator<<(std::ostream&, Route const&);
 };
 
 std::ostream& operator<<(std::ostream&, Route::Table const&);
+std::ostream& operator<<(std::ostream&, Route::Type const&);
+
+struct Rule
+{
+  enum struct Type : std::uint8_t
+  {
+    Unspec = FR_ACT_UNSPEC,
+    ToTable = FR_ACT_TO_TBL,
+    Goto = FR_ACT_GOTO,
+    Nop = FR_ACT_NOP,
+    Blackhole = FR_ACT_BLACKHOLE,
+    Unreachable = FR_ACT_UNREACHABLE,
+    Prohibit = FR_ACT_PROHIBIT,
+  };
+
+  // inclusive, `uidrange 1000-1999` or `sport 1024-65535`
+  template <typename T>
+  struct Range
+  {
+    T start{0};
+    T end{0};
+
+    [[nodiscard]] bool contains(T value) const noexcept
+    {
+      return start <= value && value <= end;
+    }
+    bool operator==(Range const&) const noexcept = default;
+  };
+
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  Rule() = default;
+  explicit Rule(allocator_type t_allocator);
+  Rule(Rule const&) = default;
+  Rule(Rule&&) noexcept = default;
+  Rule(Rule const&, allocator_type);
+  Rule(Rule&&, allocator_type);
+  Rule& operator=(Rule const&) = default;
+  Rule& operator=(Rule&&) noexcept = default;
+  ~Rule() = default;
+
+  Action action{Action::New};
+  int family{AF_UNSPEC};
+  std::uint32_t priority{0};
+  Type type{Type::ToTable};
+  Route::Table table{Route::Table::Unspec};
+  std::uint32_t gotoTarget{0};
+  Route::Destination source;
+  Route::Destination destination;
+  std::pmr::string inputInterface;
+  std::pmr::string outputInterface;
+  std::uint32_t fwmark{0};
+  std::uint32_t fwmask{0};
+  std::uint8_t tos{0};
+  bool invert{false};
+  std::optional<std::uint32_t> suppressPrefixLength;
+  std::optional<Range<std::uint32_t>> uidRange;
+  std::uint8_t ipProtocol{0};  // 0 is any
+  std::optional<Range<std::uint16_t>> sourcePorts;
+  std::optional<Range<std::uint16_t>> destinationPorts;
+  bool l3mdev{false};  // the table is the one of the VRF the packet is in
+  std::uint64_t tunnelId{0};  // 0 is any
+
+  friend std::ostream& operator<<(std::ostream&, Type);
+  friend std::ostream& operator<<(std::ostream&, Rule const&);
+};
+
+/*
+ * counters of a qdisc or class from TCA_STATS2 (gnet_stats_basic and gnet_stats_queue),
+ * zero for what the kernel left out. bytes and packets are 64 bit, the kernel's drops,
+ * overlimits and requeues are 32 bit and wrap. qlen and backlog are gauges.
+ */
+struct TrafficStats
+{
+  std::uint64_t bytes{0};
+  std::uint64_t packets{0};
+  std::uint32_t drops{0};
+  std::uint32_t overlimits{0};
+  std::uint32_t requeues{0};
+  std::uint32_t qlen{0};
+  std::uint32_t backlog{0};  // bytes
+
+  bool operator==(TrafficStats const&) const noexcept = default;
+};
+
+// "fq_codel", "htb", ...: the kernel keeps a qdisc's kind in IFNAMSIZ bytes, stored inline
+class TrafficControlKind
+{
+public:
+  static constexpr std::size_t Capacity = 15;  // IFNAMSIZ without the terminator
+
+  constexpr TrafficControlKind() noexcept = default;
+  explicit TrafficControlKind(std::string_view) noexcept;
+  TrafficControlKind& operator=(std::string_view) noexcept;  // truncated to Capacity
+
+  [[nodiscard]] std::string_view view() const noexcept
+  {
+    return {m_name.data(), m_size};
+  }
+  operator std::string_view() const noexcept
+  {
+    return view();
+  }
+  [[nodiscard]] bool empty() const noexcept
+  {
+    return m_size == 0;
+  }
+
+  bool operator==(TrafficControlKind const&) const noexcept = default;
+  friend bool operator==(TrafficControlKind const& lhs, std::string_view rhs) noexcept
+  {
+    return lhs.view() == rhs;
+  }
+
+private:
+  std::array<char, Capacity> m_name{};  // zero beyond m_size
+  std::uint8_t m_size{0};
+};
+
+// what qdiscs and classes have in common, handles are major:minor in the upper and lower 16 bits
+struct TrafficControl
+{
+  Action action{Action::New};
+  Interface::Index interfaceIndex{0};
+  InterfaceName interfaceName;
+  std::uint32_t handle{0};
+  std::uint32_t parent{0};  // TC_H_ROOT for a root qdisc
+  TrafficControlKind kind;
+  TrafficStats stats;
+};
+
+struct Qdisc : TrafficControl
+{
+  friend std::ostream& operator<<(std::ostream&, Qdisc const&);
+};
+
+struct TrafficClass : TrafficControl
+{
+  friend std::ostream& operator<<(std::ostream&, TrafficClass const&);
+};
+
+/*
+ * presentation types understood by the formatters of Address, Interface, Nexthop, Route, Rule, Qdisc and TrafficClass:
+ *   {}   "<action> <kind>: ..." as printed by the examples
+ *   {:i} iproute2 style, the line `ip route` / `ip rule` / `ip address` ... would print
+ *   {:c} compact, fixed set of space separated columns meant for diffing
+ */
+enum struct FormatStyle : char
+{
+  Default = '\0',
+  IpRoute = 'i',
+  Compact = 'c',
+};
+
+struct StyleFormatter
+{
+  FormatStyle style{FormatStyle::Default};
+
+  constexpr fmt::format_parse_context::iterator parse(fmt::format_parse_context& ctx)
+  {
+    auto it = ctx.begin();
+    if (it != ctx.end() && (*it == 'i' || *it == 'c'))
+    {
+      style = static_cast<FormatStyle>(*it++);
+    }
+    if (it != ctx.end() && *it != '}')
+    {
+      throw fmt::format_error("invalid format specifier");
+    }
+    return it;
+  }
+};
 }  // namespace wormhole::sysinfo
 
 template <>
-struct fmt::formatter<wormhole::sysinfo::Action> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Action> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Action, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Scope> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Scope, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::InterfaceName> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::InterfaceName, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::TrafficControlKind> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::TrafficControlKind const&, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Interface::Index> : formatter<int>
+{
+  format_context::iterator format(wormhole::sysinfo::Interface::Index, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Interface::Type> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Interface::Type, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Interface::OperState> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Interface::OperState, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Route::Table> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Route::Table, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Route::Type> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Route::Type, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Route::Default_t> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Route::Default_t const&, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Route::Destination> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Route::Destination const&, format_context&) const;
+};
+template <>
+struct fmt::formatter<wormhole::sysinfo::Rule::Type> : formatter<std::string_view>
+{
+  format_context::iterator format(wormhole::sysinfo::Rule::Type, format_context&) const;
+};
+template <>
+struct fmt::formatter<boost::asio::ip::address> : formatter<std::string_view>
+{
+  format_context::iterator format(boost::asio::ip::address const&, format_context&) const;
+};
+template <>
+struct fmt::formatter<boost::asio::ip::address_v4> : formatter<std::string_view>
 {
+  format_context::iterator format(boost::asio::ip::address_v4 const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Scope> : ostream_formatter
+struct fmt::formatter<boost::asio::ip::address_v6> : formatter<std::string_view>
 {
+  format_context::iterator format(boost::asio::ip::address_v6 const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Address> : ostream_formatter
+struct fmt::formatter<boost::asio::ip::network_v4> : formatter<std::string_view>
 {
+  format_context::iterator format(boost::asio::ip::network_v4 const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Interface::Index> : ostream_formatter
+struct fmt::formatter<boost::asio::ip::network_v6> : formatter<std::string_view>
 {
+  format_context::iterator format(boost::asio::ip::network_v6 const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Interface::Type> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Address> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::Address const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Interface> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Interface> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::Interface const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Route::Table> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::NexthopGroup> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::NexthopGroup const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Route::Default_t> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Nexthop> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::Nexthop const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Route::Destination> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Route> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::Route const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<wormhole::sysinfo::Route> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Rule> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::Rule const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<boost::asio::ip::address> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::TrafficStats> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::TrafficStats const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<boost::asio::ip::network_v4> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::Qdisc> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::Qdisc const&, format_context&) const;
 };
 template <>
-struct fmt::formatter<boost::asio::ip::network_v6> : ostream_formatter
+struct fmt::formatter<wormhole::sysinfo::TrafficClass> : wormhole::sysinfo::StyleFormatter
 {
+  format_context::iterator format(wormhole::sysinfo::TrafficClass const&, format_context&) const;
 };
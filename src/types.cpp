@@ -6,13 +6,35 @@
 
 #include "wormhole/sysinfo/types.hpp"
 
+#include <netinet/in.h>
+#include <linux/if.h>
+#include <linux/pkt_sched.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <mutex>
 #include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <fmt/compile.h>
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 
+#include "wormhole/sysinfo/helper.hpp"
+
 namespace
 {
+using namespace wormhole::sysinfo;
+using namespace std::string_view_literals;
+
+// "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255%4294967295/128"
+constexpr std::size_t MaxAddressLength = 64;
+using AddressBuffer = std::array<char, MaxAddressLength>;
+
 template <typename T, std::size_t N>
 std::size_t countNetmaskBits(std::array<T, N> const& bytes)
 {
@@ -33,50 +55,582 @@ std::size_t countNetmaskBits(boost::asio::ip::address const& netmask)
   }
   return 0;
 }
-}  // namespace
 
-namespace wormhole::sysinfo
+fmt::appender append(fmt::appender out, std::string_view text)
 {
-std::ostream& operator<<(std::ostream& str, Action const& action)
+  return std::copy(text.begin(), text.end(), out);
+}
+
+char* writeV4(char* out, unsigned char const* bytes)
 {
-  switch (action)
+  for (std::size_t i = 0; i < 4; ++i)
   {
-    case Action::Unknown:
-      str << "unknown";
-      break;
-    case Action::New:
-      str << "new";
-      break;
-    case Action::Del:
-      str << "del";
+    if (i != 0)
+    {
+      *out++ = '.';
+    }
+    out = std::to_chars(out, out + 3, bytes[i]).ptr;
+  }
+  return out;
+}
+
+// same text as inet_ntop(AF_INET6): longest zero run compressed, embedded IPv4 for mapped/compatible addresses
+char* writeV6(char* out, boost::asio::ip::address_v6::bytes_type const& bytes)
+{
+  std::array<unsigned, 8> words;
+  for (std::size_t i = 0; i < words.size(); ++i)
+  {
+    words[i] = static_cast<unsigned>(bytes[2 * i] << 8 | bytes[2 * i + 1]);
+  }
+  int bestBase = -1;
+  int bestLength = 0;
+  for (int i = 0; i < 8;)
+  {
+    if (words[static_cast<std::size_t>(i)] != 0)
+    {
+      ++i;
+      continue;
+    }
+    int start = i;
+    while (i < 8 && words[static_cast<std::size_t>(i)] == 0)
+    {
+      ++i;
+    }
+    if (i - start > bestLength)
+    {
+      bestBase = start;
+      bestLength = i - start;
+    }
+  }
+  if (bestLength < 2)
+  {
+    bestBase = -1;
+  }
+
+  for (int i = 0; i < 8; ++i)
+  {
+    if (bestBase != -1 && i >= bestBase && i < bestBase + bestLength)
+    {
+      if (i == bestBase)
+      {
+        *out++ = ':';
+      }
+      continue;
+    }
+    if (i != 0)
+    {
+      *out++ = ':';
+    }
+    if (i == 6 && bestBase == 0 && (bestLength == 6 || (bestLength == 5 && words[5] == 0xFFFF)))
+    {
+      return writeV4(out, bytes.data() + 12);
+    }
+    out = std::to_chars(out, out + 4, words[static_cast<std::size_t>(i)], 16).ptr;
+  }
+  if (bestBase != -1 && bestBase + bestLength == 8)
+  {
+    *out++ = ':';
+  }
+  return out;
+}
+
+std::string_view toChars(AddressBuffer& buffer, boost::asio::ip::address_v4 const& address)
+{
+  auto const bytes = address.to_bytes();
+  return {buffer.data(), writeV4(buffer.data(), bytes.data())};
+}
+
+std::string_view toChars(AddressBuffer& buffer, boost::asio::ip::address_v6 const& address)
+{
+  auto* end = writeV6(buffer.data(), address.to_bytes());
+  if (auto scope = address.scope_id(); scope != 0)
+  {
+    *end++ = '%';
+    end = std::to_chars(end, buffer.data() + buffer.size(), scope).ptr;
+  }
+  return {buffer.data(), end};
+}
+
+std::string_view toChars(AddressBuffer& buffer, boost::asio::ip::address const& address)
+{
+  if (address.is_v6())
+  {
+    return toChars(buffer, address.to_v6());
+  }
+  return toChars(buffer, address.to_v4());
+}
+
+template <typename NETWORK>
+std::string_view toChars(AddressBuffer& buffer, NETWORK const& network)
+{
+  auto text = toChars(buffer, network.address());
+  auto* end = buffer.data() + text.size();
+  *end++ = '/';
+  end = std::to_chars(end, buffer.data() + buffer.size(), network.prefix_length()).ptr;
+  return {buffer.data(), end};
+}
+
+std::string_view tableName(Route::Table table, std::array<char, 16>& buffer)
+{
+  switch (table)
+  {
+    case Route::Table::Default:
+      return "default"sv;
+    case Route::Table::Main:
+      return "main"sv;
+    case Route::Table::Local:
+      return "local"sv;
+    default:
       break;
   }
-  return str;
+  auto* end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), static_cast<std::uint32_t>(table)).ptr;
+  return {buffer.data(), end};
 }
 
-std::ostream& operator<<(std::ostream& str, Scope const& scope)
+std::string_view scopeName(Scope scope)
 {
   switch (scope)
   {
     case Scope::Universe:
-      str << "Universe";
-      break;
+      return "global"sv;
     case Scope::Site:
-      str << "Site";
-      break;
+      return "site"sv;
     case Scope::Link:
-      str << "Link";
-      break;
+      return "link"sv;
     case Scope::Host:
-      str << "Host";
-      break;
+      return "host"sv;
     case Scope::Nowhere:
-      str << "Nowhere";
-      break;
+      return "nowhere"sv;
     case Scope::Unknown:
-      str << "Unknown";
       break;
   }
+  return "unknown"sv;
+}
+
+std::string_view linkTypeName(Interface::Type type)
+{
+  switch (type)
+  {
+    case Interface::Type::Ethernet:
+      return "ether"sv;
+    case Interface::Type::IpIpTunnel:
+      return "ipip"sv;
+    case Interface::Type::IpIp6Tunnel:
+      return "tunnel6"sv;
+    case Interface::Type::Loopback:
+      return "loopback"sv;
+    case Interface::Type::Unknown:
+      return "void"sv;
+    case Interface::Type::None:
+      return "none"sv;
+  }
+  return "unknown"sv;
+}
+
+std::string_view operStateName(Interface::OperState state)
+{
+  switch (state)
+  {
+    case Interface::OperState::NotPresent:
+      return "NOTPRESENT"sv;
+    case Interface::OperState::Down:
+      return "DOWN"sv;
+    case Interface::OperState::LowerLayerDown:
+      return "LOWERLAYERDOWN"sv;
+    case Interface::OperState::Testing:
+      return "TESTING"sv;
+    case Interface::OperState::Dormant:
+      return "DORMANT"sv;
+    case Interface::OperState::Up:
+      return "UP"sv;
+    case Interface::OperState::Unknown:
+      break;
+  }
+  return "UNKNOWN"sv;
+}
+
+// <BROADCAST,MULTICAST,UP,LOWER_UP> as printed by iproute2
+fmt::appender writeLinkFlags(fmt::appender out, std::uint32_t flags)
+{
+  static constexpr std::array<std::pair<std::uint32_t, std::string_view>, 11> names{{
+      {IFF_LOOPBACK, "LOOPBACK"sv},
+      {IFF_BROADCAST, "BROADCAST"sv},
+      {IFF_POINTOPOINT, "POINTOPOINT"sv},
+      {IFF_MULTICAST, "MULTICAST"sv},
+      {IFF_NOARP, "NOARP"sv},
+      {IFF_ALLMULTI, "ALLMULTI"sv},
+      {IFF_PROMISC, "PROMISC"sv},
+      {IFF_MASTER, "MASTER"sv},
+      {IFF_SLAVE, "SLAVE"sv},
+      {IFF_UP, "UP"sv},
+      {IFF_LOWER_UP, "LOWER_UP"sv},
+  }};
+  std::string_view separator;
+  out = append(out, "<"sv);
+  if ((flags & IFF_UP) != 0 && (flags & IFF_RUNNING) == 0)
+  {
+    out = append(out, "NO-CARRIER"sv);
+    separator = ","sv;
+  }
+  for (auto const& [flag, name] : names)
+  {
+    if ((flags & flag) != 0)
+    {
+      out = append(out, separator);
+      out = append(out, name);
+      separator = ","sv;
+    }
+  }
+  return append(out, ">"sv);
+}
+
+fmt::appender deleted(fmt::appender out, Action action)
+{
+  return action == Action::Del ? append(out, "Deleted "sv) : out;
+}
+
+// host routes are printed without prefix length by iproute2
+fmt::appender writeHostOrNetwork(fmt::appender out, Route::Destination const& destination)
+{
+  return std::visit(helper::overloaded{[out](Route::Default_t)
+                        {
+                          return append(out, "default"sv);
+                        },
+                        [out](auto const& network)
+                        {
+                          if (network.is_host())
+                          {
+                            return fmt::format_to(out, FMT_COMPILE("{}"), network.address());
+                          }
+                          return fmt::format_to(out, FMT_COMPILE("{}"), network);
+                        }},
+      destination.value);
+}
+
+// names as /etc/protocols has them, iproute2 falls back to "ipproto-N" as well
+fmt::appender writeProtocol(fmt::appender out, std::uint8_t protocol)
+{
+  switch (protocol)
+  {
+    case IPPROTO_ICMP:
+      return append(out, "icmp"sv);
+    case IPPROTO_TCP:
+      return append(out, "tcp"sv);
+    case IPPROTO_UDP:
+      return append(out, "udp"sv);
+    case IPPROTO_ICMPV6:
+      return append(out, "ipv6-icmp"sv);
+    case IPPROTO_SCTP:
+      return append(out, "sctp"sv);
+    default:
+      return fmt::format_to(out, FMT_COMPILE("ipproto-{}"), protocol);
+  }
+}
+
+// "sport 80" or "sport 1024-65535"
+fmt::appender writePortRange(fmt::appender out, std::string_view name, std::optional<Rule::Range<std::uint16_t>> const& range)
+{
+  if (!range)
+  {
+    return out;
+  }
+  if (range->start == range->end)
+  {
+    return fmt::format_to(out, FMT_COMPILE("{} {}"), name, range->start);
+  }
+  return fmt::format_to(out, FMT_COMPILE("{} {}-{}"), name, range->start, range->end);
+}
+
+fmt::appender writeRuleSelector(fmt::appender out, Rule const& rule)
+{
+  if (rule.invert)
+  {
+    out = append(out, "not "sv);
+  }
+  if (rule.source.IsDefaultRoute())
+  {
+    out = append(out, "from all"sv);
+  }
+  else
+  {
+    out = fmt::format_to(out, FMT_COMPILE("from {}"), rule.source);
+  }
+  if (!rule.destination.IsDefaultRoute())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" to {}"), rule.destination);
+  }
+  if (rule.tos != 0)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" tos {:#x}"), rule.tos);
+  }
+  if (rule.fwmask == 0xFFFFFFFF)
+  {
+    // a full mask is left out, as by iproute2
+    out = fmt::format_to(out, FMT_COMPILE(" fwmark {:#x}"), rule.fwmark);
+  }
+  else if (rule.fwmask != 0)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" fwmark {:#x}/{:#x}"), rule.fwmark, rule.fwmask);
+  }
+  if (!rule.inputInterface.empty())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" iif {}"), rule.inputInterface);
+  }
+  if (!rule.outputInterface.empty())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" oif {}"), rule.outputInterface);
+  }
+  if (rule.uidRange)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" uidrange {}-{}"), rule.uidRange->start, rule.uidRange->end);
+  }
+  if (rule.ipProtocol != 0)
+  {
+    out = append(out, " ipproto "sv);
+    out = writeProtocol(out, rule.ipProtocol);
+  }
+  out = writePortRange(out, " sport"sv, rule.sourcePorts);
+  out = writePortRange(out, " dport"sv, rule.destinationPorts);
+  if (rule.tunnelId != 0)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" tun_id {}"), rule.tunnelId);
+  }
+  out = fmt::format_to(out, FMT_COMPILE(" {}"), rule.type);
+  if (rule.type == Rule::Type::ToTable && rule.l3mdev)
+  {
+    out = append(out, " [l3mdev-table]"sv);
+  }
+  else if (rule.type == Rule::Type::ToTable)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" {}"), rule.table);
+  }
+  else if (rule.type == Rule::Type::Goto)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" {}"), rule.gotoTarget);
+  }
+  if (rule.suppressPrefixLength)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" suppress_prefixlength {}"), *rule.suppressPrefixLength);
+  }
+  return out;
+}
+
+fmt::appender writeNexthopBody(fmt::appender out, Nexthop const& nexthop)
+{
+  out = fmt::format_to(out, FMT_COMPILE("id {}"), nexthop.id);
+  if (!nexthop.group.empty())
+  {
+    out = append(out, " group"sv);
+    char separator = ' ';
+    for (auto const& member : nexthop.group)
+    {
+      out = fmt::format_to(out, FMT_COMPILE("{}{}"), separator, member.id);
+      if (member.weight > 1)
+      {
+        out = fmt::format_to(out, FMT_COMPILE(",{}"), member.weight);
+      }
+      separator = '/';
+    }
+  }
+  if (nexthop.blackhole)
+  {
+    out = append(out, " blackhole"sv);
+  }
+  if (!nexthop.gateway.is_unspecified())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" via {}"), nexthop.gateway);
+  }
+  if (nexthop.interfaceIndex.value != 0)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" oif {}"), nexthop.interfaceIndex);
+  }
+  return out;
+}
+
+// major:minor in hex as tc prints it, "8001:" without a minor
+fmt::appender writeHandle(fmt::appender out, std::uint32_t handle)
+{
+  if (handle == TC_H_ROOT)
+  {
+    return append(out, "root"sv);
+  }
+  if (handle == TC_H_INGRESS)
+  {
+    return append(out, "ingress"sv);
+  }
+  if (TC_H_MIN(handle) == 0)
+  {
+    return fmt::format_to(out, FMT_COMPILE("{:x}:"), TC_H_MAJ(handle) >> 16);
+  }
+  return fmt::format_to(out, FMT_COMPILE("{:x}:{:x}"), TC_H_MAJ(handle) >> 16, TC_H_MIN(handle));
+}
+
+// "qdisc fq_codel 8001: dev eth0 root", the line `tc qdisc` / `tc class` would print
+fmt::appender writeTrafficControlBody(fmt::appender out, std::string_view object, TrafficControl const& tc)
+{
+  out = fmt::format_to(out, FMT_COMPILE("{} {} "), object, tc.kind.empty() ? "-"sv : tc.kind.view());
+  out = writeHandle(out, tc.handle);
+  if (!tc.interfaceName.empty())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" dev {}"), tc.interfaceName);
+  }
+  else
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" dev {}"), tc.interfaceIndex);
+  }
+  if (tc.parent == TC_H_ROOT)
+  {
+    return append(out, " root"sv);
+  }
+  out = append(out, " parent "sv);
+  return writeHandle(out, tc.parent);
+}
+
+fmt::appender writeTrafficControlCompact(fmt::appender out, TrafficControl const& tc)
+{
+  out = fmt::format_to(out, FMT_COMPILE("{} "), tc.interfaceName.empty() ? "-"sv : tc.interfaceName.view());
+  out = writeHandle(out, tc.handle);
+  out = append(out, " "sv);
+  out = writeHandle(out, tc.parent);
+  return fmt::format_to(out, FMT_COMPILE(" {} {:c}"), tc.kind.empty() ? "-"sv : tc.kind.view(), tc.stats);
+}
+
+/*
+ * entries never move, readers of a name need no lock. every InterfaceName holds a
+ * reference, the id of a name nobody holds any more is reused for the next new name.
+ * more than MaxChunks * ChunkSize names in use at once is an error, std::length_error.
+ */
+class NameTable
+{
+public:
+  static constexpr std::size_t ChunkSize = 1024;
+  static constexpr std::size_t MaxChunks = 1024;
+
+  std::uint32_t intern(std::string_view name)
+  {
+    name = name.substr(0, std::min(name.size(), InterfaceName::Capacity - 1));
+    if (name.empty())
+    {
+      return 0;
+    }
+    std::lock_guard lock{m_mutex};
+    if (auto it = m_ids.find(name); it != m_ids.end())
+    {
+      entry(it->second).references.fetch_add(1, std::memory_order_relaxed);
+      return it->second;
+    }
+    std::uint32_t id = 0;
+    if (!m_free.empty())
+    {
+      id = m_free.back();
+      m_free.pop_back();
+    }
+    else
+    {
+      id = m_size.load(std::memory_order_relaxed);
+      auto const chunk = id / ChunkSize;
+      if (chunk >= MaxChunks)
+      {
+        throw std::length_error{"more than a million interface names in use"};
+      }
+      if (m_chunks[chunk] == nullptr)
+      {
+        m_chunks[chunk] = std::make_unique<Entry[]>(ChunkSize);
+      }
+    }
+    auto& interned = entry(id);
+    std::ranges::copy(name, interned.data.begin());
+    interned.length = static_cast<std::uint8_t>(name.size());
+    interned.mapped = true;
+    interned.references.store(1, std::memory_order_relaxed);
+    m_ids.emplace(std::string_view{interned.data.data(), name.size()}, id);
+    if (id == m_size.load(std::memory_order_relaxed))
+    {
+      m_size.store(id + 1, std::memory_order_release);
+    }
+    return id;
+  }
+
+  void retain(std::uint32_t id) noexcept
+  {
+    if (id != 0)
+    {
+      entry(id).references.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void release(std::uint32_t id) noexcept
+  {
+    if (id == 0 || entry(id).references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+      return;
+    }
+    // intern() may have handed the name out again meanwhile, or another release() freed it
+    std::lock_guard lock{m_mutex};
+    auto& released = entry(id);
+    if (released.references.load(std::memory_order_relaxed) == 0 && released.mapped)
+    {
+      m_ids.erase(std::string_view{released.data.data(), released.length});
+      released.mapped = false;
+      m_free.push_back(id);
+    }
+  }
+
+  std::string_view view(std::uint32_t id) const noexcept
+  {
+    if (id == 0 || id >= m_size.load(std::memory_order_acquire))
+    {
+      return {};
+    }
+    auto const& interned = entry(id);
+    return {interned.data.data(), interned.length};
+  }
+
+  std::size_t size()
+  {
+    std::lock_guard lock{m_mutex};
+    return m_ids.size();
+  }
+
+private:
+  struct Entry
+  {
+    std::array<char, InterfaceName::Capacity> data;
+    std::uint8_t length;
+    bool mapped;  // in m_ids, guarded by m_mutex
+    std::atomic<std::uint32_t> references;
+  };
+
+  Entry& entry(std::uint32_t id) const noexcept
+  {
+    return m_chunks[id / ChunkSize][id % ChunkSize];
+  }
+
+  std::mutex m_mutex;
+  std::array<std::unique_ptr<Entry[]>, MaxChunks> m_chunks;
+  std::atomic<std::uint32_t> m_size{1};  // id 0 is the empty name
+  std::unordered_map<std::string_view, std::uint32_t> m_ids;
+  std::vector<std::uint32_t> m_free;
+};
+
+NameTable& names()
+{
+  static NameTable table;
+  return table;
+}
+}  // namespace
+
+namespace wormhole::sysinfo
+{
+std::ostream& operator<<(std::ostream& str, Action const& action)
+{
+  fmt::print(str, "{}", action);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Scope const& scope)
+{
+  fmt::print(str, "{}", scope);
   return str;
 }
 
@@ -103,21 +657,13 @@ Address::Address(boost::asio::ip::address t_address, std::size_t t_netmask)
 
 std::ostream& operator<<(std::ostream& str, Address const& addr)
 {
-  fmt::print(str, "{} address {}/{} scope {}", addr.action, addr.address, addr.netmask, addr.scope);
-  if (!addr.broadcast.is_unspecified())
-  {
-    fmt::print(str, " broadcast {}", addr.broadcast);
-  }
-  if (!addr.local.is_unspecified())
-  {
-    fmt::print(str, " local {}", addr.local);
-  }
+  fmt::print(str, "{}", addr);
   return str;
 }
 
 std::ostream& operator<<(std::ostream& str, Interface::Index const index)
 {
-  fmt::print(str, "{}", index.value);
+  fmt::print(str, "{}", index);
   return str;
 }
 
@@ -138,6 +684,79 @@ boost::asio::ip::address Address::convertAddress(int family, void* data)
   return {};
 }
 
+InterfaceName::InterfaceName(std::string_view name)
+  : m_id{names().intern(name)}
+{
+}
+
+InterfaceName::InterfaceName(InterfaceName const& rhs) noexcept
+  : m_id{rhs.m_id}
+{
+  names().retain(m_id);
+}
+
+InterfaceName::InterfaceName(InterfaceName&& rhs) noexcept
+  : m_id{std::exchange(rhs.m_id, 0)}
+{
+}
+
+InterfaceName& InterfaceName::operator=(InterfaceName const& rhs) noexcept
+{
+  names().retain(rhs.m_id);
+  names().release(m_id);
+  m_id = rhs.m_id;
+  return *this;
+}
+
+InterfaceName& InterfaceName::operator=(InterfaceName&& rhs) noexcept
+{
+  if (this != &rhs)
+  {
+    names().release(m_id);
+    m_id = std::exchange(rhs.m_id, 0);
+  }
+  return *this;
+}
+
+InterfaceName::~InterfaceName()
+{
+  if (m_id != 0)
+  {
+    names().release(m_id);
+  }
+}
+
+InterfaceName& InterfaceName::operator=(std::string_view name)
+{
+  auto const id = names().intern(name);
+  names().release(m_id);
+  m_id = id;
+  return *this;
+}
+
+std::string_view InterfaceName::view() const noexcept
+{
+  return names().view(m_id);
+}
+
+std::size_t InterfaceName::interned()
+{
+  return names().size();
+}
+
+TrafficControlKind::TrafficControlKind(std::string_view kind) noexcept
+{
+  *this = kind;
+}
+
+TrafficControlKind& TrafficControlKind::operator=(std::string_view kind) noexcept
+{
+  m_size = static_cast<std::uint8_t>(std::min(kind.size(), Capacity));
+  m_name.fill('\0');
+  std::copy_n(kind.data(), m_size, m_name.data());
+  return *this;
+}
+
 Interface::Interface(std::string_view t_name)
   : name{t_name}
 {
@@ -145,8 +764,166 @@ Interface::Interface(std::string_view t_name)
 
 std::ostream& operator<<(std::ostream& str, Interface::Type const type)
 {
-  using namespace std::string_view_literals;
-  std::string_view type_name = [type]()
+  fmt::print(str, "{}", type);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Interface const& interface)
+{
+  fmt::print(str, "{}", interface);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Route::Default_t const& value)
+{
+  fmt::print(str, "{}", value);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Route::Destination const& destination)
+{
+  fmt::print(str, "{}", destination);
+  return str;
+}
+
+std::size_t Route::Destination::PrefixLength() const noexcept
+{
+  return std::visit(helper::overloaded{[](Default_t)
+                        {
+                          return std::size_t{0};
+                        },
+                        [](auto const& network)
+                        {
+                          return static_cast<std::size_t>(network.prefix_length());
+                        }},
+      value);
+}
+
+std::ostream& operator<<(std::ostream& str, Route const& route)
+{
+  fmt::print(str, "{}", route);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, NexthopGroup const& group)
+{
+  fmt::print(str, "{}", group);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Nexthop const& nexthop)
+{
+  fmt::print(str, "{}", nexthop);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Qdisc const& qdisc)
+{
+  fmt::print(str, "{}", qdisc);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, TrafficClass const& trafficClass)
+{
+  fmt::print(str, "{}", trafficClass);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Route::Table const& table)
+{
+  fmt::print(str, "{}", table);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Route::Type const& type)
+{
+  fmt::print(str, "{}", type);
+  return str;
+}
+
+std::ostream& operator<<(std::ostream& str, Rule::Type const type)
+{
+  fmt::print(str, "{}", type);
+  return str;
+}
+
+Rule::Rule(allocator_type t_allocator)
+  : inputInterface{t_allocator}
+  , outputInterface{t_allocator}
+{
+}
+
+Rule::Rule(Rule const& rhs, allocator_type t_allocator)
+  : Rule{t_allocator}
+{
+  *this = rhs;
+}
+
+Rule::Rule(Rule&& rhs, allocator_type t_allocator)
+  : Rule{t_allocator}
+{
+  *this = std::move(rhs);
+}
+
+std::ostream& operator<<(std::ostream& str, Rule const& rule)
+{
+  fmt::print(str, "{}", rule);
+  return str;
+}
+}  // namespace wormhole::sysinfo
+
+using namespace wormhole::sysinfo;
+
+fmt::format_context::iterator fmt::formatter<Action>::format(Action action, format_context& ctx) const
+{
+  auto name = [action]()
+  {
+    switch (action)
+    {
+      case Action::New:
+        return "new"sv;
+      case Action::Del:
+        return "del"sv;
+      case Action::Unknown:
+        break;
+    }
+    return "unknown"sv;
+  }();
+  return formatter<std::string_view>::format(name, ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Scope>::format(Scope scope, format_context& ctx) const
+{
+  auto name = [scope]()
+  {
+    switch (scope)
+    {
+      case Scope::Universe:
+        return "Universe"sv;
+      case Scope::Site:
+        return "Site"sv;
+      case Scope::Link:
+        return "Link"sv;
+      case Scope::Host:
+        return "Host"sv;
+      case Scope::Nowhere:
+        return "Nowhere"sv;
+      case Scope::Unknown:
+        break;
+    }
+    return "Unknown"sv;
+  }();
+  return formatter<std::string_view>::format(name, ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Interface::Index>::format(Interface::Index index, format_context& ctx) const
+{
+  return formatter<int>::format(index.value, ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Interface::Type>::format(Interface::Type type, format_context& ctx) const
+{
+  auto name = [type]()
   {
     switch (type)
     {
@@ -165,66 +942,425 @@ std::ostream& operator<<(std::ostream& str, Interface::Type const type)
     }
     return "<unknown>"sv;
   }();
-  fmt::print(str, "{}", type_name);
-  return str;
+  return formatter<std::string_view>::format(name, ctx);
 }
 
-std::ostream& operator<<(std::ostream& str, Interface const& interface)
+fmt::format_context::iterator fmt::formatter<InterfaceName>::format(InterfaceName name, format_context& ctx) const
 {
-  fmt::print(str, "{} index: {} type: {} link: {}", interface.action, interface.index, interface.type, interface.name);
-  return str;
+  return formatter<std::string_view>::format(name.view(), ctx);
 }
 
-std::ostream& operator<<(std::ostream& str, Route::Default_t const&)
+fmt::format_context::iterator fmt::formatter<TrafficControlKind>::format(TrafficControlKind const& kind, format_context& ctx) const
 {
-  fmt::print(str, "default");
-  return str;
+  return formatter<std::string_view>::format(kind.view(), ctx);
 }
 
-std::ostream& operator<<(std::ostream& str, Route::Destination const& destination)
+fmt::format_context::iterator fmt::formatter<Interface::OperState>::format(Interface::OperState state, format_context& ctx) const
 {
-  std::visit([&str](auto const& item)
-      {
-        fmt::print(str, "{}", item);
-      },
+  return formatter<std::string_view>::format(operStateName(state), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Route::Table>::format(Route::Table table, format_context& ctx) const
+{
+  std::array<char, 16> buffer;
+  return formatter<std::string_view>::format(tableName(table, buffer), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Route::Type>::format(Route::Type type, format_context& ctx) const
+{
+  auto name = [type]()
+  {
+    switch (type)
+    {
+      case Route::Type::Unspec:
+        return "none"sv;
+      case Route::Type::Unicast:
+        return "unicast"sv;
+      case Route::Type::Local:
+        return "local"sv;
+      case Route::Type::Broadcast:
+        return "broadcast"sv;
+      case Route::Type::Anycast:
+        return "anycast"sv;
+      case Route::Type::Multicast:
+        return "multicast"sv;
+      case Route::Type::Blackhole:
+        return "blackhole"sv;
+      case Route::Type::Unreachable:
+        return "unreachable"sv;
+      case Route::Type::Prohibit:
+        return "prohibit"sv;
+      case Route::Type::Throw:
+        return "throw"sv;
+      case Route::Type::Nat:
+        return "nat"sv;
+    }
+    return "<unknown>"sv;
+  }();
+  return formatter<std::string_view>::format(name, ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Route::Default_t>::format(Route::Default_t const&, format_context& ctx) const
+{
+  return formatter<std::string_view>::format("default"sv, ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Route::Destination>::format(Route::Destination const& destination, format_context& ctx) const
+{
+  AddressBuffer buffer;
+  auto text = std::visit(helper::overloaded{[](Route::Default_t)
+                             {
+                               return "default"sv;
+                             },
+                             [&buffer](auto const& network)
+                             {
+                               return toChars(buffer, network);
+                             }},
       destination.value);
-  return str;
+  return formatter<std::string_view>::format(text, ctx);
 }
 
-std::ostream& operator<<(std::ostream& str, Route const& route)
+fmt::format_context::iterator fmt::formatter<Rule::Type>::format(Rule::Type type, format_context& ctx) const
 {
-  fmt::print(str, "{} route: {}", route.action, route.destination);
-  if (!route.gateway.is_unspecified())
+  auto name = [type]()
+  {
+    switch (type)
+    {
+      case Rule::Type::Unspec:
+        return "unspec"sv;
+      case Rule::Type::ToTable:
+        return "lookup"sv;
+      case Rule::Type::Goto:
+        return "goto"sv;
+      case Rule::Type::Nop:
+        return "nop"sv;
+      case Rule::Type::Blackhole:
+        return "blackhole"sv;
+      case Rule::Type::Unreachable:
+        return "unreachable"sv;
+      case Rule::Type::Prohibit:
+        return "prohibit"sv;
+    }
+    return "<unknown>"sv;
+  }();
+  return formatter<std::string_view>::format(name, ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<boost::asio::ip::address>::format(boost::asio::ip::address const& address, format_context& ctx) const
+{
+  AddressBuffer buffer;
+  return formatter<std::string_view>::format(toChars(buffer, address), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<boost::asio::ip::address_v4>::format(boost::asio::ip::address_v4 const& address, format_context& ctx) const
+{
+  AddressBuffer buffer;
+  return formatter<std::string_view>::format(toChars(buffer, address), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<boost::asio::ip::address_v6>::format(boost::asio::ip::address_v6 const& address, format_context& ctx) const
+{
+  AddressBuffer buffer;
+  return formatter<std::string_view>::format(toChars(buffer, address), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<boost::asio::ip::network_v4>::format(boost::asio::ip::network_v4 const& network, format_context& ctx) const
+{
+  AddressBuffer buffer;
+  return formatter<std::string_view>::format(toChars(buffer, network), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<boost::asio::ip::network_v6>::format(boost::asio::ip::network_v6 const& network, format_context& ctx) const
+{
+  AddressBuffer buffer;
+  return formatter<std::string_view>::format(toChars(buffer, network), ctx);
+}
+
+fmt::format_context::iterator fmt::formatter<Address>::format(Address const& addr, format_context& ctx) const
+{
+  auto out = ctx.out();
+  auto const& local = addr.local.is_unspecified() ? addr.address : addr.local;
+  switch (style)
+  {
+    case FormatStyle::IpRoute:
+      out = deleted(out, addr.action);
+      out = fmt::format_to(out, FMT_COMPILE("{} {}/{}"), local.is_v6() ? "inet6"sv : "inet"sv, local, addr.netmask);
+      if (!addr.local.is_unspecified() && addr.local != addr.address)
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" peer {}"), addr.address);
+      }
+      if (!addr.broadcast.is_unspecified())
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" brd {}"), addr.broadcast);
+      }
+      return fmt::format_to(out, FMT_COMPILE(" scope {}"), scopeName(addr.scope));
+    case FormatStyle::Compact:
+      if (addr.broadcast.is_unspecified())
+      {
+        return fmt::format_to(out, FMT_COMPILE("{}/{} - {}"), local, addr.netmask, scopeName(addr.scope));
+      }
+      return fmt::format_to(out, FMT_COMPILE("{}/{} {} {}"), local, addr.netmask, addr.broadcast, scopeName(addr.scope));
+    case FormatStyle::Default:
+      break;
+  }
+  out = fmt::format_to(out, FMT_COMPILE("{} address {}/{} scope {}"), addr.action, addr.address, addr.netmask, addr.scope);
+  if (!addr.broadcast.is_unspecified())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" broadcast {}"), addr.broadcast);
+  }
+  if (!addr.local.is_unspecified())
   {
-    fmt::print(str, " via {}", route.gateway);
+    out = fmt::format_to(out, FMT_COMPILE(" local {}"), addr.local);
   }
+  return out;
+}
+
+fmt::format_context::iterator fmt::formatter<Interface>::format(Interface const& interface, format_context& ctx) const
+{
+  auto out = ctx.out();
+  switch (style)
+  {
+    case FormatStyle::IpRoute:
+      out = deleted(out, interface.action);
+      out = fmt::format_to(out, FMT_COMPILE("{}: {}: "), interface.index, interface.name);
+      out = writeLinkFlags(out, interface.flags);
+      return fmt::format_to(out, FMT_COMPILE(" mtu {} state {} link/{}"), interface.mtu, operStateName(interface.operState), linkTypeName(interface.type));
+    case FormatStyle::Compact:
+      return fmt::format_to(out, FMT_COMPILE("{} {} {} {} {} {}"), interface.index, interface.name.empty() ? "-"sv : std::string_view{interface.name}, linkTypeName(interface.type),
+          operStateName(interface.operState), interface.carrier ? "carrier"sv : "no-carrier"sv, interface.mtu);
+    case FormatStyle::Default:
+      break;
+  }
+  return fmt::format_to(out, FMT_COMPILE("{} index: {} type: {} link: {} flags: {:#x} state: {} carrier: {} mtu: {}"), interface.action, interface.index, interface.type, interface.name,
+      interface.flags, interface.operState, interface.carrier, interface.mtu);
+}
 
+fmt::format_context::iterator fmt::formatter<NexthopGroup>::format(NexthopGroup const& group, format_context& ctx) const
+{
+  auto out = ctx.out();
+  std::string_view separator;
+  for (auto const& path : group.paths)
+  {
+    if (style == FormatStyle::Compact)
+    {
+      out = append(out, separator);
+      separator = ","sv;
+      out = path.gateway.is_unspecified() ? append(out, "-"sv) : fmt::format_to(out, FMT_COMPILE("{}"), path.gateway);
+      out = fmt::format_to(out, FMT_COMPILE("*{}"), path.weight);
+      continue;
+    }
+    out = fmt::format_to(out, FMT_COMPILE("{}nexthop"), separator);
+    separator = " "sv;
+    if (path.id != 0 && style == FormatStyle::Default)
+    {
+      out = fmt::format_to(out, FMT_COMPILE(" id {}"), path.id);
+    }
+    if (!path.gateway.is_unspecified())
+    {
+      out = fmt::format_to(out, FMT_COMPILE(" via {}"), path.gateway);
+    }
+    if (path.interfaceIndex.value != 0 && style == FormatStyle::Default)
+    {
+      out = fmt::format_to(out, FMT_COMPILE(" oif {}"), path.interfaceIndex);
+    }
+    out = fmt::format_to(out, FMT_COMPILE(" weight {}"), path.weight);
+  }
+  return out;
+}
+
+fmt::format_context::iterator fmt::formatter<Nexthop>::format(Nexthop const& nexthop, format_context& ctx) const
+{
+  auto out = ctx.out();
+  switch (style)
+  {
+    case FormatStyle::IpRoute:
+      return writeNexthopBody(deleted(out, nexthop.action), nexthop);
+    case FormatStyle::Compact:
+      out = fmt::format_to(out, FMT_COMPILE("{} "), nexthop.id);
+      out = nexthop.gateway.is_unspecified() ? append(out, "-"sv) : fmt::format_to(out, FMT_COMPILE("{}"), nexthop.gateway);
+      out = fmt::format_to(out, FMT_COMPILE(" {} "), nexthop.interfaceIndex);
+      if (nexthop.group.empty())
+      {
+        return append(out, nexthop.blackhole ? "blackhole"sv : "-"sv);
+      }
+      for (std::string_view separator; auto const& member : nexthop.group)
+      {
+        out = fmt::format_to(out, FMT_COMPILE("{}{},{}"), separator, member.id, member.weight);
+        separator = "/"sv;
+      }
+      return out;
+    case FormatStyle::Default:
+      break;
+  }
+  out = fmt::format_to(out, FMT_COMPILE("{} nexthop: "), nexthop.action);
+  return writeNexthopBody(out, nexthop);
+}
+
+fmt::format_context::iterator fmt::formatter<Route>::format(Route const& route, format_context& ctx) const
+{
+  auto out = ctx.out();
+  switch (style)
+  {
+    case FormatStyle::IpRoute:
+      out = deleted(out, route.action);
+      if (route.type != Route::Type::Unicast)
+      {
+        out = fmt::format_to(out, FMT_COMPILE("{} "), route.type);
+      }
+      out = writeHostOrNetwork(out, route.destination);
+      if (route.nexthopId != 0)
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" nhid {}"), route.nexthopId);
+      }
+      if (!route.gateway.is_unspecified())
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" via {}"), route.gateway);
+      }
+      if (!route.interfaceName.empty())
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" dev {}"), route.interfaceName);
+      }
+      if (route.table != Route::Table::Main)
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" table {}"), route.table);
+      }
+      if (!route.source.is_unspecified())
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" src {}"), route.source);
+      }
+      if (route.priority != 0)
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" metric {}"), route.priority);
+      }
+      if (route.nexthops && route.nexthopId == 0)
+      {
+        out = fmt::format_to(out, FMT_COMPILE(" {:i}"), *route.nexthops);
+      }
+      return out;
+    case FormatStyle::Compact:
+      out = fmt::format_to(out, FMT_COMPILE("{} {} "), route.type, route.destination);
+      if (!route.gateway.is_unspecified())
+      {
+        out = fmt::format_to(out, FMT_COMPILE("{}"), route.gateway);
+      }
+      else if (route.nexthops && !route.nexthops->paths.empty())
+      {
+        out = fmt::format_to(out, FMT_COMPILE("{:c}"), *route.nexthops);
+      }
+      else
+      {
+        out = append(out, "-"sv);
+      }
+      return fmt::format_to(out, FMT_COMPILE(" {} {} {}"), route.interfaceName.empty() ? "-"sv : std::string_view{route.interfaceName}, route.priority, route.table);
+    case FormatStyle::Default:
+      break;
+  }
+  out = fmt::format_to(out, FMT_COMPILE("{} route: "), route.action);
+  if (route.type != Route::Type::Unicast)
+  {
+    out = fmt::format_to(out, FMT_COMPILE("{} "), route.type);
+  }
+  out = fmt::format_to(out, FMT_COMPILE("{}"), route.destination);
+  if (!route.gateway.is_unspecified())
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" via {}"), route.gateway);
+  }
   if (!route.interfaceName.empty())
   {
-    fmt::print(str, " dev {}", route.interfaceName);
+    out = fmt::format_to(out, FMT_COMPILE(" dev {}"), route.interfaceName);
   }
   if (!route.source.is_unspecified())
   {
-    fmt::print(str, " src {}", route.source);
+    out = fmt::format_to(out, FMT_COMPILE(" src {}"), route.source);
   }
-  fmt::print(str, " table {}", route.table);
-  return str;
+  if (route.priority != 0)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" metric {}"), route.priority);
+  }
+  if (route.nexthopId != 0)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" nhid {}"), route.nexthopId);
+  }
+  if (route.nexthops)
+  {
+    out = fmt::format_to(out, FMT_COMPILE(" {}"), *route.nexthops);
+  }
+  return fmt::format_to(out, FMT_COMPILE(" table {}"), route.table);
 }
 
-std::ostream& operator<<(std::ostream& str, Route::Table const& table)
+fmt::format_context::iterator fmt::formatter<Rule>::format(Rule const& rule, format_context& ctx) const
 {
-  switch (table)
+  auto out = ctx.out();
+  switch (style)
   {
-    case Route::Table::Default:
-      fmt::print(str, "default");
+    case FormatStyle::IpRoute:
+      out = deleted(out, rule.action);
+      out = fmt::format_to(out, FMT_COMPILE("{}:\t"), rule.priority);
+      return writeRuleSelector(out, rule);
+    case FormatStyle::Compact:
+      out = fmt::format_to(out, FMT_COMPILE("{} "), rule.priority);
+      out = rule.source.IsDefaultRoute() ? append(out, "all"sv) : fmt::format_to(out, FMT_COMPILE("{}"), rule.source);
+      out = append(out, " "sv);
+      out = rule.destination.IsDefaultRoute() ? append(out, "all"sv) : fmt::format_to(out, FMT_COMPILE("{}"), rule.destination);
+      out = fmt::format_to(out, FMT_COMPILE(" {} "), rule.type);
+      if (rule.type == Rule::Type::ToTable)
+      {
+        return fmt::format_to(out, FMT_COMPILE("{}"), rule.table);
+      }
+      if (rule.type == Rule::Type::Goto)
+      {
+        return fmt::format_to(out, FMT_COMPILE("{}"), rule.gotoTarget);
+      }
+      return append(out, "-"sv);
+    case FormatStyle::Default:
       break;
-    case Route::Table::Main:
-      fmt::print(str, "main");
+  }
+  out = fmt::format_to(out, FMT_COMPILE("{} rule: {}: "), rule.action, rule.priority);
+  return writeRuleSelector(out, rule);
+}
+
+fmt::format_context::iterator fmt::formatter<TrafficStats>::format(TrafficStats const& stats, format_context& ctx) const
+{
+  if (style == FormatStyle::Compact)
+  {
+    return fmt::format_to(ctx.out(), FMT_COMPILE("{} {} {} {} {} {} {}"), stats.bytes, stats.packets, stats.drops, stats.overlimits, stats.requeues, stats.qlen, stats.backlog);
+  }
+  return fmt::format_to(ctx.out(), FMT_COMPILE("Sent {} bytes {} pkt (dropped {}, overlimits {} requeues {}) backlog {}b {}p"), stats.bytes, stats.packets, stats.drops, stats.overlimits,
+      stats.requeues, stats.backlog, stats.qlen);
+}
+
+fmt::format_context::iterator fmt::formatter<Qdisc>::format(Qdisc const& qdisc, format_context& ctx) const
+{
+  auto out = ctx.out();
+  switch (style)
+  {
+    case FormatStyle::IpRoute:
+      out = writeTrafficControlBody(deleted(out, qdisc.action), "qdisc"sv, qdisc);
+      return fmt::format_to(out, FMT_COMPILE(" {}"), qdisc.stats);
+    case FormatStyle::Compact:
+      return writeTrafficControlCompact(out, qdisc);
+    case FormatStyle::Default:
       break;
-    case Route::Table::Local:
-      fmt::print(str, "local");
+  }
+  out = fmt::format_to(out, FMT_COMPILE("{} "), qdisc.action);
+  out = writeTrafficControlBody(out, "qdisc"sv, qdisc);
+  return fmt::format_to(out, FMT_COMPILE(" {}"), qdisc.stats);
+}
+
+fmt::format_context::iterator fmt::formatter<TrafficClass>::format(TrafficClass const& trafficClass, format_context& ctx) const
+{
+  auto out = ctx.out();
+  switch (style)
+  {
+    case FormatStyle::IpRoute:
+      out = writeTrafficControlBody(deleted(out, trafficClass.action), "class"sv, trafficClass);
+      return fmt::format_to(out, FMT_COMPILE(" {}"), trafficClass.stats);
+    case FormatStyle::Compact:
+      return writeTrafficControlCompact(out, trafficClass);
+    case FormatStyle::Default:
       break;
   }
-  return str;
+  out = fmt::format_to(out, FMT_COMPILE("{} "), trafficClass.action);
+  out = writeTrafficControlBody(out, "class"sv, trafficClass);
+  return fmt::format_to(out, FMT_COMPILE(" {}"), trafficClass.stats);
 }
-}  // namespace wormhole::sysinfo